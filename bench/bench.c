@@ -0,0 +1,526 @@
+// deepc_bench: microbenchmarks of the kernels, layers, I/O and training loop.
+//
+//   deepc_bench [--quick] [--filter NAME] [--threads N] [--output FILE]
+//
+// Every benchmark runs once to warm up, is then repeated until one sample
+// takes at least the target time, and reports the median and minimum over
+// several samples. All inputs come from a fixed seed. Results go to FILE
+// (deepc_bench.json by default) as JSON, with a readable line per benchmark
+// on stderr.
+#include "deepc/DeepC.h"
+#include "deepc/random.h"
+#include "deepc/workspace.h"
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define BENCH_SEED 0xbe9c5eedULL
+#define BENCH_SAMPLES 5
+#define BENCH_QUICK_SAMPLES 3
+#define BENCH_TARGET_SECONDS 0.05
+#define BENCH_QUICK_TARGET_SECONDS 0.01
+
+typedef void (*BenchFn)(void* ctx);
+
+typedef struct {
+    FILE* json;
+    int first;              // no result written yet
+    int quick;
+    const char* filter;
+    Rng rng;
+    char tmp_dir[256];
+} Bench;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+static Matrix* random_matrix(Bench* b, int rows, int cols) {
+    Matrix* m = create_matrix(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            m->data[i][j] = rng_uniform(&b->rng) * 2.0 - 1.0;
+        }
+    }
+    return m;
+}
+
+// Time fn and record it. Per iteration, flops, bytes and items (samples,
+// rows, ...) give the GFLOP/s, MB/s and items/s columns; 0 leaves them out.
+static void measure(Bench* b, const char* name, const char* config, BenchFn fn, void* ctx,
+                    double flops, double bytes, double items) {
+    int num_samples = b->quick ? BENCH_QUICK_SAMPLES : BENCH_SAMPLES;
+    double target = b->quick ? BENCH_QUICK_TARGET_SECONDS : BENCH_TARGET_SECONDS;
+
+    // Warm-up, which also sizes the samples
+    double start = now_seconds();
+    fn(ctx);
+    double once = now_seconds() - start;
+    long iterations = once >= target ? 1 : (long)(target / (once > 1e-9 ? once : 1e-9)) + 1;
+
+    double samples[BENCH_SAMPLES];
+    for (int s = 0; s < num_samples; s++) {
+        start = now_seconds();
+        for (long i = 0; i < iterations; i++) {
+            fn(ctx);
+        }
+        samples[s] = (now_seconds() - start) / iterations;
+    }
+    qsort(samples, num_samples, sizeof(double), compare_doubles);
+    double median = samples[num_samples / 2];
+    double min = samples[0];
+
+    fprintf(stderr, "%-22s %-34s %12.1f us", name, config, median * 1e6);
+    if (flops > 0) fprintf(stderr, "  %8.2f GFLOP/s", flops / median * 1e-9);
+    if (bytes > 0) fprintf(stderr, "  %8.1f MB/s", bytes / median * 1e-6);
+    if (items > 0) fprintf(stderr, "  %10.0f items/s", items / median);
+    fprintf(stderr, "\n");
+
+    fprintf(b->json, "%s\n    {\"name\": \"%s\", \"config\": \"%s\", \"iterations\": %ld, "
+            "\"samples\": %d, \"median_ns\": %.0f, \"min_ns\": %.0f",
+            b->first ? "" : ",", name, config, iterations, num_samples, median * 1e9, min * 1e9);
+    if (flops > 0) fprintf(b->json, ", \"gflops\": %.3f", flops / median * 1e-9);
+    if (bytes > 0) fprintf(b->json, ", \"mb_per_s\": %.1f", bytes / median * 1e-6);
+    if (items > 0) fprintf(b->json, ", \"items_per_s\": %.1f", items / median);
+    fprintf(b->json, "}");
+    fflush(b->json);
+    b->first = 0;
+}
+
+static int selected(const Bench* b, const char* name) {
+    return !b->filter || strstr(name, b->filter) != NULL;
+}
+
+// Library calls that report progress on stdout (compile, save, load) would
+// drown the results, so stdout points at /dev/null while they run
+static int quiet_stdout(void) {
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if (null >= 0) {
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    return saved;
+}
+
+static void restore_stdout(int saved) {
+    if (saved < 0) return;
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+// Matrix kernels
+
+typedef struct {
+    const Matrix* a;
+    const Matrix* b;
+} PairCtx;
+
+static void run_dot(void* ctx) {
+    PairCtx* c = (PairCtx*)ctx;
+    free_matrix(dot(c->a, c->b));
+}
+
+static void run_transpose(void* ctx) {
+    PairCtx* c = (PairCtx*)ctx;
+    free_matrix(transpose(c->a));
+}
+
+static void bench_matrix(Bench* b) {
+    static const int dot_shapes[][3] = {
+        {64, 64, 64}, {256, 256, 256}, {1024, 1024, 1024},
+        {128, 784, 256}, {4096, 64, 64}, {64, 4096, 1}
+    };
+    if (selected(b, "dot")) {
+        for (size_t s = 0; s < sizeof(dot_shapes) / sizeof(dot_shapes[0]); s++) {
+            int m = dot_shapes[s][0], k = dot_shapes[s][1], n = dot_shapes[s][2];
+            PairCtx c = { random_matrix(b, m, k), random_matrix(b, k, n) };
+            char config[64];
+            snprintf(config, sizeof(config), "m=%d k=%d n=%d", m, k, n);
+            measure(b, "dot", config, run_dot, &c, 2.0 * m * n * k, 0, 0);
+            free_matrix((Matrix*)c.a);
+            free_matrix((Matrix*)c.b);
+        }
+    }
+
+    static const int transpose_shapes[][2] = { {1024, 1024}, {4096, 256}, {256, 4096} };
+    if (selected(b, "transpose")) {
+        for (size_t s = 0; s < sizeof(transpose_shapes) / sizeof(transpose_shapes[0]); s++) {
+            int rows = transpose_shapes[s][0], cols = transpose_shapes[s][1];
+            PairCtx c = { random_matrix(b, rows, cols), NULL };
+            char config[64];
+            snprintf(config, sizeof(config), "%dx%d", rows, cols);
+            measure(b, "transpose", config, run_transpose, &c, 0,
+                    2.0 * rows * cols * sizeof(Real), 0);
+            free_matrix((Matrix*)c.a);
+        }
+    }
+}
+
+// Activations
+
+typedef struct {
+    Matrix* output;
+    const Matrix* input;
+    Activation activation;
+} ActivationCtx;
+
+static void run_activation(void* ctx) {
+    ActivationCtx* c = (ActivationCtx*)ctx;
+    apply_activation_into(c->output, c->input, c->activation);
+}
+
+static void bench_activations(Bench* b) {
+    if (!selected(b, "apply_activation")) return;
+
+    static const struct { Activation activation; const char* name; } activations[] = {
+        {LINEAR, "linear"}, {SIGMOID, "sigmoid"}, {RELU, "relu"}, {TANH, "tanh"}, {SOFTMAX, "softmax"}
+    };
+    int rows = 512, cols = 1024;
+    Matrix* input = random_matrix(b, rows, cols);
+    Matrix* output = create_matrix(rows, cols);
+
+    for (size_t a = 0; a < sizeof(activations) / sizeof(activations[0]); a++) {
+        ActivationCtx c = { output, input, activations[a].activation };
+        char config[64];
+        snprintf(config, sizeof(config), "%s %dx%d", activations[a].name, rows, cols);
+        measure(b, "apply_activation", config, run_activation, &c, 0,
+                2.0 * rows * cols * sizeof(Real), (double)rows * cols);
+    }
+
+    free_matrix(input);
+    free_matrix(output);
+}
+
+// Dense layers
+
+typedef struct {
+    Layer* layer;
+    const Matrix* input;
+    const Matrix* gradient;
+    Workspace* ws;
+} LayerCtx;
+
+static void run_forward(void* ctx) {
+    LayerCtx* c = (LayerCtx*)ctx;
+    clear_layer_cache(c->layer);
+    workspace_reset(c->ws);
+    forward_pass_ws(c->layer, c->input, c->ws);
+}
+
+// The cache from one forward pass (in its own workspace) is reused
+static void run_backward(void* ctx) {
+    LayerCtx* c = (LayerCtx*)ctx;
+    workspace_reset(c->ws);
+    backward_pass_ws(c->layer, c->gradient, c->ws);
+}
+
+static void bench_layers(Bench* b) {
+    if (!selected(b, "forward_pass") && !selected(b, "backward_pass")) return;
+
+    static const int sizes[][2] = { {128, 128}, {512, 512}, {784, 256}, {2048, 2048} };
+    int batch = 128;
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int in = sizes[s][0], out = sizes[s][1];
+        Layer* layer = Dense(out, RELU, in);
+        Matrix* input = random_matrix(b, batch, in);
+        Matrix* gradient = random_matrix(b, batch, out);
+        Workspace* forward_ws = create_workspace(0);
+        Workspace* backward_ws = create_workspace(0);
+        double flops = 2.0 * batch * in * out;
+        char config[64];
+        snprintf(config, sizeof(config), "batch=%d in=%d out=%d", batch, in, out);
+
+        if (selected(b, "forward_pass")) {
+            LayerCtx c = { layer, input, NULL, forward_ws };
+            measure(b, "forward_pass", config, run_forward, &c, flops, 0, batch);
+        }
+        if (selected(b, "backward_pass")) {
+            clear_layer_cache(layer);
+            workspace_reset(forward_ws);
+            forward_pass_ws(layer, input, forward_ws);
+            // Weight and input gradients: two products of the forward's size
+            LayerCtx c = { layer, input, gradient, backward_ws };
+            measure(b, "backward_pass", config, run_backward, &c, 2.0 * flops, 0, batch);
+        }
+
+        clear_layer_cache(layer);
+        free_workspace(forward_ws);
+        free_workspace(backward_ws);
+        free_matrix(input);
+        free_matrix(gradient);
+        free_layer(layer);
+    }
+}
+
+// Optimizer step
+
+typedef struct {
+    OptimizerState* optimizer;
+    ParameterBuffer* params;
+} OptimizerCtx;
+
+static void run_optimizer(void* ctx) {
+    OptimizerCtx* c = (OptimizerCtx*)ctx;
+    optimizer_step(c->optimizer, c->params);
+}
+
+static void bench_optimizers(Bench* b) {
+    if (!selected(b, "optimizer_step")) return;
+
+    Layer* first = Dense(1024, RELU, 1024);
+    first->next = Dense(1024, LINEAR, 1024);
+    ParameterBuffer* params = create_parameter_buffer(first);
+    for (size_t i = 0; i < params->size; i++) {
+        params->grads[i] = (Real)(rng_uniform(&b->rng) * 2e-3 - 1e-3);
+    }
+
+    static const struct { Optimizer type; double momentum; const char* name; } configs[] = {
+        {SGD, 0.0, "sgd"}, {SGD, 0.9, "sgd momentum=0.9"}, {ADAM, 0.0, "adam"}, {ADAMW, 0.0, "adamw"}
+    };
+    for (size_t o = 0; o < sizeof(configs) / sizeof(configs[0]); o++) {
+        OptimizerState* optimizer = create_optimizer(configs[o].type, 1e-4);
+        if (configs[o].momentum > 0) set_momentum(optimizer, configs[o].momentum);
+        OptimizerCtx c = { optimizer, params };
+        char config[64];
+        snprintf(config, sizeof(config), "%s params=%zu", configs[o].name, params->size);
+        measure(b, "optimizer_step", config, run_optimizer, &c, 0, 0, (double)params->size);
+        free_optimizer(optimizer);
+    }
+
+    free_layer(first->next);
+    free_layer(first);
+    free_parameter_buffer(params);
+}
+
+// File I/O
+
+typedef struct {
+    const char* path;
+    SequentialModel* model;
+} FileCtx;
+
+static void run_load_csv(void* ctx) {
+    FileCtx* c = (FileCtx*)ctx;
+    free_matrix(load_csv(c->path, 1));
+}
+
+static void run_save_model(void* ctx) {
+    FileCtx* c = (FileCtx*)ctx;
+    int saved = quiet_stdout();
+    save_model(c->model, c->path);
+    restore_stdout(saved);
+}
+
+static void run_load_model(void* ctx) {
+    FileCtx* c = (FileCtx*)ctx;
+    int saved = quiet_stdout();
+    free_model(load_model(c->path));
+    restore_stdout(saved);
+}
+
+static void run_save_model_binary(void* ctx) {
+    FileCtx* c = (FileCtx*)ctx;
+    int saved = quiet_stdout();
+    save_model_binary(c->model, c->path);
+    restore_stdout(saved);
+}
+
+static void run_load_model_binary(void* ctx) {
+    FileCtx* c = (FileCtx*)ctx;
+    int saved = quiet_stdout();
+    free_model(load_model_binary(c->path));
+    restore_stdout(saved);
+}
+
+static double file_size(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (double)st.st_size : 0.0;
+}
+
+static void bench_csv(Bench* b) {
+    if (!selected(b, "load_csv")) return;
+
+    int rows = b->quick ? 20000 : 100000, cols = 16;
+    char path[320];
+    snprintf(path, sizeof(path), "%s/deepc_bench.csv", b->tmp_dir);
+    FILE* file = fopen(path, "w");
+    DEEPC_CHECK(file != NULL, "Cannot write the benchmark CSV file");
+    for (int j = 0; j < cols; j++) {
+        fprintf(file, "%sc%d", j ? "," : "", j);
+    }
+    fprintf(file, "\n");
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            fprintf(file, "%s%.6f", j ? "," : "", rng_uniform(&b->rng) * 200.0 - 100.0);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+
+    FileCtx c = { path, NULL };
+    char config[64];
+    snprintf(config, sizeof(config), "rows=%d cols=%d", rows, cols);
+    measure(b, "load_csv", config, run_load_csv, &c, 0, file_size(path), rows);
+    remove(path);
+}
+
+static SequentialModel* build_model(int input, int hidden, int outputs) {
+    int saved = quiet_stdout();
+    SequentialModel* model = create_model("bench");
+    add_layer(model, Dense(hidden, RELU, input));
+    add_layer(model, Dense(hidden, RELU, hidden));
+    add_layer(model, Dense(outputs, SOFTMAX, hidden));
+    compile(model, ADAM, CATEGORICAL_CROSSENTROPY, 0.001);
+    restore_stdout(saved);
+    return model;
+}
+
+static void bench_model_io(Bench* b) {
+    if (!selected(b, "save_model") && !selected(b, "load_model")) return;
+
+    SequentialModel* model = build_model(784, 512, 10);
+    char text_path[320], binary_path[320];
+    snprintf(text_path, sizeof(text_path), "%s/deepc_bench_model.txt", b->tmp_dir);
+    snprintf(binary_path, sizeof(binary_path), "%s/deepc_bench_model.dc", b->tmp_dir);
+    const char* config = "784-512-512-10";
+
+    FileCtx text = { text_path, model };
+    FileCtx binary = { binary_path, model };
+    run_save_model(&text);
+    run_save_model_binary(&binary);
+
+    if (selected(b, "save_model")) {
+        measure(b, "save_model", config, run_save_model, &text, 0, file_size(text_path), 0);
+        measure(b, "save_model_binary", config, run_save_model_binary, &binary, 0,
+                file_size(binary_path), 0);
+    }
+    if (selected(b, "load_model")) {
+        measure(b, "load_model", config, run_load_model, &text, 0, file_size(text_path), 0);
+        measure(b, "load_model_binary", config, run_load_model_binary, &binary, 0,
+                file_size(binary_path), 0);
+    }
+
+    remove(text_path);
+    remove(binary_path);
+    free_model(model);
+}
+
+// End-to-end training
+
+typedef struct {
+    SequentialModel* model;
+    const Matrix* X;
+    const Matrix* y;
+    int batch_size;
+    int parallel;
+} FitCtx;
+
+static void run_fit(void* ctx) {
+    FitCtx* c = (FitCtx*)ctx;
+    if (c->parallel) {
+        fit_parallel(c->model, c->X, c->y, 1, c->batch_size, 0, 0);
+    } else {
+        fit(c->model, c->X, c->y, 1, c->batch_size, 0);
+    }
+}
+
+static void bench_fit(Bench* b) {
+    if (!selected(b, "fit")) return;
+
+    int samples = b->quick ? 2048 : 8192, features = 64, classes = 10;
+    Matrix* X = random_matrix(b, samples, features);
+    Matrix* y = create_matrix(samples, classes);
+    for (int i = 0; i < samples; i++) {
+        y->data[i][rng_bounded(&b->rng, classes)] = 1.0;
+    }
+
+    static const struct { int batch_size; int parallel; const char* name; } configs[] = {
+        {64, 0, "fit"}, {256, 0, "fit"}, {256, 1, "fit_parallel"}
+    };
+    for (size_t f = 0; f < sizeof(configs) / sizeof(configs[0]); f++) {
+        if (!selected(b, configs[f].name)) continue;
+        SequentialModel* model = build_model(features, 256, classes);
+        set_shuffle(model, 1, BENCH_SEED);
+        FitCtx c = { model, X, y, configs[f].batch_size, configs[f].parallel };
+        char config[96];
+        snprintf(config, sizeof(config), "64-256-256-10 samples=%d batch=%d", samples,
+                 configs[f].batch_size);
+        measure(b, configs[f].name, config, run_fit, &c, 0, 0, samples);
+        free_model(model);
+    }
+
+    free_matrix(X);
+    free_matrix(y);
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [--quick] [--filter NAME] [--threads N] [--output FILE]\n", program);
+}
+
+int main(int argc, char** argv) {
+    Bench bench;
+    memset(&bench, 0, sizeof(bench));
+    const char* output = "deepc_bench.json";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            bench.quick = 1;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            bench.filter = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            deepc_set_num_threads(atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    const char* tmp = getenv("TMPDIR");
+    snprintf(bench.tmp_dir, sizeof(bench.tmp_dir), "%s", tmp && *tmp ? tmp : "/tmp");
+    rng_seed(&bench.rng, BENCH_SEED);
+
+    bench.json = fopen(output, "w");
+    if (!bench.json) {
+        fprintf(stderr, "Cannot open %s for writing\n", output);
+        return EXIT_FAILURE;
+    }
+    bench.first = 1;
+
+    fprintf(bench.json, "{\n  \"library\": {\"precision\": \"%s\", \"gemm_kernel\": \"%s\", "
+            "\"quantized_kernel\": \"%s\", \"threads\": %d},\n",
+            sizeof(Real) == sizeof(float) ? "float32" : "float64", gemm_kernel_name(),
+            quantized_kernel_name(), deepc_get_num_threads());
+    fprintf(bench.json, "  \"timestamp\": %ld,\n  \"quick\": %s,\n  \"results\": [",
+            (long)time(NULL), bench.quick ? "true" : "false");
+
+    fprintf(stderr, "DeepC benchmarks (%s, %s GEMM, %d threads)\n",
+            sizeof(Real) == sizeof(float) ? "float32" : "float64", gemm_kernel_name(),
+            deepc_get_num_threads());
+
+    bench_matrix(&bench);
+    bench_activations(&bench);
+    bench_layers(&bench);
+    bench_optimizers(&bench);
+    bench_csv(&bench);
+    bench_model_io(&bench);
+    bench_fit(&bench);
+
+    fprintf(bench.json, "\n  ]\n}\n");
+    fclose(bench.json);
+    fprintf(stderr, "Results written to %s\n", output);
+    return EXIT_SUCCESS;
+}
@@ -25,5 +25,18 @@
 #include "losses.h"
 #include "optimizers.h"
 #include "data_processing.h"
+#include "threadpool.h"
+#include "inference.h"
+#include "csv_reader.h"
+#include "data_loader.h"
+#include "quantize.h"
+#include "vmath.h"
+#include "profiler.h"
+#include "expr.h"
+#include "memory_plan.h"
+#include "sparse.h"
+#include "inference_server.h"
+#include "column_stats.h"
+#include "distributed.h"
 
 #endif // DEEPC_H
@@ -0,0 +1,56 @@
+#ifndef COLUMN_STATS_H
+#define COLUMN_STATS_H
+
+#include "matrix.h"
+
+// Per-column statistics of a dataset, gathered in one pass over the rows
+// (the row-major direction) and ignoring NaNs: the number of values, Welford
+// mean and sum of squared deviations, minimum and maximum. Updates can be
+// fed chunk after chunk (e.g. from a CsvReader), and two sets of statistics
+// merge exactly, so a large file is summarized as it streams in.
+typedef struct ColumnStats {
+    int cols;
+    long long rows;         // rows seen, NaN or not
+    long long* count;       // non-NaN values per column
+    double* mean;
+    double* m2;             // sum of squared deviations from the mean
+    double* min;            // INFINITY / -INFINITY without values
+    double* max;
+} ColumnStats;
+
+// Empty statistics for cols columns
+ColumnStats* create_column_stats(int cols);
+void free_column_stats(ColumnStats* stats);
+void column_stats_reset(ColumnStats* stats);
+
+// Add every row of chunk (cols columns), splitting large chunks over the
+// thread pool. The result does not depend on the number of threads.
+void column_stats_update(ColumnStats* stats, const Matrix* chunk);
+// Add the rows summarized by other, as if they had been passed to update
+void column_stats_merge(ColumnStats* stats, const ColumnStats* other);
+
+// Statistics of a whole matrix
+ColumnStats* compute_column_stats(const Matrix* m);
+
+// Population variance and standard deviation (0 when a column is empty),
+// and the number of NaNs of column j
+double column_variance(const ColumnStats* stats, int j);
+double column_std(const ColumnStats* stats, int j);
+long long column_missing(const ColumnStats* stats, int j);
+
+// Preprocessing from the statistics, one pass over m in place. NaNs are kept
+// by normalize and standardize; columns without spread are left as they are.
+// fill_missing puts the column mean (0 for an empty column) in every NaN.
+void fill_missing_with_stats(Matrix* m, const ColumnStats* stats);
+void normalize_with_stats(Matrix* m, const ColumnStats* stats);
+void standardize_with_stats(Matrix* m, const ColumnStats* stats);
+
+void print_column_stats(const ColumnStats* stats);
+
+// Text file kept next to a saved model, so inference preprocesses its inputs
+// exactly like the training data. load returns NULL if the file cannot be
+// read or is not a statistics file.
+int save_column_stats(const ColumnStats* stats, const char* filename);
+ColumnStats* load_column_stats(const char* filename);
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef CSV_READER_H
+#define CSV_READER_H
+
+#include "matrix.h"
+#include <stddef.h>
+
+// Byte source for a CsvReader: copy up to size bytes into buffer and return
+// how many were copied, 0 at end of input or -1 on error. Plugging in e.g.
+// gzread() or a socket lets the reader consume compressed or remote data.
+typedef long (*CsvReadFunc)(void* ctx, char* buffer, size_t size);
+
+// Streaming CSV reader that yields fixed-size chunks of rows, so datasets
+// far larger than memory can be consumed batch by batch. Lines may be of
+// any length. The column count comes from the first line (the header when
+// has_header is set); short rows are padded with NaN, extra fields ignored,
+// and empty, NA, NULL, N/A, ? or unparsable fields read as NaN.
+typedef struct CsvReader {
+    CsvReadFunc read;
+    void* ctx;
+    void* file;             // FILE* opened by csv_open, closed by csv_close
+    
+    char* buffer;           // raw input
+    size_t buffer_size;
+    size_t buffer_pos;
+    size_t buffer_end;
+    int eof;
+    
+    char* line;             // current line, grown to fit the longest one
+    size_t line_capacity;
+    
+    int num_cols;
+    Real* row;              // scratch row for csv_read_batch
+    long rows_read;
+    int pending_first_row;  // first line was data and is still in line
+} CsvReader;
+
+// Load a whole file into one matrix with the same parsing rules, reading it
+// through a memory mapping and parsing chunks of lines in parallel. Returns
+// NULL if the file cannot be mapped (a pipe, say), where a CsvReader works.
+Matrix* csv_load_file(const char* filename, int has_header);
+
+// Reader management
+CsvReader* csv_open(const char* filename, int has_header);
+CsvReader* csv_open_reader(CsvReadFunc read, void* ctx, int has_header);
+void csv_close(CsvReader* reader);
+int csv_num_columns(const CsvReader* reader);
+
+// Fill up to chunk->rows rows of chunk (which must have num_cols columns)
+// and return how many were read; 0 once the input is exhausted
+int csv_read_chunk(CsvReader* reader, Matrix* chunk);
+
+// Read up to X->rows rows, splitting column label_column off into y: with
+// one column y receives the raw value, with more it is one-hot encoded
+// (the label is a class index). Returns the number of rows read.
+int csv_read_batch(CsvReader* reader, Matrix* X, Matrix* y, int label_column);
+
+// The rest of the input in one matrix (shard 0 of 1), or every
+// num_shards-th of its rows starting at row shard, parsed in place into a
+// matrix that grows as it fills. Returns NULL if no rows are left.
+Matrix* csv_read_rows(CsvReader* reader, int shard, int num_shards);
+
+// Every num_shards-th data row of a file starting at row shard, e.g. one
+// rank's part of a dataset in distributed training (see fit_distributed).
+// Returns NULL if the shard has no rows.
+Matrix* csv_load_shard(const char* filename, int has_header, int shard, int num_shards);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef DATA_LOADER_H
+#define DATA_LOADER_H
+
+#include "matrix.h"
+#include "random.h"
+#include <pthread.h>
+
+// Mini-batch producer for training loops. A background thread gathers the
+// rows of the next batch (optionally shuffled and standardized) into one of
+// two batch buffers while the caller trains on the other, so a step never
+// waits on assembling its input. The loader runs epoch after epoch: every
+// epoch visits each sample once, with a fresh order when shuffling.
+typedef struct DataLoaderSlot {
+    Matrix* X;              // batch_size rows, owned by the loader
+    Matrix* y;
+    Matrix X_view;          // first rows of X/y handed to the caller
+    Matrix y_view;
+    int rows;
+    int ready;              // filled and not yet handed out
+} DataLoaderSlot;
+
+typedef struct DataLoader {
+    const Matrix* X;
+    const Matrix* y;
+    int batch_size;
+    int num_batches;        // per epoch
+    int shuffle;
+    Rng rng;                // producer-only
+    
+    // Per-feature transform x' = (x - mean) * scale, from the whole of X;
+    // NULL when not standardizing
+    double* mean;
+    double* scale;
+    
+    int* indices;           // sample order of the epoch being produced
+    DataLoaderSlot slots[2];
+    
+    // Producer state (guarded by lock)
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t slot_ready;
+    pthread_cond_t slot_free;
+    long produced;          // batches produced since creation
+    long consumed;          // batches handed out since creation
+    int held;               // slot the caller is using, or -1
+    int stop;
+    
+    int epoch_position;     // batches handed out in the current epoch
+} DataLoader;
+
+// Loader management. X and y must stay alive and unchanged while the loader
+// exists. shuffle reorders samples every epoch, reproducibly for a given
+// seed; standardize scales each feature to mean 0 and standard deviation 1
+// like standardize_matrix.
+DataLoader* create_data_loader(const Matrix* X, const Matrix* y, int batch_size,
+                               int shuffle, int standardize, uint64_t seed);
+void free_data_loader(DataLoader* loader);
+
+// Hand out the next batch of the current epoch and return its size, or 0
+// once the epoch is over (the following call starts the next one). The
+// batch matrices belong to the loader and stay valid until the next call.
+int data_loader_next(DataLoader* loader, Matrix** X_batch, Matrix** y_batch);
+
+int data_loader_num_batches(const DataLoader* loader);
+
+#endif
@@ -2,13 +2,17 @@
 #define CSV_LOADER_H
 
 #include "matrix.h"
+#include "csv_reader.h"
+#include "column_stats.h"
+#include "random.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
 
-// Simple CSV loading
+// Simple CSV loading. The statistics-based passes below gather their
+// statistics in one row-major pass (see column_stats.h).
 Matrix* load_csv(const char *filename, int has_header);
 void fill_missing_with_mean(Matrix *m);
 void fill_missing_with_zeros(Matrix *m);
@@ -26,5 +30,6 @@ Matrix* one_hot_encode_labels(const Matrix *labels, int num_classes);
 Matrix* normalize_matrix(Matrix *X);
 Matrix* standardize_matrix(Matrix *X);
 void shuffle_dataset(Matrix *X, Matrix *y);
+void shuffle_dataset_seeded(Matrix *X, Matrix *y, uint64_t seed);
 
 #endif
\ No newline at end of file
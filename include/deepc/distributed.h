@@ -0,0 +1,69 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "matrix.h"
+#include <stddef.h>
+#include <pthread.h>
+
+// Process group for data-parallel training over TCP. The ranks form a ring:
+// every rank listens on its own address, connects to the next rank and
+// accepts the previous one. Collectives are ring algorithms, so each rank
+// sends and receives about 2 * (n - 1) / n of a buffer per all-reduce
+// whatever the number of ranks. Every rank must issue the same collectives
+// in the same order. World size 1 needs no sockets and makes every
+// collective a no-op.
+typedef struct CommJob CommJob;
+
+typedef struct Communicator {
+    int rank;
+    int world_size;
+    int next_fd;            // socket to rank + 1, or -1
+    int prev_fd;            // socket from rank - 1, or -1
+    void* scratch;          // receive buffer of the ring steps
+    size_t scratch_bytes;
+
+    // Background reductions (comm_reduce_async), processed in order
+    pthread_t thread;
+    int has_thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // a job was queued, or the communicator is closing
+    pthread_cond_t done;    // the queue drained
+    CommJob* jobs;
+    int num_jobs;
+    int job_capacity;
+    int next_job;           // first job not yet processed
+    int stop;
+    int step_rows;          // this rank's rows in the current step
+    double step_totals[2];  // rows and loss summed over ranks (comm_begin_step)
+} Communicator;
+
+// Connect rank to the others. addresses holds world_size "host:port"
+// entries, the same list on every rank; each rank listens on the port of
+// its own entry. The others may start later: connecting is retried for up
+// to timeout_ms milliseconds.
+Communicator* create_communicator(int rank, int world_size, const char* const* addresses,
+                                  int timeout_ms);
+// Same, from DEEPC_RANK, DEEPC_WORLD_SIZE and DEEPC_PEERS (comma-separated
+// addresses). Without DEEPC_WORLD_SIZE the communicator has one rank.
+Communicator* create_communicator_from_env(void);
+void free_communicator(Communicator* comm);
+
+// Blocking collectives, not to be mixed with pending asynchronous ones:
+// element-wise sums left in data on every rank (bitwise identical
+// everywhere), rank 0's data copied to all, and a barrier
+void comm_allreduce_sum(Communicator* comm, Real* data, size_t count);
+void comm_allreduce_sum_double(Communicator* comm, double* data, size_t count);
+void comm_broadcast(Communicator* comm, Real* data, size_t count);
+void comm_barrier(Communicator* comm);
+
+// Gradient averaging overlapped with the backward pass. comm_begin_step
+// queues the sum of the step's rows and loss sums; each comm_reduce_async
+// then replaces data, this rank's gradient for its rows, by the gradient of
+// every rank's rows taken as one batch, on a background thread while the
+// caller computes the next gradients. comm_wait returns once every queued job is done, with the
+// summed rows and loss. data must not be touched until then.
+void comm_begin_step(Communicator* comm, int rows, double loss_sum);
+void comm_reduce_async(Communicator* comm, Real* data, size_t count);
+void comm_wait(Communicator* comm, double* total_rows, double* total_loss);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include "matrix.h"
+
+// Lazy element-wise expressions. The builders below record a small DAG
+// instead of computing anything; evaluating it runs the whole chain as one
+// fused pass over memory, so
+//
+//   ExprGraph* g = create_expr_graph();
+//   expr_eval_into(out, expr_subtract(expr_add(expr_scale(expr_matrix(g, a), s),
+//                                              expr_matrix(g, b)),
+//                                     expr_matrix(g, c)));
+//
+// reads a, b and c once and writes out once, where
+// subtract(add(scale(a, s), b), c) allocates and fills two temporaries.
+// Evaluation walks the data in tiles small enough that every intermediate
+// stays in L1, evaluates shared subexpressions once per tile, and splits
+// large expressions across the thread pool.
+//
+// Nodes belong to their graph and live until it is reset or freed. The
+// matrices an expression reads are not copied, so they must outlive its
+// evaluation, and evaluation sees their values at that point.
+
+typedef struct ExprGraph ExprGraph;
+typedef struct Expr Expr;
+
+ExprGraph* create_expr_graph(void);
+void free_expr_graph(ExprGraph* graph);
+// Drop every node, keeping the graph for reuse
+void expr_graph_reset(ExprGraph* graph);
+
+// Leaf reading m
+Expr* expr_matrix(ExprGraph* graph, const Matrix* m);
+
+// Element-wise operations; operands must have the same shape and graph
+Expr* expr_add(Expr* a, Expr* b);
+Expr* expr_subtract(Expr* a, Expr* b);
+Expr* expr_multiply(Expr* a, Expr* b);
+Expr* expr_scale(Expr* a, double scalar);
+Expr* expr_apply(Expr* a, double (*func)(double));
+
+int expr_rows(const Expr* e);
+int expr_cols(const Expr* e);
+
+// Evaluate into dst, which must have the expression's shape and may be one
+// of the matrices it reads
+void expr_eval_into(Matrix* dst, const Expr* e);
+Matrix* expr_eval(const Expr* e);
+
+// Sum of all elements, without materializing the expression
+double expr_sum(const Expr* e);
+
+#endif
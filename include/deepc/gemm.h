@@ -0,0 +1,46 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "precision.h"
+
+// Whether an operand is used as stored or transposed (BLAS transA/transB)
+typedef enum {
+    GEMM_NO_TRANS,
+    GEMM_TRANS
+} GemmTranspose;
+
+// General matrix multiply on row-major storage:
+//   C[M x N] = alpha * op(A)[M x K] * op(B)[K x N] + beta * C
+// op(X) is X or X^T depending on the transpose flag, so A is stored as M x K
+// (or K x M when transposed) and B as K x N (or N x K). lda/ldb/ldc are the
+// row strides (in elements) of the matrices as stored.
+// The kernel is cache-blocked and packs A and B into panels consumed by a
+// SIMD micro-kernel (AVX-512, AVX2+FMA, NEON or portable C) picked once at
+// runtime from the features of the host CPU. Transposes are absorbed by the
+// packing step, so they cost nothing extra.
+void gemm(GemmTranspose trans_a, GemmTranspose trans_b,
+          int M, int N, int K, Real alpha,
+          const Real *A, int lda,
+          const Real *B, int ldb,
+          Real beta, Real *C, int ldc);
+
+// Hook run on each finished tile of C straight after its last update, while
+// it is still in L1: c points at element (row, col) of C and the tile spans
+// rows x cols elements with row stride ldc. Tiles cover C exactly once.
+typedef struct {
+    void (*apply)(void *ctx, int row, int col, Real *c, int ldc, int rows, int cols);
+    void *ctx;
+} GemmEpilogue;
+
+// gemm() followed by epilogue (which may be NULL) fused into the tile loop
+void gemm_ex(GemmTranspose trans_a, GemmTranspose trans_b,
+             int M, int N, int K, Real alpha,
+             const Real *A, int lda,
+             const Real *B, int ldb,
+             Real beta, Real *C, int ldc,
+             const GemmEpilogue *epilogue);
+
+// Name of the micro-kernel selected for this CPU ("avx512", "avx2", "neon", "generic")
+const char* gemm_kernel_name(void);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include "matrix.h"
+#include "models.h"
+
+// Inference context for one thread. The session owns two ping-pong buffers
+// large enough for any layer's output at max_batch rows; layers alternate
+// between them, nothing is cached for backpropagation and the model is
+// only read. Any number of sessions may run on one model at the same time
+// (one per thread), as long as nothing trains or frees it meanwhile.
+typedef struct InferenceSession {
+    const SequentialModel* model;
+    int max_batch;          // rows per internal pass; larger inputs are chunked
+    int max_width;          // widest layer output
+    Real* buffers[2];       // max_batch x max_width each
+    Matrix views[2];        // headers over the buffers, reshaped per layer
+} InferenceSession;
+
+// Session management
+InferenceSession* create_inference_session(const SequentialModel* model, int max_batch);
+void free_inference_session(InferenceSession* session);
+
+// Run the model on input into output (input->rows x output size). Performs
+// no allocation.
+void predict_into(InferenceSession* session, const Matrix* input, Matrix* output);
+
+// Run the model on at most max_batch rows; the result lives in the session
+// and stays valid until its next use
+const Matrix* session_predict(InferenceSession* session, const Matrix* input);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef INFERENCE_SERVER_H
+#define INFERENCE_SERVER_H
+
+#include "matrix.h"
+#include "models.h"
+#include "inference.h"
+#include <pthread.h>
+
+// Serving front end for many threads sending small requests. Callers block
+// in server_predict while a worker thread coalesces the queued requests into
+// micro-batches of up to max_batch rows, waiting at most max_wait_us after
+// the oldest one arrived for the batch to fill, runs each batch as one
+// forward pass and copies every caller's rows back. One-row requests thus
+// run at batched GEMM efficiency for at most max_wait_us of added latency.
+// The model is only read; nothing may train or free it while the server
+// runs.
+typedef struct InferenceRequest InferenceRequest;
+
+typedef struct {
+    long requests;
+    long rows;
+    long batches;           // forward passes run
+    int largest_batch;      // rows
+} InferenceServerStats;
+
+typedef struct InferenceServer {
+    const SequentialModel* model;
+    InferenceSession* session;
+    int max_batch;
+    long max_wait_us;
+
+    Matrix* batch_input;    // max_batch rows the queued inputs are gathered into
+    Matrix* batch_output;
+
+    // Queue (guarded by lock)
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;    // a request arrived, or the server is stopping
+    InferenceRequest* head;
+    InferenceRequest* tail;
+    int queued_rows;
+    int stop;
+    InferenceServerStats stats;
+} InferenceServer;
+
+// Server management. free_inference_server answers every queued request
+// before it returns; no thread may call server_predict after it starts.
+InferenceServer* create_inference_server(const SequentialModel* model, int max_batch,
+                                         long max_wait_us);
+void free_inference_server(InferenceServer* server);
+
+// Run the model on input into output (input->rows x output size) and
+// return once done; safe to call from any number of threads. Requests
+// larger than max_batch run on their own.
+void server_predict(InferenceServer* server, const Matrix* input, Matrix* output);
+
+InferenceServerStats server_stats(InferenceServer* server);
+
+#endif
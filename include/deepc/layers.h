@@ -2,6 +2,8 @@
 #define LAYERS_H
 
 #include "matrix.h"
+#include "workspace.h"
+#include "sparse.h"
 
 typedef enum {
     LINEAR,
@@ -11,6 +13,16 @@ typedef enum {
     SOFTMAX
 } Activation;
 
+// Activations saved by a forward pass for the matching backward pass
+typedef struct {
+    Matrix* input;
+    Matrix* z;
+    Matrix* output;
+    const SparseMatrix* sparse_input;   // set instead of input by forward_pass_sparse
+} LayerCache;
+
+struct QuantizedDense;
+
 typedef struct Layer {
     char* name;
     Activation activation;
@@ -24,22 +36,92 @@ typedef struct Layer {
     Matrix* dweights;
     Matrix* dbiases;
     
-    // Forward pass cache
-    Matrix* input;
-    Matrix* output;
-    Matrix* z;
+    // Forward pass cache used by forward_pass/backward_pass
+    LayerCache cache;
+    
+    // Int8 weights used by forward_pass_into instead of the float ones, or
+    // NULL (see quantize_model)
+    struct QuantizedDense* quantized;
+    
+    // Columns of dweights the last sparse backward pass wrote, or NULL
+    SparseGradientState* sparse_gradient;
 } Layer;
 
 // Layer creation
 Layer* Dense(int units, Activation activation, int input_dim);
+Layer* create_dense_layer(Matrix* weights, Matrix* biases, Activation activation);
 
 // Forward and backward passes
 Matrix* forward_pass(Layer* layer, const Matrix* input);
 Matrix* backward_pass(Layer* layer, const Matrix* gradient);
 
+// Workspace variants used by fit(): the result, every temporary and the layer
+// caches live in ws until its next reset (free_matrix on them is a no-op).
+// forward_pass_ws keeps a reference to input instead of copying it. The heap
+// variants reuse the layer's cache buffers while the batch shape is unchanged.
+Matrix* forward_pass_ws(Layer* layer, const Matrix* input, Workspace* ws);
+Matrix* backward_pass_ws(Layer* layer, const Matrix* gradient, Workspace* ws);
+void clear_layer_cache(Layer* layer);
+
+// Variants for running several passes over one layer at once (one per
+// thread): the activations live in a caller-owned cache, the gradients go
+// to caller-owned dweights/dbiases scaled by grad_scale instead of being
+// averaged, and the layer itself is only read. ws may be NULL.
+Matrix* forward_pass_with_cache(const Layer* layer, const Matrix* input, LayerCache* cache,
+                                Workspace* ws);
+Matrix* backward_pass_with_cache(const Layer* layer, const Matrix* gradient,
+                                 const LayerCache* cache, Matrix* dweights, Matrix* dbiases,
+                                 double grad_scale, Workspace* ws);
+void release_layer_cache(LayerCache* cache);
+
+// Output-layer variants taking dL/dz (delta) instead of dL/doutput, for a
+// loss fused with the activation (see loss_is_fused): the activation
+// derivative is skipped and delta is used as it is
+Matrix* backward_pass_from_logits_ws(Layer* layer, const Matrix* delta, Workspace* ws);
+Matrix* backward_pass_from_logits_with_cache(const Layer* layer, const Matrix* delta,
+                                             const LayerCache* cache, Matrix* dweights,
+                                             Matrix* dbiases, double grad_scale, Workspace* ws);
+
+// Buffers of one layer's training step under a memory plan (see
+// compile_for_batch in models.h). The planned passes allocate nothing: the
+// activation is computed in place in output (the cached z is the output),
+// the backward pass overwrites its incoming gradient with dL/dz, and
+// without prev_gradient (the first layer) dL/dinput is skipped.
+typedef struct {
+    Matrix* input;          // first layer: header for caching the caller's batch
+    Matrix* output;
+    Matrix* prev_gradient;  // dL/dinput, or NULL
+    Matrix* row_dots;       // softmax layers: one sum per row, else NULL
+    Matrix* forward_output; // checkpointing: where the first forward pass
+                            // puts a dropped activation, else NULL
+} LayerPlan;
+
+Matrix* forward_pass_planned(Layer* layer, const Matrix* input, const LayerPlan* plan);
+Matrix* backward_pass_planned(Layer* layer, Matrix* gradient, int from_logits,
+                              const LayerPlan* plan);
+
+// First-layer passes over sparse input (a CSR batch, see sparse.h): the
+// forward product only multiplies the nonzeros, and the backward pass
+// writes only the weight-gradient columns the batch uses, without
+// computing dL/dinput. The caches are in ws and keep a reference to input.
+// forward_pass_sparse_into is the inference variant, like forward_pass_into.
+Matrix* forward_pass_sparse(Layer* layer, const SparseMatrix* input, Workspace* ws);
+void backward_pass_sparse(Layer* layer, const Matrix* gradient, int from_logits, Workspace* ws);
+void forward_pass_sparse_into(const Layer* layer, const SparseMatrix* input, Matrix* output);
+
+// Inference: writes the layer's activations into output without caching
+// anything, reading the layer only (safe to call concurrently). Runs the
+// int8 kernel when the layer is quantized.
+void forward_pass_into(const Layer* layer, const Matrix* input, Matrix* output);
+
 // Activation functions
 Matrix* apply_activation(const Matrix* input, Activation activation);
+void apply_activation_into(Matrix* output, const Matrix* input, Activation activation);
+// Element-wise da/dz at z = input. SOFTMAX is an error: its Jacobian couples
+// each row's outputs, so dL/dz = p * (g - sum(g * p)) for an upstream
+// gradient g must be formed from the whole row (backward_pass does this).
 Matrix* apply_activation_derivative(const Matrix* input, Activation activation);
+void apply_activation_derivative_into(Matrix* derivative, const Matrix* input, Activation activation);
 
 // Initialization
 void initialize_weights_xavier(Matrix* weights, int input_size);
@@ -2,6 +2,7 @@
 #define LOSSES_H
 
 #include "matrix.h"
+#include "layers.h"
 
 // Loss function types
 typedef enum {
@@ -13,8 +14,24 @@ typedef enum {
 // Loss calculation
 double compute_loss(const Matrix* y_true, const Matrix* y_pred, LossFunction loss_func);
 Matrix* compute_loss_gradient(const Matrix* y_true, const Matrix* y_pred, LossFunction loss_func);
-
-// Individual loss functions
+void compute_loss_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred,
+                                LossFunction loss_func);
+
+// Output activation and loss pairs whose gradient with respect to the
+// pre-activation z is simply (p - y) / n: SOFTMAX with CATEGORICAL_CROSSENTROPY
+// (n = rows) and SIGMOID with BINARY_CROSSENTROPY (n = rows * cols). Training
+// uses it instead of chaining the loss gradient through the activation.
+int loss_is_fused(LossFunction loss_func, Activation output_activation);
+
+// For a fused pair: the loss (as compute_loss) and dL/dz written into delta,
+// in one pass over y_true and y_pred
+double compute_fused_loss_gradient_into(Matrix* delta, const Matrix* y_true, const Matrix* y_pred,
+                                        LossFunction loss_func);
+
+// Individual loss functions. The gradients are dL/dp with respect to the
+// predictions, averaged like the loss; for categorical crossentropy that is
+// -y / p / rows, and the (p - y) / rows with respect to softmax's input is
+// compute_fused_loss_gradient_into.
 double mse_loss(const Matrix* y_true, const Matrix* y_pred);
 Matrix* mse_gradient(const Matrix* y_true, const Matrix* y_pred);
 
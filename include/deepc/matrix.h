@@ -7,15 +7,31 @@
 #include <time.h>
 #include <math.h>
 #include <execinfo.h>
+#include "precision.h"
+#include "gemm.h"
+
+// Alignment (in bytes) of the element block behind every owned matrix
+#define MATRIX_ALIGNMENT 64
+
+// Who is responsible for a matrix's element block
+typedef enum {
+    MATRIX_OWNED,       // one aligned block allocated by create_matrix, released by free_matrix
+    MATRIX_VIEW,        // elements belong to someone else (another matrix, a file mapping, ...)
+    MATRIX_WORKSPACE    // header and elements live in a Workspace; free_matrix does nothing
+} MatrixStorage;
 
 typedef struct {
     int rows;
     int cols;
-    double **data;
+    Real **data;            // row pointers into values, so data[i][j] keeps working
+    Real *values;           // contiguous row-major element block
+    int stride;             // elements between the starts of consecutive rows (>= cols)
+    MatrixStorage storage;
 } Matrix;
 
 // Function declarations
 Matrix* create_matrix(int rows, int cols);
+Matrix* create_matrix_view(Real *values, int rows, int cols, int stride);
 void free_matrix(Matrix *m);
 Matrix* copy_matrix(const Matrix *src);
 Matrix* zeros(int rows, int cols);
@@ -30,6 +46,7 @@ Matrix* add(const Matrix *a, const Matrix *b);
 Matrix* subtract(const Matrix *a, const Matrix *b);
 Matrix* multiply(const Matrix *a, const Matrix *b);
 Matrix* dot(const Matrix *a, const Matrix *b);
+Matrix* matmul(const Matrix *a, GemmTranspose trans_a, const Matrix *b, GemmTranspose trans_b);
 Matrix* scale(const Matrix *a, double scalar);
 Matrix* transpose(const Matrix *a);
 Matrix* apply_function(const Matrix *a, double (*func)(double));
@@ -37,6 +54,25 @@ void add_inplace(Matrix *a, const Matrix *b);
 void subtract_inplace(Matrix *a, const Matrix *b);
 void scale_inplace(Matrix *a, double scalar);
 
+// Output-buffer variants: write the result into a caller-owned dst of the
+// result's shape instead of allocating. Element-wise ops accept dst aliasing
+// an input; transpose and the matrix products do not.
+void copy_into(Matrix *dst, const Matrix *src);
+void add_into(Matrix *dst, const Matrix *a, const Matrix *b);
+void subtract_into(Matrix *dst, const Matrix *a, const Matrix *b);
+void multiply_into(Matrix *dst, const Matrix *a, const Matrix *b);
+void dot_into(Matrix *dst, const Matrix *a, const Matrix *b);
+void matmul_into(Matrix *dst, const Matrix *a, GemmTranspose trans_a,
+                 const Matrix *b, GemmTranspose trans_b);
+void scale_into(Matrix *dst, const Matrix *a, double scalar);
+void transpose_into(Matrix *dst, const Matrix *a);
+void apply_function_into(Matrix *dst, const Matrix *a, double (*func)(double));
+Matrix* ensure_matrix(Matrix *m, int rows, int cols);
+// Give an owned matrix rows rows, keeping the existing ones. Growing moves
+// the elements to a larger block (new rows are zero); shrinking keeps the
+// block and only drops the trailing rows.
+void resize_matrix_rows(Matrix *m, int rows);
+
 // Activation functions
 double sigmoid(double x);
 double relu(double x);
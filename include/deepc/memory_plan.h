@@ -0,0 +1,53 @@
+#ifndef MEMORY_PLAN_H
+#define MEMORY_PLAN_H
+
+#include "layers.h"
+
+// Static buffer layout for training a fixed stack of layers at a fixed batch
+// size (see compile_for_batch). Every activation and gradient of a training
+// step gets an offset in one arena, and buffers whose lifetimes do not
+// overlap share memory. A step is scheduled as forward 0 .. L-1, loss,
+// backward L-1 .. 0; activation i lives from forward i to backward i, the
+// gradients only between the two backward passes that write and read them.
+//
+// With checkpointing the layers are split into segments of checkpoint_every
+// layers and only the last activation of each segment is kept through the
+// backward pass. The others live only until the next layer has read them;
+// before a segment's backward passes, its dropped activations are computed
+// again from the previous segment's output. Activation memory then grows
+// with the number of segments plus the segment length instead of with the
+// depth, for one extra forward pass over most layers.
+typedef struct {
+    int batch_size;         // largest batch the plan holds
+    int num_layers;
+    int checkpoint_every;   // layers per segment, 0 when every activation is kept
+    LayerPlan* layers;
+    Matrix* loss_gradient;  // gradient into the output layer
+
+    char* arena;
+    size_t arena_bytes;
+    size_t unshared_bytes;  // the same buffers laid out one after another
+} MemoryPlan;
+
+// checkpoint_every 0 or 1 keeps every activation
+MemoryPlan* create_memory_plan(Layer* const* layers, int num_layers, int batch_size,
+                               int checkpoint_every);
+void free_memory_plan(MemoryPlan* plan);
+
+// Resize every planned matrix to a batch of rows <= batch_size (the rows
+// are a prefix of the planned ones, so nothing moves)
+void memory_plan_bind(MemoryPlan* plan, int rows);
+
+// A buffer live from step first through step last
+typedef struct {
+    size_t bytes;
+    int first;
+    int last;
+    size_t offset;          // set by plan_buffer_offsets
+} PlannedBuffer;
+
+// Assign non-conflicting offsets, largest buffers first, each at the lowest
+// aligned offset free over its lifetime; returns the arena size
+size_t plan_buffer_offsets(PlannedBuffer* buffers, int count);
+
+#endif
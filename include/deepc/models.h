@@ -4,13 +4,42 @@
 #include "matrix.h"
 #include "layers.h"
 #include "losses.h"
+#include "random.h"
 #include "optimizers.h"
+#include "profiler.h"
+#include "workspace.h"
+#include "memory_plan.h"
+#include "distributed.h"
+
+// Loss and accuracy over a dataset (see evaluate_metrics)
+typedef struct {
+    double loss;
+    double accuracy;
+    int samples;
+} EvaluationMetrics;
+
+// Validation after every fit epoch, with early stopping (see
+// set_validation_data and set_early_stopping)
+typedef struct {
+    const Matrix* X;        // NULL: no validation
+    const Matrix* y;
+    int batch_size;         // rows per inference pass
+    int patience;           // epochs without improvement before stopping, 0 never stops
+    double min_delta;       // smallest loss decrease that counts as an improvement
+    int restore_best;       // end fit with the weights of the best epoch
+    
+    // Outcome of the last fit
+    EvaluationMetrics best;
+    int best_epoch;         // -1 if nothing was validated
+    int epochs_run;
+} Validation;
 
 typedef struct SequentialModel {
     char* name;
     Layer* input_layer;
     Layer* output_layer;
     int num_layers;
+    Layer** layers;         // the same layers by index, input layer first
     
     // Training parameters
     double learning_rate;
@@ -18,6 +47,32 @@ typedef struct SequentialModel {
     Optimizer optimizer_type;
     OptimizerState* optimizer;
     int is_compiled;
+    
+    // The layers' parameters and gradients in one block, created by the
+    // first training step (and recreated if the layers change)
+    ParameterBuffer* parameters;
+    
+    // Scratch memory for training steps, created by the first fit()
+    Workspace* workspace;
+    
+    // Activation and gradient buffers planned by compile_for_batch (fit
+    // plans its batch size), or NULL
+    MemoryPlan* plan;
+    int checkpoint_every;   // see set_gradient_checkpointing
+    
+    // Held-out data fit validates on after every epoch
+    Validation validation;
+    
+    // Per-epoch shuffling in fit; rng seeds each fit's sample order
+    int shuffle;
+    Rng rng;
+    
+    // Training profiler, NULL unless enable_profiling was called
+    Profiler* profiler;
+    
+    // File mapping the parameters point into (load_model_binary), or NULL
+    void* mapping;
+    size_t mapping_size;
 } SequentialModel;
 
 // Model creation and management
@@ -27,12 +82,89 @@ void free_model(SequentialModel* model);
 
 // Model compilation and training
 void compile(SequentialModel* model, Optimizer optimizer, LossFunction loss, double learning_rate);
+// Lay out every activation and gradient of a training step at batch_size
+// in one arena, reusing memory between buffers that are never live together
+// (memory_plan.h). Training steps on batches up to batch_size then allocate
+// nothing; larger ones fall back to the workspace. Adding a layer drops the
+// plan.
+void compile_for_batch(SequentialModel* model, int batch_size);
+// Gradient checkpointing for deep models: the memory plan keeps only the
+// last activation of every segment_layers layers and recomputes the others
+// segment by segment during backpropagation, about one more forward pass
+// per step for much less activation memory, so larger batches fit. A
+// negative segment_layers picks about sqrt(num_layers); 0 or 1 turns it
+// off. Applies to steps that run under the plan (every fit step).
+void set_gradient_checkpointing(SequentialModel* model, int segment_layers);
 Matrix* predict(SequentialModel* model, const Matrix* input);
 void fit(SequentialModel* model, const Matrix* X, const Matrix* y, 
          int epochs, int batch_size, int verbose);
 
-// Model evaluation
+// One optimizer step on a single batch, for training loops that stream their
+// data (see CsvReader); returns the batch loss or NAN on error
+double train_on_batch(SequentialModel* model, const Matrix* X, const Matrix* y);
+
+// fit and fit_parallel visit the samples in a new random order every epoch
+// (through an index permutation; X and y are never rearranged). The order
+// is reproducible from the seed, DEEPC_DEFAULT_SEED unless set here.
+void set_shuffle(SequentialModel* model, int shuffle, uint64_t seed);
+
+// Data-parallel fit: every batch is split into num_workers shards that run
+// forward and backward concurrently on the thread pool (with their own
+// activation caches), and the summed gradients drive one optimizer step.
+// num_workers <= 0 uses one worker per pool thread.
+void fit_parallel(SequentialModel* model, const Matrix* X, const Matrix* y,
+                  int epochs, int batch_size, int num_workers, int verbose);
+
+// Multi-node data-parallel fit (distributed.h). Every rank trains on its
+// own shard of the data (see csv_load_shard) with batch_size rows per step,
+// starting from rank 0's weights. Each layer's gradients are ring
+// all-reduced over the ranks as soon as its backward pass finishes, while
+// the layers below it still run, and every rank then takes the optimizer
+// step fit would take on all the ranks' batches stacked into one. An epoch runs
+// as many steps as the largest shard needs. With checkpoint_path, rank 0
+// writes the model there in the binary format after every epoch.
+void fit_distributed(SequentialModel* model, Communicator* comm, const Matrix* X, const Matrix* y,
+                     int epochs, int batch_size, const char* checkpoint_path, int verbose);
+
+// Sparse features (sparse.h) for a first Dense layer over a very wide,
+// mostly-zero input: its forward pass multiplies only the nonzeros and its
+// weight gradient is written only at the columns each batch uses. The other
+// layers train as in fit. fit_sparse shuffles like fit.
+void fit_sparse(SequentialModel* model, const SparseMatrix* X, const Matrix* y,
+                int epochs, int batch_size, int verbose);
+double train_on_sparse_batch(SequentialModel* model, const SparseMatrix* X, const Matrix* y);
+Matrix* predict_sparse(SequentialModel* model, const SparseMatrix* input);
+
+// Model evaluation. Both stream X through an inference session batch_size
+// rows at a time (<= 0 picks a default) and never hold all the predictions.
+// Accuracy compares the argmax of every row or, with a single output, the
+// prediction and the target thresholded at 0.5.
 double evaluate(SequentialModel* model, const Matrix* X, const Matrix* y);
+EvaluationMetrics evaluate_metrics(SequentialModel* model, const Matrix* X, const Matrix* y,
+                                   int batch_size);
+
+// Validate on X, y after every fit epoch (X NULL turns it off); the
+// loss and accuracy are printed with verbose, the best in model->validation
+void set_validation_data(SequentialModel* model, const Matrix* X, const Matrix* y, int batch_size);
+// Stop fit once the validation loss has not improved by min_delta for
+// patience epochs (0: never), and with restore_best_weights end it with
+// the parameters of the best epoch. The best weights are kept as an
+// in-memory snapshot of the parameter buffer, swapped in at the end.
+void set_early_stopping(SequentialModel* model, int patience, double min_delta,
+                        int restore_best_weights);
+
+// Training profiler (profiler.h). While enabled, training collects
+// per-layer and per-phase TrainingStats, which print_model_summary breaks
+// down; with record_trace it also keeps a Chrome trace of every step.
+// Enable it after adding the layers.
+void enable_profiling(SequentialModel* model, int record_trace);
+void disable_profiling(SequentialModel* model);
+const TrainingStats* get_training_stats(const SequentialModel* model);
+// Called with the stats after every training batch; enables profiling if it is off
+void set_batch_callback(SequentialModel* model, BatchCallback callback, void* user_data);
+// The recorded trace as Chrome trace-event JSON; returns 0 if profiling is
+// off or the file cannot be written
+int write_training_trace(const SequentialModel* model, const char* filename);
 
 // Utility functions
 void print_model_summary(const SequentialModel* model);
@@ -44,4 +176,15 @@ SequentialModel* load_model(const char* filename);
 void save_weights(SequentialModel* model, const char* filename);
 void load_weights(SequentialModel* model, const char* filename);
 
+// Binary .dc format: a header, a layer table and 64-byte aligned
+// little-endian parameter blobs. Loading maps the file and points the
+// weights straight at the mapping (copy-on-write, so training a loaded model
+// never modifies the file). load_model() recognizes binary files as well.
+#define DEEPC_BINARY_MAGIC "DEEPCBIN"
+#define DEEPC_BINARY_MAGIC_SIZE 8
+#define DEEPC_BINARY_VERSION 1
+
+void save_model_binary(const SequentialModel* model, const char* filename);
+SequentialModel* load_model_binary(const char* filename);
+
 #endif
\ No newline at end of file
@@ -1,37 +1,91 @@
 #ifndef OPTIMIZERS_H
 #define OPTIMIZERS_H
 
+#include <stddef.h>
 #include "matrix.h"
 #include "layers.h"
 
+// Stored in model files by value, so new types go at the end
 typedef enum {
     SGD,
-    ADAM
+    ADAM,
+    ADAMW
 } Optimizer;
 
+// Every trainable parameter of a network in one contiguous block: the
+// weights of all layers, then the biases of all layers, each matrix starting
+// on a MATRIX_ALIGNMENT boundary. The gradients live in a second block with
+// the same layout. The layers' weights, biases, dweights and dbiases become
+// views into these blocks, so an optimizer step is one pass over flat arrays.
+typedef struct {
+    Real* values;
+    Real* grads;
+    size_t size;                // elements per block, alignment padding included
+    size_t weights_size;        // elements before the first bias
+    int num_layers;
+    size_t* weight_offsets;     // per layer, into values and grads
+    size_t* bias_offsets;
+} ParameterBuffer;
+
 typedef struct OptimizerState {
     Optimizer type;
     double learning_rate;
-    int timestep;
-    
+    int timestep;               // steps taken, once per optimizer_step
+
     // Adam parameters
     double beta1;
     double beta2;
     double epsilon;
-    
 
-    Matrix*** m_weights;  // Array of matrices for each layer
-    Matrix*** v_weights;
-    Matrix*** m_biases;
-    Matrix*** v_biases;
-    int max_layers;
+    // SGD momentum; 0 is plain SGD
+    double momentum;
+
+    // Decoupled weight decay, w -= learning_rate * weight_decay * w, applied
+    // to weights but not biases. 0 except for ADAMW, where it is 0.01.
+    double weight_decay;
+
+    // Gradients are rescaled to at most this global L2 norm before the
+    // update; 0 disables clipping
+    double clip_norm;
+
+    // Per-parameter state in the ParameterBuffer layout, allocated by the
+    // first step: Adam's first and second moments, or SGD's velocity in m
+    Real* m;
+    Real* v;
+    double* norm_partials;      // squared gradient norm per chunk, for clipping
+    size_t state_size;
 } OptimizerState;
 
 // Optimizer management
 OptimizerState* create_optimizer(Optimizer type, double learning_rate);
 void free_optimizer(OptimizerState* optimizer);
+const char* optimizer_name(Optimizer type);
+
+// Hyperparameters beyond the learning rate; call after compile()
+void set_momentum(OptimizerState* optimizer, double momentum);
+void set_weight_decay(OptimizerState* optimizer, double weight_decay);
+void set_gradient_clipping(OptimizerState* optimizer, double max_norm);
+
+// Move the parameters and gradients of the layers from first_layer on into
+// a new buffer, keeping their values
+ParameterBuffer* create_parameter_buffer(Layer* first_layer);
+void free_parameter_buffer(ParameterBuffer* params);
+
+// Whether the layers from first_layer on are still exactly the views of params
+int parameter_buffer_matches(const ParameterBuffer* params, const Layer* first_layer);
+
+// Snapshots of the parameter values (e.g. the best weights seen while
+// training), blocks of params->size elements freed with free(). Saving is
+// one copy; swapping exchanges the block with params->values and points the
+// layers' weights and biases at it, so restoring copies nothing.
+Real* create_parameter_snapshot(const ParameterBuffer* params);
+void save_parameter_snapshot(const ParameterBuffer* params, Real* snapshot);
+void swap_parameter_snapshot(ParameterBuffer* params, Layer* first_layer, Real** snapshot);
 
-// Weight updates
-void update_weights(Layer* layer, OptimizerState* optimizer, int layer_index);
+// One update of every parameter from params->grads, a single fused and
+// multithreaded pass. The optimizer state is (re)initialized whenever the
+// buffer's size differs from the previous step's. This replaces the
+// per-layer update_weights of earlier versions.
+void optimizer_step(OptimizerState* optimizer, ParameterBuffer* params);
 
 #endif
@@ -0,0 +1,24 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+// Element type of every matrix. double by default; building with
+// DEEPC_USE_FLOAT32 switches the whole library to float, which halves the
+// memory traffic and doubles the SIMD width of the kernels. Scalars such as
+// losses, learning rates and statistics stay double either way.
+#include <math.h>
+
+#ifdef DEEPC_USE_FLOAT32
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
+// Square root in the element type, so float builds stay in float (the
+// transcendental functions are in vmath.h)
+#ifdef DEEPC_USE_FLOAT32
+static inline Real real_sqrt(Real x) { return sqrtf(x); }
+#else
+static inline Real real_sqrt(Real x) { return sqrt(x); }
+#endif
+
+#endif
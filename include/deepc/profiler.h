@@ -0,0 +1,95 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stddef.h>
+
+// Opt-in training profiler. While enabled on a model, fit, fit_parallel and
+// train_on_batch time every phase of each step (per layer for the forward
+// and backward passes), count the heap allocations made meanwhile, call an
+// optional per-batch callback and can record a Chrome trace
+// (chrome://tracing, Perfetto). Disabled, the hooks cost one NULL check.
+
+// Wall time and library heap allocations (matrices, workspace and optimizer
+// blocks, counted process-wide) of one kind of work, summed over its calls
+typedef struct {
+    double seconds;
+    long calls;
+    long allocations;
+    size_t allocated_bytes;
+} ProfileTimer;
+
+typedef struct {
+    ProfileTimer forward;
+    ProfileTimer backward;
+} LayerProfile;
+
+// Totals since profiling was enabled or last reset. In fit_parallel the
+// per-layer and loss times are those of the first worker's shard, which
+// runs alongside the others.
+typedef struct {
+    long batches;
+    long samples;
+
+    // The batch that just finished, for the callback
+    int epoch;
+    int batch;
+    double batch_loss;
+    double batch_seconds;           // its step, batch assembly excluded
+
+    ProfileTimer batch_assembly;    // waiting for the next batch from the data loader
+    ProfileTimer loss;              // loss and its gradient
+    ProfileTimer update;            // optimizer step
+    ProfileTimer reduce;            // fit_parallel: summing the workers' gradients
+    ProfileTimer step;              // whole training steps
+
+    int num_layers;
+    LayerProfile* layers;           // input layer first
+} TrainingStats;
+
+typedef void (*BatchCallback)(const TrainingStats* stats, void* user_data);
+
+typedef struct Profiler Profiler;
+
+// Phases the training loop reports
+typedef enum {
+    PROFILE_BATCH_ASSEMBLY,
+    PROFILE_FORWARD,
+    PROFILE_LOSS,
+    PROFILE_BACKWARD,
+    PROFILE_UPDATE,
+    PROFILE_REDUCE,
+    PROFILE_STEP
+} ProfilePhase;
+
+// Start of a timed region
+typedef struct {
+    double seconds;
+    long allocations;
+    size_t allocated_bytes;
+} ProfileMark;
+
+// Profiler for a network of num_layers layers; with record_trace every timed
+// region is also kept as a trace event (up to PROFILE_MAX_TRACE_EVENTS)
+#define PROFILE_MAX_TRACE_EVENTS (1 << 20)
+Profiler* create_profiler(int num_layers, int record_trace);
+void free_profiler(Profiler* profiler);
+void reset_profiler(Profiler* profiler);
+const TrainingStats* profiler_stats(const Profiler* profiler);
+void profiler_set_callback(Profiler* profiler, BatchCallback callback, void* user_data);
+void profiler_copy_callback(Profiler* profiler, const Profiler* from);
+
+// Chrome trace-event JSON of the recorded regions; returns 0 on failure
+int profiler_write_trace(const Profiler* profiler, const char* filename);
+
+// Hooks for the training loop; all accept a NULL profiler and do nothing.
+// layer is the layer index for PROFILE_FORWARD and PROFILE_BACKWARD.
+void profile_begin_batch(Profiler* profiler, int epoch, int batch);
+ProfileMark profile_begin(const Profiler* profiler);
+void profile_end(Profiler* profiler, ProfilePhase phase, int layer, ProfileMark mark);
+void profile_batch_done(Profiler* profiler, int rows, double loss);
+
+// Library-wide allocation counter behind ProfileTimer, always running
+void profile_count_allocation(size_t bytes);
+void deepc_allocation_stats(long* allocations, size_t* allocated_bytes);
+
+#endif
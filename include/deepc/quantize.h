@@ -0,0 +1,59 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdint.h>
+#include "matrix.h"
+#include "models.h"
+
+// Input rows are padded to a multiple of this many int8 elements (one
+// 512-bit vector), with zero weights in the padding
+#define QUANT_K_ALIGN 64
+
+// Int8 form of a Dense layer, used by inference in place of the float
+// weights. Weights are symmetric per output channel and the layer input is
+// asymmetric uint8 with a range calibrated on sample data:
+//   w[o][k] ~= weight_scales[o] * weights[o][k]               (weights in [-127, 127])
+//   x[k]    ~= input_scale * (q[k] - input_zero_point)        (q in [0, 255])
+// so each output is one integer dot product rescaled by
+// input_scale * weight_scales[o], less the zero point times weight_sums[o].
+// The biases and the activation stay in floating point.
+typedef struct QuantizedDense {
+    int output_size;
+    int input_size;
+    int padded_input;           // row stride of weights, a multiple of QUANT_K_ALIGN
+    int8_t* weights;            // output_size x padded_input
+    float* weight_scales;       // output_size
+    int32_t* weight_sums;       // output_size, sum of each row of weights
+    float input_scale;
+    int input_zero_point;
+    int mapped;                 // weights point into a model file mapping
+} QuantizedDense;
+
+// Quantize every Dense layer of model for inference. calibration is a
+// sample of typical inputs (a few hundred rows is plenty): it is run
+// through the float model to find the range of each layer's input. From
+// then on predict, predict_into and evaluate use the int8 kernels (VNNI or
+// AVX2 where available) while training still sees the float weights; any
+// weight update drops the int8 form again. save_model_binary stores it.
+void quantize_model(SequentialModel* model, const Matrix* calibration);
+
+// Go back to float inference
+void dequantize_model(SequentialModel* model);
+
+// Whether any layer of model runs quantized
+int model_is_quantized(const SequentialModel* model);
+
+// Quantize one layer's weights for inputs in [input_min, input_max]
+QuantizedDense* quantize_dense(const Layer* layer, double input_min, double input_max);
+void free_quantized_dense(QuantizedDense* q);
+
+// output = input * W^T + biases through the int8 kernel (no activation);
+// output must not alias input. Performs no allocation.
+void quantized_dense_forward(const QuantizedDense* q, const Matrix* biases,
+                             const Matrix* input, Matrix* output);
+
+// Name of the int8 dot-product kernel selected for this CPU ("avx512vnni",
+// "avx2", "generic")
+const char* quantized_kernel_name(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// Small, fast, seedable generator (xoshiro256**) for shuffling and sampling.
+// Each Rng is an independent stream; nothing touches the global rand()
+// state, so results only depend on the seed.
+typedef struct {
+    uint64_t state[4];
+} Rng;
+
+// Seed used by models that were never given one
+#define DEEPC_DEFAULT_SEED 0x5eed5eedULL
+
+void rng_seed(Rng* rng, uint64_t seed);
+uint64_t rng_next(Rng* rng);
+
+// Uniform double in [0, 1)
+double rng_uniform(Rng* rng);
+
+// Uniform integer in [0, bound) without modulo bias
+uint64_t rng_bounded(Rng* rng, uint64_t bound);
+
+// Fisher-Yates shuffle of n indices
+void rng_shuffle(Rng* rng, int* indices, int n);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+#include <stddef.h>
+
+// Compressed sparse row matrix for high-dimensional, mostly-zero inputs
+// (one-hot and hashed categoricals). Row i's nonzeros are
+// values[row_ptr[i] .. row_ptr[i + 1]) at columns col_idx[...], in
+// ascending column order.
+typedef struct SparseMatrix {
+    int rows;
+    int cols;
+    size_t nnz;
+    size_t capacity;        // room in col_idx and values
+    int row_capacity;       // room in row_ptr, minus one
+    size_t* row_ptr;        // rows + 1 entries
+    int* col_idx;
+    Real* values;
+} SparseMatrix;
+
+// Empty rows x cols matrix with room for capacity nonzeros
+SparseMatrix* create_sparse_matrix(int rows, int cols, size_t capacity);
+void free_sparse_matrix(SparseMatrix* s);
+
+// Conversion (exact zeros are dropped)
+SparseMatrix* sparse_from_dense(const Matrix* m);
+Matrix* sparse_to_dense(const SparseMatrix* s);
+
+// dst = rows indices[0 .. count) of src, e.g. a shuffled batch; dst's
+// storage is reused and grown as needed
+void sparse_gather_rows(SparseMatrix* dst, const SparseMatrix* src, const int* indices, int count);
+
+// Fraction of entries that are stored
+double sparse_density(const SparseMatrix* s);
+
+// c = a * b^T for sparse a [m, k] and dense b [n, k] (a Dense layer's
+// weights), so only a's nonzeros are multiplied: O(nnz * n) instead of
+// O(m * k * n)
+void sparse_dense_gemm_nt(Matrix* c, const SparseMatrix* a, const Matrix* b);
+
+// Columns a weight gradient has nonzeros in, kept between calls so a sparse
+// update only clears what the previous one wrote. NULL means unknown.
+typedef struct SparseGradientState SparseGradientState;
+void free_sparse_gradient_state(SparseGradientState* state);
+// Forget which columns were written (the gradient was overwritten densely)
+void sparse_gradient_invalidate(SparseGradientState* state);
+
+// dw = scale * delta^T * a for delta [m, n] and sparse a [m, k]. Only the
+// columns a uses are computed and, from *state (created on first use), only
+// the columns the previous call wrote are cleared; every other column of dw
+// is already zero. The first call clears dw completely.
+void sparse_weight_gradient(Matrix* dw, const Matrix* delta, const SparseMatrix* a,
+                            double scale, SparseGradientState** state);
+
+// libsvm / svmlight text: one sample per line, "label index:value ...",
+// indices starting at 1 (comments after '#' are ignored). num_features <= 0
+// takes the largest index seen. The labels are returned as they are, one
+// per row of *labels. Returns NULL if the file cannot be read or parsed.
+SparseMatrix* load_libsvm(const char* filename, int num_features, Matrix** labels);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Persistent worker pool shared by the whole library. Workers are started on
+// first use and then sleep between jobs, so a training step only pays for a
+// wake-up, never for thread creation.
+
+// Number of threads the library may use, the calling thread included.
+// num_threads <= 0 picks one per online core (or $DEEPC_NUM_THREADS when
+// set). Must not be called while another thread is running library code.
+void deepc_set_num_threads(int num_threads);
+int deepc_get_num_threads(void);
+
+// Work item covering the index range [begin, end)
+typedef void (*ParallelTask)(void* ctx, int begin, int end);
+
+// Split [0, count) into chunks of at least grain indices and run them on the
+// pool, the caller taking part, returning once all are done. Calls from
+// inside a task, from a thread that finds the pool busy, or with less than
+// two chunks of work run inline on the calling thread.
+void parallel_for(int count, int grain, ParallelTask task, void* ctx);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef VMATH_H
+#define VMATH_H
+
+#include "precision.h"
+
+// Vectorized transcendental kernels over arrays of Real. Each is a
+// branch-free polynomial (range reduction, then a fixed-degree series) that
+// is compiled for AVX-512, AVX2+FMA and baseline SSE2 and dispatched at load
+// time on x86; other targets get the compiler's autovectorization.
+//
+// Error bounds (double / float builds), on the whole domain unless noted:
+//   vm_exp      relative 3e-16 / 1e-7; saturates outside [-708, 709] in
+//               double and [-87, 88] in float instead of returning 0 or inf
+//   vm_log      relative 4e-16 / 2e-7, for positive normal inputs only
+//   vm_sigmoid  absolute 3e-16 / 1e-7
+//   vm_tanh     relative 1e-15 / 5e-7
+// NaN inputs give NaN. dst may be src itself, but must not partially overlap it.
+void vm_exp(Real* dst, const Real* src, int n);
+void vm_log(Real* dst, const Real* src, int n);
+void vm_sigmoid(Real* dst, const Real* src, int n);
+void vm_tanh(Real* dst, const Real* src, int n);
+
+// Softmax of one row with an online normalizer: the input is read once,
+// blocks of it are exponentiated against the running maximum (rescaling
+// the running sum whenever the maximum grows) and a final pass over dst
+// rescales every block to the row's maximum and normalizes. dst may be src.
+void vm_softmax(Real* dst, const Real* src, int n);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include "matrix.h"
+
+// Bump allocator for per-step temporaries (one training batch, one request).
+// Memory handed out stays valid until the next workspace_reset. Requests that
+// do not fit the main block go to extra heap blocks; the next reset folds
+// them into a single block of the combined size, so once the largest step
+// has been seen a workspace stops touching the heap.
+typedef struct WorkspaceBlock WorkspaceBlock;
+
+typedef struct Workspace {
+    char* buffer;               // main block
+    size_t capacity;            // size of the main block in bytes
+    size_t used;                // bytes handed out from the main block
+    size_t requested;           // bytes handed out since the last reset, overflow included
+    WorkspaceBlock* overflow;   // extra blocks allocated since the last reset
+} Workspace;
+
+// Workspace management
+Workspace* create_workspace(size_t initial_bytes);
+void free_workspace(Workspace* ws);
+void workspace_reset(Workspace* ws);
+
+// Allocation (64-byte aligned; nothing is ever freed individually)
+void* workspace_alloc(Workspace* ws, size_t bytes);
+
+// Matrix whose header, row pointers and elements all live in the workspace.
+// free_matrix ignores it. The elements are not initialized. With ws == NULL
+// this falls back to create_matrix, so callers can serve both cases.
+Matrix* workspace_matrix(Workspace* ws, int rows, int cols);
+
+// Rows [row, row + rows) of m, sharing its elements and row pointers; only
+// the header is taken from the workspace
+Matrix* workspace_row_view(Workspace* ws, const Matrix* m, int row, int rows);
+
+#endif
@@ -0,0 +1,366 @@
+#include "deepc/column_stats.h"
+#include "deepc/threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Error handling
+#define STATS_ERROR(msg) do { \
+    fprintf(stderr, "\n*** COLUMN STATS ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define STATS_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        STATS_ERROR(msg); \
+    } \
+} while(0)
+
+#define COLUMN_STATS_MAGIC "DEEPC_COLUMN_STATS"
+#define COLUMN_STATS_VERSION 1
+
+// Rows per partial summary; fixed, so the merge order and therefore the
+// rounding do not depend on the thread count
+#define COLUMN_STATS_CHUNK_ROWS 1024
+
+// Elements per task of the preprocessing passes
+#define COLUMN_STATS_GRAIN 16384
+
+ColumnStats* create_column_stats(int cols) {
+    STATS_CHECK(cols > 0, "Column count must be positive");
+
+    ColumnStats* stats = (ColumnStats*)malloc(sizeof(ColumnStats));
+    STATS_CHECK(stats != NULL, "Memory allocation failed for column stats");
+    stats->cols = cols;
+    stats->count = (long long*)malloc(cols * sizeof(long long));
+    stats->mean = (double*)malloc(cols * sizeof(double));
+    stats->m2 = (double*)malloc(cols * sizeof(double));
+    stats->min = (double*)malloc(cols * sizeof(double));
+    stats->max = (double*)malloc(cols * sizeof(double));
+    STATS_CHECK(stats->count && stats->mean && stats->m2 && stats->min && stats->max,
+                "Memory allocation failed for column stats");
+
+    column_stats_reset(stats);
+    return stats;
+}
+
+void free_column_stats(ColumnStats* stats) {
+    if (!stats) return;
+
+    free(stats->count);
+    free(stats->mean);
+    free(stats->m2);
+    free(stats->min);
+    free(stats->max);
+    free(stats);
+}
+
+void column_stats_reset(ColumnStats* stats) {
+    STATS_CHECK(stats != NULL, "Stats cannot be NULL");
+
+    stats->rows = 0;
+    for (int j = 0; j < stats->cols; j++) {
+        stats->count[j] = 0;
+        stats->mean[j] = 0.0;
+        stats->m2[j] = 0.0;
+        stats->min[j] = INFINITY;
+        stats->max[j] = -INFINITY;
+    }
+}
+
+// Chan et al.'s pairwise combination of two (count, mean, m2) summaries
+static void merge_column(long long* count, double* mean, double* m2, double* min, double* max,
+                         long long other_count, double other_mean, double other_m2,
+                         double other_min, double other_max) {
+    if (other_count == 0) return;
+    if (*count == 0) {
+        *count = other_count;
+        *mean = other_mean;
+        *m2 = other_m2;
+        *min = other_min;
+        *max = other_max;
+        return;
+    }
+
+    double n = (double)(*count + other_count);
+    double delta = other_mean - *mean;
+    *mean += delta * (other_count / n);
+    *m2 += other_m2 + delta * delta * ((double)*count * other_count / n);
+    *count += other_count;
+    if (other_min < *min) *min = other_min;
+    if (other_max > *max) *max = other_max;
+}
+
+// Summaries of consecutive row chunks, laid out per chunk
+typedef struct {
+    const Matrix* m;
+    int cols;
+    long long* count;
+    double* mean;
+    double* m2;
+    double* min;
+    double* max;
+} PartialStats;
+
+// Welford updates over the rows of chunks [begin, end), one row at a time
+static void partial_stats_task(void* ctx, int begin, int end) {
+    PartialStats* p = (PartialStats*)ctx;
+    int cols = p->cols;
+
+    for (int c = begin; c < end; c++) {
+        size_t base = (size_t)c * cols;
+        long long* count = p->count + base;
+        double* mean = p->mean + base;
+        double* m2 = p->m2 + base;
+        double* min = p->min + base;
+        double* max = p->max + base;
+        for (int j = 0; j < cols; j++) {
+            count[j] = 0;
+            mean[j] = 0.0;
+            m2[j] = 0.0;
+            min[j] = INFINITY;
+            max[j] = -INFINITY;
+        }
+
+        int first = c * COLUMN_STATS_CHUNK_ROWS;
+        int last = first + COLUMN_STATS_CHUNK_ROWS < p->m->rows ? first + COLUMN_STATS_CHUNK_ROWS
+                                                                 : p->m->rows;
+        for (int i = first; i < last; i++) {
+            const Real* row = p->m->data[i];
+            for (int j = 0; j < cols; j++) {
+                double x = row[j];
+                if (isnan(x)) continue;
+                double delta = x - mean[j];
+                mean[j] += delta / (double)++count[j];
+                m2[j] += delta * (x - mean[j]);
+                if (x < min[j]) min[j] = x;
+                if (x > max[j]) max[j] = x;
+            }
+        }
+    }
+}
+
+void column_stats_update(ColumnStats* stats, const Matrix* chunk) {
+    STATS_CHECK(stats != NULL && chunk != NULL, "Arguments cannot be NULL");
+    STATS_CHECK(chunk->cols == stats->cols, "Chunk has the wrong number of columns");
+    if (chunk->rows == 0) return;
+
+    int num_chunks = (chunk->rows + COLUMN_STATS_CHUNK_ROWS - 1) / COLUMN_STATS_CHUNK_ROWS;
+    size_t entries = (size_t)num_chunks * stats->cols;
+
+    PartialStats p;
+    p.m = chunk;
+    p.cols = stats->cols;
+    p.count = (long long*)malloc(entries * sizeof(long long));
+    p.mean = (double*)malloc(entries * sizeof(double));
+    p.m2 = (double*)malloc(entries * sizeof(double));
+    p.min = (double*)malloc(entries * sizeof(double));
+    p.max = (double*)malloc(entries * sizeof(double));
+    STATS_CHECK(p.count && p.mean && p.m2 && p.min && p.max,
+                "Memory allocation failed for partial column stats");
+
+    int grain = COLUMN_STATS_GRAIN / COLUMN_STATS_CHUNK_ROWS / stats->cols;
+    parallel_for(num_chunks, grain > 0 ? grain : 1, partial_stats_task, &p);
+
+    // Fold the chunks in row order
+    for (int c = 0; c < num_chunks; c++) {
+        size_t base = (size_t)c * stats->cols;
+        for (int j = 0; j < stats->cols; j++) {
+            merge_column(&stats->count[j], &stats->mean[j], &stats->m2[j],
+                         &stats->min[j], &stats->max[j],
+                         p.count[base + j], p.mean[base + j], p.m2[base + j],
+                         p.min[base + j], p.max[base + j]);
+        }
+    }
+    stats->rows += chunk->rows;
+
+    free(p.count);
+    free(p.mean);
+    free(p.m2);
+    free(p.min);
+    free(p.max);
+}
+
+void column_stats_merge(ColumnStats* stats, const ColumnStats* other) {
+    STATS_CHECK(stats != NULL && other != NULL, "Arguments cannot be NULL");
+    STATS_CHECK(stats->cols == other->cols, "Stats have different numbers of columns");
+
+    for (int j = 0; j < stats->cols; j++) {
+        merge_column(&stats->count[j], &stats->mean[j], &stats->m2[j],
+                     &stats->min[j], &stats->max[j],
+                     other->count[j], other->mean[j], other->m2[j],
+                     other->min[j], other->max[j]);
+    }
+    stats->rows += other->rows;
+}
+
+ColumnStats* compute_column_stats(const Matrix* m) {
+    STATS_CHECK(m != NULL, "Matrix cannot be NULL");
+
+    ColumnStats* stats = create_column_stats(m->cols);
+    column_stats_update(stats, m);
+    return stats;
+}
+
+double column_variance(const ColumnStats* stats, int j) {
+    STATS_CHECK(stats != NULL, "Stats cannot be NULL");
+    STATS_CHECK(j >= 0 && j < stats->cols, "Column index out of bounds");
+    return stats->count[j] > 0 ? stats->m2[j] / stats->count[j] : 0.0;
+}
+
+double column_std(const ColumnStats* stats, int j) {
+    return sqrt(column_variance(stats, j));
+}
+
+long long column_missing(const ColumnStats* stats, int j) {
+    STATS_CHECK(stats != NULL, "Stats cannot be NULL");
+    STATS_CHECK(j >= 0 && j < stats->cols, "Column index out of bounds");
+    return stats->rows - stats->count[j];
+}
+
+// Per-column transform x' = (x - offset) / divisor (left alone where the
+// divisor is 0), with NaNs replaced by fill when filling
+typedef struct {
+    Matrix* m;
+    const double* offset;
+    const double* divisor;
+    const double* fill;
+} ColumnTransform;
+
+static void column_transform_task(void* ctx, int begin, int end) {
+    ColumnTransform* t = (ColumnTransform*)ctx;
+    int cols = t->m->cols;
+
+    for (int i = begin; i < end; i++) {
+        Real* row = t->m->data[i];
+        for (int j = 0; j < cols; j++) {
+            double x = row[j];
+            if (isnan(x)) {
+                if (t->fill) row[j] = t->fill[j];
+            } else if (t->divisor && t->divisor[j] != 0.0) {
+                row[j] = (x - t->offset[j]) / t->divisor[j];
+            }
+        }
+    }
+}
+
+static void run_column_transform(Matrix* m, const double* offset, const double* divisor,
+                                 const double* fill) {
+    ColumnTransform t = { m, offset, divisor, fill };
+    int grain = m->cols > 0 ? COLUMN_STATS_GRAIN / m->cols : 1;
+    parallel_for(m->rows, grain > 0 ? grain : 1, column_transform_task, &t);
+}
+
+static void check_stats_for(const Matrix* m, const ColumnStats* stats) {
+    STATS_CHECK(m != NULL && stats != NULL, "Arguments cannot be NULL");
+    STATS_CHECK(m->cols == stats->cols, "Stats have the wrong number of columns");
+}
+
+void fill_missing_with_stats(Matrix* m, const ColumnStats* stats) {
+    check_stats_for(m, stats);
+
+    double* fill = (double*)malloc(m->cols * sizeof(double));
+    STATS_CHECK(fill != NULL, "Memory allocation failed for fill values");
+    for (int j = 0; j < m->cols; j++) {
+        fill[j] = stats->count[j] > 0 ? stats->mean[j] : 0.0;
+    }
+    run_column_transform(m, NULL, NULL, fill);
+    free(fill);
+}
+
+void normalize_with_stats(Matrix* m, const ColumnStats* stats) {
+    check_stats_for(m, stats);
+
+    double* range = (double*)malloc(m->cols * sizeof(double));
+    STATS_CHECK(range != NULL, "Memory allocation failed for column ranges");
+    for (int j = 0; j < m->cols; j++) {
+        range[j] = stats->count[j] > 0 && stats->max[j] > stats->min[j]
+                 ? stats->max[j] - stats->min[j] : 0.0;
+    }
+    run_column_transform(m, stats->min, range, NULL);
+    free(range);
+}
+
+void standardize_with_stats(Matrix* m, const ColumnStats* stats) {
+    check_stats_for(m, stats);
+
+    double* std_dev = (double*)malloc(m->cols * sizeof(double));
+    STATS_CHECK(std_dev != NULL, "Memory allocation failed for column deviations");
+    for (int j = 0; j < m->cols; j++) {
+        double s = column_std(stats, j);
+        std_dev[j] = s > 1e-10 ? s : 0.0;   // Avoid division by zero
+    }
+    run_column_transform(m, stats->mean, std_dev, NULL);
+    free(std_dev);
+}
+
+void print_column_stats(const ColumnStats* stats) {
+    STATS_CHECK(stats != NULL, "Stats cannot be NULL");
+
+    printf("=== COLUMN STATISTICS ===\n");
+    printf("Rows: %lld, Columns: %d\n", stats->rows, stats->cols);
+    for (int j = 0; j < stats->cols; j++) {
+        if (stats->count[j] == 0) {
+            printf("Col %d: All values missing\n", j);
+            continue;
+        }
+        printf("Col %d: mean=%.4f, std=%.4f, min=%.4f, max=%.4f, missing=%lld\n",
+               j, stats->mean[j], column_std(stats, j), stats->min[j], stats->max[j],
+               column_missing(stats, j));
+    }
+    printf("=========================\n\n");
+}
+
+int save_column_stats(const ColumnStats* stats, const char* filename) {
+    STATS_CHECK(stats != NULL && filename != NULL, "Arguments cannot be NULL");
+
+    FILE* file = fopen(filename, "w");
+    if (!file) return 0;
+
+    fprintf(file, "%s %d\n", COLUMN_STATS_MAGIC, COLUMN_STATS_VERSION);
+    fprintf(file, "%d %lld\n", stats->cols, stats->rows);
+    for (int j = 0; j < stats->cols; j++) {
+        // %.17g round-trips every double
+        fprintf(file, "%lld %.17g %.17g %.17g %.17g\n", stats->count[j], stats->mean[j],
+                stats->m2[j], stats->min[j], stats->max[j]);
+    }
+
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    return ok;
+}
+
+ColumnStats* load_column_stats(const char* filename) {
+    STATS_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    FILE* file = fopen(filename, "r");
+    if (!file) return NULL;
+
+    char magic[32];
+    int version, cols;
+    long long rows;
+    if (fscanf(file, "%31s %d", magic, &version) != 2 || strcmp(magic, COLUMN_STATS_MAGIC) != 0 ||
+        version != COLUMN_STATS_VERSION || fscanf(file, "%d %lld", &cols, &rows) != 2 || cols <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    ColumnStats* stats = create_column_stats(cols);
+    stats->rows = rows;
+    for (int j = 0; j < cols; j++) {
+        if (fscanf(file, "%lld %lf %lf %lf %lf", &stats->count[j], &stats->mean[j],
+                   &stats->m2[j], &stats->min[j], &stats->max[j]) != 5) {
+            free_column_stats(stats);
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    fclose(file);
+    return stats;
+}
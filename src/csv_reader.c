@@ -0,0 +1,619 @@
+#include "deepc/csv_reader.h"
+#include "deepc/threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Error handling macros
+#define CSV_ERROR(msg) do { \
+    fprintf(stderr, "\n*** CSV READER ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define CSV_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        CSV_ERROR(msg); \
+    } \
+} while(0)
+
+#define CSV_BUFFER_SIZE (64 * 1024)
+#define CSV_INITIAL_LINE 4096
+
+// Mapped files are split into about this many bytes per parallel chunk
+#define CSV_CHUNK_BYTES (1 << 20)
+
+// Initial rows of the matrix csv_read_rows fills; it grows by half as needed
+#define CSV_GATHER_ROWS 1024
+
+static long file_read(void* ctx, char* buffer, size_t size) {
+    FILE* file = (FILE*)ctx;
+    size_t n = fread(buffer, 1, size, file);
+    if (n == 0 && ferror(file)) return -1;
+    return (long)n;
+}
+
+static int fill_buffer(CsvReader* reader) {
+    if (reader->eof) return 0;
+
+    long n = reader->read(reader->ctx, reader->buffer, reader->buffer_size);
+    CSV_CHECK(n >= 0, "Failed to read CSV input");
+
+    if (n == 0) {
+        reader->eof = 1;
+        return 0;
+    }
+
+    reader->buffer_pos = 0;
+    reader->buffer_end = (size_t)n;
+    return 1;
+}
+
+static void append_line(CsvReader* reader, size_t* len, const char* src, size_t n) {
+    if (*len + n + 1 > reader->line_capacity) {
+        size_t capacity = reader->line_capacity;
+        while (*len + n + 1 > capacity) capacity *= 2;
+
+        char* line = (char*)realloc(reader->line, capacity);
+        CSV_CHECK(line != NULL, "Memory allocation failed for CSV line");
+        reader->line = line;
+        reader->line_capacity = capacity;
+    }
+
+    memcpy(reader->line + *len, src, n);
+    *len += n;
+}
+
+// Read the next line (newlines inside quotes included) into reader->line.
+// Returns its length without the line ending, or -1 at end of input.
+static long next_line(CsvReader* reader) {
+    size_t len = 0;
+    int in_quotes = 0;
+    int consumed = 0;
+    int found = 0;
+
+    while (!found) {
+        if (reader->buffer_pos == reader->buffer_end && !fill_buffer(reader)) break;
+
+        const char* start = reader->buffer + reader->buffer_pos;
+        const char* end = reader->buffer + reader->buffer_end;
+        const char* p = start;
+
+        while (p < end) {
+            if (*p == '"') {
+                in_quotes = !in_quotes;
+            } else if (*p == '\n' && !in_quotes) {
+                found = 1;
+                break;
+            }
+            p++;
+        }
+
+        append_line(reader, &len, start, (size_t)(p - start));
+        reader->buffer_pos += (size_t)(p - start) + found;
+        consumed = 1;
+    }
+
+    if (!consumed) return -1;
+
+    if (len > 0 && reader->line[len - 1] == '\r') len--;
+    reader->line[len] = '\0';
+    return (long)len;
+}
+
+static int is_blank(const char* s) {
+    while (*s) {
+        if (!isspace((unsigned char)*s)) return 0;
+        s++;
+    }
+    return 1;
+}
+
+static int count_fields(const char* line) {
+    int count = 1;
+    int in_quotes = 0;
+
+    for (const char* p = line; *p; p++) {
+        if (*p == '"') {
+            in_quotes = !in_quotes;
+        } else if (*p == ',' && !in_quotes) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Clinger's fast path: a decimal with at most 19 significant digits whose
+// mantissa fits in 53 bits and whose power of ten is exact takes a single
+// correctly rounded multiply or divide. Returns 0 if the field [p, end) is
+// not such a number, leaving it to strtod.
+static int parse_fast_double(const char* p, const char* end, double* value) {
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int significant = 0;
+    int exponent = 0;
+
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        if (mantissa || *p != '0') significant++;
+        mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+        digits++;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            if (mantissa || *p != '0') significant++;
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits++;
+            exponent--;
+            p++;
+        }
+    }
+
+    if (digits == 0 || significant > 19) return 0;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        int exp_negative = 0;
+        if (p < end && (*p == '-' || *p == '+')) {
+            exp_negative = (*p == '-');
+            p++;
+        }
+        if (p == end || (unsigned)(*p - '0') >= 10) return 0;
+
+        int exp_value = 0;
+        while (p < end && (unsigned)(*p - '0') < 10) {
+            if (exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+            p++;
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (p != end || mantissa > (1ULL << 53)) return 0;
+    if (exponent < -22 || exponent > 22) return 0;
+
+    double result = (double)mantissa;
+    if (exponent < 0) {
+        result /= exact_powers_of_ten[-exponent];
+    } else {
+        result *= exact_powers_of_ten[exponent];
+    }
+
+    *value = negative ? -result : result;
+    return 1;
+}
+
+// Convert the field [start, end): surrounding whitespace and quotes are
+// dropped, empty fields and NA markers become NaN, and anything else goes
+// through strtod, which reads the leading number and gives NaN if none
+static double parse_value(const char* start, const char* end) {
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+
+    if (end - start >= 2 && *start == '"' && end[-1] == '"') {
+        start++;
+        end--;
+        while (start < end && isspace((unsigned char)*start)) start++;
+        while (end > start && isspace((unsigned char)end[-1])) end--;
+    }
+
+    if (start == end) return NAN;
+
+    double value;
+    if (parse_fast_double(start, end, &value)) return value;
+
+    // Slow path on a NUL-terminated copy
+    char local[64];
+    size_t len = (size_t)(end - start);
+    char* field = len < sizeof(local) ? local : (char*)malloc(len + 1);
+    CSV_CHECK(field != NULL, "Memory allocation failed for CSV field");
+    memcpy(field, start, len);
+    field[len] = '\0';
+
+    if (strcasecmp(field, "NA") == 0 ||
+        strcasecmp(field, "NULL") == 0 ||
+        strcasecmp(field, "N/A") == 0 ||
+        strcasecmp(field, "?") == 0) {
+        value = NAN;
+    } else {
+        char* endptr;
+        value = strtod(field, &endptr);
+        if (endptr == field) value = NAN;
+    }
+
+    if (field != local) free(field);
+    return value;
+}
+
+// End of the field starting at p; commas inside quotes only need the slow
+// scan when the text has quotes at all
+static const char* field_end(const char* p, const char* end, int quotes) {
+    if (!quotes) {
+        const char* comma = (const char*)memchr(p, ',', (size_t)(end - p));
+        return comma ? comma : end;
+    }
+
+    int in_quotes = 0;
+    while (p < end && (in_quotes || *p != ',')) {
+        if (*p == '"') in_quotes = !in_quotes;
+        p++;
+    }
+    return p;
+}
+
+// Split the line [p, end) into num_cols values: short rows are padded with
+// NaN and extra fields ignored
+static void parse_row(const char* p, const char* end, int num_cols, int quotes, Real* out) {
+    int col = 0;
+
+    while (col < num_cols) {
+        const char* stop = field_end(p, end, quotes);
+        out[col++] = parse_value(p, stop);
+
+        if (stop == end) break;
+        p = stop + 1;
+    }
+
+    while (col < num_cols) {
+        out[col++] = NAN;
+    }
+}
+
+static void parse_line(CsvReader* reader, Real* out) {
+    size_t len = strlen(reader->line);
+    int quotes = memchr(reader->line, '"', len) != NULL;
+    parse_row(reader->line, reader->line + len, reader->num_cols, quotes, out);
+}
+
+// Parse the next non-blank data row into out; 0 at end of input
+static int read_row(CsvReader* reader, Real* out) {
+    for (;;) {
+        if (reader->pending_first_row) {
+            reader->pending_first_row = 0;
+        } else if (next_line(reader) < 0) {
+            return 0;
+        }
+
+        if (is_blank(reader->line)) continue;
+
+        parse_line(reader, out);
+        reader->rows_read++;
+        return 1;
+    }
+}
+
+CsvReader* csv_open_reader(CsvReadFunc read, void* ctx, int has_header) {
+    CSV_CHECK(read != NULL, "Read callback cannot be NULL");
+
+    CsvReader* reader = (CsvReader*)malloc(sizeof(CsvReader));
+    CSV_CHECK(reader != NULL, "Memory allocation failed for CSV reader");
+
+    reader->read = read;
+    reader->ctx = ctx;
+    reader->file = NULL;
+
+    reader->buffer_size = CSV_BUFFER_SIZE;
+    reader->buffer = (char*)malloc(reader->buffer_size);
+    reader->buffer_pos = 0;
+    reader->buffer_end = 0;
+    reader->eof = 0;
+
+    reader->line_capacity = CSV_INITIAL_LINE;
+    reader->line = (char*)malloc(reader->line_capacity);
+    CSV_CHECK(reader->buffer != NULL && reader->line != NULL,
+              "Memory allocation failed for CSV buffers");
+
+    // The first non-blank line fixes the number of columns
+    long len;
+    do {
+        len = next_line(reader);
+        CSV_CHECK(len >= 0, "CSV input appears to be empty or invalid");
+    } while (is_blank(reader->line));
+
+    reader->num_cols = count_fields(reader->line);
+    reader->rows_read = 0;
+    reader->pending_first_row = !has_header;
+
+    reader->row = (Real*)malloc(reader->num_cols * sizeof(Real));
+    CSV_CHECK(reader->row != NULL, "Memory allocation failed for CSV row");
+
+    return reader;
+}
+
+CsvReader* csv_open(const char* filename, int has_header) {
+    CSV_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    FILE* file = fopen(filename, "rb");
+    CSV_CHECK(file != NULL, "Cannot open CSV file");
+
+    CsvReader* reader = csv_open_reader(file_read, file, has_header);
+    reader->file = file;
+    return reader;
+}
+
+void csv_close(CsvReader* reader) {
+    if (!reader) return;
+
+    if (reader->file) fclose((FILE*)reader->file);
+    free(reader->buffer);
+    free(reader->line);
+    free(reader->row);
+    free(reader);
+}
+
+int csv_num_columns(const CsvReader* reader) {
+    CSV_CHECK(reader != NULL, "CSV reader cannot be NULL");
+    return reader->num_cols;
+}
+
+int csv_read_chunk(CsvReader* reader, Matrix* chunk) {
+    CSV_CHECK(reader != NULL, "CSV reader cannot be NULL");
+    CSV_CHECK(chunk != NULL, "Chunk matrix cannot be NULL");
+    CSV_CHECK(chunk->cols == reader->num_cols, "Chunk columns must match the CSV columns");
+
+    int rows = 0;
+    while (rows < chunk->rows && read_row(reader, chunk->data[rows])) {
+        rows++;
+    }
+
+    return rows;
+}
+
+int csv_read_batch(CsvReader* reader, Matrix* X, Matrix* y, int label_column) {
+    CSV_CHECK(reader != NULL, "CSV reader cannot be NULL");
+    CSV_CHECK(X != NULL && y != NULL, "Batch matrices cannot be NULL");
+    CSV_CHECK(label_column >= 0 && label_column < reader->num_cols, "Label column out of bounds");
+    CSV_CHECK(X->cols == reader->num_cols - 1, "X must have one column per feature");
+    CSV_CHECK(X->rows == y->rows, "X and y must have same number of rows");
+
+    int num_classes = y->cols;
+    int rows = 0;
+
+    while (rows < X->rows && read_row(reader, reader->row)) {
+        Real* features = X->data[rows];
+        Real* target = y->data[rows];
+
+        for (int j = 0, k = 0; j < reader->num_cols; j++) {
+            if (j != label_column) features[k++] = reader->row[j];
+        }
+
+        double label = reader->row[label_column];
+        if (num_classes == 1) {
+            target[0] = label;
+        } else {
+            int index = isnan(label) ? -1 : (int)label;
+            if (index < 0 || index >= num_classes) {
+                // Same fallback as one_hot_encode_labels
+                printf("WARNING: Label %g out of range [0, %d] at row %ld\n",
+                       label, num_classes - 1, reader->rows_read);
+                for (int j = 0; j < num_classes; j++) {
+                    target[j] = 1.0 / num_classes;
+                }
+            } else {
+                for (int j = 0; j < num_classes; j++) {
+                    target[j] = (j == index) ? 1.0 : 0.0;
+                }
+            }
+        }
+
+        rows++;
+    }
+
+    return rows;
+}
+
+// Whole-file loading: the mapping is cut at line starts into chunks that
+// first count their rows, then parse them straight into their slice of the
+// result, both passes in parallel
+typedef struct {
+    const char** bounds;    // chunk i is [bounds[i], bounds[i + 1])
+    long* rows;             // rows per chunk, then the first row of each
+    Matrix* matrix;
+    int num_cols;
+    int quotes;
+} CsvLoadJob;
+
+static const char* line_end(const char* p, const char* end, int quotes) {
+    if (!quotes) {
+        const char* newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+        return newline ? newline : end;
+    }
+
+    int in_quotes = 0;
+    while (p < end && (in_quotes || *p != '\n')) {
+        if (*p == '"') in_quotes = !in_quotes;
+        p++;
+    }
+    return p;
+}
+
+static int is_blank_range(const char* p, const char* end) {
+    while (p < end) {
+        if (!isspace((unsigned char)*p)) return 0;
+        p++;
+    }
+    return 1;
+}
+
+static void count_rows_task(void* ctx, int begin, int end) {
+    CsvLoadJob* job = (CsvLoadJob*)ctx;
+
+    for (int chunk = begin; chunk < end; chunk++) {
+        const char* p = job->bounds[chunk];
+        const char* stop = job->bounds[chunk + 1];
+        long rows = 0;
+
+        while (p < stop) {
+            const char* eol = line_end(p, stop, job->quotes);
+            if (!is_blank_range(p, eol)) rows++;
+            p = eol + 1;
+        }
+
+        job->rows[chunk] = rows;
+    }
+}
+
+static void parse_rows_task(void* ctx, int begin, int end) {
+    CsvLoadJob* job = (CsvLoadJob*)ctx;
+
+    for (int chunk = begin; chunk < end; chunk++) {
+        const char* p = job->bounds[chunk];
+        const char* stop = job->bounds[chunk + 1];
+        long row = job->rows[chunk];
+
+        while (p < stop) {
+            const char* eol = line_end(p, stop, job->quotes);
+            if (!is_blank_range(p, eol)) {
+                const char* content_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+                parse_row(p, content_end, job->num_cols, job->quotes, job->matrix->data[row]);
+                row++;
+            }
+            p = eol + 1;
+        }
+    }
+}
+
+Matrix* csv_load_file(const char* filename, int has_header) {
+    CSV_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    int fd = open(filename, O_RDONLY);
+    CSV_CHECK(fd >= 0, "Cannot open CSV file");
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char* map = (char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    const char* data = map;
+    const char* end = map + size;
+
+    // Quoted fields may hide newlines, so such files are parsed as one chunk
+    int quotes = memchr(data, '"', size) != NULL;
+
+    // The first non-blank line fixes the number of columns
+    const char* first = data;
+    const char* first_end = line_end(first, end, quotes);
+    while (is_blank_range(first, first_end)) {
+        CSV_CHECK(first_end < end, "CSV file appears to be empty or invalid");
+        first = first_end + 1;
+        first_end = line_end(first, end, quotes);
+    }
+
+    int num_cols = 1;
+    for (const char* p = field_end(first, first_end, quotes); p < first_end;
+         p = field_end(p + 1, first_end, quotes)) {
+        num_cols++;
+    }
+
+    const char* body = has_header ? (first_end < end ? first_end + 1 : end) : first;
+    size_t body_size = (size_t)(end - body);
+
+    int num_chunks = 1;
+    if (!quotes && deepc_get_num_threads() > 1) {
+        size_t chunks = body_size / CSV_CHUNK_BYTES + 1;
+        num_chunks = chunks > 4096 ? 4096 : (int)chunks;
+    }
+
+    const char** bounds = (const char**)malloc((num_chunks + 1) * sizeof(const char*));
+    long* rows = (long*)malloc(num_chunks * sizeof(long));
+    CSV_CHECK(bounds != NULL && rows != NULL, "Memory allocation failed for CSV chunks");
+
+    // Cut at the line start following each even split point
+    bounds[0] = body;
+    for (int i = 1; i < num_chunks; i++) {
+        const char* p = body + body_size / num_chunks * i;
+        if (p < bounds[i - 1]) p = bounds[i - 1];
+        const char* eol = line_end(p, end, 0);
+        bounds[i] = eol < end ? eol + 1 : end;
+    }
+    bounds[num_chunks] = end;
+
+    CsvLoadJob job = { bounds, rows, NULL, num_cols, quotes };
+    parallel_for(num_chunks, 1, count_rows_task, &job);
+
+    long total_rows = 0;
+    for (int i = 0; i < num_chunks; i++) {
+        long count = rows[i];
+        rows[i] = total_rows;
+        total_rows += count;
+    }
+
+    CSV_CHECK(total_rows > 0, "No data rows found");
+    CSV_CHECK(total_rows <= INT_MAX, "CSV file has too many rows");
+
+    job.matrix = create_matrix((int)total_rows, num_cols);
+    parallel_for(num_chunks, 1, parse_rows_task, &job);
+
+    free(bounds);
+    free(rows);
+    munmap(map, size);
+    return job.matrix;
+}
+
+Matrix* csv_read_rows(CsvReader* reader, int shard, int num_shards) {
+    CSV_CHECK(reader != NULL, "CSV reader cannot be NULL");
+    CSV_CHECK(num_shards > 0 && shard >= 0 && shard < num_shards, "Shard is out of range");
+
+    // Rows are parsed straight into the result; a row of another shard is
+    // overwritten by the next one
+    int capacity = CSV_GATHER_ROWS;
+    Matrix* m = create_matrix(capacity, reader->num_cols);
+    int rows = 0;
+    for (long row_index = 0;; row_index++) {
+        if (rows == capacity) {
+            CSV_CHECK(capacity < INT_MAX, "CSV file has too many rows");
+            capacity = capacity > INT_MAX / 3 * 2 ? INT_MAX : capacity + capacity / 2;
+            resize_matrix_rows(m, capacity);
+        }
+        if (!read_row(reader, m->data[rows])) break;
+        if (row_index % num_shards == shard) rows++;
+    }
+
+    if (rows == 0) {
+        free_matrix(m);
+        return NULL;
+    }
+    resize_matrix_rows(m, rows);
+    return m;
+}
+
+// Every rank of a distributed run parses the whole file but keeps only its
+// own rows
+Matrix* csv_load_shard(const char* filename, int has_header, int shard, int num_shards) {
+    CsvReader* reader = csv_open(filename, has_header);
+    Matrix* m = csv_read_rows(reader, shard, num_shards);
+    csv_close(reader);
+    return m;
+}
@@ -0,0 +1,232 @@
+#include "deepc/data_loader.h"
+#include "deepc/column_stats.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+// Error handling
+#define DATA_LOADER_ERROR(msg) do { \
+    fprintf(stderr, "\n*** DATA LOADER ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define DATA_LOADER_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        DATA_LOADER_ERROR(msg); \
+    } \
+} while(0)
+
+// Same statistics as standardize_matrix: NaNs are ignored (and kept), and
+// columns without spread are left as they are
+static void compute_standardization(DataLoader* loader) {
+    ColumnStats* stats = compute_column_stats(loader->X);
+
+    for (int j = 0; j < stats->cols; j++) {
+        double std_dev = column_std(stats, j);
+        loader->mean[j] = 0.0;
+        loader->scale[j] = 1.0;
+        if (stats->count[j] > 0 && std_dev > 1e-10) {
+            loader->mean[j] = stats->mean[j];
+            loader->scale[j] = 1.0 / std_dev;
+        }
+    }
+
+    free_column_stats(stats);
+}
+
+// Gather the rows of batch number batch of the epoch into a slot
+static void fill_slot(DataLoader* loader, DataLoaderSlot* slot, int batch) {
+    const Matrix* X = loader->X;
+    const Matrix* y = loader->y;
+
+    int start = batch * loader->batch_size;
+    int rows = X->rows - start < loader->batch_size ? X->rows - start : loader->batch_size;
+
+    for (int i = 0; i < rows; i++) {
+        int sample = loader->indices[start + i];
+        Real* dst = slot->X->data[i];
+        const Real* src = X->data[sample];
+
+        if (loader->mean) {
+            for (int j = 0; j < X->cols; j++) {
+                dst[j] = (src[j] - loader->mean[j]) * loader->scale[j];
+            }
+        } else {
+            memcpy(dst, src, X->cols * sizeof(Real));
+        }
+        memcpy(slot->y->data[i], y->data[sample], y->cols * sizeof(Real));
+    }
+
+    slot->rows = rows;
+    slot->X_view.rows = rows;
+    slot->y_view.rows = rows;
+}
+
+// Producer: fill slots in turn, across epoch boundaries, as they come free
+static void* producer_main(void* arg) {
+    DataLoader* loader = (DataLoader*)arg;
+
+    for (;;) {
+        pthread_mutex_lock(&loader->lock);
+        DataLoaderSlot* slot = &loader->slots[loader->produced % 2];
+        while (!loader->stop && (slot->ready || loader->held == (int)(loader->produced % 2))) {
+            pthread_cond_wait(&loader->slot_free, &loader->lock);
+        }
+        if (loader->stop) {
+            pthread_mutex_unlock(&loader->lock);
+            return NULL;
+        }
+        long batch = loader->produced;
+        pthread_mutex_unlock(&loader->lock);
+
+        int batch_in_epoch = (int)(batch % loader->num_batches);
+        if (batch_in_epoch == 0 && loader->shuffle) {
+            // The previous epoch is fully gathered, so its order can go
+            rng_shuffle(&loader->rng, loader->indices, loader->X->rows);
+        }
+
+        fill_slot(loader, slot, batch_in_epoch);
+
+        pthread_mutex_lock(&loader->lock);
+        slot->ready = 1;
+        loader->produced++;
+        pthread_cond_signal(&loader->slot_ready);
+        pthread_mutex_unlock(&loader->lock);
+    }
+}
+
+// Create a loader and start prefetching the first batch
+DataLoader* create_data_loader(const Matrix* X, const Matrix* y, int batch_size,
+                               int shuffle, int standardize, uint64_t seed) {
+    DATA_LOADER_CHECK(X != NULL && y != NULL, "X and y cannot be NULL");
+    DATA_LOADER_CHECK(X->rows == y->rows, "X and y must have same number of samples");
+    DATA_LOADER_CHECK(X->rows > 0, "Dataset cannot be empty");
+
+    if (batch_size <= 0 || batch_size > X->rows) {
+        batch_size = X->rows;
+    }
+
+    DataLoader* loader = (DataLoader*)malloc(sizeof(DataLoader));
+    DATA_LOADER_CHECK(loader != NULL, "Memory allocation failed for data loader");
+
+    loader->X = X;
+    loader->y = y;
+    loader->batch_size = batch_size;
+    loader->num_batches = (X->rows + batch_size - 1) / batch_size;
+    loader->shuffle = shuffle;
+    rng_seed(&loader->rng, seed);
+
+    loader->mean = NULL;
+    loader->scale = NULL;
+    if (standardize) {
+        loader->mean = (double*)malloc(X->cols * sizeof(double));
+        loader->scale = (double*)malloc(X->cols * sizeof(double));
+        DATA_LOADER_CHECK(loader->mean != NULL && loader->scale != NULL,
+                          "Memory allocation failed for standardization");
+        compute_standardization(loader);
+    }
+
+    loader->indices = (int*)malloc(X->rows * sizeof(int));
+    DATA_LOADER_CHECK(loader->indices != NULL, "Memory allocation failed for indices");
+    for (int i = 0; i < X->rows; i++) {
+        loader->indices[i] = i;
+    }
+
+    for (int s = 0; s < 2; s++) {
+        DataLoaderSlot* slot = &loader->slots[s];
+        slot->X = create_matrix(batch_size, X->cols);
+        slot->y = create_matrix(batch_size, y->cols);
+        slot->X_view = *slot->X;
+        slot->X_view.storage = MATRIX_VIEW;
+        slot->y_view = *slot->y;
+        slot->y_view.storage = MATRIX_VIEW;
+        slot->rows = 0;
+        slot->ready = 0;
+    }
+
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->slot_ready, NULL);
+    pthread_cond_init(&loader->slot_free, NULL);
+    loader->produced = 0;
+    loader->consumed = 0;
+    loader->held = -1;
+    loader->stop = 0;
+    loader->epoch_position = 0;
+
+    DATA_LOADER_CHECK(pthread_create(&loader->thread, NULL, producer_main, loader) == 0,
+                      "Failed to start data loader thread");
+
+    return loader;
+}
+
+// Stop the producer and free the loader
+void free_data_loader(DataLoader* loader) {
+    if (!loader) return;
+
+    pthread_mutex_lock(&loader->lock);
+    loader->stop = 1;
+    pthread_cond_broadcast(&loader->slot_free);
+    pthread_mutex_unlock(&loader->lock);
+    pthread_join(loader->thread, NULL);
+
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->slot_ready);
+    pthread_cond_destroy(&loader->slot_free);
+
+    for (int s = 0; s < 2; s++) {
+        free_matrix(loader->slots[s].X);
+        free_matrix(loader->slots[s].y);
+    }
+    free(loader->indices);
+    free(loader->mean);
+    free(loader->scale);
+    free(loader);
+}
+
+int data_loader_next(DataLoader* loader, Matrix** X_batch, Matrix** y_batch) {
+    DATA_LOADER_CHECK(loader != NULL, "Data loader cannot be NULL");
+    DATA_LOADER_CHECK(X_batch != NULL && y_batch != NULL, "Batch outputs cannot be NULL");
+
+    pthread_mutex_lock(&loader->lock);
+
+    // The batch handed out last time is done with
+    if (loader->held >= 0) {
+        loader->held = -1;
+        pthread_cond_signal(&loader->slot_free);
+    }
+
+    if (loader->epoch_position == loader->num_batches) {
+        loader->epoch_position = 0;
+        pthread_mutex_unlock(&loader->lock);
+        *X_batch = NULL;
+        *y_batch = NULL;
+        return 0;
+    }
+
+    int index = (int)(loader->consumed % 2);
+    DataLoaderSlot* slot = &loader->slots[index];
+    while (!slot->ready) {
+        pthread_cond_wait(&loader->slot_ready, &loader->lock);
+    }
+
+    slot->ready = 0;
+    loader->held = index;
+    loader->consumed++;
+    loader->epoch_position++;
+
+    pthread_mutex_unlock(&loader->lock);
+
+    *X_batch = &slot->X_view;
+    *y_batch = &slot->y_view;
+    return slot->rows;
+}
+
+int data_loader_num_batches(const DataLoader* loader) {
+    DATA_LOADER_CHECK(loader != NULL, "Data loader cannot be NULL");
+    return loader->num_batches;
+}
@@ -1,4 +1,5 @@
 #include "deepc/data_processing.h"
+#include <time.h>
 
 // Error handling macros
 #define CSV_ERROR(msg) do { \
@@ -61,83 +62,16 @@ char* trim_whitespace(char *str) {
 Matrix* load_csv(const char *filename, int has_header) {
     CSV_CHECK(filename != NULL, "Filename cannot be NULL");
     
-    FILE *file = fopen(filename, "r");
-    CSV_CHECK(file != NULL, "Cannot open CSV file");
+    // Regular files are mapped and parsed in parallel
+    Matrix *mapped = csv_load_file(filename, has_header);
+    if (mapped) return mapped;
     
-    // Count lines and determine dimensions
-    char line[4096];
-    int line_count = 0;
-    int num_cols = 0;
-    int num_rows = 0;
+    // Otherwise stream the rows into one growing matrix
+    CsvReader *reader = csv_open(filename, has_header);
+    Matrix *matrix = csv_read_rows(reader, 0, 1);
+    csv_close(reader);
     
-    // First pass: count rows and columns
-    while (fgets(line, sizeof(line), file)) {
-        if (line_count == 0) {
-            num_cols = count_columns(line);
-        }
-        line_count++;
-    }
-    
-    CSV_CHECK(num_cols > 0, "CSV file appears to be empty or invalid");
-    
-    // Calculate dataset dimensions
-    num_rows = has_header ? line_count - 1 : line_count;
-    CSV_CHECK(num_rows > 0, "No data rows found");
-    
-    // Rewind file for second pass
-    rewind(file);
-    
-    // Create matrix
-    Matrix *matrix = create_matrix(num_rows, num_cols);
-    
-    // Skip header if present
-    if (has_header) {
-        CSV_CHECK(fgets(line, sizeof(line), file) != NULL, "Cannot read header line");
-    }
-    
-    // Read data rows
-    int row = 0;
-    while (fgets(line, sizeof(line), file)) {
-        if (strlen(trim_whitespace(line)) == 0) continue; // Skip empty lines
-        
-        char *token = strtok(line, ",\n");
-        int col = 0;
-        
-        while (token != NULL && col < num_cols) {
-            char *clean_token = trim_whitespace(token);
-            double value;
-            
-            // Handle missing values (empty strings or "NA", "NULL", etc.)
-            if (strlen(clean_token) == 0 || 
-                strcasecmp(clean_token, "NA") == 0 ||
-                strcasecmp(clean_token, "NULL") == 0 ||
-                strcasecmp(clean_token, "N/A") == 0 ||
-                strcasecmp(clean_token, "?") == 0) {
-                value = NAN; // Use NaN to represent missing values
-            } else {
-                char *endptr;
-                value = strtod(clean_token, &endptr);
-                if (endptr == clean_token) {
-                    // Conversion failed, treat as missing
-                    value = NAN;
-                }
-            }
-            
-            matrix->data[row][col] = value;
-            token = strtok(NULL, ",\n");
-            col++;
-        }
-        
-        // Fill remaining columns with NaN if line had fewer columns
-        while (col < num_cols) {
-            matrix->data[row][col] = NAN;
-            col++;
-        }
-        
-        row++;
-    }
-    
-    fclose(file);
+    CSV_CHECK(matrix != NULL, "No data rows found");
     return matrix;
 }
 
@@ -156,39 +90,13 @@ int count_missing_values(const Matrix *m) {
     return count;
 }
 
-// Fill missing values with column mean
+// Fill missing values with column mean (0 for a column of NaNs)
 void fill_missing_with_mean(Matrix *m) {
     CSV_CHECK(m != NULL, "Matrix cannot be NULL");
     
-    for (int j = 0; j < m->cols; j++) {
-        // Calculate mean for column j (ignoring NaN)
-        double sum = 0.0;
-        int count = 0;
-        
-        for (int i = 0; i < m->rows; i++) {
-            if (!isnan(m->data[i][j])) {
-                sum += m->data[i][j];
-                count++;
-            }
-        }
-        
-        if (count > 0) {
-            double mean = sum / count;
-            // Fill missing values with mean
-            for (int i = 0; i < m->rows; i++) {
-                if (isnan(m->data[i][j])) {
-                    m->data[i][j] = mean;
-                }
-            }
-        } else {
-            // If all values are missing, fill with 0
-            for (int i = 0; i < m->rows; i++) {
-                if (isnan(m->data[i][j])) {
-                    m->data[i][j] = 0.0;
-                }
-            }
-        }
-    }
+    ColumnStats* stats = compute_column_stats(m);
+    fill_missing_with_stats(m, stats);
+    free_column_stats(stats);
 }
 
 // fills the missing values with zero
@@ -208,34 +116,26 @@ void fill_missing_with_zeros(Matrix *m) {
 void print_matrix_stats(const Matrix *m) {
     CSV_CHECK(m != NULL, "Matrix cannot be NULL");
     
+    ColumnStats* stats = compute_column_stats(m);
+    long long missing = 0;
+    for (int j = 0; j < m->cols; j++) {
+        missing += column_missing(stats, j);
+    }
+    
     printf("=== MATRIX STATISTICS ===\n");
     printf("Dimensions: %d x %d\n", m->rows, m->cols);
-    printf("Missing values: %d\n", count_missing_values(m));
+    printf("Missing values: %lld\n", missing);
     
     for (int j = 0; j < m->cols; j++) {
-        double sum = 0.0;
-        double min_val = INFINITY;
-        double max_val = -INFINITY;
-        int count = 0;
-        
-        for (int i = 0; i < m->rows; i++) {
-            if (!isnan(m->data[i][j])) {
-                sum += m->data[i][j];
-                if (m->data[i][j] < min_val) min_val = m->data[i][j];
-                if (m->data[i][j] > max_val) max_val = m->data[i][j];
-                count++;
-            }
-        }
-        
-        if (count > 0) {
-            double mean = sum / count;
-            printf("Col %d: mean=%.4f, min=%.4f, max=%.4f, valid=%d\n",
-                   j, mean, min_val, max_val, count);
+        if (stats->count[j] > 0) {
+            printf("Col %d: mean=%.4f, min=%.4f, max=%.4f, valid=%lld\n",
+                   j, stats->mean[j], stats->min[j], stats->max[j], stats->count[j]);
         } else {
             printf("Col %d: All values missing\n", j);
         }
     }
     printf("========================\n\n");
+    free_column_stats(stats);
 }
 
 // Train-test split function
@@ -388,111 +288,68 @@ Matrix* one_hot_decode_labels(const Matrix *one_hot) {
     return labels;
 }
 
-// Normalize matrix to [0, 1] range
+// Normalize matrix to [0, 1] range: (x - min) / (max - min)
 Matrix* normalize_matrix(Matrix *X) {
     CSV_CHECK(X != NULL, "Matrix cannot be NULL");
     
     Matrix* normalized = copy_matrix(X);
-    
-    for (int j = 0; j < normalized->cols; j++) {
-        // Find min and max for column j
-        double min_val = INFINITY;
-        double max_val = -INFINITY;
-        int valid_count = 0;
-        
-        for (int i = 0; i < normalized->rows; i++) {
-            if (!isnan(normalized->data[i][j])) {
-                if (normalized->data[i][j] < min_val) min_val = normalized->data[i][j];
-                if (normalized->data[i][j] > max_val) max_val = normalized->data[i][j];
-                valid_count++;
-            }
-        }
-        
-        if (valid_count > 0 && max_val > min_val) {
-            // Normalize: (x - min) / (max - min)
-            for (int i = 0; i < normalized->rows; i++) {
-                if (!isnan(normalized->data[i][j])) {
-                    normalized->data[i][j] = (normalized->data[i][j] - min_val) / (max_val - min_val);
-                }
-            }
-        }
-    }
+    ColumnStats* stats = compute_column_stats(X);
+    normalize_with_stats(normalized, stats);
+    free_column_stats(stats);
     
     return normalized;
 }
 
-// Standardize matrix to mean=0, std=1
+// Standardize matrix to mean=0, std=1: (x - mean) / std_dev
 Matrix* standardize_matrix(Matrix *X) {
     CSV_CHECK(X != NULL, "Matrix cannot be NULL");
     
     Matrix* standardized = copy_matrix(X);
-    
-    for (int j = 0; j < standardized->cols; j++) {
-        // Calculate mean for column j
-        double sum = 0.0;
-        int valid_count = 0;
-        
-        for (int i = 0; i < standardized->rows; i++) {
-            if (!isnan(standardized->data[i][j])) {
-                sum += standardized->data[i][j];
-                valid_count++;
-            }
-        }
-        
-        if (valid_count > 0) {
-            double mean = sum / valid_count;
-            
-            // Calculate standard deviation
-            double variance = 0.0;
-            for (int i = 0; i < standardized->rows; i++) {
-                if (!isnan(standardized->data[i][j])) {
-                    double diff = standardized->data[i][j] - mean;
-                    variance += diff * diff;
-                }
-            }
-            double std_dev = sqrt(variance / valid_count);
-            
-            if (std_dev > 1e-10) {  // Avoid division by zero
-                // Standardize: (x - mean) / std_dev
-                for (int i = 0; i < standardized->rows; i++) {
-                    if (!isnan(standardized->data[i][j])) {
-                        standardized->data[i][j] = (standardized->data[i][j] - mean) / std_dev;
-                    }
-                }
-            }
-        }
-    }
+    ColumnStats* stats = compute_column_stats(X);
+    standardize_with_stats(standardized, stats);
+    free_column_stats(stats);
     
     return standardized;
 }
 
-// Shuffle dataset (X and y together)
+// Shuffle dataset (X and y together); a fresh order on every call
 void shuffle_dataset(Matrix *X, Matrix *y) {
+    static uint64_t calls = 0;
+    uint64_t seed = (uint64_t)time(NULL) ^ (__atomic_fetch_add(&calls, 1, __ATOMIC_RELAXED) << 32);
+    shuffle_dataset_seeded(X, y, seed);
+}
+
+// Shuffle dataset rows reproducibly, whole rows of both X and y
+void shuffle_dataset_seeded(Matrix *X, Matrix *y, uint64_t seed) {
     CSV_CHECK(X != NULL, "X matrix cannot be NULL");
     CSV_CHECK(y != NULL, "y matrix cannot be NULL");
     CSV_CHECK(X->rows == y->rows, "X and y must have same number of samples");
     
     int num_samples = X->rows;
+    size_t X_bytes = X->cols * sizeof(Real);
+    size_t y_bytes = y->cols * sizeof(Real);
     
-    // Create temporary storage for one sample
-    double* temp_X = (double*)malloc(X->cols * sizeof(double));
-    double temp_y = 0.0;
+    // Temporary storage for one sample
+    Real* temp = (Real*)malloc(X_bytes > y_bytes ? X_bytes : y_bytes);
+    CSV_CHECK(temp != NULL, "Memory allocation failed for shuffle buffer");
     
     // Fisher-Yates shuffle
-    srand(time(NULL));
+    Rng rng;
+    rng_seed(&rng, seed);
     for (int i = num_samples - 1; i > 0; i--) {
-        int j = rand() % (i + 1);
+        int j = (int)rng_bounded(&rng, (uint64_t)i + 1);
+        if (j == i) continue;
         
         // Swap X samples
-        memcpy(temp_X, X->data[i], X->cols * sizeof(double));
-        memcpy(X->data[i], X->data[j], X->cols * sizeof(double));
-        memcpy(X->data[j], temp_X, X->cols * sizeof(double));
+        memcpy(temp, X->data[i], X_bytes);
+        memcpy(X->data[i], X->data[j], X_bytes);
+        memcpy(X->data[j], temp, X_bytes);
         
         // Swap y samples
-        temp_y = y->data[i][0];
-        y->data[i][0] = y->data[j][0];
-        y->data[j][0] = temp_y;
+        memcpy(temp, y->data[i], y_bytes);
+        memcpy(y->data[i], y->data[j], y_bytes);
+        memcpy(y->data[j], temp, y_bytes);
     }
     
-    free(temp_X);
+    free(temp);
 }
@@ -0,0 +1,490 @@
+#include "deepc/distributed.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Error handling
+#define COMM_ERROR(msg) do { \
+    fprintf(stderr, "\n*** COMMUNICATOR ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define COMM_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        COMM_ERROR(msg); \
+    } \
+} while(0)
+
+// create_communicator_from_env waits this long for the other ranks
+#define COMM_DEFAULT_TIMEOUT_MS 60000
+
+// Broadcasts are forwarded down the ring in pieces of this many bytes
+#define COMM_BROADCAST_PIECE (1 << 20)
+
+typedef enum {
+    COMM_JOB_TOTALS,
+    COMM_JOB_GRADIENT
+} CommJobType;
+
+struct CommJob {
+    CommJobType type;
+    Real* data;
+    size_t count;
+};
+
+// Element-wise dst += src over count elements of one type
+typedef void (*CommAddFunc)(void* dst, const void* src, size_t count);
+
+static void add_reals(void* dst, const void* src, size_t count) {
+    Real* d = (Real*)dst;
+    const Real* s = (const Real*)src;
+    for (size_t i = 0; i < count; i++) d[i] += s[i];
+}
+
+static void add_doubles(void* dst, const void* src, size_t count) {
+    double* d = (double*)dst;
+    const double* s = (const double*)src;
+    for (size_t i = 0; i < count; i++) d[i] += s[i];
+}
+
+// Socket setup
+
+// Split "host:port" at its last colon
+static void parse_address(const char* address, char* host, size_t host_size, char* port,
+                          size_t port_size) {
+    const char* colon = strrchr(address, ':');
+    COMM_CHECK(colon != NULL && colon != address && colon[1] != '\0',
+               "Addresses must look like host:port");
+    size_t length = (size_t)(colon - address);
+    COMM_CHECK(length < host_size && strlen(colon + 1) < port_size, "Address is too long");
+    memcpy(host, address, length);
+    host[length] = '\0';
+    strcpy(port, colon + 1);
+}
+
+static int listen_on(const char* address) {
+    char host[256], port[16];
+    parse_address(address, host, sizeof(host), port, sizeof(port));
+
+    // Every interface, on the port of this rank's address
+    struct addrinfo hints, *info;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    COMM_CHECK(getaddrinfo(NULL, port, &hints, &info) == 0, "Could not resolve the listening port");
+
+    int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    COMM_CHECK(fd >= 0, "Could not create a socket");
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    COMM_CHECK(bind(fd, info->ai_addr, info->ai_addrlen) == 0, "Could not bind the listening port");
+    COMM_CHECK(listen(fd, 4) == 0, "Could not listen for the previous rank");
+    freeaddrinfo(info);
+    return fd;
+}
+
+static long elapsed_ms(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+// Small messages go out at once instead of waiting to be coalesced
+static void set_no_delay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void send_all(int fd, const void* data, size_t bytes) {
+    const char* p = (const char*)data;
+    while (bytes > 0) {
+        ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        COMM_CHECK(n > 0, "Lost the connection to the next rank");
+        p += n;
+        bytes -= (size_t)n;
+    }
+}
+
+static void recv_all(int fd, void* data, size_t bytes) {
+    char* p = (char*)data;
+    while (bytes > 0) {
+        ssize_t n = recv(fd, p, bytes, 0);
+        if (n < 0 && errno == EINTR) continue;
+        COMM_CHECK(n > 0, "Lost the connection to the previous rank");
+        p += n;
+        bytes -= (size_t)n;
+    }
+}
+
+// Connect to address, retrying while the peer is not listening yet
+static int connect_to(const char* address, int timeout_ms) {
+    char host[256], port[16];
+    parse_address(address, host, sizeof(host), port, sizeof(port));
+
+    struct addrinfo hints, *info;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    COMM_CHECK(getaddrinfo(host, port, &hints, &info) == 0, "Could not resolve the next rank");
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int fd;
+    for (;;) {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        COMM_CHECK(fd >= 0, "Could not create a socket");
+        if (connect(fd, info->ai_addr, info->ai_addrlen) == 0) break;
+        close(fd);
+        COMM_CHECK(elapsed_ms(&start) < timeout_ms, "Timed out connecting to the next rank");
+        usleep(50000);
+    }
+    freeaddrinfo(info);
+    set_no_delay(fd);
+    return fd;
+}
+
+static int accept_from(int listen_fd, int expected_rank, int timeout_ms) {
+    struct pollfd p = { listen_fd, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll(&p, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    COMM_CHECK(ready > 0, "Timed out waiting for the previous rank");
+
+    int fd = accept(listen_fd, NULL, NULL);
+    COMM_CHECK(fd >= 0, "Could not accept the previous rank");
+    set_no_delay(fd);
+
+    int rank;
+    recv_all(fd, &rank, sizeof(rank));
+    COMM_CHECK(rank == expected_rank, "Connection from an unexpected rank");
+    return fd;
+}
+
+// Ring collectives
+
+// Send a chunk to the next rank while receiving one from the previous, so
+// the whole ring moves at once without either side blocking the other
+static void exchange(Communicator* comm, const void* send_data, size_t send_bytes,
+                     void* recv_data, size_t recv_bytes) {
+    const char* out = (const char*)send_data;
+    char* in = (char*)recv_data;
+
+    while (send_bytes > 0 || recv_bytes > 0) {
+        struct pollfd fds[2];
+        int n = 0, send_slot = -1, recv_slot = -1;
+        if (send_bytes > 0) {
+            send_slot = n;
+            fds[n].fd = comm->next_fd;
+            fds[n].events = POLLOUT;
+            fds[n++].revents = 0;
+        }
+        if (recv_bytes > 0) {
+            recv_slot = n;
+            fds[n].fd = comm->prev_fd;
+            fds[n].events = POLLIN;
+            fds[n++].revents = 0;
+        }
+        if (poll(fds, n, -1) < 0) {
+            COMM_CHECK(errno == EINTR, "Polling the ring sockets failed");
+            continue;
+        }
+
+        if (send_slot >= 0 && fds[send_slot].revents) {
+            ssize_t sent = send(comm->next_fd, out, send_bytes, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent > 0) {
+                out += sent;
+                send_bytes -= (size_t)sent;
+            } else {
+                COMM_CHECK(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR,
+                           "Lost the connection to the next rank");
+            }
+        }
+        if (recv_slot >= 0 && fds[recv_slot].revents) {
+            ssize_t received = recv(comm->prev_fd, in, recv_bytes, MSG_DONTWAIT);
+            if (received > 0) {
+                in += received;
+                recv_bytes -= (size_t)received;
+            } else {
+                COMM_CHECK(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK ||
+                           errno == EINTR), "Lost the connection to the previous rank");
+            }
+        }
+    }
+}
+
+static void* comm_scratch(Communicator* comm, size_t bytes) {
+    if (bytes > comm->scratch_bytes) {
+        void* scratch = realloc(comm->scratch, bytes);
+        COMM_CHECK(scratch != NULL, "Memory allocation failed for the ring buffer");
+        comm->scratch = scratch;
+        comm->scratch_bytes = bytes;
+    }
+    return comm->scratch;
+}
+
+// Ring all-reduce: the buffer is cut into world_size chunks; in n - 1
+// reduce-scatter steps every rank ends up with the full sum of one chunk,
+// and n - 1 all-gather steps pass the finished chunks around. Each sum is
+// formed on one rank only, so every rank gets the same bits.
+static void ring_allreduce(Communicator* comm, void* data, size_t count, size_t elem_size,
+                           CommAddFunc add) {
+    int n = comm->world_size;
+    if (n == 1 || count == 0) return;
+
+    char* bytes = (char*)data;
+    size_t max_chunk = (count + n - 1) / n;
+    void* incoming = comm_scratch(comm, max_chunk * elem_size);
+    #define CHUNK_BEGIN(k) ((size_t)(k) * count / n)
+    #define CHUNK_COUNT(k) (CHUNK_BEGIN((k) + 1) - CHUNK_BEGIN(k))
+
+    for (int step = 0; step < n - 1; step++) {
+        int send_chunk = ((comm->rank - step) % n + n) % n;
+        int recv_chunk = ((comm->rank - step - 1) % n + n) % n;
+        exchange(comm, bytes + CHUNK_BEGIN(send_chunk) * elem_size,
+                 CHUNK_COUNT(send_chunk) * elem_size, incoming,
+                 CHUNK_COUNT(recv_chunk) * elem_size);
+        add(bytes + CHUNK_BEGIN(recv_chunk) * elem_size, incoming, CHUNK_COUNT(recv_chunk));
+    }
+    for (int step = 0; step < n - 1; step++) {
+        int send_chunk = ((comm->rank - step + 1) % n + n) % n;
+        int recv_chunk = ((comm->rank - step) % n + n) % n;
+        exchange(comm, bytes + CHUNK_BEGIN(send_chunk) * elem_size,
+                 CHUNK_COUNT(send_chunk) * elem_size, bytes + CHUNK_BEGIN(recv_chunk) * elem_size,
+                 CHUNK_COUNT(recv_chunk) * elem_size);
+    }
+
+    #undef CHUNK_BEGIN
+    #undef CHUNK_COUNT
+}
+
+// Background reductions
+
+static void run_job(Communicator* comm, const CommJob* job) {
+    if (job->type == COMM_JOB_TOTALS) {
+        ring_allreduce(comm, comm->step_totals, 2, sizeof(double), add_doubles);
+        return;
+    }
+
+    // The layers' gradients are sums over the rows divided by rows^2 (the
+    // loss gradient and the weight gradients both average over the batch),
+    // so undo the local scaling, sum, and scale by the total rows instead:
+    // exactly the gradient of the ranks' batches stacked into one
+    double total_rows = comm->step_totals[0];
+    Real local = (Real)((double)comm->step_rows * comm->step_rows);
+    for (size_t i = 0; i < job->count; i++) job->data[i] *= local;
+    ring_allreduce(comm, job->data, job->count, sizeof(Real), add_reals);
+    Real scale = total_rows > 0 ? (Real)(1.0 / (total_rows * total_rows)) : 0;
+    for (size_t i = 0; i < job->count; i++) job->data[i] *= scale;
+}
+
+static void* comm_main(void* arg) {
+    Communicator* comm = (Communicator*)arg;
+
+    pthread_mutex_lock(&comm->lock);
+    for (;;) {
+        while (comm->next_job == comm->num_jobs && !comm->stop) {
+            pthread_cond_wait(&comm->work, &comm->lock);
+        }
+        if (comm->next_job == comm->num_jobs) break;
+
+        CommJob job = comm->jobs[comm->next_job];
+        pthread_mutex_unlock(&comm->lock);
+        run_job(comm, &job);
+        pthread_mutex_lock(&comm->lock);
+
+        if (++comm->next_job == comm->num_jobs) pthread_cond_broadcast(&comm->done);
+    }
+    pthread_mutex_unlock(&comm->lock);
+    return NULL;
+}
+
+static void queue_job(Communicator* comm, CommJobType type, Real* data, size_t count) {
+    pthread_mutex_lock(&comm->lock);
+    if (comm->num_jobs == comm->job_capacity) {
+        int capacity = comm->job_capacity ? 2 * comm->job_capacity : 64;
+        CommJob* jobs = (CommJob*)realloc(comm->jobs, capacity * sizeof(CommJob));
+        COMM_CHECK(jobs != NULL, "Memory allocation failed for the reduction queue");
+        comm->jobs = jobs;
+        comm->job_capacity = capacity;
+    }
+    CommJob* job = &comm->jobs[comm->num_jobs++];
+    job->type = type;
+    job->data = data;
+    job->count = count;
+    pthread_cond_signal(&comm->work);
+    pthread_mutex_unlock(&comm->lock);
+}
+
+// Communicator management
+
+Communicator* create_communicator(int rank, int world_size, const char* const* addresses,
+                                  int timeout_ms) {
+    COMM_CHECK(world_size > 0, "World size must be positive");
+    COMM_CHECK(rank >= 0 && rank < world_size, "Rank is out of range");
+    COMM_CHECK(world_size == 1 || addresses != NULL, "Every rank needs an address");
+
+    Communicator* comm = (Communicator*)calloc(1, sizeof(Communicator));
+    COMM_CHECK(comm != NULL, "Memory allocation failed for communicator");
+    comm->rank = rank;
+    comm->world_size = world_size;
+    comm->next_fd = -1;
+    comm->prev_fd = -1;
+    pthread_mutex_init(&comm->lock, NULL);
+    pthread_cond_init(&comm->work, NULL);
+    pthread_cond_init(&comm->done, NULL);
+    if (world_size == 1) return comm;
+
+    // Listening first lets the previous rank's connect complete before the accept
+    int listen_fd = listen_on(addresses[rank]);
+    comm->next_fd = connect_to(addresses[(rank + 1) % world_size], timeout_ms);
+    send_all(comm->next_fd, &rank, sizeof(rank));
+    comm->prev_fd = accept_from(listen_fd, (rank + world_size - 1) % world_size, timeout_ms);
+    close(listen_fd);
+
+    COMM_CHECK(pthread_create(&comm->thread, NULL, comm_main, comm) == 0,
+               "Could not start the communication thread");
+    comm->has_thread = 1;
+
+    // Nobody trains before the whole ring is up
+    comm_barrier(comm);
+    return comm;
+}
+
+Communicator* create_communicator_from_env(void) {
+    const char* world = getenv("DEEPC_WORLD_SIZE");
+    if (!world) return create_communicator(0, 1, NULL, 0);
+
+    int world_size = atoi(world);
+    const char* rank_env = getenv("DEEPC_RANK");
+    const char* peers = getenv("DEEPC_PEERS");
+    COMM_CHECK(world_size > 0, "DEEPC_WORLD_SIZE must be positive");
+    COMM_CHECK(rank_env != NULL, "DEEPC_RANK is not set");
+    if (world_size == 1) return create_communicator(atoi(rank_env), 1, NULL, 0);
+    COMM_CHECK(peers != NULL, "DEEPC_PEERS is not set");
+
+    char* list = strdup(peers);
+    const char** addresses = (const char**)malloc(world_size * sizeof(char*));
+    COMM_CHECK(list != NULL && addresses != NULL, "Memory allocation failed for peer list");
+    int count = 0;
+    for (char* save = NULL, *token = strtok_r(list, ",", &save); token;
+         token = strtok_r(NULL, ",", &save)) {
+        COMM_CHECK(count < world_size, "DEEPC_PEERS has more entries than DEEPC_WORLD_SIZE");
+        addresses[count++] = token;
+    }
+    COMM_CHECK(count == world_size, "DEEPC_PEERS needs one address per rank");
+
+    Communicator* comm = create_communicator(atoi(rank_env), world_size, addresses,
+                                             COMM_DEFAULT_TIMEOUT_MS);
+    free(addresses);
+    free(list);
+    return comm;
+}
+
+void free_communicator(Communicator* comm) {
+    if (!comm) return;
+
+    if (comm->has_thread) {
+        pthread_mutex_lock(&comm->lock);
+        comm->stop = 1;
+        pthread_cond_broadcast(&comm->work);
+        pthread_mutex_unlock(&comm->lock);
+        pthread_join(comm->thread, NULL);
+    }
+    if (comm->next_fd >= 0) close(comm->next_fd);
+    if (comm->prev_fd >= 0) close(comm->prev_fd);
+
+    pthread_mutex_destroy(&comm->lock);
+    pthread_cond_destroy(&comm->work);
+    pthread_cond_destroy(&comm->done);
+    free(comm->jobs);
+    free(comm->scratch);
+    free(comm);
+}
+
+// Blocking collectives
+
+static void check_idle(Communicator* comm) {
+    COMM_CHECK(comm != NULL, "Communicator cannot be NULL");
+    pthread_mutex_lock(&comm->lock);
+    int idle = comm->next_job == comm->num_jobs;
+    pthread_mutex_unlock(&comm->lock);
+    COMM_CHECK(idle, "Reductions are still pending (call comm_wait first)");
+}
+
+void comm_allreduce_sum(Communicator* comm, Real* data, size_t count) {
+    check_idle(comm);
+    ring_allreduce(comm, data, count, sizeof(Real), add_reals);
+}
+
+void comm_allreduce_sum_double(Communicator* comm, double* data, size_t count) {
+    check_idle(comm);
+    ring_allreduce(comm, data, count, sizeof(double), add_doubles);
+}
+
+// Passed down the ring from rank 0 in pieces, so the ranks forward one
+// piece while receiving the next
+void comm_broadcast(Communicator* comm, Real* data, size_t count) {
+    check_idle(comm);
+    if (comm->world_size == 1) return;
+
+    char* bytes = (char*)data;
+    size_t total = count * sizeof(Real);
+    for (size_t offset = 0; offset < total; offset += COMM_BROADCAST_PIECE) {
+        size_t piece = total - offset < COMM_BROADCAST_PIECE ? total - offset : COMM_BROADCAST_PIECE;
+        if (comm->rank > 0) recv_all(comm->prev_fd, bytes + offset, piece);
+        if (comm->rank < comm->world_size - 1) send_all(comm->next_fd, bytes + offset, piece);
+    }
+}
+
+void comm_barrier(Communicator* comm) {
+    double token = 0.0;
+    comm_allreduce_sum_double(comm, &token, 1);
+}
+
+// Asynchronous gradient averaging
+
+void comm_begin_step(Communicator* comm, int rows, double loss_sum) {
+    check_idle(comm);
+    COMM_CHECK(rows >= 0, "Row count cannot be negative");
+
+    comm->step_rows = rows;
+    comm->step_totals[0] = rows;
+    comm->step_totals[1] = loss_sum;
+    if (comm->world_size > 1) queue_job(comm, COMM_JOB_TOTALS, NULL, 0);
+}
+
+void comm_reduce_async(Communicator* comm, Real* data, size_t count) {
+    COMM_CHECK(comm != NULL, "Communicator cannot be NULL");
+    COMM_CHECK(data != NULL || count == 0, "Data cannot be NULL");
+    if (comm->world_size > 1) queue_job(comm, COMM_JOB_GRADIENT, data, count);
+}
+
+void comm_wait(Communicator* comm, double* total_rows, double* total_loss) {
+    COMM_CHECK(comm != NULL, "Communicator cannot be NULL");
+
+    pthread_mutex_lock(&comm->lock);
+    while (comm->next_job < comm->num_jobs) {
+        pthread_cond_wait(&comm->done, &comm->lock);
+    }
+    comm->next_job = 0;
+    comm->num_jobs = 0;
+    pthread_mutex_unlock(&comm->lock);
+
+    if (total_rows) *total_rows = comm->step_totals[0];
+    if (total_loss) *total_loss = comm->step_totals[1];
+}
@@ -0,0 +1,443 @@
+#include "deepc/expr.h"
+#include "deepc/threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Error handling
+#define EXPR_ERROR(msg) do { \
+    fprintf(stderr, "\n*** EXPRESSION ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define EXPR_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        EXPR_ERROR(msg); \
+    } \
+} while(0)
+
+// Elements per tile; every intermediate is one tile-sized slot
+#define EXPR_TILE 256
+// Intermediates alive at once (slots are reused once their value is dead)
+#define EXPR_MAX_SLOTS 16
+// Distinct leaves one expression may read
+#define EXPR_MAX_INPUTS 64
+// Elements per parallel task, at least
+#define EXPR_CHUNK 16384
+
+typedef enum {
+    EXPR_INPUT,
+    EXPR_ADD,
+    EXPR_SUBTRACT,
+    EXPR_MULTIPLY,
+    EXPR_SCALE,
+    EXPR_APPLY
+} ExprOp;
+
+struct Expr {
+    ExprOp op;
+    int rows;
+    int cols;
+    Expr* a;
+    Expr* b;
+    const Matrix* input;        // EXPR_INPUT
+    double scalar;              // EXPR_SCALE
+    double (*func)(double);     // EXPR_APPLY
+    ExprGraph* graph;
+    int id;                     // index in graph->nodes
+};
+
+struct ExprGraph {
+    Expr** nodes;
+    int num_nodes;
+    int capacity;
+};
+
+ExprGraph* create_expr_graph(void) {
+    ExprGraph* graph = (ExprGraph*)calloc(1, sizeof(ExprGraph));
+    EXPR_CHECK(graph != NULL, "Memory allocation failed for expression graph");
+    return graph;
+}
+
+void expr_graph_reset(ExprGraph* graph) {
+    EXPR_CHECK(graph != NULL, "Expression graph cannot be NULL");
+
+    for (int i = 0; i < graph->num_nodes; i++) {
+        free(graph->nodes[i]);
+    }
+    graph->num_nodes = 0;
+}
+
+void free_expr_graph(ExprGraph* graph) {
+    if (!graph) return;
+
+    expr_graph_reset(graph);
+    free(graph->nodes);
+    free(graph);
+}
+
+static Expr* new_node(ExprGraph* graph, ExprOp op, int rows, int cols) {
+    if (graph->num_nodes == graph->capacity) {
+        int capacity = graph->capacity ? graph->capacity * 2 : 32;
+        Expr** nodes = (Expr**)realloc(graph->nodes, capacity * sizeof(Expr*));
+        EXPR_CHECK(nodes != NULL, "Memory allocation failed for expression nodes");
+        graph->nodes = nodes;
+        graph->capacity = capacity;
+    }
+
+    Expr* e = (Expr*)calloc(1, sizeof(Expr));
+    EXPR_CHECK(e != NULL, "Memory allocation failed for expression node");
+    e->op = op;
+    e->rows = rows;
+    e->cols = cols;
+    e->graph = graph;
+    e->id = graph->num_nodes;
+    graph->nodes[graph->num_nodes++] = e;
+    return e;
+}
+
+Expr* expr_matrix(ExprGraph* graph, const Matrix* m) {
+    EXPR_CHECK(graph != NULL, "Expression graph cannot be NULL");
+    EXPR_CHECK(m != NULL, "Matrix cannot be NULL");
+
+    Expr* e = new_node(graph, EXPR_INPUT, m->rows, m->cols);
+    e->input = m;
+    return e;
+}
+
+static Expr* binary(ExprOp op, Expr* a, Expr* b) {
+    EXPR_CHECK(a != NULL && b != NULL, "Expressions cannot be NULL");
+    EXPR_CHECK(a->graph == b->graph, "Expressions belong to different graphs");
+    EXPR_CHECK(a->rows == b->rows && a->cols == b->cols, "Expression dimensions don't match");
+
+    Expr* e = new_node(a->graph, op, a->rows, a->cols);
+    e->a = a;
+    e->b = b;
+    return e;
+}
+
+Expr* expr_add(Expr* a, Expr* b) {
+    return binary(EXPR_ADD, a, b);
+}
+
+Expr* expr_subtract(Expr* a, Expr* b) {
+    return binary(EXPR_SUBTRACT, a, b);
+}
+
+Expr* expr_multiply(Expr* a, Expr* b) {
+    return binary(EXPR_MULTIPLY, a, b);
+}
+
+Expr* expr_scale(Expr* a, double scalar) {
+    EXPR_CHECK(a != NULL, "Expression cannot be NULL");
+
+    // Consecutive scales fold into one
+    if (a->op == EXPR_SCALE) {
+        scalar *= a->scalar;
+        a = a->a;
+    }
+    if (scalar == 1.0) return a;
+
+    Expr* e = new_node(a->graph, EXPR_SCALE, a->rows, a->cols);
+    e->a = a;
+    e->scalar = scalar;
+    return e;
+}
+
+Expr* expr_apply(Expr* a, double (*func)(double)) {
+    EXPR_CHECK(a != NULL, "Expression cannot be NULL");
+    EXPR_CHECK(func != NULL, "Function pointer cannot be NULL");
+
+    Expr* e = new_node(a->graph, EXPR_APPLY, a->rows, a->cols);
+    e->a = a;
+    e->func = func;
+    return e;
+}
+
+int expr_rows(const Expr* e) {
+    EXPR_CHECK(e != NULL, "Expression cannot be NULL");
+    return e->rows;
+}
+
+int expr_cols(const Expr* e) {
+    EXPR_CHECK(e != NULL, "Expression cannot be NULL");
+    return e->cols;
+}
+
+// One operation on a tile. Operands >= 0 are slots, < 0 are inputs -(k + 1);
+// out -1 is the destination.
+typedef struct {
+    ExprOp op;
+    int out;
+    int a;
+    int b;
+    Real scalar;
+    double (*func)(double);
+} ExprInstruction;
+
+// An expression flattened into instructions over tiles
+typedef struct {
+    ExprInstruction* code;
+    int length;
+    const Matrix** inputs;
+    int num_inputs;
+    int rows;
+    int cols;
+    int flat;                   // every matrix contiguous: one row of rows * cols
+} ExprProgram;
+
+// Post-order walk: operands before their users, each node once
+static void schedule(const Expr* e, int* operand, const Expr** order, int* length,
+                     ExprProgram* prog) {
+    if (operand[e->id] != 0) return;
+
+    if (e->op == EXPR_INPUT) {
+        EXPR_CHECK(prog->num_inputs < EXPR_MAX_INPUTS, "Expression reads too many matrices");
+        prog->inputs[prog->num_inputs] = e->input;
+        operand[e->id] = -(++prog->num_inputs);
+        return;
+    }
+    schedule(e->a, operand, order, length, prog);
+    if (e->b) schedule(e->b, operand, order, length, prog);
+
+    // Marked scheduled; the slot is assigned afterwards
+    operand[e->id] = 1;
+    order[(*length)++] = e;
+}
+
+static void compile_expr(ExprProgram* prog, const Expr* e, const Matrix* dst) {
+    const ExprGraph* graph = e->graph;
+    int n = graph->num_nodes;
+
+    int* operand = (int*)calloc(n, sizeof(int));
+    int* last_use = (int*)malloc(n * sizeof(int));
+    const Expr** order = (const Expr**)malloc(n * sizeof(Expr*));
+    prog->inputs = (const Matrix**)malloc(n * sizeof(Matrix*));
+    prog->code = (ExprInstruction*)malloc(n * sizeof(ExprInstruction));
+    EXPR_CHECK(operand && last_use && order && prog->inputs && prog->code,
+               "Memory allocation failed for expression program");
+
+    prog->num_inputs = 0;
+    prog->rows = e->rows;
+    prog->cols = e->cols;
+    int length = 0;
+    schedule(e, operand, order, &length, prog);
+    prog->length = length;
+
+    // Instruction that reads each value last
+    for (int k = 0; k < length; k++) {
+        last_use[order[k]->a->id] = k;
+        if (order[k]->b) last_use[order[k]->b->id] = k;
+    }
+
+    int free_slots[EXPR_MAX_SLOTS];
+    int num_free = 0;
+    int num_slots = 0;
+    for (int k = 0; k < length; k++) {
+        const Expr* node = order[k];
+        ExprInstruction* inst = &prog->code[k];
+        inst->op = node->op;
+        inst->a = operand[node->a->id];
+        inst->b = node->b ? operand[node->b->id] : 0;
+        inst->scalar = (Real)node->scalar;
+        inst->func = node->func;
+
+        // Operands dying here can hold the result: every operation reads
+        // element i of its operands before writing element i
+        if (inst->a >= 0 && last_use[node->a->id] == k) free_slots[num_free++] = inst->a;
+        if (node->b && node->b != node->a && inst->b >= 0 && last_use[node->b->id] == k) {
+            free_slots[num_free++] = inst->b;
+        }
+
+        if (k == length - 1) {
+            inst->out = -1;
+        } else {
+            if (num_free == 0) {
+                EXPR_CHECK(num_slots < EXPR_MAX_SLOTS, "Expression needs too many live intermediates");
+                free_slots[num_free++] = num_slots++;
+            }
+            inst->out = free_slots[--num_free];
+        }
+        operand[node->id] = inst->out;
+    }
+
+    prog->flat = dst == NULL || dst->stride == dst->cols;
+    for (int k = 0; k < prog->num_inputs; k++) {
+        if (prog->inputs[k]->stride != prog->inputs[k]->cols) prog->flat = 0;
+    }
+
+    free(operand);
+    free(last_use);
+    free(order);
+}
+
+static void free_program(ExprProgram* prog) {
+    free(prog->code);
+    free(prog->inputs);
+}
+
+// Run the program on len elements: in[k] points at input k's elements, out
+// at the destination's
+static void run_tile(const ExprProgram* prog, const Real* const* in, Real* out, int len,
+                     Real slots[][EXPR_TILE]) {
+    for (int k = 0; k < prog->length; k++) {
+        const ExprInstruction* inst = &prog->code[k];
+        const Real* x = inst->a >= 0 ? slots[inst->a] : in[-inst->a - 1];
+        const Real* y = inst->b >= 0 ? slots[inst->b] : in[-inst->b - 1];
+        Real* o = inst->out >= 0 ? slots[inst->out] : out;
+
+        switch (inst->op) {
+            case EXPR_ADD:
+                for (int i = 0; i < len; i++) o[i] = x[i] + y[i];
+                break;
+            case EXPR_SUBTRACT:
+                for (int i = 0; i < len; i++) o[i] = x[i] - y[i];
+                break;
+            case EXPR_MULTIPLY:
+                for (int i = 0; i < len; i++) o[i] = x[i] * y[i];
+                break;
+            case EXPR_SCALE: {
+                Real s = inst->scalar;
+                for (int i = 0; i < len; i++) o[i] = x[i] * s;
+                break;
+            }
+            case EXPR_APPLY:
+                for (int i = 0; i < len; i++) o[i] = (Real)inst->func(x[i]);
+                break;
+            case EXPR_INPUT:
+                break;
+        }
+    }
+}
+
+typedef struct {
+    const ExprProgram* prog;
+    Matrix* dst;                // NULL when summing
+    double* partials;           // per chunk, when summing
+    int rows_per_chunk;         // row-by-row programs
+} EvalTask;
+
+static int num_chunks(const ExprProgram* prog, int* rows_per_chunk) {
+    size_t total = (size_t)prog->rows * prog->cols;
+    if (total == 0) return 0;
+    if (prog->flat) {
+        *rows_per_chunk = 0;
+        return (int)((total + EXPR_CHUNK - 1) / EXPR_CHUNK);
+    }
+    *rows_per_chunk = prog->cols >= EXPR_CHUNK ? 1 : EXPR_CHUNK / prog->cols;
+    return (prog->rows + *rows_per_chunk - 1) / *rows_per_chunk;
+}
+
+// Evaluate elements [offset, offset + len) of row row (of the single flat
+// row in flat mode), tile by tile
+static double eval_span(const EvalTask* t, int row, size_t offset, size_t len,
+                        Real slots[][EXPR_TILE]) {
+    const ExprProgram* prog = t->prog;
+    const Real* inputs[EXPR_MAX_INPUTS];
+    Real sum_tile[EXPR_TILE];
+    double sum = 0.0;
+
+    for (size_t done = 0; done < len; done += EXPR_TILE) {
+        int n = len - done < EXPR_TILE ? (int)(len - done) : EXPR_TILE;
+        for (int k = 0; k < prog->num_inputs; k++) {
+            const Matrix* m = prog->inputs[k];
+            inputs[k] = (prog->flat ? m->values : m->data[row]) + offset + done;
+        }
+
+        const Real* out;
+        if (prog->length == 0) {
+            // A bare leaf, only ever summed
+            out = inputs[0];
+        } else {
+            Real* o = t->dst ? (prog->flat ? t->dst->values : t->dst->data[row]) + offset + done
+                             : sum_tile;
+            run_tile(prog, inputs, o, n, slots);
+            out = o;
+        }
+
+        if (!t->dst) {
+            for (int i = 0; i < n; i++) sum += out[i];
+        }
+    }
+    return sum;
+}
+
+static void eval_task(void* ctx, int begin, int end) {
+    const EvalTask* t = (const EvalTask*)ctx;
+    const ExprProgram* prog = t->prog;
+    Real slots[EXPR_MAX_SLOTS][EXPR_TILE];
+
+    for (int c = begin; c < end; c++) {
+        double sum = 0.0;
+        if (prog->flat) {
+            size_t total = (size_t)prog->rows * prog->cols;
+            size_t lo = (size_t)c * EXPR_CHUNK;
+            size_t hi = lo + EXPR_CHUNK < total ? lo + EXPR_CHUNK : total;
+            sum = eval_span(t, 0, lo, hi - lo, slots);
+        } else {
+            int first = c * t->rows_per_chunk;
+            int last = first + t->rows_per_chunk < prog->rows ? first + t->rows_per_chunk : prog->rows;
+            for (int r = first; r < last; r++) {
+                sum += eval_span(t, r, 0, prog->cols, slots);
+            }
+        }
+        if (t->partials) t->partials[c] = sum;
+    }
+}
+
+void expr_eval_into(Matrix* dst, const Expr* e) {
+    EXPR_CHECK(dst != NULL && e != NULL, "Arguments cannot be NULL");
+    EXPR_CHECK(dst->rows == e->rows && dst->cols == e->cols,
+               "Destination dimensions don't match the expression");
+
+    // A bare leaf has nothing to fuse
+    if (e->op == EXPR_INPUT) {
+        if (dst != e->input) copy_into(dst, e->input);
+        return;
+    }
+
+    ExprProgram prog;
+    compile_expr(&prog, e, dst);
+
+    EvalTask task = { &prog, dst, NULL, 0 };
+    int chunks = num_chunks(&prog, &task.rows_per_chunk);
+    parallel_for(chunks, 1, eval_task, &task);
+
+    free_program(&prog);
+}
+
+Matrix* expr_eval(const Expr* e) {
+    EXPR_CHECK(e != NULL, "Expression cannot be NULL");
+
+    Matrix* result = create_matrix(e->rows, e->cols);
+    expr_eval_into(result, e);
+    return result;
+}
+
+// Partial sums per chunk, added in chunk order so the result does not
+// depend on the thread count
+double expr_sum(const Expr* e) {
+    EXPR_CHECK(e != NULL, "Expression cannot be NULL");
+
+    ExprProgram prog;
+    compile_expr(&prog, e, NULL);
+
+    EvalTask task = { &prog, NULL, NULL, 0 };
+    int chunks = num_chunks(&prog, &task.rows_per_chunk);
+    task.partials = (double*)malloc(chunks * sizeof(double));
+    EXPR_CHECK(task.partials != NULL, "Memory allocation failed for expression sum");
+    parallel_for(chunks, 1, eval_task, &task);
+
+    double sum = 0.0;
+    for (int c = 0; c < chunks; c++) {
+        sum += task.partials[c];
+    }
+
+    free(task.partials);
+    free_program(&prog);
+    return sum;
+}
@@ -0,0 +1,722 @@
+#include "deepc/gemm.h"
+#include "deepc/threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef DEEPC_USE_BLAS
+#include <cblas.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GEMM_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define GEMM_NEON 1
+#endif
+
+// Error handling
+#define GEMM_ERROR(msg) do { \
+    fprintf(stderr, "\n*** GEMM ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define GEMM_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        GEMM_ERROR(msg); \
+    } \
+} while(0)
+
+// Cache blocking (in elements). An MC x KC block of packed A is sized for L2,
+// a KC x NR sliver of packed B for L1. MC and NC are multiples of every
+// kernel's MR and NR.
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 2048
+
+// Largest micro-tile of any kernel, for the edge-tile scratch buffer. The
+// float kernels are as tall as the double ones and twice as wide.
+#define GEMM_MAX_MR 8
+#ifdef DEEPC_USE_FLOAT32
+#define GEMM_MAX_NR 32
+#else
+#define GEMM_MAX_NR 16
+#endif
+
+// Below this many multiply-adds, packing costs more than it saves
+#define GEMM_SMALL_WORK (32.0 * 32.0 * 32.0)
+
+// Below this many multiply-adds, waking the thread pool costs more than it saves
+#define GEMM_PARALLEL_WORK (128.0 * 128.0 * 64.0)
+
+// A micro-kernel computes c[mr x nr] += alpha * a_panel * b_panel, where the
+// panels hold kc steps of mr (resp. nr) packed values
+typedef void (*MicroKernel)(int kc, Real alpha, const Real *a, const Real *b,
+                            Real *c, int ldc);
+
+typedef struct {
+    const char *name;
+    int mr;
+    int nr;
+    MicroKernel micro;
+} GemmKernel;
+
+// Portable 4x4 kernel
+static void micro_generic(int kc, Real alpha, const Real *a, const Real *b,
+                          Real *c, int ldc) {
+    Real acc[4][4] = {{0.0}};
+
+    for (int k = 0; k < kc; k++) {
+        for (int i = 0; i < 4; i++) {
+            Real ai = a[i];
+            for (int j = 0; j < 4; j++) {
+                acc[i][j] += ai * b[j];
+            }
+        }
+        a += 4;
+        b += 4;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            c[i * ldc + j] += alpha * acc[i][j];
+        }
+    }
+}
+
+static const GemmKernel generic_kernel = { "generic", 4, 4, micro_generic };
+
+#ifdef DEEPC_USE_FLOAT32
+
+#ifdef GEMM_X86
+
+// AVX2 + FMA 6x16 kernel: 12 accumulators, 2 B vectors and 1 broadcast of A
+#define AVX2_ROW(i) do { \
+    __m256 a##i = _mm256_broadcast_ss(a + i); \
+    c##i##0 = _mm256_fmadd_ps(a##i, b0, c##i##0); \
+    c##i##1 = _mm256_fmadd_ps(a##i, b1, c##i##1); \
+} while(0)
+
+#define AVX2_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    _mm256_storeu_ps(ci, _mm256_fmadd_ps(va, c##i##0, _mm256_loadu_ps(ci))); \
+    _mm256_storeu_ps(ci + 8, _mm256_fmadd_ps(va, c##i##1, _mm256_loadu_ps(ci + 8))); \
+} while(0)
+
+__attribute__((target("avx2,fma")))
+static void micro_avx2(int kc, Real alpha, const Real *a, const Real *b,
+                       Real *c, int ldc) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (int k = 0; k < kc; k++) {
+        __m256 b0 = _mm256_load_ps(b);
+        __m256 b1 = _mm256_load_ps(b + 8);
+        AVX2_ROW(0); AVX2_ROW(1); AVX2_ROW(2);
+        AVX2_ROW(3); AVX2_ROW(4); AVX2_ROW(5);
+        a += 6;
+        b += 16;
+    }
+
+    __m256 va = _mm256_set1_ps(alpha);
+    AVX2_STORE(0); AVX2_STORE(1); AVX2_STORE(2);
+    AVX2_STORE(3); AVX2_STORE(4); AVX2_STORE(5);
+}
+
+static const GemmKernel avx2_kernel = { "avx2", 6, 16, micro_avx2 };
+
+// AVX-512 8x32 kernel: 16 accumulators, 2 B vectors and 1 broadcast of A
+#define AVX512_ROW(i) do { \
+    __m512 a##i = _mm512_set1_ps(a[i]); \
+    c##i##0 = _mm512_fmadd_ps(a##i, b0, c##i##0); \
+    c##i##1 = _mm512_fmadd_ps(a##i, b1, c##i##1); \
+} while(0)
+
+#define AVX512_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    _mm512_storeu_ps(ci, _mm512_fmadd_ps(va, c##i##0, _mm512_loadu_ps(ci))); \
+    _mm512_storeu_ps(ci + 16, _mm512_fmadd_ps(va, c##i##1, _mm512_loadu_ps(ci + 16))); \
+} while(0)
+
+__attribute__((target("avx512f")))
+static void micro_avx512(int kc, Real alpha, const Real *a, const Real *b,
+                         Real *c, int ldc) {
+    __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+    __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+    __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+    __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+    __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+    __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+    __m512 c60 = _mm512_setzero_ps(), c61 = _mm512_setzero_ps();
+    __m512 c70 = _mm512_setzero_ps(), c71 = _mm512_setzero_ps();
+
+    for (int k = 0; k < kc; k++) {
+        __m512 b0 = _mm512_load_ps(b);
+        __m512 b1 = _mm512_load_ps(b + 16);
+        AVX512_ROW(0); AVX512_ROW(1); AVX512_ROW(2); AVX512_ROW(3);
+        AVX512_ROW(4); AVX512_ROW(5); AVX512_ROW(6); AVX512_ROW(7);
+        a += 8;
+        b += 32;
+    }
+
+    __m512 va = _mm512_set1_ps(alpha);
+    AVX512_STORE(0); AVX512_STORE(1); AVX512_STORE(2); AVX512_STORE(3);
+    AVX512_STORE(4); AVX512_STORE(5); AVX512_STORE(6); AVX512_STORE(7);
+}
+
+static const GemmKernel avx512_kernel = { "avx512", 8, 32, micro_avx512 };
+
+#endif // GEMM_X86
+
+#ifdef GEMM_NEON
+
+// NEON 4x16 kernel: 16 accumulators of four floats each
+#define NEON_ROW(i) do { \
+    c##i##0 = vfmaq_n_f32(c##i##0, b0, a[i]); \
+    c##i##1 = vfmaq_n_f32(c##i##1, b1, a[i]); \
+    c##i##2 = vfmaq_n_f32(c##i##2, b2, a[i]); \
+    c##i##3 = vfmaq_n_f32(c##i##3, b3, a[i]); \
+} while(0)
+
+#define NEON_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    vst1q_f32(ci, vfmaq_n_f32(vld1q_f32(ci), c##i##0, alpha)); \
+    vst1q_f32(ci + 4, vfmaq_n_f32(vld1q_f32(ci + 4), c##i##1, alpha)); \
+    vst1q_f32(ci + 8, vfmaq_n_f32(vld1q_f32(ci + 8), c##i##2, alpha)); \
+    vst1q_f32(ci + 12, vfmaq_n_f32(vld1q_f32(ci + 12), c##i##3, alpha)); \
+} while(0)
+
+static void micro_neon(int kc, Real alpha, const Real *a, const Real *b,
+                       Real *c, int ldc) {
+    float32x4_t c00 = vdupq_n_f32(0.0f), c01 = c00, c02 = c00, c03 = c00;
+    float32x4_t c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+    float32x4_t c20 = c00, c21 = c00, c22 = c00, c23 = c00;
+    float32x4_t c30 = c00, c31 = c00, c32 = c00, c33 = c00;
+
+    for (int k = 0; k < kc; k++) {
+        float32x4_t b0 = vld1q_f32(b);
+        float32x4_t b1 = vld1q_f32(b + 4);
+        float32x4_t b2 = vld1q_f32(b + 8);
+        float32x4_t b3 = vld1q_f32(b + 12);
+        NEON_ROW(0); NEON_ROW(1); NEON_ROW(2); NEON_ROW(3);
+        a += 4;
+        b += 16;
+    }
+
+    NEON_STORE(0); NEON_STORE(1); NEON_STORE(2); NEON_STORE(3);
+}
+
+static const GemmKernel neon_kernel = { "neon", 4, 16, micro_neon };
+
+#endif // GEMM_NEON
+
+#else // double
+
+#ifdef GEMM_X86
+
+// AVX2 + FMA 6x8 kernel: 12 accumulators, 2 B vectors and 1 broadcast of A
+#define AVX2_ROW(i) do { \
+    __m256d a##i = _mm256_broadcast_sd(a + i); \
+    c##i##0 = _mm256_fmadd_pd(a##i, b0, c##i##0); \
+    c##i##1 = _mm256_fmadd_pd(a##i, b1, c##i##1); \
+} while(0)
+
+#define AVX2_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    _mm256_storeu_pd(ci, _mm256_fmadd_pd(va, c##i##0, _mm256_loadu_pd(ci))); \
+    _mm256_storeu_pd(ci + 4, _mm256_fmadd_pd(va, c##i##1, _mm256_loadu_pd(ci + 4))); \
+} while(0)
+
+__attribute__((target("avx2,fma")))
+static void micro_avx2(int kc, Real alpha, const Real *a, const Real *b,
+                       Real *c, int ldc) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+    __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+
+    for (int k = 0; k < kc; k++) {
+        __m256d b0 = _mm256_load_pd(b);
+        __m256d b1 = _mm256_load_pd(b + 4);
+        AVX2_ROW(0); AVX2_ROW(1); AVX2_ROW(2);
+        AVX2_ROW(3); AVX2_ROW(4); AVX2_ROW(5);
+        a += 6;
+        b += 8;
+    }
+
+    __m256d va = _mm256_set1_pd(alpha);
+    AVX2_STORE(0); AVX2_STORE(1); AVX2_STORE(2);
+    AVX2_STORE(3); AVX2_STORE(4); AVX2_STORE(5);
+}
+
+static const GemmKernel avx2_kernel = { "avx2", 6, 8, micro_avx2 };
+
+// AVX-512 8x16 kernel: 16 accumulators, 2 B vectors and 1 broadcast of A
+#define AVX512_ROW(i) do { \
+    __m512d a##i = _mm512_set1_pd(a[i]); \
+    c##i##0 = _mm512_fmadd_pd(a##i, b0, c##i##0); \
+    c##i##1 = _mm512_fmadd_pd(a##i, b1, c##i##1); \
+} while(0)
+
+#define AVX512_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    _mm512_storeu_pd(ci, _mm512_fmadd_pd(va, c##i##0, _mm512_loadu_pd(ci))); \
+    _mm512_storeu_pd(ci + 8, _mm512_fmadd_pd(va, c##i##1, _mm512_loadu_pd(ci + 8))); \
+} while(0)
+
+__attribute__((target("avx512f")))
+static void micro_avx512(int kc, Real alpha, const Real *a, const Real *b,
+                         Real *c, int ldc) {
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    __m512d c40 = _mm512_setzero_pd(), c41 = _mm512_setzero_pd();
+    __m512d c50 = _mm512_setzero_pd(), c51 = _mm512_setzero_pd();
+    __m512d c60 = _mm512_setzero_pd(), c61 = _mm512_setzero_pd();
+    __m512d c70 = _mm512_setzero_pd(), c71 = _mm512_setzero_pd();
+
+    for (int k = 0; k < kc; k++) {
+        __m512d b0 = _mm512_load_pd(b);
+        __m512d b1 = _mm512_load_pd(b + 8);
+        AVX512_ROW(0); AVX512_ROW(1); AVX512_ROW(2); AVX512_ROW(3);
+        AVX512_ROW(4); AVX512_ROW(5); AVX512_ROW(6); AVX512_ROW(7);
+        a += 8;
+        b += 16;
+    }
+
+    __m512d va = _mm512_set1_pd(alpha);
+    AVX512_STORE(0); AVX512_STORE(1); AVX512_STORE(2); AVX512_STORE(3);
+    AVX512_STORE(4); AVX512_STORE(5); AVX512_STORE(6); AVX512_STORE(7);
+}
+
+static const GemmKernel avx512_kernel = { "avx512", 8, 16, micro_avx512 };
+
+#endif // GEMM_X86
+
+#ifdef GEMM_NEON
+
+// NEON 4x8 kernel: 16 accumulators of two Reals each
+#define NEON_ROW(i) do { \
+    c##i##0 = vfmaq_n_f64(c##i##0, b0, a[i]); \
+    c##i##1 = vfmaq_n_f64(c##i##1, b1, a[i]); \
+    c##i##2 = vfmaq_n_f64(c##i##2, b2, a[i]); \
+    c##i##3 = vfmaq_n_f64(c##i##3, b3, a[i]); \
+} while(0)
+
+#define NEON_STORE(i) do { \
+    Real *ci = c + i * ldc; \
+    vst1q_f64(ci, vfmaq_n_f64(vld1q_f64(ci), c##i##0, alpha)); \
+    vst1q_f64(ci + 2, vfmaq_n_f64(vld1q_f64(ci + 2), c##i##1, alpha)); \
+    vst1q_f64(ci + 4, vfmaq_n_f64(vld1q_f64(ci + 4), c##i##2, alpha)); \
+    vst1q_f64(ci + 6, vfmaq_n_f64(vld1q_f64(ci + 6), c##i##3, alpha)); \
+} while(0)
+
+static void micro_neon(int kc, Real alpha, const Real *a, const Real *b,
+                       Real *c, int ldc) {
+    float64x2_t c00 = vdupq_n_f64(0.0), c01 = c00, c02 = c00, c03 = c00;
+    float64x2_t c10 = c00, c11 = c00, c12 = c00, c13 = c00;
+    float64x2_t c20 = c00, c21 = c00, c22 = c00, c23 = c00;
+    float64x2_t c30 = c00, c31 = c00, c32 = c00, c33 = c00;
+
+    for (int k = 0; k < kc; k++) {
+        float64x2_t b0 = vld1q_f64(b);
+        float64x2_t b1 = vld1q_f64(b + 2);
+        float64x2_t b2 = vld1q_f64(b + 4);
+        float64x2_t b3 = vld1q_f64(b + 6);
+        NEON_ROW(0); NEON_ROW(1); NEON_ROW(2); NEON_ROW(3);
+        a += 4;
+        b += 8;
+    }
+
+    NEON_STORE(0); NEON_STORE(1); NEON_STORE(2); NEON_STORE(3);
+}
+
+static const GemmKernel neon_kernel = { "neon", 4, 8, micro_neon };
+
+#endif // GEMM_NEON
+
+#endif // DEEPC_USE_FLOAT32
+
+// Pick the widest micro-kernel the CPU supports (once)
+static const GemmKernel* select_kernel(void) {
+    static const GemmKernel *selected = NULL;
+
+    if (selected == NULL) {
+        const GemmKernel *kernel = &generic_kernel;
+#if defined(GEMM_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = &avx512_kernel;
+        } else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            kernel = &avx2_kernel;
+        }
+#elif defined(GEMM_NEON)
+        kernel = &neon_kernel;
+#endif
+        selected = kernel;
+    }
+
+    return selected;
+}
+
+const char* gemm_kernel_name(void) {
+#ifdef DEEPC_USE_BLAS
+    return "blas";
+#else
+    return select_kernel()->name;
+#endif
+}
+
+// Per-thread packing buffers, grown on demand and reused across calls
+static __thread Real *pack_a_buffer = NULL;
+static __thread size_t pack_a_capacity = 0;
+static __thread Real *pack_b_buffer = NULL;
+static __thread size_t pack_b_capacity = 0;
+
+// Pool threads exit when the pool is resized; a thread-specific key with a
+// destructor frees their buffers on the way out
+static pthread_key_t pack_key;
+static pthread_once_t pack_key_once = PTHREAD_ONCE_INIT;
+
+static void free_pack_buffers(void *unused) {
+    (void)unused;
+    free(pack_a_buffer);
+    free(pack_b_buffer);
+    pack_a_buffer = pack_b_buffer = NULL;
+    pack_a_capacity = pack_b_capacity = 0;
+}
+
+static void create_pack_key(void) {
+    pthread_key_create(&pack_key, free_pack_buffers);
+}
+
+static Real* reserve_buffer(Real **buffer, size_t *capacity, size_t count) {
+    if (count > *capacity) {
+        pthread_once(&pack_key_once, create_pack_key);
+        pthread_setspecific(pack_key, buffer);
+
+        void *block = NULL;
+        free(*buffer);
+        GEMM_CHECK(posix_memalign(&block, 64, count * sizeof(Real)) == 0,
+                   "Memory allocation failed for GEMM packing buffer");
+        *buffer = (Real*)block;
+        *capacity = count;
+    }
+    return *buffer;
+}
+
+// Pack an mc x kc block of op(A) into panels of mr rows; within a panel the
+// mr values of each k are contiguous. Short panels are zero-padded.
+static void pack_a(GemmTranspose trans, int mc, int kc, const Real *A, int lda,
+                   int mr, Real *dst) {
+    for (int i0 = 0; i0 < mc; i0 += mr) {
+        int rows = mc - i0 < mr ? mc - i0 : mr;
+        for (int k = 0; k < kc; k++) {
+            if (trans == GEMM_NO_TRANS) {
+                for (int i = 0; i < rows; i++) {
+                    dst[i] = A[(size_t)(i0 + i) * lda + k];
+                }
+            } else {
+                const Real *src = A + (size_t)k * lda + i0;
+                for (int i = 0; i < rows; i++) {
+                    dst[i] = src[i];
+                }
+            }
+            for (int i = rows; i < mr; i++) {
+                dst[i] = 0.0;
+            }
+            dst += mr;
+        }
+    }
+}
+
+// Pack a kc x nc block of op(B) into panels of nr columns; within a panel the
+// nr values of each k are contiguous. Short panels are zero-padded.
+static void pack_b(GemmTranspose trans, int kc, int nc, const Real *B, int ldb,
+                   int nr, Real *dst) {
+    for (int j0 = 0; j0 < nc; j0 += nr) {
+        int cols = nc - j0 < nr ? nc - j0 : nr;
+        for (int k = 0; k < kc; k++) {
+            if (trans == GEMM_NO_TRANS) {
+                const Real *src = B + (size_t)k * ldb + j0;
+                for (int j = 0; j < cols; j++) {
+                    dst[j] = src[j];
+                }
+            } else {
+                for (int j = 0; j < cols; j++) {
+                    dst[j] = B[(size_t)(j0 + j) * ldb + k];
+                }
+            }
+            for (int j = cols; j < nr; j++) {
+                dst[j] = 0.0;
+            }
+            dst += nr;
+        }
+    }
+}
+
+// Multiply a packed mc x kc block of A by a packed kc x nc block of B into C.
+// On the last kc block the epilogue (if any) runs on each tile as it completes;
+// row0/col0 locate C within the full output.
+static void macro_kernel(const GemmKernel *kernel, int mc, int nc, int kc, Real alpha,
+                         const Real *packed_a, const Real *packed_b,
+                         Real *C, int ldc,
+                         const GemmEpilogue *epilogue, int row0, int col0) {
+    int mr = kernel->mr;
+    int nr = kernel->nr;
+    Real tile[GEMM_MAX_MR * GEMM_MAX_NR] __attribute__((aligned(64)));
+
+    for (int jr = 0; jr < nc; jr += nr) {
+        int n = nc - jr < nr ? nc - jr : nr;
+        const Real *b = packed_b + (size_t)jr * kc;
+
+        for (int ir = 0; ir < mc; ir += mr) {
+            int m = mc - ir < mr ? mc - ir : mr;
+            const Real *a = packed_a + (size_t)ir * kc;
+            Real *c = C + (size_t)ir * ldc + jr;
+
+            if (m == mr && n == nr) {
+                kernel->micro(kc, alpha, a, b, c, ldc);
+            } else {
+                // Edge tile: compute the full tile in scratch, keep the valid part
+                memset(tile, 0, sizeof(Real) * mr * nr);
+                kernel->micro(kc, alpha, a, b, tile, nr);
+                for (int i = 0; i < m; i++) {
+                    for (int j = 0; j < n; j++) {
+                        c[(size_t)i * ldc + j] += tile[i * nr + j];
+                    }
+                }
+            }
+
+            if (epilogue) {
+                epilogue->apply(epilogue->ctx, row0 + ir, col0 + jr, c, ldc, m, n);
+            }
+        }
+    }
+}
+
+// Unblocked loops for products too small to amortize packing. The loop order
+// keeps the innermost access contiguous for each transpose combination.
+static void gemm_small(GemmTranspose trans_a, GemmTranspose trans_b,
+                       int M, int N, int K, Real alpha,
+                       const Real *A, int lda, const Real *B, int ldb,
+                       Real *C, int ldc, const GemmEpilogue *epilogue) {
+    for (int i = 0; i < M; i++) {
+        Real *c = C + (size_t)i * ldc;
+
+        if (trans_b == GEMM_NO_TRANS) {
+            // i-k-j: stream rows of B into the row of C
+            for (int k = 0; k < K; k++) {
+                Real aik = trans_a == GEMM_NO_TRANS ? A[(size_t)i * lda + k]
+                                                      : A[(size_t)k * lda + i];
+                const Real *b = B + (size_t)k * ldb;
+                aik *= alpha;
+                for (int j = 0; j < N; j++) {
+                    c[j] += aik * b[j];
+                }
+            }
+        } else {
+            // i-j-k: rows of B^T are rows of the stored B
+            for (int j = 0; j < N; j++) {
+                const Real *b = B + (size_t)j * ldb;
+                Real sum = 0.0;
+                if (trans_a == GEMM_NO_TRANS) {
+                    const Real *a = A + (size_t)i * lda;
+                    for (int k = 0; k < K; k++) {
+                        sum += a[k] * b[k];
+                    }
+                } else {
+                    for (int k = 0; k < K; k++) {
+                        sum += A[(size_t)k * lda + i] * b[k];
+                    }
+                }
+                c[j] += alpha * sum;
+            }
+        }
+
+        if (epilogue) {
+            epilogue->apply(epilogue->ctx, i, 0, c, ldc, 1, N);
+        }
+    }
+}
+
+// One (jc, pc) step of the blocked loop, shared by the tasks that run it
+typedef struct {
+    const GemmKernel *kernel;
+    GemmTranspose trans_a;
+    const Real *A;
+    int lda;
+    Real alpha;
+    const Real *packed_b;
+    Real *C;
+    int ldc;
+    int M;
+    int jc, nc, pc, kc;
+    int col_groups;
+    int group_panels;
+    const GemmEpilogue *epilogue;
+} GemmBlockJob;
+
+// Each task packs its own MC row block of A (into the thread's buffer) and
+// multiplies it by a group of column panels of the shared packed B
+static void gemm_block_task(void *ctx, int begin, int end) {
+    const GemmBlockJob *job = (const GemmBlockJob *)ctx;
+    int mr = job->kernel->mr;
+    int nr = job->kernel->nr;
+    int kc = job->kc;
+
+    for (int t = begin; t < end; t++) {
+        int ic = t / job->col_groups * GEMM_MC;
+        int jr = t % job->col_groups * job->group_panels * nr;
+        if (jr >= job->nc) continue;
+
+        int mc = job->M - ic < GEMM_MC ? job->M - ic : GEMM_MC;
+        int nc = job->nc - jr < job->group_panels * nr ? job->nc - jr : job->group_panels * nr;
+
+        size_t a_count = (size_t)((mc + mr - 1) / mr * mr) * kc;
+        Real *packed_a = reserve_buffer(&pack_a_buffer, &pack_a_capacity, a_count);
+        const Real *a_block = job->trans_a == GEMM_NO_TRANS
+                                ? job->A + (size_t)ic * job->lda + job->pc
+                                : job->A + (size_t)job->pc * job->lda + ic;
+        pack_a(job->trans_a, mc, kc, a_block, job->lda, mr, packed_a);
+
+        macro_kernel(job->kernel, mc, nc, kc, job->alpha, packed_a,
+                     job->packed_b + (size_t)jr * kc,
+                     job->C + (size_t)ic * job->ldc + job->jc + jr, job->ldc,
+                     job->epilogue, ic, job->jc + jr);
+    }
+}
+
+void gemm(GemmTranspose trans_a, GemmTranspose trans_b,
+          int M, int N, int K, Real alpha,
+          const Real *A, int lda,
+          const Real *B, int ldb,
+          Real beta, Real *C, int ldc) {
+    gemm_ex(trans_a, trans_b, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, NULL);
+}
+
+// Run the epilogue over all of C in one go
+static void apply_epilogue(const GemmEpilogue *epilogue, int M, int N, Real *C, int ldc) {
+    if (epilogue) {
+        epilogue->apply(epilogue->ctx, 0, 0, C, ldc, M, N);
+    }
+}
+
+void gemm_ex(GemmTranspose trans_a, GemmTranspose trans_b,
+             int M, int N, int K, Real alpha,
+             const Real *A, int lda,
+             const Real *B, int ldb,
+             Real beta, Real *C, int ldc,
+             const GemmEpilogue *epilogue) {
+    GEMM_CHECK(M >= 0 && N >= 0 && K >= 0, "GEMM dimensions cannot be negative");
+    GEMM_CHECK(C != NULL, "GEMM output cannot be NULL");
+
+    if (M == 0 || N == 0) return;
+
+#ifdef DEEPC_USE_BLAS
+    // Vendor-tuned (and possibly multithreaded) sgemm/dgemm replaces the built-in kernels
+#ifdef DEEPC_USE_FLOAT32
+    cblas_sgemm(CblasRowMajor,
+                trans_a == GEMM_TRANS ? CblasTrans : CblasNoTrans,
+                trans_b == GEMM_TRANS ? CblasTrans : CblasNoTrans,
+                M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+#else
+    cblas_dgemm(CblasRowMajor,
+                trans_a == GEMM_TRANS ? CblasTrans : CblasNoTrans,
+                trans_b == GEMM_TRANS ? CblasTrans : CblasNoTrans,
+                M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+#endif
+    apply_epilogue(epilogue, M, N, C, ldc);
+    return;
+#endif
+
+    // Apply beta up front so the kernels only ever accumulate into C
+    if (beta != 1.0) {
+        for (int i = 0; i < M; i++) {
+            Real *c = C + (size_t)i * ldc;
+            if (beta == 0.0) {
+                memset(c, 0, N * sizeof(Real));
+            } else {
+                for (int j = 0; j < N; j++) {
+                    c[j] *= beta;
+                }
+            }
+        }
+    }
+
+    if (K == 0 || alpha == 0.0) {
+        apply_epilogue(epilogue, M, N, C, ldc);
+        return;
+    }
+    GEMM_CHECK(A != NULL && B != NULL, "GEMM inputs cannot be NULL");
+
+    if ((double)M * N * K < GEMM_SMALL_WORK) {
+        gemm_small(trans_a, trans_b, M, N, K, alpha, A, lda, B, ldb, C, ldc, epilogue);
+        return;
+    }
+
+    const GemmKernel *kernel = select_kernel();
+    int nr = kernel->nr;
+
+    int nc_max = N < GEMM_NC ? N : GEMM_NC;
+    int kc_max = K < GEMM_KC ? K : GEMM_KC;
+    size_t b_count = (size_t)((nc_max + nr - 1) / nr * nr) * kc_max;
+    Real *packed_b = reserve_buffer(&pack_b_buffer, &pack_b_capacity, b_count);
+
+    int threads = (double)M * N * K < GEMM_PARALLEL_WORK ? 1 : deepc_get_num_threads();
+
+    GemmBlockJob job;
+    job.kernel = kernel;
+    job.trans_a = trans_a;
+    job.A = A;
+    job.lda = lda;
+    job.alpha = alpha;
+    job.packed_b = packed_b;
+    job.C = C;
+    job.ldc = ldc;
+    job.M = M;
+
+    for (int jc = 0; jc < N; jc += GEMM_NC) {
+        int nc = N - jc < GEMM_NC ? N - jc : GEMM_NC;
+
+        // Tasks are MC row blocks, further split into column panels when
+        // there are too few row blocks to keep every thread busy
+        int row_blocks = (M + GEMM_MC - 1) / GEMM_MC;
+        int panels = (nc + nr - 1) / nr;
+        int col_groups = (2 * threads + row_blocks - 1) / row_blocks;
+        if (threads == 1 || col_groups < 1) col_groups = 1;
+        if (col_groups > panels) col_groups = panels;
+
+        job.jc = jc;
+        job.nc = nc;
+        job.col_groups = col_groups;
+        job.group_panels = (panels + col_groups - 1) / col_groups;
+
+        for (int pc = 0; pc < K; pc += GEMM_KC) {
+            int kc = K - pc < GEMM_KC ? K - pc : GEMM_KC;
+            const Real *b_block = trans_b == GEMM_NO_TRANS ? B + (size_t)pc * ldb + jc
+                                                             : B + (size_t)jc * ldb + pc;
+            pack_b(trans_b, kc, nc, b_block, ldb, nr, packed_b);
+
+            job.pc = pc;
+            job.kc = kc;
+            job.epilogue = pc + kc == K ? epilogue : NULL;
+
+            int tasks = row_blocks * col_groups;
+            parallel_for(tasks, threads == 1 ? tasks : 1, gemm_block_task, &job);
+        }
+    }
+}
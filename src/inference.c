@@ -0,0 +1,141 @@
+#include "deepc/inference.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+// Error handling
+#define INFERENCE_ERROR(msg) do { \
+    fprintf(stderr, "\n*** INFERENCE ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define INFERENCE_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        INFERENCE_ERROR(msg); \
+    } \
+} while(0)
+
+// Create a session able to run up to max_batch rows per pass
+InferenceSession* create_inference_session(const SequentialModel* model, int max_batch) {
+    INFERENCE_CHECK(model != NULL, "Model cannot be NULL");
+    INFERENCE_CHECK(model->input_layer != NULL, "Model has no layers");
+    INFERENCE_CHECK(max_batch > 0, "Maximum batch size must be positive");
+    
+    InferenceSession* session = (InferenceSession*)malloc(sizeof(InferenceSession));
+    INFERENCE_CHECK(session != NULL, "Memory allocation failed for inference session");
+    
+    session->model = model;
+    session->max_batch = max_batch;
+    session->max_width = 0;
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next) {
+        if (layer->output_size > session->max_width) {
+            session->max_width = layer->output_size;
+        }
+    }
+    
+    for (int b = 0; b < 2; b++) {
+        void* block = NULL;
+        size_t bytes = (size_t)max_batch * session->max_width * sizeof(Real);
+        INFERENCE_CHECK(posix_memalign(&block, MATRIX_ALIGNMENT, bytes) == 0,
+                        "Memory allocation failed for inference buffer");
+        session->buffers[b] = (Real*)block;
+        
+        Matrix* view = &session->views[b];
+        view->rows = 0;
+        view->cols = 0;
+        view->stride = 0;
+        view->values = session->buffers[b];
+        view->storage = MATRIX_VIEW;
+        view->data = (Real**)malloc(max_batch * sizeof(Real*));
+        INFERENCE_CHECK(view->data != NULL, "Memory allocation failed for inference buffer");
+    }
+    
+    return session;
+}
+
+// Free a session (the model is not touched)
+void free_inference_session(InferenceSession* session) {
+    if (!session) return;
+    
+    for (int b = 0; b < 2; b++) {
+        free(session->buffers[b]);
+        free(session->views[b].data);
+    }
+    free(session);
+}
+
+// Point a session view at a compact rows x cols matrix in its buffer
+static Matrix* shape_view(Matrix* view, int rows, int cols) {
+    view->rows = rows;
+    view->cols = cols;
+    view->stride = cols;
+    for (int i = 0; i < rows; i++) {
+        view->data[i] = view->values + (size_t)i * cols;
+    }
+    return view;
+}
+
+// Header for rows [row, row + rows) of m, sharing its memory
+static Matrix row_slice(const Matrix* m, int row, int rows) {
+    Matrix slice;
+    slice.rows = rows;
+    slice.cols = m->cols;
+    slice.stride = m->stride;
+    slice.data = m->data + row;
+    slice.values = m->data[row];
+    slice.storage = MATRIX_VIEW;
+    return slice;
+}
+
+// Run every layer on input (at most max_batch rows), alternating between
+// the two buffers. The last layer writes to final_output when given.
+static const Matrix* run_layers(InferenceSession* session, const Matrix* input,
+                                Matrix* final_output) {
+    const Matrix* current = input;
+    int next_buffer = 0;
+    
+    for (const Layer* layer = session->model->input_layer; layer; layer = layer->next) {
+        Matrix* output;
+        if (!layer->next && final_output) {
+            output = final_output;
+        } else {
+            output = shape_view(&session->views[next_buffer], input->rows, layer->output_size);
+            next_buffer ^= 1;
+        }
+        
+        forward_pass_into(layer, current, output);
+        current = output;
+    }
+    
+    return current;
+}
+
+void predict_into(InferenceSession* session, const Matrix* input, Matrix* output) {
+    INFERENCE_CHECK(session != NULL, "Session cannot be NULL");
+    INFERENCE_CHECK(input != NULL && output != NULL, "Matrices cannot be NULL");
+    INFERENCE_CHECK(input->cols == session->model->input_layer->input_size,
+                    "Input dimension doesn't match the model");
+    INFERENCE_CHECK(output->rows == input->rows &&
+                    output->cols == session->model->output_layer->output_size,
+                    "Output dimensions don't match the model");
+    
+    for (int row = 0; row < input->rows; row += session->max_batch) {
+        int rows = input->rows - row < session->max_batch ? input->rows - row : session->max_batch;
+        Matrix input_rows = row_slice(input, row, rows);
+        Matrix output_rows = row_slice(output, row, rows);
+        run_layers(session, &input_rows, &output_rows);
+    }
+}
+
+const Matrix* session_predict(InferenceSession* session, const Matrix* input) {
+    INFERENCE_CHECK(session != NULL, "Session cannot be NULL");
+    INFERENCE_CHECK(input != NULL, "Input matrix cannot be NULL");
+    INFERENCE_CHECK(input->rows <= session->max_batch, "Input has more rows than the session allows");
+    INFERENCE_CHECK(input->cols == session->model->input_layer->input_size,
+                    "Input dimension doesn't match the model");
+    
+    return run_layers(session, input, NULL);
+}
@@ -0,0 +1,228 @@
+#include "deepc/inference_server.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Error handling
+#define SERVER_ERROR(msg) do { \
+    fprintf(stderr, "\n*** INFERENCE SERVER ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define SERVER_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        SERVER_ERROR(msg); \
+    } \
+} while(0)
+
+// One caller's request, living on its stack until it is answered
+struct InferenceRequest {
+    const Matrix* input;
+    Matrix* output;
+    struct timespec arrival;
+    int done;
+    pthread_cond_t answered;
+    InferenceRequest* next;
+};
+
+static void add_microseconds(struct timespec* ts, long us) {
+    ts->tv_sec += us / 1000000;
+    ts->tv_nsec += (us % 1000000) * 1000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+// Copy rows of src into dst starting at row
+static void copy_rows(Matrix* dst, int row, const Matrix* src) {
+    for (int i = 0; i < src->rows; i++) {
+        memcpy(dst->data[row + i], src->data[i], src->cols * sizeof(Real));
+    }
+}
+
+static void scatter_rows(Matrix* dst, const Matrix* src, int row) {
+    for (int i = 0; i < dst->rows; i++) {
+        memcpy(dst->data[i], src->data[row + i], dst->cols * sizeof(Real));
+    }
+}
+
+// Serve one micro-batch: requests taken off the queue as a list, run as a
+// single pass unless one alone exceeds max_batch
+static void serve(InferenceServer* server, InferenceRequest* first, int rows) {
+    if (first->input->rows >= server->max_batch) {
+        predict_into(server->session, first->input, first->output);
+        return;
+    }
+
+    int row = 0;
+    for (InferenceRequest* r = first; r; r = r->next) {
+        copy_rows(server->batch_input, row, r->input);
+        row += r->input->rows;
+    }
+
+    // The first rows of the batch buffers
+    Matrix input = *server->batch_input;
+    Matrix output = *server->batch_output;
+    input.rows = rows;
+    output.rows = rows;
+    predict_into(server->session, &input, &output);
+
+    row = 0;
+    for (InferenceRequest* r = first; r; r = r->next) {
+        scatter_rows(r->output, server->batch_output, row);
+        row += r->output->rows;
+    }
+}
+
+static void* server_main(void* arg) {
+    InferenceServer* server = (InferenceServer*)arg;
+
+    pthread_mutex_lock(&server->lock);
+    for (;;) {
+        while (!server->head && !server->stop) {
+            pthread_cond_wait(&server->work, &server->lock);
+        }
+        if (!server->head) break;
+
+        // Give the batch until max_wait_us after its oldest request to fill
+        struct timespec deadline = server->head->arrival;
+        add_microseconds(&deadline, server->max_wait_us);
+        while (server->queued_rows < server->max_batch && !server->stop) {
+            if (pthread_cond_timedwait(&server->work, &server->lock, &deadline) != 0) break;
+        }
+
+        // Take requests in arrival order while they fit
+        InferenceRequest* first = server->head;
+        InferenceRequest* last = first;
+        int rows = first->input->rows;
+        while (last->next && rows + last->next->input->rows <= server->max_batch) {
+            last = last->next;
+            rows += last->input->rows;
+        }
+        server->head = last->next;
+        if (!server->head) server->tail = NULL;
+        server->queued_rows -= rows;
+        last->next = NULL;
+
+        server->stats.batches++;
+        if (rows > server->stats.largest_batch) server->stats.largest_batch = rows;
+        pthread_mutex_unlock(&server->lock);
+
+        serve(server, first, rows);
+
+        pthread_mutex_lock(&server->lock);
+        for (InferenceRequest* r = first; r;) {
+            // The caller may return (and its request vanish) once done is set
+            InferenceRequest* next = r->next;
+            r->done = 1;
+            pthread_cond_signal(&r->answered);
+            r = next;
+        }
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    return NULL;
+}
+
+InferenceServer* create_inference_server(const SequentialModel* model, int max_batch,
+                                         long max_wait_us) {
+    SERVER_CHECK(model != NULL, "Model cannot be NULL");
+    SERVER_CHECK(model->input_layer != NULL, "Model has no layers");
+    SERVER_CHECK(max_batch > 0, "Maximum batch size must be positive");
+    SERVER_CHECK(max_wait_us >= 0, "Maximum wait cannot be negative");
+
+    InferenceServer* server = (InferenceServer*)calloc(1, sizeof(InferenceServer));
+    SERVER_CHECK(server != NULL, "Memory allocation failed for inference server");
+
+    server->model = model;
+    server->max_batch = max_batch;
+    server->max_wait_us = max_wait_us;
+    server->session = create_inference_session(model, max_batch);
+    server->batch_input = create_matrix(max_batch, model->input_layer->input_size);
+    server->batch_output = create_matrix(max_batch, model->output_layer->output_size);
+
+    // Deadlines are measured on the monotonic clock, like the arrivals
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&server->lock, NULL);
+    pthread_cond_init(&server->work, &attr);
+    pthread_condattr_destroy(&attr);
+
+    SERVER_CHECK(pthread_create(&server->thread, NULL, server_main, server) == 0,
+                 "Could not start the inference server thread");
+    return server;
+}
+
+void free_inference_server(InferenceServer* server) {
+    if (!server) return;
+
+    pthread_mutex_lock(&server->lock);
+    server->stop = 1;
+    pthread_cond_broadcast(&server->work);
+    pthread_mutex_unlock(&server->lock);
+    pthread_join(server->thread, NULL);
+
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->work);
+    free_inference_session(server->session);
+    free_matrix(server->batch_input);
+    free_matrix(server->batch_output);
+    free(server);
+}
+
+void server_predict(InferenceServer* server, const Matrix* input, Matrix* output) {
+    SERVER_CHECK(server != NULL, "Server cannot be NULL");
+    SERVER_CHECK(input != NULL && output != NULL, "Matrices cannot be NULL");
+    SERVER_CHECK(input->cols == server->model->input_layer->input_size,
+                 "Input dimension doesn't match the model");
+    SERVER_CHECK(output->rows == input->rows &&
+                 output->cols == server->model->output_layer->output_size,
+                 "Output dimensions don't match the model");
+
+    InferenceRequest request;
+    request.input = input;
+    request.output = output;
+    request.done = 0;
+    request.next = NULL;
+    clock_gettime(CLOCK_MONOTONIC, &request.arrival);
+    pthread_cond_init(&request.answered, NULL);
+
+    pthread_mutex_lock(&server->lock);
+    SERVER_CHECK(!server->stop, "Inference server is shutting down");
+    if (server->tail) {
+        server->tail->next = &request;
+    } else {
+        server->head = &request;
+    }
+    server->tail = &request;
+    server->queued_rows += input->rows;
+    server->stats.requests++;
+    server->stats.rows += input->rows;
+
+    // The worker only needs waking for the first request or a full batch
+    if (server->head == &request || server->queued_rows >= server->max_batch) {
+        pthread_cond_signal(&server->work);
+    }
+    while (!request.done) {
+        pthread_cond_wait(&request.answered, &server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    pthread_cond_destroy(&request.answered);
+}
+
+InferenceServerStats server_stats(InferenceServer* server) {
+    SERVER_CHECK(server != NULL, "Server cannot be NULL");
+
+    pthread_mutex_lock(&server->lock);
+    InferenceServerStats stats = server->stats;
+    pthread_mutex_unlock(&server->lock);
+    return stats;
+}
@@ -1,4 +1,7 @@
 #include "deepc/layers.h"
+#include "deepc/threadpool.h"
+#include "deepc/quantize.h"
+#include "deepc/vmath.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -23,6 +26,15 @@
     } \
 } while(0)
 
+// Element-wise work is split across the thread pool in chunks of at least
+// this many elements
+#define LAYER_PARALLEL_GRAIN 16384
+
+// Rows (or columns) per parallel chunk for a pass over n elements per index
+static int parallel_grain(int n) {
+    return n >= LAYER_PARALLEL_GRAIN ? 1 : LAYER_PARALLEL_GRAIN / n;
+}
+
 // Create a Dense layer
 Layer* Dense(int units, Activation activation, int input_dim) {
     LAYER_CHECK(units > 0, "Units must be positive");
@@ -48,9 +60,12 @@ Layer* Dense(int units, Activation activation, int input_dim) {
     layer->dbiases = create_matrix(units, 1);  // FIXED: units x 1
     
     // Initialize cache matrices
-    layer->input = NULL;
-    layer->output = NULL;
-    layer->z = NULL;
+    layer->cache.input = NULL;
+    layer->cache.z = NULL;
+    layer->cache.output = NULL;
+    layer->cache.sparse_input = NULL;
+    layer->quantized = NULL;
+    layer->sparse_gradient = NULL;
     
     // Initialize weights using Xavier initialization
     initialize_weights_xavier(layer->weights, input_dim);
@@ -70,6 +85,38 @@ Layer* Dense(int units, Activation activation, int input_dim) {
     
     return layer;
 }
+// Create a Dense layer around existing parameters (weights: units x
+// input_dim, biases: units x 1); the layer takes ownership of both and
+// skips the random initialization, as when loading a saved model
+Layer* create_dense_layer(Matrix* weights, Matrix* biases, Activation activation) {
+    LAYER_CHECK(weights != NULL && biases != NULL, "Parameters cannot be NULL");
+    LAYER_CHECK(biases->rows == weights->rows && biases->cols == 1,
+                "Biases must be a units x 1 column");
+    
+    Layer* layer = (Layer*)malloc(sizeof(Layer));
+    LAYER_CHECK(layer != NULL, "Memory allocation failed for layer");
+    
+    layer->name = strdup("dense");
+    layer->activation = activation;
+    layer->input_size = weights->cols;
+    layer->output_size = weights->rows;
+    layer->next = NULL;
+    
+    layer->weights = weights;
+    layer->biases = biases;
+    layer->dweights = create_matrix(weights->rows, weights->cols);
+    layer->dbiases = create_matrix(biases->rows, 1);
+    
+    layer->cache.input = NULL;
+    layer->cache.z = NULL;
+    layer->cache.output = NULL;
+    layer->cache.sparse_input = NULL;
+    layer->quantized = NULL;
+    layer->sparse_gradient = NULL;
+    
+    return layer;
+}
+
 // Free layer memory
 void free_layer(Layer* layer) {
     if (!layer) return;
@@ -83,16 +130,87 @@ void free_layer(Layer* layer) {
     if (layer->biases) free_matrix(layer->biases);
     if (layer->dweights) free_matrix(layer->dweights);
     if (layer->dbiases) free_matrix(layer->dbiases);
-    if (layer->input) free_matrix(layer->input);
-    if (layer->output) free_matrix(layer->output);
-    if (layer->z) free_matrix(layer->z);
+    release_layer_cache(&layer->cache);
+    free_quantized_dense(layer->quantized);
+    free_sparse_gradient_state(layer->sparse_gradient);
     
     free(layer);
 }
 
-// CORRECTED Forward pass through a single layer
-// In layers.c - REPLACE the forward_pass function with this:
-Matrix* forward_pass(Layer* layer, const Matrix* input) {
+// Header in ws describing the caller's matrix, so a cached reference is
+// never mistaken for a buffer the layer owns
+static Matrix* workspace_alias(Workspace* ws, const Matrix* m) {
+    Matrix* alias = (Matrix*)workspace_alloc(ws, sizeof(Matrix));
+    *alias = *m;
+    alias->storage = MATRIX_WORKSPACE;
+    return alias;
+}
+
+// State for the fused bias + activation GEMM epilogue
+typedef struct {
+    const Matrix* biases;
+    Matrix* output;
+    Activation activation;
+} DenseEpilogue;
+
+// Runs on each finished tile of z: add the bias in place and write the
+// activated values into the matching tile of the output. Softmax needs whole
+// rows, so here it only copies z and is normalized after the GEMM. The
+// output may be z itself.
+static void dense_epilogue(void* ctx, int row, int col, Real* c, int ldc, int rows, int cols) {
+    const DenseEpilogue* e = (const DenseEpilogue*)ctx;
+    const Real* bias = e->biases->values + (size_t)col * e->biases->stride;
+    int bias_stride = e->biases->stride;
+    
+    for (int i = 0; i < rows; i++) {
+        Real* z = c + (size_t)i * ldc;
+        Real* out = e->output->data[row + i] + col;
+        
+        for (int j = 0; j < cols; j++) {
+            z[j] += bias[(size_t)j * bias_stride];
+        }
+        
+        switch (e->activation) {
+            case RELU:
+                for (int j = 0; j < cols; j++) {
+                    out[j] = z[j] > 0 ? z[j] : 0;
+                }
+                break;
+            case SIGMOID:
+                vm_sigmoid(out, z, cols);
+                break;
+            case TANH:
+                vm_tanh(out, z, cols);
+                break;
+            case LINEAR:
+            case SOFTMAX:
+                if (out != z) memcpy(out, z, cols * sizeof(Real));
+                break;
+        }
+    }
+}
+
+// z = input * weights^T + bias, output = activation(z); output may be z
+static void dense_forward_into(const Layer* layer, const Matrix* input, Matrix* z,
+                               Matrix* output) {
+    // input: [batch_size, input_size] 
+    // weights: [output_size, input_size], used transposed without a copy
+    // z: [batch_size, output_size]
+    // Bias and activation run in the GEMM epilogue, so z is not re-read
+    DenseEpilogue state = { layer->biases, output, layer->activation };
+    GemmEpilogue epilogue = { dense_epilogue, &state };
+    gemm_ex(GEMM_NO_TRANS, GEMM_TRANS, input->rows, layer->output_size, layer->input_size,
+            1.0, input->values, input->stride, layer->weights->values, layer->weights->stride,
+            0.0, z->values, z->stride, &epilogue);
+    
+    if (layer->activation == SOFTMAX) {
+        apply_activation_into(output, output, SOFTMAX);
+    }
+}
+
+// Forward pass shared by all variants; the activations go to cache
+static Matrix* dense_forward(const Layer* layer, const Matrix* input, LayerCache* cache,
+                             Workspace* ws) {
     if (!layer || !input) {
         printf("ERROR: Layer or input is NULL in forward_pass\n");
         return NULL;
@@ -104,107 +222,410 @@ Matrix* forward_pass(Layer* layer, const Matrix* input) {
         return NULL;
     }
     
-    // Store input for backpropagation
-    if (layer->input) free_matrix(layer->input);
-    layer->input = copy_matrix(input);
-    
-    // z = input * weights^T + bias
-    // input: [batch_size, input_size] 
-    // weights: [output_size, input_size]
-    // weights^T: [input_size, output_size]
-    // z: [batch_size, output_size]
+    Matrix* z;
+    Matrix* output;
+    if (ws) {
+        // The caches alias workspace memory (and the caller's input, which
+        // must stay alive until the backward pass); nothing is copied
+        cache->input = workspace_alias(ws, input);
+        z = workspace_matrix(ws, input->rows, layer->output_size);
+        output = workspace_matrix(ws, input->rows, layer->output_size);
+    } else {
+        // Heap caches persist across calls and are only reallocated when
+        // the batch shape changes
+        cache->input = ensure_matrix(cache->input, input->rows, input->cols);
+        copy_into(cache->input, input);
+        z = ensure_matrix(cache->z, input->rows, layer->output_size);
+        output = ensure_matrix(cache->output, input->rows, layer->output_size);
+    }
+    cache->z = z;
+    cache->output = output;
+    cache->sparse_input = NULL;
+    dense_forward_into(layer, input, z, output);
+    
+    // The heap variant hands the caller a matrix of its own to free
+    return ws ? output : copy_matrix(output);
+}
+
+// Forward pass through a single layer
+Matrix* forward_pass(Layer* layer, const Matrix* input) {
+    if (!layer) {
+        printf("ERROR: Layer or input is NULL in forward_pass\n");
+        return NULL;
+    }
+    return dense_forward(layer, input, &layer->cache, NULL);
+}
+
+// Forward pass with every temporary, the result and the caches in ws
+Matrix* forward_pass_ws(Layer* layer, const Matrix* input, Workspace* ws) {
+    LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
+    LAYER_CHECK(ws != NULL, "Workspace cannot be NULL");
+    return dense_forward(layer, input, &layer->cache, ws);
+}
+
+// Forward pass that leaves the layer untouched, caching into cache instead
+Matrix* forward_pass_with_cache(const Layer* layer, const Matrix* input, LayerCache* cache,
+                                Workspace* ws) {
+    LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
+    LAYER_CHECK(cache != NULL, "Layer cache cannot be NULL");
+    return dense_forward(layer, input, cache, ws);
+}
+
+// Forward pass into the plan's buffers, the activation computed in place
+Matrix* forward_pass_planned(Layer* layer, const Matrix* input, const LayerPlan* plan) {
+    LAYER_CHECK(layer != NULL && plan != NULL, "Arguments cannot be NULL");
     
-    Matrix* weights_transpose = transpose(layer->weights);
-    if (!weights_transpose) {
-        printf("ERROR: Failed to transpose weights\n");
+    if (!input || input->cols != layer->input_size) {
+        printf("ERROR: Input dimension mismatch in forward_pass\n");
         return NULL;
     }
+    LAYER_CHECK(plan->output->rows == input->rows && plan->output->cols == layer->output_size,
+                "Planned output dimensions don't match the layer");
     
-    Matrix* z = dot(input, weights_transpose);
-    free_matrix(weights_transpose);
+    // The cache must not own the caller's batch, so it gets the plan's header
+    if (plan->input) {
+        *plan->input = *input;
+        plan->input->storage = MATRIX_WORKSPACE;
+        layer->cache.input = plan->input;
+    } else {
+        layer->cache.input = (Matrix*)input;
+    }
+    layer->cache.z = plan->output;
+    layer->cache.output = plan->output;
+    layer->cache.sparse_input = NULL;
     
-    if (!z) {
-        printf("ERROR: Dot product failed in forward_pass\n");
-        return NULL;
+    dense_forward_into(layer, input, plan->output, plan->output);
+    return plan->output;
+}
+
+// Inference-only forward pass: output = activation(input * weights^T + bias)
+// computed in place in the caller's output, with nothing cached and the
+// layer only read. Safe to call concurrently on the same layer.
+void forward_pass_into(const Layer* layer, const Matrix* input, Matrix* output) {
+    LAYER_CHECK(layer != NULL && input != NULL && output != NULL, "Arguments cannot be NULL");
+    LAYER_CHECK(input->cols == layer->input_size, "Input dimension mismatch in forward_pass_into");
+    LAYER_CHECK(output->rows == input->rows && output->cols == layer->output_size,
+                "Output dimensions don't match the layer");
+    
+    if (layer->quantized) {
+        quantized_dense_forward(layer->quantized, layer->biases, input, output);
+        if (layer->activation != LINEAR) {
+            apply_activation_into(output, output, layer->activation);
+        }
+        return;
     }
     
-    // Add bias (broadcast to each sample in batch)
-    for (int i = 0; i < z->rows; i++) {
-        for (int j = 0; j < z->cols; j++) {
-            z->data[i][j] += layer->biases->data[j][0];
+    DenseEpilogue state = { layer->biases, output, layer->activation };
+    GemmEpilogue epilogue = { dense_epilogue, &state };
+    gemm_ex(GEMM_NO_TRANS, GEMM_TRANS, input->rows, layer->output_size, layer->input_size,
+            1.0, input->values, input->stride, layer->weights->values, layer->weights->stride,
+            0.0, output->values, output->stride, &epilogue);
+    
+    if (layer->activation == SOFTMAX) {
+        apply_activation_into(output, output, SOFTMAX);
+    }
+}
+
+// One pass over the batch computing delta = gradient * f'(z) and the
+// column sums of delta, times scale, into dbiases. The derivative is taken from the
+// cached activations (sigmoid' = s(1-s), tanh' = 1-t^2, relu' = [out > 0]),
+// which avoids re-evaluating exp/tanh on z. Softmax couples each row:
+// delta_j = s_j * (g_j - sum_k g_k s_k), with the sums precomputed per row.
+// Without a delta matrix the gradient is dL/dz already and only the bias
+// sums are taken.
+typedef struct {
+    Matrix* delta;
+    const Matrix* gradient;
+    const Matrix* output;
+    Activation activation;
+    Matrix* dbiases;
+    double scale;
+    const Matrix* row_dots;     // softmax only: sum_k g_k s_k per row
+} DenseDelta;
+
+// Threads own disjoint column ranges, so every bias sum is accumulated in
+// the same order whatever the thread count
+static void dense_delta_task(void* ctx, int begin, int end) {
+    const DenseDelta* t = (const DenseDelta*)ctx;
+    int cols = end - begin;
+    Real* bias_grad = t->dbiases->values;
+    int bias_stride = t->dbiases->stride;
+    
+    for (int j = begin; j < end; j++) {
+        bias_grad[(size_t)j * bias_stride] = 0.0;
+    }
+    
+    for (int i = 0; i < t->gradient->rows; i++) {
+        const Real* g = t->gradient->data[i] + begin;
+        const Real* out = t->output->data[i] + begin;
+        
+        if (!t->delta) {
+            for (int j = 0; j < cols; j++) {
+                bias_grad[(size_t)(begin + j) * bias_stride] += g[j];
+            }
+            continue;
+        }
+        
+        Real* d = t->delta->data[i] + begin;
+        switch (t->activation) {
+            case SIGMOID:
+                for (int j = 0; j < cols; j++) {
+                    d[j] = g[j] * out[j] * (1 - out[j]);
+                }
+                break;
+            case RELU:
+                for (int j = 0; j < cols; j++) {
+                    d[j] = out[j] > 0 ? g[j] : 0.0;
+                }
+                break;
+            case TANH:
+                for (int j = 0; j < cols; j++) {
+                    d[j] = g[j] * (1 - out[j] * out[j]);
+                }
+                break;
+            case SOFTMAX: {
+                Real dot = t->row_dots->data[i][0];
+                for (int j = 0; j < cols; j++) {
+                    d[j] = out[j] * (g[j] - dot);
+                }
+                break;
+            }
+            case LINEAR:
+                if (d != g) memcpy(d, g, cols * sizeof(Real));
+                break;
+        }
+        
+        for (int j = 0; j < cols; j++) {
+            bias_grad[(size_t)(begin + j) * bias_stride] += d[j];
         }
     }
     
-    // Store z for backpropagation
-    if (layer->z) free_matrix(layer->z);
-    layer->z = copy_matrix(z);
+    for (int j = begin; j < end; j++) {
+        bias_grad[(size_t)j * bias_stride] *= t->scale;
+    }
+}
+
+// row_dots may be NULL, the softmax sums then go to ws
+static void dense_delta(Matrix* delta, const Matrix* gradient, const Matrix* output,
+                        Activation activation, Matrix* dbiases, double scale,
+                        Matrix* row_dots, Workspace* ws) {
+    DenseDelta task = { delta, gradient, output, activation, dbiases, scale, NULL };
+    
+    Matrix* owned_dots = NULL;
+    if (delta && activation == SOFTMAX) {
+        if (!row_dots) {
+            owned_dots = workspace_matrix(ws, gradient->rows, 1);
+            row_dots = owned_dots;
+        }
+        for (int i = 0; i < gradient->rows; i++) {
+            const Real* g = gradient->data[i];
+            const Real* s = output->data[i];
+            double dot = 0.0;
+            for (int j = 0; j < gradient->cols; j++) {
+                dot += g[j] * s[j];
+            }
+            row_dots->data[i][0] = (Real)dot;
+        }
+        task.row_dots = row_dots;
+    }
     
-    // Apply activation function
-    Matrix* output = apply_activation(z, layer->activation);
-    free_matrix(z);
+    parallel_for(gradient->cols, parallel_grain(gradient->rows), dense_delta_task, &task);
+    free_matrix(owned_dots);
+}
+
+// Backward pass shared by all variants: reads the activations from cache and
+// writes grad_scale * dL/dW and grad_scale * dL/db summed over the batch.
+// delta receives dL/dz (it may be gradient itself); with delta NULL the
+// gradient is dL/dz already. dL/dinput goes to prev_gradient unless that is
+// NULL. row_dots may be NULL (softmax scratch then comes from ws).
+static void dense_backward_into(const Layer* layer, const Matrix* gradient, const LayerCache* cache,
+                                Matrix* dweights, Matrix* dbiases, double grad_scale,
+                                Matrix* delta_out, Matrix* prev_gradient, Matrix* row_dots,
+                                Workspace* ws) {
+    LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
+    LAYER_CHECK(gradient != NULL, "Gradient cannot be NULL");
+    LAYER_CHECK(cache->output != NULL, "Layer cache is empty - run forward pass first");
+    LAYER_CHECK(cache->input != NULL, "Layer input cache is empty");
+    LAYER_CHECK(gradient->rows == cache->output->rows && gradient->cols == cache->output->cols,
+                "Gradient dimensions don't match the cached output");
+    LAYER_CHECK(dweights->rows == layer->weights->rows && dweights->cols == layer->weights->cols,
+                "Weight gradient dimensions don't match the weights");
+    LAYER_CHECK(dbiases->rows == layer->biases->rows, "Bias gradient dimensions don't match the biases");
     
-    if (!output) {
-        printf("ERROR: Activation function failed\n");
-        return NULL;
+    // gradient: dL/doutput [batch_size, output_size]
+    
+    // 1-2. delta = dL/dz = dL/doutput * doutput/dz [batch_size, output_size],
+    // fused with the bias gradient dL/db = sum(delta, axis=0) * grad_scale
+    const Matrix* delta = delta_out ? delta_out : gradient;
+    dense_delta(delta_out, gradient, cache->output, layer->activation, dbiases, grad_scale,
+                row_dots, ws);
+    
+    // 3. Compute weight gradients: dL/dW = delta^T * input * grad_scale
+    gemm(GEMM_TRANS, GEMM_NO_TRANS,
+         dweights->rows, dweights->cols, delta->rows, grad_scale,
+         delta->values, delta->stride, cache->input->values, cache->input->stride,
+         0.0, dweights->values, dweights->stride);
+    if (dweights == layer->dweights) sparse_gradient_invalidate(layer->sparse_gradient);
+    
+    // 4. Compute gradient for previous layer: dL/dinput = delta * weights
+    if (prev_gradient) {
+        gemm(GEMM_NO_TRANS, GEMM_NO_TRANS, delta->rows, layer->input_size, layer->output_size,
+             1.0, delta->values, delta->stride, layer->weights->values, layer->weights->stride,
+             0.0, prev_gradient->values, prev_gradient->stride);
     }
+}
+
+// With from_logits the gradient is taken with respect to z, not the output
+static Matrix* dense_backward(const Layer* layer, const Matrix* gradient, const LayerCache* cache,
+                              Matrix* dweights, Matrix* dbiases, double grad_scale,
+                              int from_logits, Workspace* ws) {
+    LAYER_CHECK(gradient != NULL, "Gradient cannot be NULL");
     
-    // Store output
-    if (layer->output) free_matrix(layer->output);
-    layer->output = copy_matrix(output);
+    Matrix* delta = from_logits ? NULL : workspace_matrix(ws, gradient->rows, gradient->cols);
+    Matrix* prev_gradient = workspace_matrix(ws, gradient->rows, layer->input_size);
+    dense_backward_into(layer, gradient, cache, dweights, dbiases, grad_scale,
+                        delta, prev_gradient, NULL, ws);
     
-    return output;
+    // Cleanup (no-op for workspace matrices)
+    free_matrix(delta);
+    
+    return prev_gradient;
 }
 
-// Backward pass through a single layer
+// Backward pass through a single layer (gradients averaged over the batch)
 Matrix* backward_pass(Layer* layer, const Matrix* gradient) {
     LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
     LAYER_CHECK(gradient != NULL, "Gradient cannot be NULL");
-    LAYER_CHECK(layer->z != NULL, "Layer cache is empty - run forward pass first");
-    LAYER_CHECK(layer->input != NULL, "Layer input cache is empty");
-    
-    // gradient: dL/doutput [batch_size, output_size]
+    return dense_backward(layer, gradient, &layer->cache, layer->dweights, layer->dbiases,
+                          1.0 / gradient->rows, 0, NULL);
+}
+
+// Backward pass with every temporary and the result in ws
+Matrix* backward_pass_ws(Layer* layer, const Matrix* gradient, Workspace* ws) {
+    LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
+    LAYER_CHECK(gradient != NULL, "Gradient cannot be NULL");
+    LAYER_CHECK(ws != NULL, "Workspace cannot be NULL");
+    return dense_backward(layer, gradient, &layer->cache, layer->dweights, layer->dbiases,
+                          1.0 / gradient->rows, 0, ws);
+}
+
+Matrix* backward_pass_from_logits_ws(Layer* layer, const Matrix* delta, Workspace* ws) {
+    LAYER_CHECK(layer != NULL, "Layer cannot be NULL");
+    LAYER_CHECK(delta != NULL, "Delta cannot be NULL");
+    LAYER_CHECK(ws != NULL, "Workspace cannot be NULL");
+    return dense_backward(layer, delta, &layer->cache, layer->dweights, layer->dbiases,
+                          1.0 / delta->rows, 1, ws);
+}
+
+// Backward pass against the plan's buffers: gradient is overwritten with
+// dL/dz, and the result is the plan's prev_gradient (NULL for the first layer)
+Matrix* backward_pass_planned(Layer* layer, Matrix* gradient, int from_logits,
+                              const LayerPlan* plan) {
+    LAYER_CHECK(layer != NULL && gradient != NULL && plan != NULL, "Arguments cannot be NULL");
+    LAYER_CHECK(!plan->prev_gradient || plan->prev_gradient->rows == gradient->rows,
+                "Planned gradient rows don't match the batch");
+    
+    dense_backward_into(layer, gradient, &layer->cache, layer->dweights, layer->dbiases,
+                        1.0 / gradient->rows, from_logits ? NULL : gradient,
+                        plan->prev_gradient, plan->row_dots, NULL);
+    return plan->prev_gradient;
+}
+
+// Forward pass over a sparse batch, z = input * weights^T computed from the
+// nonzeros; bias and activation run over z through the GEMM epilogue
+static void sparse_forward_into(const Layer* layer, const SparseMatrix* input, Matrix* z,
+                                Matrix* output) {
+    sparse_dense_gemm_nt(z, input, layer->weights);
     
-    // 1. Compute activation derivative: doutput/dz
-    Matrix* activation_deriv = apply_activation_derivative(layer->z, layer->activation);
+    DenseEpilogue state = { layer->biases, output, layer->activation };
+    dense_epilogue(&state, 0, 0, z->values, z->stride, z->rows, z->cols);
     
-    // 2. Compute delta: dL/dz = dL/doutput * doutput/dz [batch_size, output_size]
-    Matrix* delta = create_matrix(gradient->rows, gradient->cols);
-    for (int i = 0; i < gradient->rows; i++) {
-        for (int j = 0; j < gradient->cols; j++) {
-            delta->data[i][j] = gradient->data[i][j] * activation_deriv->data[i][j];
-        }
+    if (layer->activation == SOFTMAX) {
+        apply_activation_into(output, output, SOFTMAX);
     }
+}
+
+Matrix* forward_pass_sparse(Layer* layer, const SparseMatrix* input, Workspace* ws) {
+    LAYER_CHECK(layer != NULL && input != NULL, "Arguments cannot be NULL");
+    LAYER_CHECK(ws != NULL, "Workspace cannot be NULL");
     
-    // 3. Compute weight gradients: dL/dW = delta^T * input / batch_size
-    Matrix* input_transpose = transpose(layer->input);
-    for (int i = 0; i < layer->dweights->rows; i++) {
-        for (int j = 0; j < layer->dweights->cols; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < delta->rows; k++) {
-                sum += delta->data[k][i] * input_transpose->data[j][k];
-            }
-            layer->dweights->data[i][j] = sum / delta->rows;
-        }
+    if (input->cols != layer->input_size) {
+        printf("ERROR: Input dimension mismatch in forward_pass: ");
+        printf("expected %d, got %d\n", layer->input_size, input->cols);
+        return NULL;
     }
-    free_matrix(input_transpose);
     
-    // 4. Compute bias gradients: dL/db = mean(delta, axis=0)
-    for (int i = 0; i < layer->dbiases->rows; i++) {
-        double sum = 0.0;
-        for (int k = 0; k < delta->rows; k++) {
-            sum += delta->data[k][i];
-        }
-        layer->dbiases->data[i][0] = sum / delta->rows;
-    }
+    // The activation is computed in place, as nothing reads z afterwards
+    Matrix* output = workspace_matrix(ws, input->rows, layer->output_size);
+    layer->cache.input = NULL;
+    layer->cache.sparse_input = input;
+    layer->cache.z = output;
+    layer->cache.output = output;
     
-    // 5. Compute gradient for previous layer: dL/dinput = delta * weights
-    Matrix* prev_gradient = dot(delta, layer->weights);
+    sparse_forward_into(layer, input, output, output);
+    return output;
+}
+
+void forward_pass_sparse_into(const Layer* layer, const SparseMatrix* input, Matrix* output) {
+    LAYER_CHECK(layer != NULL && input != NULL && output != NULL, "Arguments cannot be NULL");
+    LAYER_CHECK(input->cols == layer->input_size, "Input dimension mismatch in forward_pass_sparse_into");
+    LAYER_CHECK(output->rows == input->rows && output->cols == layer->output_size,
+                "Output dimensions don't match the layer");
     
-    // Cleanup
-    free_matrix(activation_deriv);
+    sparse_forward_into(layer, input, output, output);
+}
+
+// dL/db as usual; dL/dW only at the columns the batch uses
+void backward_pass_sparse(Layer* layer, const Matrix* gradient, int from_logits, Workspace* ws) {
+    LAYER_CHECK(layer != NULL && gradient != NULL, "Arguments cannot be NULL");
+    LAYER_CHECK(layer->cache.sparse_input != NULL, "Sparse input cache is empty - run forward_pass_sparse first");
+    LAYER_CHECK(gradient->rows == layer->cache.output->rows && gradient->cols == layer->cache.output->cols,
+                "Gradient dimensions don't match the cached output");
+    
+    double grad_scale = 1.0 / gradient->rows;
+    Matrix* delta = from_logits ? NULL : workspace_matrix(ws, gradient->rows, gradient->cols);
+    dense_delta(delta, gradient, layer->cache.output, layer->activation, layer->dbiases,
+                grad_scale, NULL, ws);
+    
+    sparse_weight_gradient(layer->dweights, delta ? delta : gradient, layer->cache.sparse_input,
+                           grad_scale, &layer->sparse_gradient);
     free_matrix(delta);
-    
-    return prev_gradient;
+}
+
+// Backward pass that leaves the layer untouched: reads cache and writes the
+// scaled gradients into dweights/dbiases (shaped like weights/biases)
+Matrix* backward_pass_with_cache(const Layer* layer, const Matrix* gradient,
+                                 const LayerCache* cache, Matrix* dweights, Matrix* dbiases,
+                                 double grad_scale, Workspace* ws) {
+    LAYER_CHECK(cache != NULL, "Layer cache cannot be NULL");
+    LAYER_CHECK(dweights != NULL && dbiases != NULL, "Gradient matrices cannot be NULL");
+    return dense_backward(layer, gradient, cache, dweights, dbiases, grad_scale, 0, ws);
+}
+
+Matrix* backward_pass_from_logits_with_cache(const Layer* layer, const Matrix* delta,
+                                             const LayerCache* cache, Matrix* dweights,
+                                             Matrix* dbiases, double grad_scale, Workspace* ws) {
+    LAYER_CHECK(cache != NULL, "Layer cache cannot be NULL");
+    LAYER_CHECK(dweights != NULL && dbiases != NULL, "Gradient matrices cannot be NULL");
+    return dense_backward(layer, delta, cache, dweights, dbiases, grad_scale, 1, ws);
+}
+
+// Drop cached activations; workspace-backed caches are simply forgotten
+void release_layer_cache(LayerCache* cache) {
+    if (!cache) return;
+    
+    free_matrix(cache->input);
+    free_matrix(cache->z);
+    free_matrix(cache->output);
+    cache->input = NULL;
+    cache->z = NULL;
+    cache->output = NULL;
+    cache->sparse_input = NULL;
+}
+
+void clear_layer_cache(Layer* layer) {
+    if (!layer) return;
+    release_layer_cache(&layer->cache);
 }
 
 // Apply activation function to matrix
@@ -214,9 +635,36 @@ Matrix* apply_activation(const Matrix* input, Activation activation) {
     Matrix* output = create_matrix(input->rows, input->cols);
     LAYER_CHECK(output != NULL, "Failed to create activation output matrix");
     
-    switch (activation) {
+    apply_activation_into(output, input, activation);
+    return output;
+}
+
+// Apply activation derivative
+Matrix* apply_activation_derivative(const Matrix* input, Activation activation) {
+    LAYER_CHECK(input != NULL, "Input matrix cannot be NULL");
+    
+    Matrix* derivative = create_matrix(input->rows, input->cols);
+    LAYER_CHECK(derivative != NULL, "Failed to create activation derivative matrix");
+    
+    apply_activation_derivative_into(derivative, input, activation);
+    return derivative;
+}
+
+// Rows of input mapped into the matching rows of output
+typedef struct {
+    Matrix* output;
+    const Matrix* input;
+    Activation activation;
+} ActivationTask;
+
+static void activation_task(void* ctx, int begin, int end) {
+    const ActivationTask* t = (const ActivationTask*)ctx;
+    Matrix* output = t->output;
+    const Matrix* input = t->input;
+    
+    switch (t->activation) {
         case LINEAR:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
                 for (int j = 0; j < input->cols; j++) {
                     output->data[i][j] = input->data[i][j];
                 }
@@ -224,15 +672,13 @@ Matrix* apply_activation(const Matrix* input, Activation activation) {
             break;
             
         case SIGMOID:
-            for (int i = 0; i < input->rows; i++) {
-                for (int j = 0; j < input->cols; j++) {
-                    output->data[i][j] = 1.0 / (1.0 + exp(-input->data[i][j]));
-                }
+            for (int i = begin; i < end; i++) {
+                vm_sigmoid(output->data[i], input->data[i], input->cols);
             }
             break;
             
         case RELU:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
                 for (int j = 0; j < input->cols; j++) {
                     output->data[i][j] = input->data[i][j] > 0 ? input->data[i][j] : 0;
                 }
@@ -240,52 +686,28 @@ Matrix* apply_activation(const Matrix* input, Activation activation) {
             break;
             
         case TANH:
-            for (int i = 0; i < input->rows; i++) {
-                for (int j = 0; j < input->cols; j++) {
-                    output->data[i][j] = tanh(input->data[i][j]);
-                }
+            for (int i = begin; i < end; i++) {
+                vm_tanh(output->data[i], input->data[i], input->cols);
             }
             break;
             
         case SOFTMAX:
-            for (int i = 0; i < input->rows; i++) {
-                double max_val = -INFINITY;
-                double sum = 0.0;
-                
-                // Find max for numerical stability
-                for (int j = 0; j < input->cols; j++) {
-                    if (input->data[i][j] > max_val) {
-                        max_val = input->data[i][j];
-                    }
-                }
-                
-                // Calculate exponentials and sum
-                for (int j = 0; j < input->cols; j++) {
-                    output->data[i][j] = exp(input->data[i][j] - max_val);
-                    sum += output->data[i][j];
-                }
-                
-                // Normalize
-                for (int j = 0; j < input->cols; j++) {
-                    output->data[i][j] /= sum;
-                }
+            // Shifted by the row maximum for numerical stability
+            for (int i = begin; i < end; i++) {
+                vm_softmax(output->data[i], input->data[i], input->cols);
             }
             break;
     }
-    
-    return output;
 }
 
-// Apply activation derivative
-Matrix* apply_activation_derivative(const Matrix* input, Activation activation) {
-    LAYER_CHECK(input != NULL, "Input matrix cannot be NULL");
-    
-    Matrix* derivative = create_matrix(input->rows, input->cols);
-    LAYER_CHECK(derivative != NULL, "Failed to create activation derivative matrix");
+static void activation_derivative_task(void* ctx, int begin, int end) {
+    const ActivationTask* t = (const ActivationTask*)ctx;
+    Matrix* derivative = t->output;
+    const Matrix* input = t->input;
     
-    switch (activation) {
+    switch (t->activation) {
         case LINEAR:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
                 for (int j = 0; j < input->cols; j++) {
                     derivative->data[i][j] = 1.0;
                 }
@@ -293,16 +715,17 @@ Matrix* apply_activation_derivative(const Matrix* input, Activation activation)
             break;
             
         case SIGMOID:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
+                Real* d = derivative->data[i];
+                vm_sigmoid(d, input->data[i], input->cols);
                 for (int j = 0; j < input->cols; j++) {
-                    double sig = 1.0 / (1.0 + exp(-input->data[i][j]));
-                    derivative->data[i][j] = sig * (1 - sig);
+                    d[j] = d[j] * (1 - d[j]);
                 }
             }
             break;
             
         case RELU:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
                 for (int j = 0; j < input->cols; j++) {
                     derivative->data[i][j] = input->data[i][j] > 0 ? 1.0 : 0.0;
                 }
@@ -310,26 +733,42 @@ Matrix* apply_activation_derivative(const Matrix* input, Activation activation)
             break;
             
         case TANH:
-            for (int i = 0; i < input->rows; i++) {
+            for (int i = begin; i < end; i++) {
+                Real* d = derivative->data[i];
+                vm_tanh(d, input->data[i], input->cols);
                 for (int j = 0; j < input->cols; j++) {
-                    double tanh_val = tanh(input->data[i][j]);
-                    derivative->data[i][j] = 1 - tanh_val * tanh_val;
+                    d[j] = 1 - d[j] * d[j];
                 }
             }
             break;
             
         case SOFTMAX:
-            // For softmax, we assume the derivative is handled in the loss function
-            // This is typically used with categorical crossentropy
-            for (int i = 0; i < input->rows; i++) {
-                for (int j = 0; j < input->cols; j++) {
-                    derivative->data[i][j] = 1.0;
-                }
-            }
+            // Rejected by apply_activation_derivative_into
             break;
     }
-    
-    return derivative;
+}
+
+// Apply activation function into output (which may be input itself)
+void apply_activation_into(Matrix* output, const Matrix* input, Activation activation) {
+    LAYER_CHECK(input != NULL && output != NULL, "Matrices cannot be NULL");
+    LAYER_CHECK(output->rows == input->rows && output->cols == input->cols,
+                "Activation output dimensions don't match input");
+    
+    ActivationTask task = { output, input, activation };
+    parallel_for(input->rows, parallel_grain(input->cols), activation_task, &task);
+}
+
+// Apply activation derivative into derivative (which may be input itself)
+void apply_activation_derivative_into(Matrix* derivative, const Matrix* input, Activation activation) {
+    LAYER_CHECK(input != NULL && derivative != NULL, "Matrices cannot be NULL");
+    LAYER_CHECK(derivative->rows == input->rows && derivative->cols == input->cols,
+                "Activation derivative dimensions don't match input");
+    // Each softmax output depends on the whole row: backward_pass applies
+    // its Jacobian, there is no element-wise derivative to return
+    LAYER_CHECK(activation != SOFTMAX, "Softmax has no element-wise derivative");
+    
+    ActivationTask task = { derivative, input, activation };
+    parallel_for(input->rows, parallel_grain(input->cols), activation_derivative_task, &task);
 }
 
 // Initialize weights using Xavier initialization
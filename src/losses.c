@@ -1,4 +1,5 @@
 #include "deepc/losses.h"
+#include "deepc/vmath.h"
 
 // Error handling
 #define LOSS_ERROR(msg) do { \
@@ -16,7 +17,57 @@
     } \
 } while(0)
 
+// Predictions are clipped to [epsilon, 1 - epsilon] before taking logs
+#define LOSS_EPSILON 1e-7
 
+// Elements per vectorized log call in the cross-entropy losses
+#define LOSS_LOG_CHUNK 256
+
+// Sum over all elements of y_true * log(p) (and (1 - y_true) * log(1 - p)
+// when binary) with p the clipped prediction. The logs are taken a chunk
+// of a row at a time through vm_log. With delta given, the same pass also
+// writes delta = (y_pred - y_true) * delta_scale and reports NaNs.
+static double cross_entropy_sum(const Matrix* y_true, const Matrix* y_pred, int binary,
+                                Matrix* delta, double delta_scale, int* has_nan) {
+    Real p[2 * LOSS_LOG_CHUNK];
+    Real log_p[2 * LOSS_LOG_CHUNK];
+    double sum = 0.0;
+    
+    for (int i = 0; i < y_true->rows; i++) {
+        const Real* t = y_true->data[i];
+        const Real* pred = y_pred->data[i];
+        
+        if (delta) {
+            Real* d = delta->data[i];
+            for (int j = 0; j < y_true->cols; j++) {
+                if (isnan(pred[j]) || isnan(t[j])) *has_nan = 1;
+                d[j] = (Real)((pred[j] - t[j]) * delta_scale);
+            }
+        }
+        
+        for (int start = 0; start < y_true->cols; start += LOSS_LOG_CHUNK) {
+            int n = y_true->cols - start < LOSS_LOG_CHUNK ? y_true->cols - start : LOSS_LOG_CHUNK;
+            
+            // Clipped in double: 1 - epsilon is not representable in float
+            for (int j = 0; j < n; j++) {
+                double y_p = pred[start + j];
+                if (y_p < LOSS_EPSILON) y_p = LOSS_EPSILON;
+                if (y_p > 1 - LOSS_EPSILON) y_p = 1 - LOSS_EPSILON;
+                p[j] = (Real)y_p;
+                p[n + j] = (Real)(1 - y_p);
+            }
+            vm_log(log_p, p, binary ? 2 * n : n);
+            
+            for (int j = 0; j < n; j++) {
+                double y_t = t[start + j];
+                sum += y_t * log_p[j];
+                if (binary) sum += (1 - y_t) * log_p[n + j];
+            }
+        }
+    }
+    
+    return sum;
+}
 
 // Compute loss based on the specified loss function
 double compute_loss(const Matrix* y_true, const Matrix* y_pred, LossFunction loss_func) {
@@ -41,27 +92,46 @@ double compute_loss(const Matrix* y_true, const Matrix* y_pred, LossFunction los
     return 0.0;
 }
 
+static void mse_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred);
+static void binary_crossentropy_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred);
+static void categorical_crossentropy_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred);
+
 // Compute loss gradient based on the specified loss function
 Matrix* compute_loss_gradient(const Matrix* y_true, const Matrix* y_pred, LossFunction loss_func) {
     LOSS_CHECK(y_true != NULL, "True labels cannot be NULL");
     LOSS_CHECK(y_pred != NULL, "Predictions cannot be NULL");
+    
+    Matrix* gradient = create_matrix(y_true->rows, y_true->cols);
+    compute_loss_gradient_into(gradient, y_true, y_pred, loss_func);
+    return gradient;
+}
+
+// Compute loss gradient into a caller-provided matrix of the same shape
+void compute_loss_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred,
+                                LossFunction loss_func) {
+    LOSS_CHECK(gradient != NULL, "Gradient matrix cannot be NULL");
+    LOSS_CHECK(y_true != NULL, "True labels cannot be NULL");
+    LOSS_CHECK(y_pred != NULL, "Predictions cannot be NULL");
     LOSS_CHECK(y_true->rows == y_pred->rows && y_true->cols == y_pred->cols, 
                "True labels and predictions must have same dimensions");
+    LOSS_CHECK(gradient->rows == y_true->rows && gradient->cols == y_true->cols,
+               "Gradient matrix must match the labels' dimensions");
     LOSS_CHECK(!matrix_has_nan(y_true), "NaN detected in true labels");
     LOSS_CHECK(!matrix_has_nan(y_pred), "NaN detected in predictions");
     
     switch (loss_func) {
         case MEAN_SQUARED_ERROR:
-            return mse_gradient(y_true, y_pred);
+            mse_gradient_into(gradient, y_true, y_pred);
+            break;
         case BINARY_CROSSENTROPY:
-            return binary_crossentropy_gradient(y_true, y_pred);
+            binary_crossentropy_gradient_into(gradient, y_true, y_pred);
+            break;
         case CATEGORICAL_CROSSENTROPY:
-            return categorical_crossentropy_gradient(y_true, y_pred);
+            categorical_crossentropy_gradient_into(gradient, y_true, y_pred);
+            break;
         default:
             LOSS_ERROR("Unknown loss function");
     }
-    
-    return NULL;
 }
 
 // Mean Squared Error loss
@@ -82,6 +152,11 @@ double mse_loss(const Matrix* y_true, const Matrix* y_pred) {
 // MSE gradient
 Matrix* mse_gradient(const Matrix* y_true, const Matrix* y_pred) {
     Matrix* gradient = create_matrix(y_true->rows, y_true->cols);
+    mse_gradient_into(gradient, y_true, y_pred);
+    return gradient;
+}
+
+static void mse_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred) {
     int total_elements = y_true->rows * y_true->cols;
     
     for (int i = 0; i < y_true->rows; i++) {
@@ -89,35 +164,22 @@ Matrix* mse_gradient(const Matrix* y_true, const Matrix* y_pred) {
             gradient->data[i][j] = 2.0 * (y_pred->data[i][j] - y_true->data[i][j]) / total_elements;
         }
     }
-    
-    return gradient;
 }
 
 // Binary Cross Entropy loss
 double binary_crossentropy_loss(const Matrix* y_true, const Matrix* y_pred) {
-    double sum = 0.0;
     int total_elements = y_true->rows * y_true->cols;
-    double epsilon = 1e-7;  // To avoid log(0)
-    
-    for (int i = 0; i < y_true->rows; i++) {
-        for (int j = 0; j < y_true->cols; j++) {
-            double y_t = y_true->data[i][j];
-            double y_p = y_pred->data[i][j];
-            
-            // Clip predictions to avoid log(0)
-            if (y_p < epsilon) y_p = epsilon;
-            if (y_p > 1 - epsilon) y_p = 1 - epsilon;
-            
-            sum += y_t * log(y_p) + (1 - y_t) * log(1 - y_p);
-        }
-    }
-    
-    return -sum / total_elements;
+    return -cross_entropy_sum(y_true, y_pred, 1, NULL, 0.0, NULL) / total_elements;
 }
 
 // Binary Cross Entropy gradient
 Matrix* binary_crossentropy_gradient(const Matrix* y_true, const Matrix* y_pred) {
     Matrix* gradient = create_matrix(y_true->rows, y_true->cols);
+    binary_crossentropy_gradient_into(gradient, y_true, y_pred);
+    return gradient;
+}
+
+static void binary_crossentropy_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred) {
     int total_elements = y_true->rows * y_true->cols;
     double epsilon = 1e-7;  // To avoid division by zero
     
@@ -133,35 +195,24 @@ Matrix* binary_crossentropy_gradient(const Matrix* y_true, const Matrix* y_pred)
             gradient->data[i][j] = (y_p - y_t) / (y_p * (1 - y_p)) / total_elements;
         }
     }
-    
-    return gradient;
 }
 
 // Categorical Cross Entropy loss
 double categorical_crossentropy_loss(const Matrix* y_true, const Matrix* y_pred) {
-    double sum = 0.0;
     int total_samples = y_true->rows;
-    double epsilon = 1e-7;  // To avoid log(0)
-    
-    for (int i = 0; i < y_true->rows; i++) {
-        for (int j = 0; j < y_true->cols; j++) {
-            double y_t = y_true->data[i][j];
-            double y_p = y_pred->data[i][j];
-            
-            // Clip predictions to avoid log(0)
-            if (y_p < epsilon) y_p = epsilon;
-            if (y_p > 1 - epsilon) y_p = 1 - epsilon;
-            
-            sum += y_t * log(y_p);
-        }
-    }
-    
-    return -sum / total_samples;
+    return -cross_entropy_sum(y_true, y_pred, 0, NULL, 0.0, NULL) / total_samples;
 }
 
 // Categorical Cross Entropy gradient
 Matrix* categorical_crossentropy_gradient(const Matrix* y_true, const Matrix* y_pred) {
     Matrix* gradient = create_matrix(y_true->rows, y_true->cols);
+    categorical_crossentropy_gradient_into(gradient, y_true, y_pred);
+    return gradient;
+}
+
+// dL/dp = -y / p; chained through the softmax Jacobian this becomes
+// (p - y) / n, which training computes directly (see loss_is_fused)
+static void categorical_crossentropy_gradient_into(Matrix* gradient, const Matrix* y_true, const Matrix* y_pred) {
     int total_samples = y_true->rows;
     double epsilon = 1e-7;  // To avoid division by zero
     
@@ -174,9 +225,34 @@ Matrix* categorical_crossentropy_gradient(const Matrix* y_true, const Matrix* y_
             if (y_p < epsilon) y_p = epsilon;
             if (y_p > 1 - epsilon) y_p = 1 - epsilon;
             
-            gradient->data[i][j] = (y_p - y_t) / total_samples;
+            gradient->data[i][j] = -y_t / y_p / total_samples;
         }
     }
+}
+
+int loss_is_fused(LossFunction loss_func, Activation output_activation) {
+    return (loss_func == CATEGORICAL_CROSSENTROPY && output_activation == SOFTMAX) ||
+           (loss_func == BINARY_CROSSENTROPY && output_activation == SIGMOID);
+}
+
+double compute_fused_loss_gradient_into(Matrix* delta, const Matrix* y_true, const Matrix* y_pred,
+                                        LossFunction loss_func) {
+    LOSS_CHECK(delta != NULL, "Delta matrix cannot be NULL");
+    LOSS_CHECK(y_true != NULL, "True labels cannot be NULL");
+    LOSS_CHECK(y_pred != NULL, "Predictions cannot be NULL");
+    LOSS_CHECK(y_true->rows == y_pred->rows && y_true->cols == y_pred->cols, 
+               "True labels and predictions must have same dimensions");
+    LOSS_CHECK(delta->rows == y_true->rows && delta->cols == y_true->cols,
+               "Delta matrix must match the labels' dimensions");
+    LOSS_CHECK(loss_func == CATEGORICAL_CROSSENTROPY || loss_func == BINARY_CROSSENTROPY,
+               "Loss function has no fused gradient");
     
-    return gradient;
+    int binary = loss_func == BINARY_CROSSENTROPY;
+    double n = binary ? (double)y_true->rows * y_true->cols : (double)y_true->rows;
+    
+    int has_nan = 0;
+    double sum = cross_entropy_sum(y_true, y_pred, binary, delta, 1.0 / n, &has_nan);
+    LOSS_CHECK(!has_nan, "NaN detected in labels or predictions");
+    
+    return -sum / n;
 }
@@ -1,4 +1,9 @@
 #include "deepc/matrix.h"
+#include "deepc/profiler.h"
+
+#ifdef DEEPC_USE_BLAS
+#include <cblas.h>
+#endif
 
 // Stack trace function
 void print_stack_trace(void) {
@@ -42,6 +47,60 @@ void print_stack_trace(void) {
     } \
 } while(0)
 
+// Allocate an aligned, zero-initialized block of elements
+static Real* alloc_values(size_t count) {
+    void *block = NULL;
+    size_t bytes = count * sizeof(Real);
+    
+    // Round up so the block ends on an alignment boundary as well
+    bytes = (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    if (posix_memalign(&block, MATRIX_ALIGNMENT, bytes) != 0) {
+        return NULL;
+    }
+    
+    memset(block, 0, bytes);
+    return (Real*)block;
+}
+
+// Point the row pointers of a matrix into its element block
+static void link_rows(Matrix *m) {
+    for (int i = 0; i < m->rows; i++) {
+        m->data[i] = m->values + (size_t)i * m->stride;
+    }
+}
+
+#ifdef DEEPC_USE_BLAS
+#ifdef DEEPC_USE_FLOAT32
+#define BLAS_AXPY cblas_saxpy
+#define BLAS_SCAL cblas_sscal
+#else
+#define BLAS_AXPY cblas_daxpy
+#define BLAS_SCAL cblas_dscal
+#endif
+
+// y += alpha * x through cblas_[sd]axpy, one call when both blocks are packed
+static void blas_axpy(double alpha, const Matrix *x, Matrix *y) {
+    if (x->stride == x->cols && y->stride == y->cols) {
+        BLAS_AXPY(x->rows * x->cols, alpha, x->values, 1, y->values, 1);
+    } else {
+        for (int i = 0; i < x->rows; i++) {
+            BLAS_AXPY(x->cols, alpha, x->data[i], 1, y->data[i], 1);
+        }
+    }
+}
+
+// a *= alpha through cblas_[sd]scal
+static void blas_scal(double alpha, Matrix *a) {
+    if (a->stride == a->cols) {
+        BLAS_SCAL(a->rows * a->cols, alpha, a->values, 1);
+    } else {
+        for (int i = 0; i < a->rows; i++) {
+            BLAS_SCAL(a->cols, alpha, a->data[i], 1);
+        }
+    }
+}
+#endif
+
 // Create a new matrix
 Matrix* create_matrix(int rows, int cols) {
     MATRIX_CHECK(rows > 0 && cols > 0, "Matrix dimensions must be positive");
@@ -51,42 +110,62 @@ Matrix* create_matrix(int rows, int cols) {
     
     m->rows = rows;
     m->cols = cols;
+    m->stride = cols;
+    m->storage = MATRIX_OWNED;
     
     // Allocate memory for row pointers
-    m->data = (double**)malloc(rows * sizeof(double*));
-    MATRIX_CHECK(m->data != NULL, "Memory allocation failed for matrix rows");
+    m->data = (Real**)malloc(rows * sizeof(Real*));
+    if (!m->data) {
+        free(m);
+        MATRIX_ERROR("Memory allocation failed for matrix rows");
+    }
     
-    // Allocate memory for each row
-    for (int i = 0; i < rows; i++) {
-        m->data[i] = (double*)malloc(cols * sizeof(double));
-        if (!m->data[i]) {
-            // Free previously allocated memory before terminating
-            for (int j = 0; j < i; j++) {
-                free(m->data[j]);
-            }
-            free(m->data);
-            free(m);
-            MATRIX_ERROR("Memory allocation failed for matrix row");
-        }
-        
-        // Initialize to zero
-        for (int j = 0; j < cols; j++) {
-            m->data[i][j] = 0.0;
-        }
+    // One aligned block for all elements, initialized to zero
+    m->values = alloc_values((size_t)rows * cols);
+    if (!m->values) {
+        free(m->data);
+        free(m);
+        MATRIX_ERROR("Memory allocation failed for matrix data");
+    }
+    
+    link_rows(m);
+    profile_count_allocation(sizeof(Matrix) + rows * sizeof(Real*) + (size_t)rows * cols * sizeof(Real));
+    return m;
+}
+
+// Wrap existing row-major storage without copying it; free_matrix leaves it alone
+Matrix* create_matrix_view(Real *values, int rows, int cols, int stride) {
+    MATRIX_CHECK(values != NULL, "View storage cannot be NULL");
+    MATRIX_CHECK(rows > 0 && cols > 0, "Matrix dimensions must be positive");
+    MATRIX_CHECK(stride >= cols, "Row stride must be at least the number of columns");
+    
+    Matrix *m = (Matrix*)malloc(sizeof(Matrix));
+    MATRIX_CHECK(m != NULL, "Memory allocation failed for matrix structure");
+    
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = stride;
+    m->storage = MATRIX_VIEW;
+    m->values = values;
+    
+    m->data = (Real**)malloc(rows * sizeof(Real*));
+    if (!m->data) {
+        free(m);
+        MATRIX_ERROR("Memory allocation failed for matrix rows");
     }
     
+    link_rows(m);
+    profile_count_allocation(sizeof(Matrix) + rows * sizeof(Real*));
     return m;
 }
 
 // Free matrix memory
 void free_matrix(Matrix *m) {
-    if (m) {
+    if (m && m->storage != MATRIX_WORKSPACE) {
+        if (m->storage == MATRIX_OWNED && m->values) {
+            free(m->values);
+        }
         if (m->data) {
-            for (int i = 0; i < m->rows; i++) {
-                if (m->data[i]) {
-                    free(m->data[i]);
-                }
-            }
             free(m->data);
         }
         free(m);
@@ -98,14 +177,56 @@ Matrix* copy_matrix(const Matrix *src) {
     MATRIX_CHECK(src != NULL, "Source matrix is NULL");
     
     Matrix *dest = create_matrix(src->rows, src->cols);
+    copy_into(dest, src);
+    return dest;
+}
+
+// Copy the elements of src into dst (same shape)
+void copy_into(Matrix *dst, const Matrix *src) {
+    MATRIX_CHECK(dst != NULL && src != NULL, "Matrices cannot be NULL");
+    MATRIX_CHECK(dst->rows == src->rows && dst->cols == src->cols,
+                "Destination dimensions don't match for copy");
+    
+    if (dst->values == src->values && dst->stride == src->stride) return;
     
     for (int i = 0; i < src->rows; i++) {
-        for (int j = 0; j < src->cols; j++) {
-            dest->data[i][j] = src->data[i][j];
-        }
+        memcpy(dst->data[i], src->data[i], src->cols * sizeof(Real));
+    }
+}
+
+// Reuse m as a rows x cols buffer when it already owns one of that shape,
+// otherwise free it and return a fresh (zeroed) matrix. The contents of a
+// reused buffer are left as they were.
+Matrix* ensure_matrix(Matrix *m, int rows, int cols) {
+    if (m && m->storage == MATRIX_OWNED && m->rows == rows && m->cols == cols) {
+        return m;
     }
     
-    return dest;
+    free_matrix(m);
+    return create_matrix(rows, cols);
+}
+
+// Change the number of rows of an owned matrix in place
+void resize_matrix_rows(Matrix *m, int rows) {
+    MATRIX_CHECK(m != NULL, "Matrix cannot be NULL");
+    MATRIX_CHECK(m->storage == MATRIX_OWNED, "Only owned matrices can be resized");
+    MATRIX_CHECK(rows > 0, "Matrix dimensions must be positive");
+    
+    Real **data = (Real**)realloc(m->data, rows * sizeof(Real*));
+    MATRIX_CHECK(data != NULL, "Memory allocation failed for matrix rows");
+    m->data = data;
+    
+    if (rows > m->rows) {
+        Real *values = alloc_values((size_t)rows * m->stride);
+        MATRIX_CHECK(values != NULL, "Memory allocation failed for matrix data");
+        memcpy(values, m->values, (size_t)m->rows * m->stride * sizeof(Real));
+        free(m->values);
+        m->values = values;
+        profile_count_allocation((size_t)rows * m->stride * sizeof(Real));
+    }
+    
+    m->rows = rows;
+    link_rows(m);
 }
 
 // Create matrix filled with zeros
@@ -218,55 +339,76 @@ void set_col(Matrix *m, int col_index, const Matrix *col_data) {
     }
 }
 
+#define CHECK_SAME_SHAPE(x, y, msg) \
+    MATRIX_CHECK((x)->rows == (y)->rows && (x)->cols == (y)->cols, msg)
+
 // Element-wise addition
 Matrix* add(const Matrix *a, const Matrix *b) {
     MATRIX_CHECK(a != NULL && b != NULL, "Matrices cannot be NULL");
-    MATRIX_CHECK(a->rows == b->rows && a->cols == b->cols, 
-                "Matrix dimensions don't match for addition");
     
     Matrix *result = create_matrix(a->rows, a->cols);
+    add_into(result, a, b);
+    return result;
+}
+
+void add_into(Matrix *dst, const Matrix *a, const Matrix *b) {
+    MATRIX_CHECK(dst != NULL && a != NULL && b != NULL, "Matrices cannot be NULL");
+    CHECK_SAME_SHAPE(a, b, "Matrix dimensions don't match for addition");
+    CHECK_SAME_SHAPE(dst, a, "Destination dimensions don't match for addition");
     
     for (int i = 0; i < a->rows; i++) {
+        const Real *ra = a->data[i], *rb = b->data[i];
+        Real *rd = dst->data[i];
         for (int j = 0; j < a->cols; j++) {
-            result->data[i][j] = a->data[i][j] + b->data[i][j];
+            rd[j] = ra[j] + rb[j];
         }
     }
-    
-    return result;
 }
 
 // Element-wise subtraction
 Matrix* subtract(const Matrix *a, const Matrix *b) {
     MATRIX_CHECK(a != NULL && b != NULL, "Matrices cannot be NULL");
-    MATRIX_CHECK(a->rows == b->rows && a->cols == b->cols, 
-                "Matrix dimensions don't match for subtraction");
     
     Matrix *result = create_matrix(a->rows, a->cols);
+    subtract_into(result, a, b);
+    return result;
+}
+
+void subtract_into(Matrix *dst, const Matrix *a, const Matrix *b) {
+    MATRIX_CHECK(dst != NULL && a != NULL && b != NULL, "Matrices cannot be NULL");
+    CHECK_SAME_SHAPE(a, b, "Matrix dimensions don't match for subtraction");
+    CHECK_SAME_SHAPE(dst, a, "Destination dimensions don't match for subtraction");
     
     for (int i = 0; i < a->rows; i++) {
+        const Real *ra = a->data[i], *rb = b->data[i];
+        Real *rd = dst->data[i];
         for (int j = 0; j < a->cols; j++) {
-            result->data[i][j] = a->data[i][j] - b->data[i][j];
+            rd[j] = ra[j] - rb[j];
         }
     }
-    
-    return result;
 }
 
 // Element-wise multiplication (Hadamard product)
 Matrix* multiply(const Matrix *a, const Matrix *b) {
     MATRIX_CHECK(a != NULL && b != NULL, "Matrices cannot be NULL");
-    MATRIX_CHECK(a->rows == b->rows && a->cols == b->cols, 
-                "Matrix dimensions don't match for element-wise multiplication");
     
     Matrix *result = create_matrix(a->rows, a->cols);
+    multiply_into(result, a, b);
+    return result;
+}
+
+void multiply_into(Matrix *dst, const Matrix *a, const Matrix *b) {
+    MATRIX_CHECK(dst != NULL && a != NULL && b != NULL, "Matrices cannot be NULL");
+    CHECK_SAME_SHAPE(a, b, "Matrix dimensions don't match for element-wise multiplication");
+    CHECK_SAME_SHAPE(dst, a, "Destination dimensions don't match for element-wise multiplication");
     
     for (int i = 0; i < a->rows; i++) {
+        const Real *ra = a->data[i], *rb = b->data[i];
+        Real *rd = dst->data[i];
         for (int j = 0; j < a->cols; j++) {
-            result->data[i][j] = a->data[i][j] * b->data[i][j];
+            rd[j] = ra[j] * rb[j];
         }
     }
-    
-    return result;
 }
 
 Matrix* dot(const Matrix *a, const Matrix *b) {
@@ -288,40 +430,69 @@ Matrix* dot(const Matrix *a, const Matrix *b) {
         return NULL;
     }
     
-    // Initialize to zero
-    for (int i = 0; i < result->rows; i++) {
-        for (int j = 0; j < result->cols; j++) {
-            result->data[i][j] = 0.0;
-        }
-    }
+    dot_into(result, a, b);
+    return result;
+}
+
+void dot_into(Matrix *dst, const Matrix *a, const Matrix *b) {
+    matmul_into(dst, a, GEMM_NO_TRANS, b, GEMM_NO_TRANS);
+}
+
+// Matrix product of op(a) and op(b), transposing either operand on the fly
+Matrix* matmul(const Matrix *a, GemmTranspose trans_a, const Matrix *b, GemmTranspose trans_b) {
+    MATRIX_CHECK(a != NULL && b != NULL, "Matrices cannot be NULL");
     
-    // Perform matrix multiplication
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < b->cols; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < a->cols; k++) {
-                sum += a->data[i][k] * b->data[k][j];
-            }
-            result->data[i][j] = sum;
-        }
-    }
+    int m = trans_a == GEMM_NO_TRANS ? a->rows : a->cols;
+    int n = trans_b == GEMM_NO_TRANS ? b->cols : b->rows;
     
+    Matrix *result = create_matrix(m, n);
+    matmul_into(result, a, trans_a, b, trans_b);
     return result;
 }
 
+void matmul_into(Matrix *dst, const Matrix *a, GemmTranspose trans_a,
+                 const Matrix *b, GemmTranspose trans_b) {
+    MATRIX_CHECK(dst != NULL && a != NULL && b != NULL, "Matrices cannot be NULL");
+    MATRIX_CHECK(dst != a && dst != b, "Matrix product cannot be computed in place");
+    
+    int m = trans_a == GEMM_NO_TRANS ? a->rows : a->cols;
+    int k = trans_a == GEMM_NO_TRANS ? a->cols : a->rows;
+    int kb = trans_b == GEMM_NO_TRANS ? b->rows : b->cols;
+    int n = trans_b == GEMM_NO_TRANS ? b->cols : b->rows;
+    MATRIX_CHECK(k == kb, "Matrix dimensions don't match for matrix product");
+    MATRIX_CHECK(dst->rows == m && dst->cols == n,
+                "Destination dimensions don't match for matrix product");
+    
+    // Cache-blocked SIMD kernel (see gemm.c)
+    gemm(trans_a, trans_b, m, n, k, 1.0, a->values, a->stride, b->values, b->stride,
+         0.0, dst->values, dst->stride);
+}
+
 // Scalar multiplication
 Matrix* scale(const Matrix *a, double scalar) {
     MATRIX_CHECK(a != NULL, "Matrix cannot be NULL");
     
     Matrix *result = create_matrix(a->rows, a->cols);
+    scale_into(result, a, scalar);
+    return result;
+}
+
+void scale_into(Matrix *dst, const Matrix *a, double scalar) {
+    MATRIX_CHECK(dst != NULL && a != NULL, "Matrices cannot be NULL");
+    CHECK_SAME_SHAPE(dst, a, "Destination dimensions don't match for scaling");
     
+#ifdef DEEPC_USE_BLAS
+    copy_into(dst, a);
+    blas_scal(scalar, dst);
+#else
     for (int i = 0; i < a->rows; i++) {
+        const Real *ra = a->data[i];
+        Real *rd = dst->data[i];
         for (int j = 0; j < a->cols; j++) {
-            result->data[i][j] = a->data[i][j] * scalar;
+            rd[j] = ra[j] * scalar;
         }
     }
-    
-    return result;
+#endif
 }
 
 // Matrix transpose
@@ -329,30 +500,52 @@ Matrix* transpose(const Matrix *a) {
     MATRIX_CHECK(a != NULL, "Matrix cannot be NULL");
     
     Matrix *result = create_matrix(a->cols, a->rows);
-    
-    for (int i = 0; i < a->rows; i++) {
-        for (int j = 0; j < a->cols; j++) {
-            result->data[j][i] = a->data[i][j];
+    transpose_into(result, a);
+    return result;
+}
+
+void transpose_into(Matrix *dst, const Matrix *a) {
+    MATRIX_CHECK(dst != NULL && a != NULL, "Matrices cannot be NULL");
+    MATRIX_CHECK(dst != a, "Transpose cannot be computed in place");
+    MATRIX_CHECK(dst->rows == a->cols && dst->cols == a->rows,
+                "Destination dimensions don't match for transpose");
+    
+    // Work in square tiles so both sides stay in cache
+    const int tile = 32;
+    for (int i0 = 0; i0 < a->rows; i0 += tile) {
+        int i1 = i0 + tile < a->rows ? i0 + tile : a->rows;
+        for (int j0 = 0; j0 < a->cols; j0 += tile) {
+            int j1 = j0 + tile < a->cols ? j0 + tile : a->cols;
+            for (int i = i0; i < i1; i++) {
+                for (int j = j0; j < j1; j++) {
+                    dst->data[j][i] = a->data[i][j];
+                }
+            }
         }
     }
-    
-    return result;
 }
 
 // Apply function to each element
 Matrix* apply_function(const Matrix *a, double (*func)(double)) {
     MATRIX_CHECK(a != NULL, "Matrix cannot be NULL");
-    MATRIX_CHECK(func != NULL, "Function pointer cannot be NULL");
     
     Matrix *result = create_matrix(a->rows, a->cols);
+    apply_function_into(result, a, func);
+    return result;
+}
+
+void apply_function_into(Matrix *dst, const Matrix *a, double (*func)(double)) {
+    MATRIX_CHECK(dst != NULL && a != NULL, "Matrices cannot be NULL");
+    MATRIX_CHECK(func != NULL, "Function pointer cannot be NULL");
+    CHECK_SAME_SHAPE(dst, a, "Destination dimensions don't match for apply_function");
     
     for (int i = 0; i < a->rows; i++) {
+        const Real *ra = a->data[i];
+        Real *rd = dst->data[i];
         for (int j = 0; j < a->cols; j++) {
-            result->data[i][j] = func(a->data[i][j]);
+            rd[j] = func(ra[j]);
         }
     }
-    
-    return result;
 }
 
 // In-place operations (more efficient)
@@ -361,11 +554,15 @@ void add_inplace(Matrix *a, const Matrix *b) {
     MATRIX_CHECK(a->rows == b->rows && a->cols == b->cols, 
                 "Matrix dimensions don't match for in-place addition");
     
+#ifdef DEEPC_USE_BLAS
+    blas_axpy(1.0, b, a);
+#else
     for (int i = 0; i < a->rows; i++) {
         for (int j = 0; j < a->cols; j++) {
             a->data[i][j] += b->data[i][j];
         }
     }
+#endif
 }
 
 void subtract_inplace(Matrix *a, const Matrix *b) {
@@ -373,21 +570,29 @@ void subtract_inplace(Matrix *a, const Matrix *b) {
     MATRIX_CHECK(a->rows == b->rows && a->cols == b->cols, 
                 "Matrix dimensions don't match for in-place subtraction");
     
+#ifdef DEEPC_USE_BLAS
+    blas_axpy(-1.0, b, a);
+#else
     for (int i = 0; i < a->rows; i++) {
         for (int j = 0; j < a->cols; j++) {
             a->data[i][j] -= b->data[i][j];
         }
     }
+#endif
 }
 
 void scale_inplace(Matrix *a, double scalar) {
     MATRIX_CHECK(a != NULL, "Matrix cannot be NULL");
     
+#ifdef DEEPC_USE_BLAS
+    blas_scal(scalar, a);
+#else
     for (int i = 0; i < a->rows; i++) {
         for (int j = 0; j < a->cols; j++) {
             a->data[i][j] *= scalar;
         }
     }
+#endif
 }
 
 // Activation functions
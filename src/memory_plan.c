@@ -0,0 +1,279 @@
+#include "deepc/memory_plan.h"
+#include "deepc/profiler.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Error handling
+#define PLAN_ERROR(msg) do { \
+    fprintf(stderr, "\n*** MEMORY PLAN ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define PLAN_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        PLAN_ERROR(msg); \
+    } \
+} while(0)
+
+static size_t align_up(size_t bytes) {
+    return (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+static int lifetimes_overlap(const PlannedBuffer* a, const PlannedBuffer* b) {
+    return a->first <= b->last && b->first <= a->last;
+}
+
+size_t plan_buffer_offsets(PlannedBuffer* buffers, int count) {
+    PLAN_CHECK(count >= 0, "Buffer count cannot be negative");
+    if (count == 0) return 0;
+
+    int* order = (int*)malloc(count * sizeof(int));
+    int* placed = (int*)malloc(count * sizeof(int));
+    PLAN_CHECK(order != NULL && placed != NULL, "Memory allocation failed for plan");
+
+    // Largest first (insertion sort, stable so equal sizes keep their order)
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while (j > 0 && buffers[order[j - 1]].bytes < buffers[i].bytes) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    size_t total = 0;
+    for (int k = 0; k < count; k++) {
+        PlannedBuffer* buffer = &buffers[order[k]];
+        size_t bytes = align_up(buffer->bytes);
+
+        // Buffers already placed that are live at the same time, by offset
+        int num_conflicts = 0;
+        for (int p = 0; p < k; p++) {
+            const PlannedBuffer* other = &buffers[order[p]];
+            if (!lifetimes_overlap(buffer, other)) continue;
+
+            int j = num_conflicts++;
+            while (j > 0 && buffers[placed[j - 1]].offset > other->offset) {
+                placed[j] = placed[j - 1];
+                j--;
+            }
+            placed[j] = order[p];
+        }
+
+        // First gap between them that is large enough
+        size_t offset = 0;
+        for (int c = 0; c < num_conflicts; c++) {
+            const PlannedBuffer* other = &buffers[placed[c]];
+            if (offset + bytes <= other->offset) break;
+            size_t end = other->offset + align_up(other->bytes);
+            if (end > offset) offset = end;
+        }
+
+        buffer->offset = offset;
+        if (offset + bytes > total) total = offset + bytes;
+    }
+
+    free(order);
+    free(placed);
+    return total;
+}
+
+// Header and row pointers for rows x cols elements owned by the plan; the
+// workspace storage tag keeps free_matrix and the layer caches off them
+static Matrix* plan_matrix(Real* values, int rows, int cols) {
+    Matrix* m = (Matrix*)malloc(sizeof(Matrix));
+    PLAN_CHECK(m != NULL, "Memory allocation failed for planned matrix");
+    m->data = (Real**)malloc(rows * sizeof(Real*));
+    PLAN_CHECK(m->data != NULL, "Memory allocation failed for planned matrix rows");
+    profile_count_allocation(sizeof(Matrix) + rows * sizeof(Real*));
+
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = cols;
+    m->storage = MATRIX_WORKSPACE;
+    m->values = values;
+    for (int i = 0; i < rows; i++) {
+        m->data[i] = values + (size_t)i * cols;
+    }
+    return m;
+}
+
+static void free_plan_matrix(Matrix* m) {
+    if (!m) return;
+    free(m->data);
+    free(m);
+}
+
+// Whether layer i's output stays live from its forward pass to its backward
+// pass: every activation without checkpointing, otherwise the last of each
+// segment (the next segment's input) and the model output
+static int keeps_output(int i, int num_layers, int checkpoint_every) {
+    return checkpoint_every <= 0 || i % checkpoint_every == checkpoint_every - 1 ||
+           i == num_layers - 1;
+}
+
+// Buffers of the plan, in this order: the output of every layer, the
+// gradient into every layer (the last one being the loss gradient) except
+// the first, the softmax row sums, then the first-pass outputs of the layers
+// whose activations are dropped
+MemoryPlan* create_memory_plan(Layer* const* layers, int num_layers, int batch_size,
+                               int checkpoint_every) {
+    PLAN_CHECK(layers != NULL && num_layers > 0, "Plan needs at least one layer");
+    PLAN_CHECK(batch_size > 0, "Batch size must be positive");
+    PLAN_CHECK(checkpoint_every >= 0, "Checkpoint segment cannot be negative");
+
+    int L = num_layers;
+    if (checkpoint_every == 1) checkpoint_every = 0;
+
+    PlannedBuffer* buffers = (PlannedBuffer*)calloc(4 * L, sizeof(PlannedBuffer));
+    int* gradient_of = (int*)malloc((L + 1) * sizeof(int));
+    int* row_dots_of = (int*)malloc(L * sizeof(int));
+    int* forward_of = (int*)malloc(L * sizeof(int));
+    int* forward_step = (int*)malloc(L * sizeof(int));
+    int* recompute_step = (int*)malloc(L * sizeof(int));
+    int* backward_step = (int*)malloc(L * sizeof(int));
+    PLAN_CHECK(buffers && gradient_of && row_dots_of && forward_of && forward_step &&
+               recompute_step && backward_step, "Memory allocation failed for plan");
+
+    // Steps: forward 0 .. L-1, the loss, then per segment from the last one
+    // down, the forward passes of its dropped layers again and its backward
+    // passes. Without checkpointing forward i is i, the loss L and backward
+    // i is 2L - i.
+    int step = 0;
+    for (int i = 0; i < L; i++) forward_step[i] = step++;
+    int loss_step = step++;
+    for (int end = L - 1; end >= 0;) {
+        int start = end;
+        while (start > 0 && !keeps_output(start - 1, L, checkpoint_every)) start--;
+        for (int i = start; i < end; i++) recompute_step[i] = step++;
+        for (int i = end; i >= start; i--) backward_step[i] = step++;
+        end = start - 1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < L; i++) {
+        PlannedBuffer* b = &buffers[count++];
+        b->bytes = (size_t)batch_size * layers[i]->output_size * sizeof(Real);
+        b->first = keeps_output(i, L, checkpoint_every) ? forward_step[i] : recompute_step[i];
+        b->last = backward_step[i];
+    }
+    // Gradient into layer i: written by backward i + 1 (the loss, for the
+    // last layer) and turned into dL/dz in place by backward i
+    gradient_of[0] = -1;
+    for (int i = 1; i <= L; i++) {
+        PlannedBuffer* b = &buffers[count];
+        gradient_of[i] = count++;
+        b->bytes = (size_t)batch_size * layers[i - 1]->output_size * sizeof(Real);
+        b->first = i == L ? loss_step : backward_step[i];
+        b->last = backward_step[i - 1];
+    }
+    for (int i = 0; i < L; i++) {
+        row_dots_of[i] = -1;
+        if (layers[i]->activation != SOFTMAX) continue;
+        PlannedBuffer* b = &buffers[count];
+        row_dots_of[i] = count++;
+        b->bytes = (size_t)batch_size * sizeof(Real);
+        b->first = backward_step[i];
+        b->last = b->first;
+    }
+    // A dropped activation lives only until the next layer's forward pass
+    for (int i = 0; i < L; i++) {
+        forward_of[i] = -1;
+        if (keeps_output(i, L, checkpoint_every)) continue;
+        PlannedBuffer* b = &buffers[count];
+        forward_of[i] = count++;
+        b->bytes = (size_t)batch_size * layers[i]->output_size * sizeof(Real);
+        b->first = forward_step[i];
+        b->last = forward_step[i + 1];
+    }
+
+    MemoryPlan* plan = (MemoryPlan*)calloc(1, sizeof(MemoryPlan));
+    PLAN_CHECK(plan != NULL, "Memory allocation failed for plan");
+    plan->batch_size = batch_size;
+    plan->num_layers = L;
+    plan->checkpoint_every = checkpoint_every;
+
+    for (int i = 0; i < count; i++) {
+        plan->unshared_bytes += align_up(buffers[i].bytes);
+    }
+    plan->arena_bytes = plan_buffer_offsets(buffers, count);
+
+    void* arena = NULL;
+    PLAN_CHECK(posix_memalign(&arena, MATRIX_ALIGNMENT, plan->arena_bytes) == 0,
+               "Memory allocation failed for plan arena");
+    profile_count_allocation(plan->arena_bytes);
+    plan->arena = (char*)arena;
+
+    plan->layers = (LayerPlan*)calloc(L, sizeof(LayerPlan));
+    PLAN_CHECK(plan->layers != NULL, "Memory allocation failed for layer plans");
+
+    // gradient i, the input gradient of layer i, is layer i - 1's delta
+    // buffer; layer i computes it as its prev_gradient
+    for (int i = 0; i < L; i++) {
+        LayerPlan* lp = &plan->layers[i];
+        lp->output = plan_matrix((Real*)(plan->arena + buffers[i].offset),
+                                 batch_size, layers[i]->output_size);
+        if (i == 0) {
+            // Filled with a copy of the batch's header on every step
+            lp->input = (Matrix*)calloc(1, sizeof(Matrix));
+            PLAN_CHECK(lp->input != NULL, "Memory allocation failed for planned matrix");
+        } else {
+            lp->prev_gradient = plan_matrix((Real*)(plan->arena + buffers[gradient_of[i]].offset),
+                                            batch_size, layers[i]->input_size);
+        }
+        if (row_dots_of[i] >= 0) {
+            lp->row_dots = plan_matrix((Real*)(plan->arena + buffers[row_dots_of[i]].offset),
+                                       batch_size, 1);
+        }
+        if (forward_of[i] >= 0) {
+            lp->forward_output = plan_matrix((Real*)(plan->arena + buffers[forward_of[i]].offset),
+                                             batch_size, layers[i]->output_size);
+        }
+    }
+    plan->loss_gradient = plan_matrix((Real*)(plan->arena + buffers[gradient_of[L]].offset),
+                                      batch_size, layers[L - 1]->output_size);
+
+    free(buffers);
+    free(gradient_of);
+    free(row_dots_of);
+    free(forward_of);
+    free(forward_step);
+    free(recompute_step);
+    free(backward_step);
+    return plan;
+}
+
+void free_memory_plan(MemoryPlan* plan) {
+    if (!plan) return;
+
+    for (int i = 0; i < plan->num_layers; i++) {
+        free(plan->layers[i].input);
+        free_plan_matrix(plan->layers[i].output);
+        free_plan_matrix(plan->layers[i].prev_gradient);
+        free_plan_matrix(plan->layers[i].row_dots);
+        free_plan_matrix(plan->layers[i].forward_output);
+    }
+    free_plan_matrix(plan->loss_gradient);
+    free(plan->layers);
+    free(plan->arena);
+    free(plan);
+}
+
+void memory_plan_bind(MemoryPlan* plan, int rows) {
+    PLAN_CHECK(plan != NULL, "Plan cannot be NULL");
+    PLAN_CHECK(rows > 0 && rows <= plan->batch_size, "Batch is larger than the plan");
+
+    for (int i = 0; i < plan->num_layers; i++) {
+        LayerPlan* lp = &plan->layers[i];
+        lp->output->rows = rows;
+        if (lp->prev_gradient) lp->prev_gradient->rows = rows;
+        if (lp->row_dots) lp->row_dots->rows = rows;
+        if (lp->forward_output) lp->forward_output->rows = rows;
+    }
+    plan->loss_gradient->rows = rows;
+}
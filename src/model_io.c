@@ -0,0 +1,504 @@
+#include "deepc/models.h"
+#include "deepc/layers.h"
+#include "deepc/quantize.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Binary .dc layout (all integers and floating-point values little-endian):
+//
+//   0    header (64 bytes)
+//          0  magic "DEEPCBIN"       8  u32 version     12  u32 dtype
+//         16  u32 num_layers        20  u32 is_compiled 24  u32 optimizer
+//         28  u32 loss             32  f64 learning_rate
+//         40  u64 name offset      48  u32 name length  52  u32 reserved
+//         56  u64 file size
+//   64   layer table, one 64-byte entry per layer
+//          0  u32 layer type       4  u32 activation    8  u32 input size
+//         12  u32 output size      16  u64 weights offset
+//         24  u64 biases offset    32  u64 name offset  40  u32 name length
+//         44  u32 reserved         48  u64 int8 offset (0: not quantized)
+//         56  reserved (zero)
+//   ...  names (not terminated)
+//   ...  parameter blobs, each starting on a 64-byte boundary: the weights
+//        as output_size x input_size row-major values, the biases as
+//        output_size values, all of the header's dtype
+//   ...  int8 blocks of quantized layers, on 64-byte boundaries:
+//          0  f32 input scale      4  i32 input zero point
+//          8  u32 padded input     12  reserved (zero)
+//         64  f32 weight scales[output_size], then on the next boundary
+//             i32 weight sums[output_size], then on the next boundary the
+//             int8 weights, output_size x padded input
+// Readers that predate the int8 block ignore it and load the float model.
+
+#define DC_HEADER_SIZE 64
+#define DC_LAYER_ENTRY_SIZE 64
+#define DC_ALIGNMENT 64
+
+// Element type of the parameter blobs; files are written in the element
+// type of the build and either type can be read
+#define DC_DTYPE_FLOAT64 1
+#define DC_DTYPE_FLOAT32 2
+
+#ifdef DEEPC_USE_FLOAT32
+#define DC_DTYPE_NATIVE DC_DTYPE_FLOAT32
+#else
+#define DC_DTYPE_NATIVE DC_DTYPE_FLOAT64
+#endif
+
+// Layer types in the table
+#define DC_LAYER_DENSE 0
+
+// Header of an int8 block, before the weight scales
+#define DC_QUANT_HEADER_SIZE 64
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define DC_NATIVE_LITTLE_ENDIAN 0
+#else
+#define DC_NATIVE_LITTLE_ENDIAN 1
+#endif
+
+// Error handling
+#define MODEL_IO_ERROR(msg) do { \
+    fprintf(stderr, "\n*** MODEL IO ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define MODEL_IO_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        MODEL_IO_ERROR(msg); \
+    } \
+} while(0)
+
+static uint64_t align_offset(uint64_t offset) {
+    return (offset + DC_ALIGNMENT - 1) / DC_ALIGNMENT * DC_ALIGNMENT;
+}
+
+// Little-endian field access, independent of the host byte order
+static void put_u32(unsigned char* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_u64(unsigned char* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static void put_f64(unsigned char* p, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_u64(p, bits);
+}
+
+static void put_f32(unsigned char* p, float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_u32(p, bits);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) v |= (uint32_t)p[i] << (8 * i);
+    return v;
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static double get_f64(const unsigned char* p) {
+    uint64_t bits = get_u64(p);
+    double v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static float get_f32(const unsigned char* p) {
+    uint32_t bits = get_u32(p);
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// Offsets of the parts of an int8 block starting at offset; returns its end
+static uint64_t quant_layout(uint64_t offset, uint32_t output_size, uint32_t padded_input,
+                             uint64_t* scales, uint64_t* sums, uint64_t* weights) {
+    *scales = offset + DC_QUANT_HEADER_SIZE;
+    *sums = align_offset(*scales + (uint64_t)output_size * 4);
+    *weights = align_offset(*sums + (uint64_t)output_size * 4);
+    return *weights + (uint64_t)output_size * padded_input;
+}
+
+// Bytes per element of a blob dtype, 0 if unknown
+static size_t dtype_size(uint32_t dtype) {
+    return dtype == DC_DTYPE_FLOAT64 ? 8 : dtype == DC_DTYPE_FLOAT32 ? 4 : 0;
+}
+
+static int write_padding(FILE* file, uint64_t* offset) {
+    static const unsigned char zeros[DC_ALIGNMENT] = {0};
+    uint64_t aligned = align_offset(*offset);
+    size_t n = (size_t)(aligned - *offset);
+    *offset = aligned;
+    return fwrite(zeros, 1, n, file) == n;
+}
+
+// Write a matrix row by row as little-endian elements of the native dtype
+static int write_values(FILE* file, const Matrix* m, uint64_t* offset) {
+    for (int i = 0; i < m->rows; i++) {
+#if DC_NATIVE_LITTLE_ENDIAN
+        if (fwrite(m->data[i], sizeof(Real), m->cols, file) != (size_t)m->cols) return 0;
+#else
+        for (int j = 0; j < m->cols; j++) {
+            unsigned char bytes[sizeof(Real)];
+            if (DC_DTYPE_NATIVE == DC_DTYPE_FLOAT32) {
+                put_f32(bytes, (float)m->data[i][j]);
+            } else {
+                put_f64(bytes, m->data[i][j]);
+            }
+            if (fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) return 0;
+        }
+#endif
+    }
+    *offset += (uint64_t)m->rows * m->cols * sizeof(Real);
+    return 1;
+}
+
+// Write the int8 block of a quantized layer (offset is already aligned)
+static int write_quantized(FILE* file, const QuantizedDense* q, uint64_t* offset) {
+    unsigned char header[DC_QUANT_HEADER_SIZE] = {0};
+    put_f32(header + 0, q->input_scale);
+    put_u32(header + 4, (uint32_t)q->input_zero_point);
+    put_u32(header + 8, (uint32_t)q->padded_input);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) return 0;
+    *offset += sizeof(header);
+
+    for (int o = 0; o < q->output_size; o++) {
+        unsigned char bytes[4];
+        put_f32(bytes, q->weight_scales[o]);
+        if (fwrite(bytes, 1, 4, file) != 4) return 0;
+    }
+    *offset += (uint64_t)q->output_size * 4;
+    if (!write_padding(file, offset)) return 0;
+
+    for (int o = 0; o < q->output_size; o++) {
+        unsigned char bytes[4];
+        put_u32(bytes, (uint32_t)q->weight_sums[o]);
+        if (fwrite(bytes, 1, 4, file) != 4) return 0;
+    }
+    *offset += (uint64_t)q->output_size * 4;
+    if (!write_padding(file, offset)) return 0;
+
+    size_t bytes = (size_t)q->output_size * q->padded_input;
+    if (fwrite(q->weights, 1, bytes, file) != bytes) return 0;
+    *offset += bytes;
+    return 1;
+}
+
+// Save model in the binary .dc format
+void save_model_binary(const SequentialModel* model, const char* filename) {
+    MODEL_IO_CHECK(model != NULL, "Model cannot be NULL");
+    MODEL_IO_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    int num_layers = model->num_layers;
+    size_t table_size = (size_t)num_layers * DC_LAYER_ENTRY_SIZE;
+    unsigned char* table = (unsigned char*)calloc(1, table_size > 0 ? table_size : 1);
+    MODEL_IO_CHECK(table != NULL, "Memory allocation failed for layer table");
+
+    // Lay out names, then parameter blobs
+    uint64_t offset = DC_HEADER_SIZE + table_size;
+    uint64_t model_name_offset = offset;
+    offset += strlen(model->name);
+
+    int index = 0;
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next, index++) {
+        unsigned char* entry = table + (size_t)index * DC_LAYER_ENTRY_SIZE;
+        put_u32(entry + 0, DC_LAYER_DENSE);
+        put_u32(entry + 4, (uint32_t)layer->activation);
+        put_u32(entry + 8, (uint32_t)layer->input_size);
+        put_u32(entry + 12, (uint32_t)layer->output_size);
+        put_u64(entry + 32, offset);
+        put_u32(entry + 40, (uint32_t)strlen(layer->name));
+        offset += strlen(layer->name);
+    }
+
+    index = 0;
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next, index++) {
+        unsigned char* entry = table + (size_t)index * DC_LAYER_ENTRY_SIZE;
+        offset = align_offset(offset);
+        put_u64(entry + 16, offset);
+        offset += (uint64_t)layer->weights->rows * layer->weights->cols * sizeof(Real);
+        offset = align_offset(offset);
+        put_u64(entry + 24, offset);
+        offset += (uint64_t)layer->biases->rows * sizeof(Real);
+    }
+
+    index = 0;
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next, index++) {
+        if (!layer->quantized) continue;
+        unsigned char* entry = table + (size_t)index * DC_LAYER_ENTRY_SIZE;
+        uint64_t scales, sums, weights;
+        offset = align_offset(offset);
+        put_u64(entry + 48, offset);
+        offset = quant_layout(offset, (uint32_t)layer->output_size,
+                              (uint32_t)layer->quantized->padded_input, &scales, &sums, &weights);
+    }
+    uint64_t file_size = offset;
+
+    unsigned char header[DC_HEADER_SIZE] = {0};
+    memcpy(header, DEEPC_BINARY_MAGIC, DEEPC_BINARY_MAGIC_SIZE);
+    put_u32(header + 8, DEEPC_BINARY_VERSION);
+    put_u32(header + 12, DC_DTYPE_NATIVE);
+    put_u32(header + 16, (uint32_t)num_layers);
+    put_u32(header + 20, (uint32_t)model->is_compiled);
+    put_u32(header + 24, (uint32_t)model->optimizer_type);
+    put_u32(header + 28, (uint32_t)model->loss_function);
+    put_f64(header + 32, model->learning_rate);
+    put_u64(header + 40, model_name_offset);
+    put_u32(header + 48, (uint32_t)strlen(model->name));
+    put_u64(header + 56, file_size);
+
+    FILE* file = fopen(filename, "wb");
+    if (!file) {
+        printf("ERROR: Cannot create file: %s\n", filename);
+        free(table);
+        return;
+    }
+
+    int ok = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+             fwrite(table, 1, table_size, file) == table_size &&
+             fwrite(model->name, 1, strlen(model->name), file) == strlen(model->name);
+    for (const Layer* layer = model->input_layer; ok && layer; layer = layer->next) {
+        ok = fwrite(layer->name, 1, strlen(layer->name), file) == strlen(layer->name);
+    }
+
+    offset = DC_HEADER_SIZE + table_size + strlen(model->name);
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next) {
+        offset += strlen(layer->name);
+    }
+    for (const Layer* layer = model->input_layer; ok && layer; layer = layer->next) {
+        ok = write_padding(file, &offset) && write_values(file, layer->weights, &offset) &&
+             write_padding(file, &offset) && write_values(file, layer->biases, &offset);
+    }
+    for (const Layer* layer = model->input_layer; ok && layer; layer = layer->next) {
+        if (!layer->quantized) continue;
+        ok = write_padding(file, &offset) && write_quantized(file, layer->quantized, &offset);
+    }
+
+    free(table);
+    if (fclose(file) != 0) ok = 0;
+
+    if (!ok) {
+        printf("ERROR: Failed to write model file: %s\n", filename);
+        return;
+    }
+    printf("Model saved: %s\n", filename);
+}
+
+// Parameter matrix backed by a blob of the mapping: a view straight into it
+// when the blob is already in the native layout, a converted copy otherwise
+// (big-endian hosts, or a file saved by a build of the other precision)
+static Matrix* map_values(unsigned char* blob, uint32_t dtype, int rows, int cols) {
+    if (DC_NATIVE_LITTLE_ENDIAN && dtype == DC_DTYPE_NATIVE) {
+        return create_matrix_view((Real*)blob, rows, cols, cols);
+    }
+
+    size_t element_size = dtype_size(dtype);
+    Matrix* m = create_matrix(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            const unsigned char* p = blob + ((size_t)i * cols + j) * element_size;
+            m->data[i][j] = dtype == DC_DTYPE_FLOAT32 ? get_f32(p) : get_f64(p);
+        }
+    }
+    return m;
+}
+
+static char* copy_name(const unsigned char* base, uint64_t offset, uint32_t length) {
+    char* name = (char*)malloc(length + 1);
+    MODEL_IO_CHECK(name != NULL, "Memory allocation failed for name");
+    memcpy(name, base + offset, length);
+    name[length] = '\0';
+    return name;
+}
+
+// Whether [offset, offset + bytes) lies inside a file of file_size bytes
+static int in_file(uint64_t offset, uint64_t bytes, uint64_t file_size) {
+    return offset <= file_size && bytes <= file_size - offset;
+}
+
+// Int8 form of a layer from its block at offset: the weights stay in the
+// mapping, the small scale and sum arrays are read out. NULL if the block is
+// malformed.
+static QuantizedDense* map_quantized(unsigned char* base, uint64_t offset, uint64_t size,
+                                     uint32_t input_size, uint32_t output_size) {
+    uint64_t scales, sums, weights;
+    uint32_t padded_input = (input_size + QUANT_K_ALIGN - 1) / QUANT_K_ALIGN * QUANT_K_ALIGN;
+    if (offset % DC_ALIGNMENT != 0 || !in_file(offset, DC_QUANT_HEADER_SIZE, size) ||
+        get_u32(base + offset + 8) != padded_input) {
+        return NULL;
+    }
+    uint64_t end = quant_layout(offset, output_size, padded_input, &scales, &sums, &weights);
+    float input_scale = get_f32(base + offset);
+    uint32_t zero_point = get_u32(base + offset + 4);
+    if (end > size || !(input_scale > 0) || !isfinite(input_scale) || zero_point > 255) {
+        return NULL;
+    }
+
+    QuantizedDense* q = (QuantizedDense*)malloc(sizeof(QuantizedDense));
+    MODEL_IO_CHECK(q != NULL, "Memory allocation failed for quantized layer");
+    q->output_size = (int)output_size;
+    q->input_size = (int)input_size;
+    q->padded_input = (int)padded_input;
+    q->weights = (int8_t*)(base + weights);
+    q->mapped = 1;
+    q->input_scale = input_scale;
+    q->input_zero_point = (int)zero_point;
+    q->weight_scales = (float*)malloc(output_size * sizeof(float));
+    q->weight_sums = (int32_t*)malloc(output_size * sizeof(int32_t));
+    MODEL_IO_CHECK(q->weight_scales != NULL && q->weight_sums != NULL,
+                   "Memory allocation failed for quantized layer");
+    for (uint32_t o = 0; o < output_size; o++) {
+        q->weight_scales[o] = get_f32(base + scales + (uint64_t)o * 4);
+        q->weight_sums[o] = (int32_t)get_u32(base + sums + (uint64_t)o * 4);
+    }
+    return q;
+}
+
+// Load a binary .dc model, mapping its parameters instead of copying them
+SequentialModel* load_model_binary(const char* filename) {
+    MODEL_IO_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: Cannot open file: %s\n", filename);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < DC_HEADER_SIZE) {
+        printf("ERROR: Invalid model file format\n");
+        close(fd);
+        return NULL;
+    }
+
+    // Private and writable: weights can be trained in memory, the file is
+    // never modified and untouched pages stay shared with the page cache
+    size_t size = (size_t)st.st_size;
+    void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("ERROR: Cannot map file: %s\n", filename);
+        return NULL;
+    }
+
+    unsigned char* base = (unsigned char*)mapping;
+    uint32_t version = get_u32(base + 8);
+    uint32_t dtype = get_u32(base + 12);
+    uint32_t num_layers = get_u32(base + 16);
+    uint64_t name_offset = get_u64(base + 40);
+    uint32_t name_length = get_u32(base + 48);
+
+    const char* problem = NULL;
+    if (memcmp(base, DEEPC_BINARY_MAGIC, DEEPC_BINARY_MAGIC_SIZE) != 0) {
+        problem = "Invalid model file format";
+    } else if (version != DEEPC_BINARY_VERSION) {
+        problem = "Unsupported model file version";
+    } else if (dtype_size(dtype) == 0) {
+        problem = "Unsupported parameter type in model file";
+    } else if (get_u64(base + 56) != size || num_layers == 0 ||
+               !in_file(DC_HEADER_SIZE, (uint64_t)num_layers * DC_LAYER_ENTRY_SIZE, size) ||
+               !in_file(name_offset, name_length, size)) {
+        problem = "Model file is truncated or corrupt";
+    }
+    if (problem) {
+        printf("ERROR: %s: %s\n", problem, filename);
+        munmap(mapping, size);
+        return NULL;
+    }
+
+    char* model_name = copy_name(base, name_offset, name_length);
+    SequentialModel* model = create_model(model_name);
+    free(model_name);
+    model->mapping = mapping;
+    model->mapping_size = size;
+
+    for (uint32_t i = 0; i < num_layers; i++) {
+        const unsigned char* entry = base + DC_HEADER_SIZE + (size_t)i * DC_LAYER_ENTRY_SIZE;
+        uint32_t type = get_u32(entry + 0);
+        uint32_t activation = get_u32(entry + 4);
+        uint32_t input_size = get_u32(entry + 8);
+        uint32_t output_size = get_u32(entry + 12);
+        uint64_t weights_offset = get_u64(entry + 16);
+        uint64_t biases_offset = get_u64(entry + 24);
+        uint64_t layer_name_offset = get_u64(entry + 32);
+        uint32_t layer_name_length = get_u32(entry + 40);
+        uint64_t quant_offset = get_u64(entry + 48);
+
+        uint64_t weights_bytes = (uint64_t)input_size * output_size * dtype_size(dtype);
+        uint64_t biases_bytes = (uint64_t)output_size * dtype_size(dtype);
+
+        if (type != DC_LAYER_DENSE || activation > SOFTMAX ||
+            input_size == 0 || output_size == 0 || input_size > INT32_MAX || output_size > INT32_MAX ||
+            weights_offset % DC_ALIGNMENT != 0 || biases_offset % DC_ALIGNMENT != 0 ||
+            !in_file(weights_offset, weights_bytes, size) ||
+            !in_file(biases_offset, biases_bytes, size) ||
+            !in_file(layer_name_offset, layer_name_length, size) ||
+            (model->output_layer && model->output_layer->output_size != (int)input_size)) {
+            printf("ERROR: Invalid layer %u in model file: %s\n", i + 1, filename);
+            free_model(model);
+            return NULL;
+        }
+
+        Matrix* weights = map_values(base + weights_offset, dtype, (int)output_size, (int)input_size);
+        Matrix* biases = map_values(base + biases_offset, dtype, (int)output_size, 1);
+        Layer* layer = create_dense_layer(weights, biases, (Activation)activation);
+
+        free(layer->name);
+        layer->name = copy_name(base, layer_name_offset, layer_name_length);
+        add_layer(model, layer);
+
+        if (quant_offset != 0) {
+            layer->quantized = map_quantized(base, quant_offset, size, input_size, output_size);
+            if (!layer->quantized) {
+                printf("ERROR: Invalid int8 weights for layer %u in model file: %s\n", i + 1, filename);
+                free_model(model);
+                return NULL;
+            }
+        }
+    }
+
+    uint32_t is_compiled = get_u32(base + 20);
+    uint32_t optimizer_type = get_u32(base + 24);
+    uint32_t loss_function = get_u32(base + 28);
+    double learning_rate = get_f64(base + 32);
+
+    if (optimizer_type > ADAMW || loss_function > CATEGORICAL_CROSSENTROPY ||
+        (is_compiled && !(learning_rate > 0.0))) {
+        printf("ERROR: Invalid training settings in model file: %s\n", filename);
+        free_model(model);
+        return NULL;
+    }
+
+    model->is_compiled = (int)is_compiled;
+    model->optimizer_type = (Optimizer)optimizer_type;
+    model->loss_function = (LossFunction)loss_function;
+    model->learning_rate = learning_rate;
+
+    // Compile if the model was compiled
+    if (model->is_compiled) {
+        model->optimizer = create_optimizer(model->optimizer_type, model->learning_rate);
+    }
+
+    printf("Model loaded successfully: %s\n", filename);
+    return model;
+}
@@ -1,8 +1,14 @@
 #include "deepc/models.h"
 #include "deepc/layers.h"
+#include "deepc/threadpool.h"
+#include "deepc/inference.h"
+#include "deepc/data_loader.h"
+#include "deepc/quantize.h"
+#include "deepc/distributed.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 
 // Error handling
 #define MODEL_ERROR(msg) do { \
@@ -20,45 +26,167 @@
     } \
 } while(0)
 
-// Store layers in array for easy access during backpropagation
-typedef struct {
-    Layer** layers;
-    int count;
-} LayerArray;
+// predict() runs large inputs through its buffers this many rows at a time
+#define PREDICT_CHUNK_ROWS 1024
 
-LayerArray get_layers_array(SequentialModel* model) {
-    LayerArray array;
-    array.count = model->num_layers;
-    array.layers = (Layer**)malloc(array.count * sizeof(Layer*));
-    
-    Layer* current = model->input_layer;
-    for (int i = 0; i < array.count; i++) {
-        array.layers[i] = current;
-        current = current->next;
-    }
-    
-    return array;
-}
+// evaluate_metrics runs this many rows per inference pass by default
+#define EVALUATE_BATCH_ROWS 256
+
+// fit_parallel sums the workers' gradients this many parameters per task
+#define GRADIENT_REDUCE_CHUNK 16384
 
 // Complete backpropagation through all layers
 void backward_propagation(SequentialModel* model, const Matrix* loss_gradient) {
     MODEL_CHECK(model != NULL, "Model cannot be NULL");
     MODEL_CHECK(loss_gradient != NULL, "Loss gradient cannot be NULL");
     
-    // Get layers in reverse order for backpropagation
-    LayerArray array = get_layers_array(model);
-    
     Matrix* gradient = copy_matrix(loss_gradient);
     
     // Backward pass through layers in reverse order
-    for (int i = array.count - 1; i >= 0; i--) {
-        Matrix* prev_gradient = backward_pass(array.layers[i], gradient);
+    for (int i = model->num_layers - 1; i >= 0; i--) {
+        Matrix* prev_gradient = backward_pass(model->layers[i], gradient);
         free_matrix(gradient);
         gradient = prev_gradient;
     }
     
     free_matrix(gradient);
-    free(array.layers);
+}
+
+// Forward pass through all layers with temporaries in the workspace
+static Matrix* forward_propagation_ws(SequentialModel* model, const Matrix* input, Workspace* ws) {
+    const Matrix* current_output = input;
+    Layer* current_layer = model->input_layer;
+    
+    for (int i = 0; current_layer; i++) {
+        ProfileMark mark = profile_begin(model->profiler);
+        Matrix* next_output = forward_pass_ws(current_layer, current_output, ws);
+        if (!next_output) return NULL;
+        profile_end(model->profiler, PROFILE_FORWARD, i, mark);
+        current_output = next_output;
+        current_layer = current_layer->next;
+    }
+    
+    return (Matrix*)current_output;
+}
+
+// Backpropagation down to layer first with temporaries in the workspace;
+// returns dL/dinput of that layer. With from_logits the gradient is dL/dz
+// of the output layer.
+static const Matrix* backward_propagation_ws(SequentialModel* model, const Matrix* loss_gradient,
+                                             int from_logits, int first, Workspace* ws) {
+    const Matrix* gradient = loss_gradient;
+    for (int i = model->num_layers - 1; i >= first; i--) {
+        ProfileMark mark = profile_begin(model->profiler);
+        if (from_logits && i == model->num_layers - 1) {
+            gradient = backward_pass_from_logits_ws(model->layers[i], gradient, ws);
+        } else {
+            gradient = backward_pass_ws(model->layers[i], gradient, ws);
+        }
+        profile_end(model->profiler, PROFILE_BACKWARD, i, mark);
+    }
+    return gradient;
+}
+
+// Forward pass through the memory plan's buffers (bound to the batch).
+// Activations the plan drops go to their short-lived first-pass buffers.
+static Matrix* forward_propagation_planned(SequentialModel* model, const Matrix* input,
+                                           MemoryPlan* plan) {
+    const Matrix* current_output = input;
+    
+    for (int i = 0; i < model->num_layers; i++) {
+        const LayerPlan* layer_plan = &plan->layers[i];
+        LayerPlan dropped;
+        if (layer_plan->forward_output) {
+            dropped = *layer_plan;
+            dropped.output = layer_plan->forward_output;
+            layer_plan = &dropped;
+        }
+        
+        ProfileMark mark = profile_begin(model->profiler);
+        Matrix* next_output = forward_pass_planned(model->layers[i], current_output, layer_plan);
+        if (!next_output) return NULL;
+        profile_end(model->profiler, PROFILE_FORWARD, i, mark);
+        current_output = next_output;
+    }
+    
+    return (Matrix*)current_output;
+}
+
+// Forward passes of layers start .. end - 1 again, into the buffers that
+// stay live through their backward passes, from the segment's input; the
+// recomputation is timed as forward time
+static void recompute_segment(SequentialModel* model, const Matrix* input, int start, int end,
+                              MemoryPlan* plan) {
+    const Matrix* current_output = start == 0 ? input : plan->layers[start - 1].output;
+    
+    for (int i = start; i < end; i++) {
+        ProfileMark mark = profile_begin(model->profiler);
+        current_output = forward_pass_planned(model->layers[i], current_output, &plan->layers[i]);
+        profile_end(model->profiler, PROFILE_FORWARD, i, mark);
+    }
+    
+    // The segment's last layer cached its input in a first-pass buffer
+    if (end > start) model->layers[end]->cache.input = (Matrix*)current_output;
+}
+
+// Queue the averaging of a layer's finished gradients over the ranks
+static void reduce_layer_gradients(Communicator* comm, Layer* layer) {
+    comm_reduce_async(comm, layer->dweights->values,
+                      (size_t)layer->dweights->rows * layer->dweights->cols);
+    comm_reduce_async(comm, layer->dbiases->values,
+                      (size_t)layer->dbiases->rows * layer->dbiases->cols);
+}
+
+// Backpropagation through the memory plan's buffers; loss_gradient is
+// overwritten. With checkpointing, every segment's dropped activations are
+// recomputed from input or the previous segment's output first. With comm,
+// each layer's gradients are all-reduced while the layers below it run.
+static void backward_propagation_planned(SequentialModel* model, const Matrix* input,
+                                         Matrix* loss_gradient, int from_logits,
+                                         MemoryPlan* plan, Communicator* comm) {
+    Matrix* gradient = loss_gradient;
+    for (int end = model->num_layers - 1; end >= 0;) {
+        int start = end;
+        while (start > 0 && plan->layers[start - 1].forward_output) start--;
+        recompute_segment(model, input, start, end, plan);
+        
+        for (int i = end; i >= start; i--) {
+            ProfileMark mark = profile_begin(model->profiler);
+            gradient = backward_pass_planned(model->layers[i], gradient,
+                                             from_logits && i == model->num_layers - 1,
+                                             &plan->layers[i]);
+            profile_end(model->profiler, PROFILE_BACKWARD, i, mark);
+            if (comm) reduce_layer_gradients(comm, model->layers[i]);
+        }
+        end = start - 1;
+    }
+}
+
+// The memory plan if it can hold a batch of rows, NULL otherwise
+static MemoryPlan* usable_plan(SequentialModel* model, int rows) {
+    MemoryPlan* plan = model->plan;
+    if (!plan || rows > plan->batch_size || plan->num_layers != model->num_layers) return NULL;
+    return plan;
+}
+
+// Start a training step: forget the previous step's layer caches (before
+// their workspace memory is recycled) and reset the workspace
+static void begin_training_step(SequentialModel* model) {
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        clear_layer_cache(layer);
+    }
+    workspace_reset(model->workspace);
+}
+
+// The model's parameter buffer, (re)building it if the layers no longer
+// point into it. Gradients already in the layers move along.
+static ParameterBuffer* model_parameters(SequentialModel* model) {
+    if (!parameter_buffer_matches(model->parameters, model->input_layer)) {
+        ParameterBuffer* params = create_parameter_buffer(model->input_layer);
+        free_parameter_buffer(model->parameters);
+        model->parameters = params;
+    }
+    return model->parameters;
 }
 
 // Update all layers' weights
@@ -66,14 +194,13 @@ void update_model_weights(SequentialModel* model) {
     MODEL_CHECK(model != NULL, "Model cannot be NULL");
     MODEL_CHECK(model->optimizer != NULL, "Optimizer cannot be NULL");
     
-    Layer* current = model->input_layer;
-    int layer_index = 0;
+    ProfileMark mark = profile_begin(model->profiler);
     
-    while (current) {
-        update_weights(current, model->optimizer, layer_index);
-        current = current->next;
-        layer_index++;
-    }
+    // Int8 copies of the weights would go stale
+    dequantize_model(model);
+    
+    optimizer_step(model->optimizer, model_parameters(model));
+    profile_end(model->profiler, PROFILE_UPDATE, -1, mark);
 }
 
 // Create a sequential model
@@ -85,11 +212,25 @@ SequentialModel* create_model(const char* name) {
     model->input_layer = NULL;
     model->output_layer = NULL;
     model->num_layers = 0;
+    model->layers = NULL;
+    model->plan = NULL;
+    model->checkpoint_every = 0;
     model->learning_rate = 0.01;
     model->loss_function = MEAN_SQUARED_ERROR;
     model->optimizer_type = SGD;
     model->optimizer = NULL;
     model->is_compiled = 0;
+    model->parameters = NULL;
+    model->profiler = NULL;
+    model->workspace = NULL;
+    model->mapping = NULL;
+    model->mapping_size = 0;
+    
+    memset(&model->validation, 0, sizeof(Validation));
+    model->validation.best_epoch = -1;
+    
+    model->shuffle = 1;
+    rng_seed(&model->rng, DEEPC_DEFAULT_SEED);
     
     return model;
 }
@@ -115,7 +256,14 @@ void add_layer(SequentialModel* model, Layer* layer) {
         model->output_layer = layer;
     }
     
-    model->num_layers++;
+    Layer** layers = (Layer**)realloc(model->layers, (model->num_layers + 1) * sizeof(Layer*));
+    MODEL_CHECK(layers != NULL, "Memory allocation failed for layer array");
+    model->layers = layers;
+    model->layers[model->num_layers++] = layer;
+    
+    // The shapes changed, so any memory plan is stale
+    free_memory_plan(model->plan);
+    model->plan = NULL;
 }
 
 // Free model memory
@@ -129,7 +277,15 @@ void free_model(SequentialModel* model) {
         current = next;
     }
     
+    // Layers first: their caches may point into the workspace and their
+    // parameters into the parameter buffer or the file mapping
+    free_parameter_buffer(model->parameters);
+    free_memory_plan(model->plan);
+    if (model->workspace) free_workspace(model->workspace);
+    if (model->mapping) munmap(model->mapping, model->mapping_size);
     if (model->optimizer) free_optimizer(model->optimizer);
+    free_profiler(model->profiler);
+    free(model->layers);
     if (model->name) free(model->name);
     free(model);
 }
@@ -143,36 +299,189 @@ void compile(SequentialModel* model, Optimizer optimizer, LossFunction loss, dou
     model->optimizer_type = optimizer;
     model->loss_function = loss;
     model->learning_rate = learning_rate;
+    if (model->optimizer) free_optimizer(model->optimizer);
     model->optimizer = create_optimizer(optimizer, learning_rate);
     model->is_compiled = 1;
     
     printf("Model compiled successfully!\n");
     printf("  Name: %s\n", model->name);
     printf("  Layers: %d\n", model->num_layers);
-    printf("  Optimizer: %s\n", optimizer == SGD ? "SGD" : "Adam");
+    printf("  Optimizer: %s\n", optimizer_name(optimizer));
     printf("  Loss: %s\n", 
            loss == MEAN_SQUARED_ERROR ? "MSE" : 
            loss == BINARY_CROSSENTROPY ? "BinaryCE" : "CategoricalCE");
     printf("  Learning rate: %.4f\n", learning_rate);
 }
 
-// Predict using the entire model
+// Layers per checkpointed segment for the current depth, 0 for none.
+// About sqrt(num_layers) keeps the fewest activations live at once.
+static int checkpoint_segment(const SequentialModel* model) {
+    if (model->checkpoint_every >= 0) return model->checkpoint_every;
+    
+    int segment = 1;
+    while ((segment + 1) * (segment + 1) <= model->num_layers) segment++;
+    return segment;
+}
+
+// Plan every activation and gradient buffer of a training step at
+// batch_size into one shared arena
+void compile_for_batch(SequentialModel* model, int batch_size) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    MODEL_CHECK(model->input_layer != NULL, "Model has no layers");
+    MODEL_CHECK(batch_size > 0, "Batch size must be positive");
+    
+    // Layer caches may point into the old plan
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        clear_layer_cache(layer);
+    }
+    free_memory_plan(model->plan);
+    model->plan = create_memory_plan(model->layers, model->num_layers, batch_size,
+                                     checkpoint_segment(model));
+}
+
+// Opt into recomputing activations in the backward pass; takes effect with
+// the next memory plan
+void set_gradient_checkpointing(SequentialModel* model, int segment_layers) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    model->checkpoint_every = segment_layers;
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        clear_layer_cache(layer);
+    }
+    free_memory_plan(model->plan);
+    model->plan = NULL;
+}
+
+// Predict using the entire model. Runs through a temporary inference
+// session, so the model is only read and concurrent predictions are safe.
 Matrix* predict(SequentialModel* model, const Matrix* input) {
     MODEL_CHECK(model != NULL, "Model cannot be NULL");
     MODEL_CHECK(input != NULL, "Input matrix cannot be NULL");
     MODEL_CHECK(model->input_layer != NULL, "Model has no layers");
     
-    Matrix* current_output = copy_matrix(input);
-    Layer* current_layer = model->input_layer;
+    if (input->cols != model->input_layer->input_size) {
+        printf("ERROR: Input dimension mismatch in predict: ");
+        printf("expected %d, got %d\n", model->input_layer->input_size, input->cols);
+        return NULL;
+    }
     
-    while (current_layer) {
-        Matrix* next_output = forward_pass(current_layer, current_output);
-        free_matrix(current_output);
-        current_output = next_output;
-        current_layer = current_layer->next;
+    int chunk_rows = input->rows < PREDICT_CHUNK_ROWS ? input->rows : PREDICT_CHUNK_ROWS;
+    InferenceSession* session = create_inference_session(model, chunk_rows > 0 ? chunk_rows : 1);
+    Matrix* output = create_matrix(input->rows, model->output_layer->output_size);
+    
+    predict_into(session, input, output);
+    
+    free_inference_session(session);
+    return output;
+}
+
+// Configure per-epoch shuffling in fit and fit_parallel; the same seed
+// gives the same sample order on every run
+void set_shuffle(SequentialModel* model, int shuffle, uint64_t seed) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    model->shuffle = shuffle;
+    rng_seed(&model->rng, seed);
+}
+
+// Batch loss and its gradient into loss_gradient; returns whether the
+// gradient is dL/dz of the output layer (loss fused with the activation)
+static int compute_step_loss(SequentialModel* model, const Matrix* y_batch,
+                             const Matrix* predictions, Matrix* loss_gradient,
+                             double* batch_loss) {
+    ProfileMark loss_mark = profile_begin(model->profiler);
+    int fused = loss_is_fused(model->loss_function, model->output_layer->activation);
+    if (fused) {
+        // Loss and dL/dz = (p - y) / n in one pass, no activation derivative
+        *batch_loss = compute_fused_loss_gradient_into(loss_gradient, y_batch, predictions,
+                                                       model->loss_function);
+    } else {
+        // Compute loss
+        *batch_loss = compute_loss(y_batch, predictions, model->loss_function);
+        
+        // Compute gradient
+        compute_loss_gradient_into(loss_gradient, y_batch, predictions, model->loss_function);
+    }
+    profile_end(model->profiler, PROFILE_LOSS, -1, loss_mark);
+    return fused;
+}
+
+// One optimizer step on a batch, with all temporaries in the model's
+// workspace (begin_training_step must have been called). Returns 0 if the
+// forward pass failed.
+static int train_step(SequentialModel* model, const Matrix* X_batch, const Matrix* y_batch,
+                      double* batch_loss) {
+    Workspace* ws = model->workspace;
+    MemoryPlan* plan = usable_plan(model, X_batch->rows);
+    ProfileMark step_mark = profile_begin(model->profiler);
+    
+    // Forward pass
+    Matrix* predictions;
+    if (plan) {
+        memory_plan_bind(plan, X_batch->rows);
+        predictions = forward_propagation_planned(model, X_batch, plan);
+    } else {
+        predictions = forward_propagation_ws(model, X_batch, ws);
+    }
+    if (!predictions) return 0;
+    
+    Matrix* loss_gradient = plan ? plan->loss_gradient
+                                 : workspace_matrix(ws, y_batch->rows, y_batch->cols);
+    int fused = compute_step_loss(model, y_batch, predictions, loss_gradient, batch_loss);
+    
+    // Backward pass
+    if (plan) {
+        backward_propagation_planned(model, X_batch, loss_gradient, fused, plan, NULL);
+    } else {
+        backward_propagation_ws(model, loss_gradient, fused, 0, ws);
+    }
+    
+    // Update weights
+    update_model_weights(model);
+    profile_end(model->profiler, PROFILE_STEP, -1, step_mark);
+    return 1;
+}
+
+// The next batch from the loader, with the wait timed as batch assembly
+static int next_batch(SequentialModel* model, DataLoader* loader, Matrix** X_batch,
+                      Matrix** y_batch, int epoch, int batch) {
+    profile_begin_batch(model->profiler, epoch, batch);
+    ProfileMark mark = profile_begin(model->profiler);
+    int rows = data_loader_next(loader, X_batch, y_batch);
+    if (rows > 0) profile_end(model->profiler, PROFILE_BATCH_ASSEMBLY, -1, mark);
+    return rows;
+}
+
+// Validate after an epoch: record an improvement (and snapshot its weights
+// into *best_weights when restoring them), and return 0 once the patience
+// has run out
+static int validate_epoch(SequentialModel* model, int epoch, Real** best_weights, int verbose) {
+    Validation* validation = &model->validation;
+    EvaluationMetrics metrics = evaluate_metrics(model, validation->X, validation->y,
+                                                 validation->batch_size);
+    if (verbose) {
+        printf("Epoch %d - Validation Loss: %.6f, Accuracy: %.4f\n",
+               epoch + 1, metrics.loss, metrics.accuracy);
     }
     
-    return current_output;
+    if (validation->best_epoch < 0 || metrics.loss < validation->best.loss - validation->min_delta) {
+        validation->best = metrics;
+        validation->best_epoch = epoch;
+        if (validation->restore_best) {
+            ParameterBuffer* params = model_parameters(model);
+            if (!*best_weights) *best_weights = create_parameter_snapshot(params);
+            save_parameter_snapshot(params, *best_weights);
+        }
+        return 1;
+    }
+    
+    if (validation->patience > 0 && epoch - validation->best_epoch >= validation->patience) {
+        if (verbose) {
+            printf("Early stopping: no improvement for %d epochs\n", validation->patience);
+        }
+        return 0;
+    }
+    return 1;
 }
 
 // Train the model
@@ -203,6 +512,24 @@ void fit(SequentialModel* model, const Matrix* X, const Matrix* y,
     
     int num_batches = (num_samples + batch_size - 1) / batch_size;
     
+    // Every step runs in the buffers planned for this batch size
+    if (!model->plan || model->plan->batch_size < batch_size ||
+        model->plan->num_layers != model->num_layers) {
+        compile_for_batch(model, batch_size);
+    }
+    if (!model->workspace) {
+        model->workspace = create_workspace(0);
+    }
+    
+    // Batches are gathered on a background thread while the previous one trains
+    DataLoader* loader = create_data_loader(X, y, batch_size, model->shuffle, 0,
+                                            rng_next(&model->rng));
+    
+    Validation* validation = &model->validation;
+    validation->best_epoch = -1;
+    validation->epochs_run = 0;
+    Real* best_weights = NULL;
+    
     if (verbose) {
         printf("Starting training...\n");
         printf("Samples: %d, Batch size: %d, Batches per epoch: %d, Epochs: %d\n",
@@ -213,57 +540,513 @@ void fit(SequentialModel* model, const Matrix* X, const Matrix* y,
         double total_loss = 0.0;
         int batches_processed = 0;
         
-        for (int batch = 0; batch < num_batches; batch++) {
-            int start_idx = batch * batch_size;
-            int end_idx = (batch + 1) * batch_size;
-            if (end_idx > num_samples) end_idx = num_samples;
+        Matrix* X_batch;
+        Matrix* y_batch;
+        int current_batch_size;
+        
+        for (int batch = 0;
+             (current_batch_size = next_batch(model, loader, &X_batch, &y_batch, epoch, batch)) > 0;
+             batch++) {
+            // Everything allocated for this batch lives in the workspace
+            begin_training_step(model);
             
-            int current_batch_size = end_idx - start_idx;
+            double batch_loss;
+            if (!train_step(model, X_batch, y_batch, &batch_loss)) {
+                printf("ERROR: Forward pass failed in batch %d\n", batch);
+                continue;
+            }
             
-            // Create batch data
-            Matrix* X_batch = create_matrix(current_batch_size, X->cols);
-            Matrix* y_batch = create_matrix(current_batch_size, y->cols);
+            total_loss += batch_loss * current_batch_size;
+            batches_processed++;
+            profile_batch_done(model->profiler, current_batch_size, batch_loss);
             
-            for (int i = 0; i < current_batch_size; i++) {
-                for (int j = 0; j < X->cols; j++) {
-                    X_batch->data[i][j] = X->data[start_idx + i][j];
-                }
-                for (int j = 0; j < y->cols; j++) {
-                    y_batch->data[i][j] = y->data[start_idx + i][j];
-                }
+            if (verbose && batch % 10 == 0) {
+                printf("Epoch %d, Batch %d/%d - Loss: %.6f\n", 
+                       epoch + 1, batch + 1, num_batches, batch_loss);
             }
+        }
+        
+        double average_loss = total_loss / num_samples;
+        
+        if (verbose) {
+            printf("Epoch %d/%d - Average Loss: %.6f\n", epoch + 1, epochs, average_loss);
+        }
+        
+        validation->epochs_run = epoch + 1;
+        if (validation->X && !validate_epoch(model, epoch, &best_weights, verbose)) break;
+    }
+    
+    free_data_loader(loader);
+    
+    // The snapshot is from an earlier epoch than the final weights: swap it back in
+    if (best_weights && validation->best_epoch < validation->epochs_run - 1) {
+        swap_parameter_snapshot(model_parameters(model), model->input_layer, &best_weights);
+        if (verbose) printf("Restored the weights of epoch %d\n", validation->best_epoch + 1);
+    }
+    free(best_weights);
+}
+
+// Single training step on one batch (e.g. a chunk from a CsvReader);
+// returns the batch loss, or NAN if training could not run
+double train_on_batch(SequentialModel* model, const Matrix* X, const Matrix* y) {
+    if (!model || !X || !y) {
+        printf("ERROR: Model or data is NULL in train_on_batch\n");
+        return NAN;
+    }
+    
+    if (!model->is_compiled) {
+        printf("ERROR: Model must be compiled before training\n");
+        return NAN;
+    }
+    
+    if (X->rows != y->rows) {
+        printf("ERROR: X and y must have same number of samples\n");
+        return NAN;
+    }
+    
+    if (!model->workspace) {
+        model->workspace = create_workspace(0);
+    }
+    
+    // The layers only alias the batch, so it is used in place
+    begin_training_step(model);
+    if (model->profiler) {
+        profile_begin_batch(model->profiler, 0, (int)profiler_stats(model->profiler)->batches);
+    }
+    
+    double batch_loss;
+    if (!train_step(model, X, y, &batch_loss)) {
+        printf("ERROR: Forward pass failed in train_on_batch\n");
+        return NAN;
+    }
+    
+    profile_batch_done(model->profiler, X->rows, batch_loss);
+    return batch_loss;
+}
+
+// One optimizer step on a sparse batch: the first layer runs the sparse
+// kernels, the rest the workspace path. Returns 0 if the forward pass failed.
+static int sparse_train_step(SequentialModel* model, const SparseMatrix* X_batch,
+                             const Matrix* y_batch, double* batch_loss) {
+    Workspace* ws = model->workspace;
+    ProfileMark step_mark = profile_begin(model->profiler);
+    
+    // Forward pass
+    ProfileMark mark = profile_begin(model->profiler);
+    const Matrix* current = forward_pass_sparse(model->layers[0], X_batch, ws);
+    if (!current) return 0;
+    profile_end(model->profiler, PROFILE_FORWARD, 0, mark);
+    for (int i = 1; i < model->num_layers; i++) {
+        mark = profile_begin(model->profiler);
+        current = forward_pass_ws(model->layers[i], current, ws);
+        if (!current) return 0;
+        profile_end(model->profiler, PROFILE_FORWARD, i, mark);
+    }
+    
+    Matrix* loss_gradient = workspace_matrix(ws, y_batch->rows, y_batch->cols);
+    int fused = compute_step_loss(model, y_batch, current, loss_gradient, batch_loss);
+    
+    // Backward pass; nothing needs the gradient of the sparse input
+    const Matrix* gradient = backward_propagation_ws(model, loss_gradient, fused, 1, ws);
+    mark = profile_begin(model->profiler);
+    backward_pass_sparse(model->layers[0], gradient, fused && model->num_layers == 1, ws);
+    profile_end(model->profiler, PROFILE_BACKWARD, 0, mark);
+    
+    // Update weights
+    update_model_weights(model);
+    profile_end(model->profiler, PROFILE_STEP, -1, step_mark);
+    return 1;
+}
+
+// Train on sparse features (see fit)
+void fit_sparse(SequentialModel* model, const SparseMatrix* X, const Matrix* y,
+                int epochs, int batch_size, int verbose) {
+    if (!model || !X || !y) {
+        printf("ERROR: Model or data is NULL in fit_sparse\n");
+        return;
+    }
+    
+    if (!model->is_compiled) {
+        printf("ERROR: Model must be compiled before training\n");
+        return;
+    }
+    
+    if (X->rows != y->rows) {
+        printf("ERROR: X and y must have same number of samples\n");
+        return;
+    }
+    
+    int num_samples = X->rows;
+    if (batch_size <= 0 || batch_size > num_samples) {
+        batch_size = num_samples;
+    }
+    int num_batches = (num_samples + batch_size - 1) / batch_size;
+    
+    if (!model->workspace) {
+        model->workspace = create_workspace(0);
+    }
+    
+    // Batches are gathered through an index permutation, reshuffled per epoch
+    Rng rng;
+    rng_seed(&rng, rng_next(&model->rng));
+    int* indices = (int*)malloc(num_samples * sizeof(int));
+    MODEL_CHECK(indices != NULL, "Memory allocation failed for sample indices");
+    for (int i = 0; i < num_samples; i++) {
+        indices[i] = i;
+    }
+    SparseMatrix* X_batch = create_sparse_matrix(batch_size, X->cols, 0);
+    Matrix* y_rows = create_matrix(batch_size, y->cols);
+    
+    if (verbose) {
+        printf("Starting training...\n");
+        printf("Samples: %d, Features: %d (density %.4f%%), Batch size: %d, Epochs: %d\n",
+               num_samples, X->cols, sparse_density(X) * 100.0, batch_size, epochs);
+    }
+    
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        if (model->shuffle) rng_shuffle(&rng, indices, num_samples);
+        double total_loss = 0.0;
+        
+        for (int batch = 0; batch < num_batches; batch++) {
+            int start = batch * batch_size;
+            int rows = start + batch_size <= num_samples ? batch_size : num_samples - start;
+            begin_training_step(model);
             
-            // Forward pass
-            Matrix* predictions = predict(model, X_batch);
-            if (!predictions) {
+            profile_begin_batch(model->profiler, epoch, batch);
+            ProfileMark mark = profile_begin(model->profiler);
+            sparse_gather_rows(X_batch, X, indices + start, rows);
+            for (int r = 0; r < rows; r++) {
+                memcpy(y_rows->data[r], y->data[indices[start + r]], y->cols * sizeof(Real));
+            }
+            Matrix* y_batch = workspace_row_view(model->workspace, y_rows, 0, rows);
+            profile_end(model->profiler, PROFILE_BATCH_ASSEMBLY, -1, mark);
+            
+            double batch_loss;
+            if (!sparse_train_step(model, X_batch, y_batch, &batch_loss)) {
                 printf("ERROR: Forward pass failed in batch %d\n", batch);
-                free_matrix(X_batch);
-                free_matrix(y_batch);
                 continue;
             }
             
-            // Compute loss
-            double batch_loss = compute_loss(y_batch, predictions, model->loss_function);
-            total_loss += batch_loss * current_batch_size;
-            batches_processed++;
+            total_loss += batch_loss * rows;
+            profile_batch_done(model->profiler, rows, batch_loss);
             
-            // Compute gradient
-            Matrix* loss_gradient = compute_loss_gradient(y_batch, predictions, model->loss_function);
+            if (verbose && batch % 10 == 0) {
+                printf("Epoch %d, Batch %d/%d - Loss: %.6f\n",
+                       epoch + 1, batch + 1, num_batches, batch_loss);
+            }
+        }
+        
+        if (verbose) {
+            printf("Epoch %d/%d - Average Loss: %.6f\n", epoch + 1, epochs, total_loss / num_samples);
+        }
+    }
+    
+    // The layer caches reference the batch
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        clear_layer_cache(layer);
+    }
+    free_sparse_matrix(X_batch);
+    free_matrix(y_rows);
+    free(indices);
+}
+
+// train_on_batch for a sparse batch
+double train_on_sparse_batch(SequentialModel* model, const SparseMatrix* X, const Matrix* y) {
+    if (!model || !X || !y) {
+        printf("ERROR: Model or data is NULL in train_on_sparse_batch\n");
+        return NAN;
+    }
+    
+    if (!model->is_compiled) {
+        printf("ERROR: Model must be compiled before training\n");
+        return NAN;
+    }
+    
+    if (X->rows != y->rows) {
+        printf("ERROR: X and y must have same number of samples\n");
+        return NAN;
+    }
+    
+    if (!model->workspace) {
+        model->workspace = create_workspace(0);
+    }
+    
+    begin_training_step(model);
+    if (model->profiler) {
+        profile_begin_batch(model->profiler, 0, (int)profiler_stats(model->profiler)->batches);
+    }
+    
+    double batch_loss;
+    if (!sparse_train_step(model, X, y, &batch_loss)) {
+        printf("ERROR: Forward pass failed in train_on_sparse_batch\n");
+        return NAN;
+    }
+    
+    profile_batch_done(model->profiler, X->rows, batch_loss);
+    return batch_loss;
+}
+
+// Predict from sparse features; the model is only read
+Matrix* predict_sparse(SequentialModel* model, const SparseMatrix* input) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    MODEL_CHECK(input != NULL, "Input matrix cannot be NULL");
+    MODEL_CHECK(model->input_layer != NULL, "Model has no layers");
+    
+    if (input->cols != model->input_layer->input_size) {
+        printf("ERROR: Input dimension mismatch in predict_sparse: ");
+        printf("expected %d, got %d\n", model->input_layer->input_size, input->cols);
+        return NULL;
+    }
+    
+    Matrix* output = create_matrix(input->rows, model->input_layer->output_size);
+    forward_pass_sparse_into(model->input_layer, input, output);
+    
+    for (int i = 1; i < model->num_layers; i++) {
+        Matrix* next = create_matrix(input->rows, model->layers[i]->output_size);
+        forward_pass_into(model->layers[i], output, next);
+        free_matrix(output);
+        output = next;
+    }
+    
+    return output;
+}
+
+// Per-worker state for fit_parallel: activations, gradients and scratch
+// memory of its own, so workers never write to the shared layers
+typedef struct {
+    LayerCache* caches;     // one per layer
+    Matrix** dweights;      // worker 0 uses the layers' own gradients
+    Matrix** dbiases;
+    Matrix* grads;          // other workers: one block laid out like the model's
+                            // ParameterBuffer, which dweights/dbiases view
+    Workspace* workspace;
+    int rows;               // shard size in the current step
+    double loss;            // shard loss weighted by its size
+} TrainingWorker;
+
+// One data-parallel training step over the batch X, y
+typedef struct {
+    SequentialModel* model;
+    Layer** layers;
+    ParameterBuffer* params;
+    TrainingWorker* workers;
+    int num_workers;
+    const Matrix* X;
+    const Matrix* y;
+    int batch_size;
+} ParallelStep;
+
+// Forward and backward pass of one worker's shard. Every loss gradient is
+// averaged over the rows it is given, so a shard of s rows scales its own by
+// s / batch_size, and the layers use 1 / batch_size where fit() uses
+// 1 / rows: the sum over shards then equals the full-batch gradient.
+static void train_shard_task(void* ctx, int begin, int end) {
+    const ParallelStep* step = (const ParallelStep*)ctx;
+    const SequentialModel* model = step->model;
+    
+    for (int w = begin; w < end; w++) {
+        TrainingWorker* worker = &step->workers[w];
+        
+        // The first batch_size % num_workers shards take one extra row, so
+        // only trailing workers can be idle (on a short last batch)
+        int base = step->batch_size / step->num_workers;
+        int extra = step->batch_size % step->num_workers;
+        int shard_begin = w * base + (w < extra ? w : extra);
+        
+        worker->rows = base + (w < extra ? 1 : 0);
+        worker->loss = 0.0;
+        if (worker->rows == 0) continue;
+        
+        Workspace* ws = worker->workspace;
+        for (int i = 0; i < model->num_layers; i++) {
+            release_layer_cache(&worker->caches[i]);
+        }
+        workspace_reset(ws);
+        
+        Matrix* X_shard = workspace_row_view(ws, step->X, shard_begin, worker->rows);
+        Matrix* y_shard = workspace_row_view(ws, step->y, shard_begin, worker->rows);
+        
+        // Only the first worker reports to the profiler, so it is never
+        // written concurrently
+        Profiler* profiler = w == 0 ? model->profiler : NULL;
+        
+        const Matrix* output = X_shard;
+        for (int i = 0; i < model->num_layers; i++) {
+            ProfileMark mark = profile_begin(profiler);
+            output = forward_pass_with_cache(step->layers[i], output, &worker->caches[i], ws);
+            MODEL_CHECK(output != NULL, "Forward pass failed in fit_parallel");
+            profile_end(profiler, PROFILE_FORWARD, i, mark);
+        }
+        
+        ProfileMark loss_mark = profile_begin(profiler);
+        Matrix* gradient = workspace_matrix(ws, worker->rows, step->y->cols);
+        int fused = loss_is_fused(model->loss_function, model->output_layer->activation);
+        if (fused) {
+            worker->loss = compute_fused_loss_gradient_into(gradient, y_shard, output,
+                                                            model->loss_function) * worker->rows;
+        } else {
+            worker->loss = compute_loss(y_shard, output, model->loss_function) * worker->rows;
+            compute_loss_gradient_into(gradient, y_shard, output, model->loss_function);
+        }
+        scale_inplace(gradient, (double)worker->rows / step->batch_size);
+        profile_end(profiler, PROFILE_LOSS, -1, loss_mark);
+        
+        const Matrix* current = gradient;
+        for (int i = model->num_layers - 1; i >= 0; i--) {
+            ProfileMark mark = profile_begin(profiler);
+            if (fused && i == model->num_layers - 1) {
+                current = backward_pass_from_logits_with_cache(step->layers[i], current,
+                                                               &worker->caches[i],
+                                                               worker->dweights[i],
+                                                               worker->dbiases[i],
+                                                               1.0 / step->batch_size, ws);
+            } else {
+                current = backward_pass_with_cache(step->layers[i], current, &worker->caches[i],
+                                                   worker->dweights[i], worker->dbiases[i],
+                                                   1.0 / step->batch_size, ws);
+            }
+            profile_end(profiler, PROFILE_BACKWARD, i, mark);
+        }
+    }
+}
+
+// Sum the workers' gradients into the model's gradient block, one chunk of
+// it per task, always in worker order so the result does not depend on
+// scheduling
+static void reduce_gradients_task(void* ctx, int begin, int end) {
+    const ParallelStep* step = (const ParallelStep*)ctx;
+    size_t size = step->params->size;
+    
+    for (int c = begin; c < end; c++) {
+        size_t lo = (size_t)c * GRADIENT_REDUCE_CHUNK;
+        size_t hi = lo + GRADIENT_REDUCE_CHUNK < size ? lo + GRADIENT_REDUCE_CHUNK : size;
+        Real* restrict sum = step->params->grads;
+        
+        // Worker 0 always has rows and wrote straight into the layers
+        for (int w = 1; w < step->num_workers; w++) {
+            if (step->workers[w].rows == 0) continue;
+            const Real* restrict g = step->workers[w].grads->values;
+            for (size_t i = lo; i < hi; i++) {
+                sum[i] += g[i];
+            }
+        }
+    }
+}
+
+// Train with each batch split across num_workers data-parallel workers
+void fit_parallel(SequentialModel* model, const Matrix* X, const Matrix* y,
+                  int epochs, int batch_size, int num_workers, int verbose) {
+    if (!model || !X || !y) {
+        printf("ERROR: Model or data is NULL in fit_parallel\n");
+        return;
+    }
+    
+    if (!model->is_compiled) {
+        printf("ERROR: Model must be compiled before training\n");
+        return;
+    }
+    
+    if (X->rows != y->rows) {
+        printf("ERROR: X and y must have same number of samples\n");
+        return;
+    }
+    
+    int num_samples = X->rows;
+    
+    // Use full batch if batch_size is invalid
+    if (batch_size <= 0 || batch_size > num_samples) {
+        batch_size = num_samples;
+    }
+    
+    if (num_workers <= 0) {
+        num_workers = deepc_get_num_threads();
+    }
+    if (num_workers > batch_size) {
+        num_workers = batch_size;
+    }
+    
+    int num_batches = (num_samples + batch_size - 1) / batch_size;
+    
+    ParallelStep step;
+    step.model = model;
+    step.num_workers = num_workers;
+    
+    step.layers = model->layers;
+    step.workers = (TrainingWorker*)calloc(num_workers, sizeof(TrainingWorker));
+    MODEL_CHECK(step.workers != NULL, "Memory allocation failed for training workers");
+    
+    // Before taking the layers' gradient matrices, which this may replace
+    ParameterBuffer* params = model_parameters(model);
+    step.params = params;
+    int num_reduce_chunks = (int)((params->size + GRADIENT_REDUCE_CHUNK - 1) / GRADIENT_REDUCE_CHUNK);
+    
+    for (int w = 0; w < num_workers; w++) {
+        TrainingWorker* worker = &step.workers[w];
+        worker->caches = (LayerCache*)calloc(model->num_layers, sizeof(LayerCache));
+        worker->dweights = (Matrix**)malloc(model->num_layers * sizeof(Matrix*));
+        worker->dbiases = (Matrix**)malloc(model->num_layers * sizeof(Matrix*));
+        MODEL_CHECK(worker->caches != NULL && worker->dweights != NULL && worker->dbiases != NULL,
+                    "Memory allocation failed for training workers");
+        worker->workspace = create_workspace(0);
+        worker->grads = w == 0 ? NULL : create_matrix(1, (int)params->size);
+        
+        for (int i = 0; i < model->num_layers; i++) {
+            Layer* layer = step.layers[i];
+            if (w == 0) {
+                worker->dweights[i] = layer->dweights;
+                worker->dbiases[i] = layer->dbiases;
+            } else {
+                worker->dweights[i] = create_matrix_view(worker->grads->values + params->weight_offsets[i],
+                                                         layer->dweights->rows, layer->dweights->cols,
+                                                         layer->dweights->cols);
+                worker->dbiases[i] = create_matrix_view(worker->grads->values + params->bias_offsets[i],
+                                                        layer->dbiases->rows, layer->dbiases->cols,
+                                                        layer->dbiases->cols);
+            }
+        }
+    }
+    
+    DataLoader* loader = create_data_loader(X, y, batch_size, model->shuffle, 0,
+                                            rng_next(&model->rng));
+    
+    if (verbose) {
+        printf("Starting parallel training...\n");
+        printf("Samples: %d, Batch size: %d, Batches per epoch: %d, Epochs: %d, Workers: %d\n",
+               num_samples, batch_size, num_batches, epochs, num_workers);
+    }
+    
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        double total_loss = 0.0;
+        
+        Matrix* X_batch;
+        Matrix* y_batch;
+        int current_batch_size;
+        
+        for (int batch = 0;
+             (current_batch_size = next_batch(model, loader, &X_batch, &y_batch, epoch, batch)) > 0;
+             batch++) {
+            step.X = X_batch;
+            step.y = y_batch;
+            step.batch_size = current_batch_size;
             
-            if (loss_gradient) {
-                // Backward pass
-                backward_propagation(model, loss_gradient);
-                
-                // Update weights
-                update_model_weights(model);
-                
-                free_matrix(loss_gradient);
+            ProfileMark step_mark = profile_begin(model->profiler);
+            parallel_for(num_workers, 1, train_shard_task, &step);
+            
+            ProfileMark reduce_mark = profile_begin(model->profiler);
+            parallel_for(num_reduce_chunks, 1, reduce_gradients_task, &step);
+            profile_end(model->profiler, PROFILE_REDUCE, -1, reduce_mark);
+            
+            double batch_loss = 0.0;
+            for (int w = 0; w < num_workers; w++) {
+                batch_loss += step.workers[w].loss;
             }
+            total_loss += batch_loss;
+            batch_loss /= step.batch_size;
             
-            // Cleanup
-            free_matrix(predictions);
-            free_matrix(X_batch);
-            free_matrix(y_batch);
+            // Update weights
+            update_model_weights(model);
+            profile_end(model->profiler, PROFILE_STEP, -1, step_mark);
+            profile_batch_done(model->profiler, current_batch_size, batch_loss);
             
             if (verbose && batch % 10 == 0) {
                 printf("Epoch %d, Batch %d/%d - Loss: %.6f\n", 
@@ -277,18 +1060,333 @@ void fit(SequentialModel* model, const Matrix* X, const Matrix* y,
             printf("Epoch %d/%d - Average Loss: %.6f\n", epoch + 1, epochs, average_loss);
         }
     }
+    
+    for (int w = 0; w < num_workers; w++) {
+        TrainingWorker* worker = &step.workers[w];
+        for (int i = 0; i < model->num_layers; i++) {
+            release_layer_cache(&worker->caches[i]);
+            if (w > 0) {
+                free_matrix(worker->dweights[i]);
+                free_matrix(worker->dbiases[i]);
+            }
+        }
+        free_matrix(worker->grads);
+        free_workspace(worker->workspace);
+        free(worker->caches);
+        free(worker->dweights);
+        free(worker->dbiases);
+    }
+    free(step.workers);
+    free_data_loader(loader);
+}
+
+// One step of distributed training: the local forward and backward passes
+// under the memory plan, with every layer's gradients averaged over the
+// ranks as soon as they are computed. A rank whose shard has no batch left
+// this epoch (rows 0) contributes nothing but still takes part in every
+// reduction. Returns the global batch loss and sets *total_rows.
+static double distributed_train_step(SequentialModel* model, Communicator* comm,
+                                     const Matrix* X_batch, const Matrix* y_batch, int rows,
+                                     double* total_rows) {
+    ProfileMark step_mark = profile_begin(model->profiler);
+    
+    if (rows > 0) {
+        MemoryPlan* plan = model->plan;
+        memory_plan_bind(plan, rows);
+        Matrix* predictions = forward_propagation_planned(model, X_batch, plan);
+        MODEL_CHECK(predictions != NULL, "Forward pass failed in distributed training");
+        
+        double batch_loss;
+        int fused = compute_step_loss(model, y_batch, predictions, plan->loss_gradient, &batch_loss);
+        comm_begin_step(comm, rows, batch_loss * rows);
+        backward_propagation_planned(model, X_batch, plan->loss_gradient, fused, plan, comm);
+    } else {
+        ParameterBuffer* params = model_parameters(model);
+        memset(params->grads, 0, params->size * sizeof(Real));
+        comm_begin_step(comm, 0, 0.0);
+        for (int i = model->num_layers - 1; i >= 0; i--) {
+            reduce_layer_gradients(comm, model->layers[i]);
+        }
+    }
+    
+    // Whatever the last reductions did not overlap with
+    ProfileMark reduce_mark = profile_begin(model->profiler);
+    double total_loss;
+    comm_wait(comm, total_rows, &total_loss);
+    profile_end(model->profiler, PROFILE_REDUCE, -1, reduce_mark);
+    
+    // Every rank applies the same averaged gradients to the same weights
+    update_model_weights(model);
+    profile_end(model->profiler, PROFILE_STEP, -1, step_mark);
+    return total_loss / *total_rows;
+}
+
+// Rank 0 writes the checkpoint next to its final name first, so a crash
+// mid-write never leaves a truncated checkpoint behind
+static void write_checkpoint(const SequentialModel* model, const char* path) {
+    size_t length = strlen(path) + 5;
+    char* temporary = (char*)malloc(length);
+    MODEL_CHECK(temporary != NULL, "Memory allocation failed for checkpoint path");
+    snprintf(temporary, length, "%s.tmp", path);
+    save_model_binary(model, temporary);
+    MODEL_CHECK(rename(temporary, path) == 0, "Could not move the checkpoint into place");
+    free(temporary);
+}
+
+void fit_distributed(SequentialModel* model, Communicator* comm, const Matrix* X, const Matrix* y,
+                     int epochs, int batch_size, const char* checkpoint_path, int verbose) {
+    MODEL_CHECK(model != NULL && comm != NULL, "Model and communicator cannot be NULL");
+    MODEL_CHECK(X != NULL && y != NULL, "Every rank needs a shard of the data");
+    MODEL_CHECK(model->is_compiled, "Model must be compiled before training");
+    MODEL_CHECK(X->rows == y->rows, "X and y must have same number of samples");
+    MODEL_CHECK(batch_size > 0, "Batch size must be positive");
+    
+    int local_batch = batch_size < X->rows ? batch_size : X->rows;
+    
+    // The epoch lasts as many steps as the largest shard needs
+    double* shard_rows = (double*)calloc(comm->world_size, sizeof(double));
+    MODEL_CHECK(shard_rows != NULL, "Memory allocation failed for shard sizes");
+    shard_rows[comm->rank] = X->rows;
+    comm_allreduce_sum_double(comm, shard_rows, comm->world_size);
+    double num_samples = 0.0;
+    int num_steps = 0;
+    for (int r = 0; r < comm->world_size; r++) {
+        int steps = (int)((shard_rows[r] + batch_size - 1) / batch_size);
+        if (steps > num_steps) num_steps = steps;
+        num_samples += shard_rows[r];
+    }
+    free(shard_rows);
+    
+    if (!model->plan || model->plan->batch_size < local_batch ||
+        model->plan->num_layers != model->num_layers) {
+        compile_for_batch(model, local_batch);
+    }
+    if (!model->workspace) {
+        model->workspace = create_workspace(0);
+    }
+    
+    // Start every rank from rank 0's weights
+    ParameterBuffer* params = model_parameters(model);
+    comm_broadcast(comm, params->values, params->size);
+    dequantize_model(model);
+    
+    DataLoader* loader = create_data_loader(X, y, local_batch, model->shuffle, 0,
+                                            rng_next(&model->rng));
+    
+    int report = verbose && comm->rank == 0;
+    if (report) {
+        printf("Starting distributed training...\n");
+        printf("Ranks: %d, Samples: %.0f, Batch size: %d per rank, Steps per epoch: %d, Epochs: %d\n",
+               comm->world_size, num_samples, batch_size, num_steps, epochs);
+    }
+    
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        double total_loss = 0.0;
+        int exhausted = 0;
+        
+        for (int batch = 0; batch < num_steps; batch++) {
+            Matrix* X_batch = NULL;
+            Matrix* y_batch = NULL;
+            int rows = 0;
+            if (!exhausted) {
+                rows = next_batch(model, loader, &X_batch, &y_batch, epoch, batch);
+                exhausted = rows == 0;
+            } else {
+                profile_begin_batch(model->profiler, epoch, batch);
+            }
+            
+            begin_training_step(model);
+            double step_rows;
+            double batch_loss = distributed_train_step(model, comm, X_batch, y_batch, rows,
+                                                       &step_rows);
+            total_loss += batch_loss * step_rows;
+            profile_batch_done(model->profiler, rows, batch_loss);
+            
+            if (report && batch % 10 == 0) {
+                printf("Epoch %d, Batch %d/%d - Loss: %.6f\n",
+                       epoch + 1, batch + 1, num_steps, batch_loss);
+            }
+        }
+        
+        // Take the end-of-epoch marker so the next epoch starts afresh
+        if (!exhausted) {
+            Matrix *X_batch, *y_batch;
+            MODEL_CHECK(data_loader_next(loader, &X_batch, &y_batch) == 0,
+                        "Shard has more batches than the epoch has steps");
+        }
+        
+        if (report) {
+            printf("Epoch %d/%d - Average Loss: %.6f\n", epoch + 1, epochs, total_loss / num_samples);
+        }
+        if (checkpoint_path && comm->rank == 0) {
+            write_checkpoint(model, checkpoint_path);
+        }
+    }
+    
+    free_data_loader(loader);
 }
 
 // Evaluate model on test data
 double evaluate(SequentialModel* model, const Matrix* X, const Matrix* y) {
+    return evaluate_metrics(model, X, y, 0).loss;
+}
+
+// Rows of y_pred whose prediction matches y_true
+static int count_correct(const Matrix* y_true, const Matrix* y_pred) {
+    int correct = 0;
+    for (int i = 0; i < y_true->rows; i++) {
+        const Real* t = y_true->data[i];
+        const Real* p = y_pred->data[i];
+        if (y_true->cols == 1) {
+            correct += (p[0] >= 0.5) == (t[0] >= 0.5);
+            continue;
+        }
+        int predicted = 0, expected = 0;
+        for (int j = 1; j < y_true->cols; j++) {
+            if (p[j] > p[predicted]) predicted = j;
+            if (t[j] > t[expected]) expected = j;
+        }
+        correct += predicted == expected;
+    }
+    return correct;
+}
+
+// Loss and accuracy batch by batch; every loss is a mean over the rows (or
+// the rows and the fixed number of columns), so weighting the batch losses
+// by their rows gives the loss over the whole set
+EvaluationMetrics evaluate_metrics(SequentialModel* model, const Matrix* X, const Matrix* y,
+                                   int batch_size) {
     MODEL_CHECK(model != NULL, "Model cannot be NULL");
     MODEL_CHECK(X != NULL && y != NULL, "Data cannot be NULL");
-    
-    Matrix* predictions = predict(model, X);
-    double loss = compute_loss(y, predictions, model->loss_function);
+    MODEL_CHECK(model->input_layer != NULL, "Model has no layers");
+    MODEL_CHECK(X->rows == y->rows, "X and y must have same number of samples");
+    MODEL_CHECK(X->cols == model->input_layer->input_size, "Input dimension doesn't match the model");
+    MODEL_CHECK(y->cols == model->output_layer->output_size, "Target dimension doesn't match the model");
+    
+    EvaluationMetrics metrics = { 0.0, 0.0, X->rows };
+    if (X->rows == 0) return metrics;
+    
+    if (batch_size <= 0) batch_size = EVALUATE_BATCH_ROWS;
+    if (batch_size > X->rows) batch_size = X->rows;
+    InferenceSession* session = create_inference_session(model, batch_size);
+    Matrix* predictions = create_matrix(batch_size, model->output_layer->output_size);
+    
+    double loss_sum = 0.0;
+    int correct = 0;
+    for (int row = 0; row < X->rows; row += batch_size) {
+        int rows = X->rows - row < batch_size ? X->rows - row : batch_size;
+        Matrix X_rows = *X, y_rows = *y, p_rows = *predictions;
+        X_rows.data += row;
+        y_rows.data += row;
+        X_rows.rows = y_rows.rows = p_rows.rows = rows;
+        
+        predict_into(session, &X_rows, &p_rows);
+        loss_sum += compute_loss(&y_rows, &p_rows, model->loss_function) * rows;
+        correct += count_correct(&y_rows, &p_rows);
+    }
     
     free_matrix(predictions);
-    return loss;
+    free_inference_session(session);
+    
+    metrics.loss = loss_sum / X->rows;
+    metrics.accuracy = (double)correct / X->rows;
+    return metrics;
+}
+
+void set_validation_data(SequentialModel* model, const Matrix* X, const Matrix* y, int batch_size) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    MODEL_CHECK(!X || (y && X->rows == y->rows), "X and y must have same number of samples");
+    
+    model->validation.X = X;
+    model->validation.y = y;
+    model->validation.batch_size = batch_size;
+}
+
+void set_early_stopping(SequentialModel* model, int patience, double min_delta,
+                        int restore_best_weights) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    MODEL_CHECK(patience >= 0, "Patience cannot be negative");
+    MODEL_CHECK(min_delta >= 0, "Minimum improvement cannot be negative");
+    
+    model->validation.patience = patience;
+    model->validation.min_delta = min_delta;
+    model->validation.restore_best = restore_best_weights;
+}
+
+// Start collecting training stats, discarding any collected so far (the
+// batch callback stays)
+void enable_profiling(SequentialModel* model, int record_trace) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    Profiler* profiler = create_profiler(model->num_layers, record_trace);
+    profiler_copy_callback(profiler, model->profiler);
+    free_profiler(model->profiler);
+    model->profiler = profiler;
+}
+
+void disable_profiling(SequentialModel* model) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    free_profiler(model->profiler);
+    model->profiler = NULL;
+}
+
+const TrainingStats* get_training_stats(const SequentialModel* model) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    return profiler_stats(model->profiler);
+}
+
+void set_batch_callback(SequentialModel* model, BatchCallback callback, void* user_data) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    if (!model->profiler) {
+        model->profiler = create_profiler(model->num_layers, 0);
+    }
+    profiler_set_callback(model->profiler, callback, user_data);
+}
+
+int write_training_trace(const SequentialModel* model, const char* filename) {
+    MODEL_CHECK(model != NULL, "Model cannot be NULL");
+    
+    if (!model->profiler) {
+        printf("ERROR: Profiling is not enabled on this model\n");
+        return 0;
+    }
+    return profiler_write_trace(model->profiler, filename);
+}
+
+// One row of the profile table: time and allocations per batch
+static void print_profile_row(const char* name, const ProfileTimer* timer, const TrainingStats* stats) {
+    double per_batch = timer->seconds / stats->batches;
+    double share = stats->step.seconds > 0 ? 100.0 * timer->seconds / stats->step.seconds : 0.0;
+    printf("%-22s %10.3f ms %7.1f%% %10.1f %12.0f\n", name, per_batch * 1e3, share,
+           (double)timer->allocations / stats->batches,
+           (double)timer->allocated_bytes / stats->batches);
+}
+
+// Where training time went, per batch, when the model was profiled
+static void print_training_profile(const SequentialModel* model) {
+    const TrainingStats* stats = profiler_stats(model->profiler);
+    if (!stats || stats->batches == 0) return;
+    
+    printf("\nTraining Profile (%ld batches, %ld samples, %.0f samples/s):\n",
+           stats->batches, stats->samples,
+           stats->step.seconds > 0 ? stats->samples / stats->step.seconds : 0.0);
+    printf("%-22s %13s %8s %10s %12s\n", "", "Time/batch", "Of step", "Allocs", "Bytes");
+    printf("-------------------------------------------------------------------\n");
+    
+    char name[32];
+    for (int i = 0; i < stats->num_layers; i++) {
+        snprintf(name, sizeof(name), "Layer %d forward", i + 1);
+        print_profile_row(name, &stats->layers[i].forward, stats);
+        snprintf(name, sizeof(name), "Layer %d backward", i + 1);
+        print_profile_row(name, &stats->layers[i].backward, stats);
+    }
+    print_profile_row("Loss", &stats->loss, stats);
+    if (stats->reduce.calls > 0) print_profile_row("Gradient reduction", &stats->reduce, stats);
+    print_profile_row("Optimizer update", &stats->update, stats);
+    print_profile_row("Step total", &stats->step, stats);
+    print_profile_row("Batch assembly (wait)", &stats->batch_assembly, stats);
 }
 
 // Print model summary
@@ -300,7 +1398,7 @@ void print_model_summary(const SequentialModel* model) {
     
     if (model->is_compiled) {
         printf("Compiled: Yes\n");
-        printf("Optimizer: %s\n", model->optimizer_type == SGD ? "SGD" : "Adam");
+        printf("Optimizer: %s\n", optimizer_name(model->optimizer_type));
         printf("Loss: %s\n", 
                model->loss_function == MEAN_SQUARED_ERROR ? "MSE" : 
                model->loss_function == BINARY_CROSSENTROPY ? "BinaryCE" : "CategoricalCE");
@@ -340,6 +1438,15 @@ void print_model_summary(const SequentialModel* model) {
     
     printf("-------------------------------------------------\n");
     printf("Total parameters: %d\n", total_params);
+    if (model->plan) {
+        printf("Memory plan: batch %d, %.1f KB of activations and gradients (%.1f KB unshared)\n",
+               model->plan->batch_size, model->plan->arena_bytes / 1024.0,
+               model->plan->unshared_bytes / 1024.0);
+        if (model->plan->checkpoint_every > 0) {
+            printf("Gradient checkpointing: segments of %d layers\n", model->plan->checkpoint_every);
+        }
+    }
+    print_training_profile(model);
     printf("=================================================\n\n");
 }
 
@@ -412,6 +1519,15 @@ SequentialModel* load_model(const char* filename) {
     
     char line[256];
     
+    // Binary models have their own loader
+    char magic[DEEPC_BINARY_MAGIC_SIZE];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+        memcmp(magic, DEEPC_BINARY_MAGIC, sizeof(magic)) == 0) {
+        fclose(file);
+        return load_model_binary(filename);
+    }
+    rewind(file);
+    
     // Check file format
     if (!fgets(line, sizeof(line), file) || strcmp(line, "DEEPC_MODEL_V2\n") != 0) {
         printf("ERROR: Invalid model file format\n");
@@ -444,7 +1560,6 @@ SequentialModel* load_model(const char* filename) {
     
     // Create model
     SequentialModel* model = create_model(model_name);
-    model->num_layers = num_layers;
     model->is_compiled = is_compiled;
     model->optimizer_type = optimizer_type;
     model->loss_function = loss_function;
@@ -502,13 +1617,7 @@ SequentialModel* load_model(const char* filename) {
         fgets(line, sizeof(line), file); // LAYER_END
         
         // Add layer to model
-        if (model->input_layer == NULL) {
-            model->input_layer = layer;
-            model->output_layer = layer;
-        } else {
-            model->output_layer->next = layer;
-            model->output_layer = layer;
-        }
+        add_layer(model, layer);
     }
     
     fclose(file);
@@ -517,7 +1626,7 @@ SequentialModel* load_model(const char* filename) {
     if (is_compiled) {
         model->optimizer = create_optimizer(optimizer_type, learning_rate);
         printf("Model compiled: %s optimizer, %s loss, lr=%.4f\n",
-               optimizer_type == SGD ? "SGD" : "Adam",
+               optimizer_name(optimizer_type),
                loss_function == MEAN_SQUARED_ERROR ? "MSE" :
                loss_function == BINARY_CROSSENTROPY ? "BinaryCE" : "CategoricalCE",
                learning_rate);
@@ -575,6 +1684,8 @@ void load_weights(SequentialModel* model, const char* filename) {
         return;
     }
     
+    dequantize_model(model);
+    
     char line[256];
     
     // Check file format
@@ -1,6 +1,9 @@
 #include "deepc/optimizers.h"
+#include "deepc/threadpool.h"
+#include "deepc/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 // Error handling
@@ -19,179 +22,381 @@
     } \
 } while(0)
 
+// One copy of the update kernels per ISA level, picked by the loader
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define OPTIMIZER_CLONES __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define OPTIMIZER_CLONES
+#endif
+
+// Parameters per parallel chunk of an optimizer step
+#define OPTIMIZER_CHUNK 8192
+
 // Create optimizer
 OptimizerState* create_optimizer(Optimizer type, double learning_rate) {
     OPTIMIZER_CHECK(learning_rate > 0, "Learning rate must be positive");
-    
+    OPTIMIZER_CHECK(type == SGD || type == ADAM || type == ADAMW, "Unknown optimizer type");
+
     OptimizerState* optimizer = (OptimizerState*)malloc(sizeof(OptimizerState));
     OPTIMIZER_CHECK(optimizer != NULL, "Memory allocation failed for optimizer");
-    
+
     optimizer->type = type;
     optimizer->learning_rate = learning_rate;
     optimizer->timestep = 0;
-    optimizer->max_layers = 100; // Support up to 100 layers
-    
-    if (type == ADAM) {
-        optimizer->beta1 = 0.9;
-        optimizer->beta2 = 0.999;
-        optimizer->epsilon = 1e-8;
-        
-        // Allocate arrays for moments
-        optimizer->m_weights = (Matrix***)calloc(optimizer->max_layers, sizeof(Matrix**));
-        optimizer->v_weights = (Matrix***)calloc(optimizer->max_layers, sizeof(Matrix**));
-        optimizer->m_biases = (Matrix***)calloc(optimizer->max_layers, sizeof(Matrix**));
-        optimizer->v_biases = (Matrix***)calloc(optimizer->max_layers, sizeof(Matrix**));
-    } else {
-        optimizer->m_weights = NULL;
-        optimizer->v_weights = NULL;
-        optimizer->m_biases = NULL;
-        optimizer->v_biases = NULL;
-    }
-    
+
+    optimizer->beta1 = 0.9;
+    optimizer->beta2 = 0.999;
+    optimizer->epsilon = 1e-8;
+    optimizer->momentum = 0.0;
+    optimizer->weight_decay = type == ADAMW ? 0.01 : 0.0;
+    optimizer->clip_norm = 0.0;
+
+    // The state is sized by the parameters, so the first step allocates it
+    optimizer->m = NULL;
+    optimizer->v = NULL;
+    optimizer->norm_partials = NULL;
+    optimizer->state_size = 0;
+
     return optimizer;
 }
 
 // Free optimizer memory
 void free_optimizer(OptimizerState* optimizer) {
     if (!optimizer) return;
-    
-    if (optimizer->m_weights) {
-        for (int i = 0; i < optimizer->max_layers; i++) {
-            if (optimizer->m_weights[i]) free_matrix(*optimizer->m_weights[i]);
-            if (optimizer->v_weights[i]) free_matrix(*optimizer->v_weights[i]);
-            if (optimizer->m_biases[i]) free_matrix(*optimizer->m_biases[i]);
-            if (optimizer->v_biases[i]) free_matrix(*optimizer->v_biases[i]);
-        }
-        free(optimizer->m_weights);
-        free(optimizer->v_weights);
-        free(optimizer->m_biases);
-        free(optimizer->v_biases);
-    }
-    
+
+    free(optimizer->m);
+    free(optimizer->v);
+    free(optimizer->norm_partials);
     free(optimizer);
 }
 
-// Initialize Adam moments for a layer
-void initialize_adam_moments(OptimizerState* optimizer, Layer* layer, int layer_index) {
+const char* optimizer_name(Optimizer type) {
+    switch (type) {
+        case SGD:   return "SGD";
+        case ADAM:  return "Adam";
+        case ADAMW: return "AdamW";
+        default:    return "Unknown";
+    }
+}
+
+void set_momentum(OptimizerState* optimizer, double momentum) {
+    OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
+    OPTIMIZER_CHECK(momentum >= 0 && momentum < 1, "Momentum must be in [0, 1)");
+    optimizer->momentum = momentum;
+}
+
+void set_weight_decay(OptimizerState* optimizer, double weight_decay) {
+    OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
+    OPTIMIZER_CHECK(weight_decay >= 0, "Weight decay cannot be negative");
+    optimizer->weight_decay = weight_decay;
+}
+
+void set_gradient_clipping(OptimizerState* optimizer, double max_norm) {
     OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
-    OPTIMIZER_CHECK(layer != NULL, "Layer cannot be NULL");
-    OPTIMIZER_CHECK(layer_index < optimizer->max_layers, "Layer index out of bounds");
-    
-    if (optimizer->m_weights[layer_index] == NULL) {
-        optimizer->m_weights[layer_index] = (Matrix**)malloc(sizeof(Matrix*));
-        optimizer->v_weights[layer_index] = (Matrix**)malloc(sizeof(Matrix*));
-        optimizer->m_biases[layer_index] = (Matrix**)malloc(sizeof(Matrix*));
-        optimizer->v_biases[layer_index] = (Matrix**)malloc(sizeof(Matrix*));
-        
-        *optimizer->m_weights[layer_index] = create_matrix(layer->weights->rows, layer->weights->cols);
-        *optimizer->v_weights[layer_index] = create_matrix(layer->weights->rows, layer->weights->cols);
-        *optimizer->m_biases[layer_index] = create_matrix(layer->biases->rows, layer->biases->cols);
-        *optimizer->v_biases[layer_index] = create_matrix(layer->biases->rows, layer->biases->cols);
-        
-        // Initialize to zeros
-        for (int i = 0; i < layer->weights->rows; i++) {
-            for (int j = 0; j < layer->weights->cols; j++) {
-                (*optimizer->m_weights[layer_index])->data[i][j] = 0.0;
-                (*optimizer->v_weights[layer_index])->data[i][j] = 0.0;
-            }
+    OPTIMIZER_CHECK(max_norm >= 0, "Clipping norm cannot be negative");
+    optimizer->clip_norm = max_norm;
+}
+
+// Zeroed block of count elements on a MATRIX_ALIGNMENT boundary
+static Real* alloc_block(size_t count) {
+    void* block = NULL;
+    size_t bytes = count > 0 ? count * sizeof(Real) : MATRIX_ALIGNMENT;
+    OPTIMIZER_CHECK(posix_memalign(&block, MATRIX_ALIGNMENT, bytes) == 0,
+                    "Memory allocation failed for parameter block");
+    memset(block, 0, bytes);
+    profile_count_allocation(bytes);
+    return (Real*)block;
+}
+
+// Round count up to whole MATRIX_ALIGNMENT units
+static size_t aligned_count(size_t count) {
+    size_t unit = MATRIX_ALIGNMENT / sizeof(Real);
+    return (count + unit - 1) / unit * unit;
+}
+
+// Copy m into the block at offset and return a view of it there, freeing m
+static Matrix* rehome_matrix(Matrix* m, Real* block, size_t offset) {
+    Matrix* view = create_matrix_view(block + offset, m->rows, m->cols, m->cols);
+    copy_into(view, m);
+    free_matrix(m);
+    return view;
+}
+
+ParameterBuffer* create_parameter_buffer(Layer* first_layer) {
+    OPTIMIZER_CHECK(first_layer != NULL, "Layers cannot be NULL");
+
+    ParameterBuffer* params = (ParameterBuffer*)malloc(sizeof(ParameterBuffer));
+    OPTIMIZER_CHECK(params != NULL, "Memory allocation failed for parameter buffer");
+
+    params->num_layers = 0;
+    for (Layer* layer = first_layer; layer; layer = layer->next) {
+        params->num_layers++;
+    }
+
+    params->weight_offsets = (size_t*)malloc(params->num_layers * sizeof(size_t));
+    params->bias_offsets = (size_t*)malloc(params->num_layers * sizeof(size_t));
+    OPTIMIZER_CHECK(params->weight_offsets != NULL && params->bias_offsets != NULL,
+                    "Memory allocation failed for parameter offsets");
+
+    // All weights first, so weight decay covers one prefix of the block
+    size_t size = 0;
+    int i = 0;
+    for (Layer* layer = first_layer; layer; layer = layer->next, i++) {
+        params->weight_offsets[i] = size;
+        size += aligned_count((size_t)layer->weights->rows * layer->weights->cols);
+    }
+    params->weights_size = size;
+    i = 0;
+    for (Layer* layer = first_layer; layer; layer = layer->next, i++) {
+        params->bias_offsets[i] = size;
+        size += aligned_count((size_t)layer->biases->rows * layer->biases->cols);
+    }
+    params->size = size;
+
+    // Padding stays zero in both blocks, and every update maps zero to zero
+    params->values = alloc_block(size);
+    params->grads = alloc_block(size);
+
+    i = 0;
+    for (Layer* layer = first_layer; layer; layer = layer->next, i++) {
+        layer->weights = rehome_matrix(layer->weights, params->values, params->weight_offsets[i]);
+        layer->biases = rehome_matrix(layer->biases, params->values, params->bias_offsets[i]);
+        layer->dweights = rehome_matrix(layer->dweights, params->grads, params->weight_offsets[i]);
+        layer->dbiases = rehome_matrix(layer->dbiases, params->grads, params->bias_offsets[i]);
+    }
+
+    return params;
+}
+
+// The layers' views are left alone; they must not be used afterwards
+void free_parameter_buffer(ParameterBuffer* params) {
+    if (!params) return;
+
+    free(params->values);
+    free(params->grads);
+    free(params->weight_offsets);
+    free(params->bias_offsets);
+    free(params);
+}
+
+int parameter_buffer_matches(const ParameterBuffer* params, const Layer* first_layer) {
+    if (!params) return 0;
+
+    int i = 0;
+    for (const Layer* layer = first_layer; layer; layer = layer->next, i++) {
+        if (i >= params->num_layers) return 0;
+        if (layer->weights->values != params->values + params->weight_offsets[i] ||
+            layer->biases->values != params->values + params->bias_offsets[i] ||
+            layer->dweights->values != params->grads + params->weight_offsets[i] ||
+            layer->dbiases->values != params->grads + params->bias_offsets[i]) {
+            return 0;
         }
-        for (int i = 0; i < layer->biases->rows; i++) {
-            (*optimizer->m_biases[layer_index])->data[i][0] = 0.0;
-            (*optimizer->v_biases[layer_index])->data[i][0] = 0.0;
+    }
+    return i == params->num_layers;
+}
+
+// Point a view at values laid out like it (rows stride elements apart)
+static void repoint_view(Matrix* m, Real* values) {
+    m->values = values;
+    for (int i = 0; i < m->rows; i++) {
+        m->data[i] = values + (size_t)i * m->stride;
+    }
+}
+
+Real* create_parameter_snapshot(const ParameterBuffer* params) {
+    OPTIMIZER_CHECK(params != NULL, "Parameter buffer cannot be NULL");
+    return alloc_block(params->size);
+}
+
+void save_parameter_snapshot(const ParameterBuffer* params, Real* snapshot) {
+    OPTIMIZER_CHECK(params != NULL && snapshot != NULL, "Arguments cannot be NULL");
+    memcpy(snapshot, params->values, params->size * sizeof(Real));
+}
+
+void swap_parameter_snapshot(ParameterBuffer* params, Layer* first_layer, Real** snapshot) {
+    OPTIMIZER_CHECK(params != NULL && snapshot != NULL && *snapshot != NULL,
+                    "Arguments cannot be NULL");
+    OPTIMIZER_CHECK(parameter_buffer_matches(params, first_layer),
+                    "Layers are not views of the parameter buffer");
+
+    Real* values = *snapshot;
+    *snapshot = params->values;
+    params->values = values;
+
+    int i = 0;
+    for (Layer* layer = first_layer; layer; layer = layer->next, i++) {
+        repoint_view(layer->weights, values + params->weight_offsets[i]);
+        repoint_view(layer->biases, values + params->bias_offsets[i]);
+    }
+}
+
+// Update kernels over n contiguous parameters. keep = 1 - lr * weight_decay
+// for weights and 1 for biases; grad_scale is the clipping factor.
+OPTIMIZER_CLONES
+static void sgd_kernel(Real* restrict w, const Real* restrict g, size_t n,
+                       Real lr, Real grad_scale, Real keep) {
+    for (size_t i = 0; i < n; i++) {
+        w[i] = keep * w[i] - lr * (grad_scale * g[i]);
+    }
+}
+
+OPTIMIZER_CLONES
+static void momentum_kernel(Real* restrict w, const Real* restrict g, Real* restrict velocity,
+                            size_t n, Real lr, Real momentum, Real grad_scale, Real keep) {
+    for (size_t i = 0; i < n; i++) {
+        velocity[i] = momentum * velocity[i] + grad_scale * g[i];
+        w[i] = keep * w[i] - lr * velocity[i];
+    }
+}
+
+// With both bias corrections folded into step_size and inv_sqrt_bc2 this is
+// w -= lr * m_hat / (sqrt(v_hat) + epsilon), m_hat = m / (1 - beta1^t) and
+// v_hat = v / (1 - beta2^t)
+OPTIMIZER_CLONES
+static void adam_kernel(Real* restrict w, const Real* restrict g, Real* restrict m,
+                        Real* restrict v, size_t n, Real beta1, Real beta2, Real step_size,
+                        Real inv_sqrt_bc2, Real epsilon, Real grad_scale, Real keep) {
+    const Real one_minus_beta1 = 1 - beta1;
+    const Real one_minus_beta2 = 1 - beta2;
+
+    for (size_t i = 0; i < n; i++) {
+        Real grad = grad_scale * g[i];
+
+        // Biased first and second raw moment estimates
+        m[i] = beta1 * m[i] + one_minus_beta1 * grad;
+        v[i] = beta2 * v[i] + one_minus_beta2 * grad * grad;
+
+        w[i] = keep * w[i] - step_size * m[i] / (real_sqrt(v[i]) * inv_sqrt_bc2 + epsilon);
+    }
+}
+
+// Constants of one step, shared by all chunks
+typedef struct {
+    const OptimizerState* optimizer;
+    ParameterBuffer* params;
+    double grad_scale;
+    double step_size;           // Adam: lr / (1 - beta1^t); SGD: lr
+    double inv_sqrt_bc2;        // Adam: 1 / sqrt(1 - beta2^t)
+    double keep;                // 1 - lr * weight_decay
+    double* partials;           // squared gradient norm per chunk
+} StepTask;
+
+static void update_range(const StepTask* t, size_t begin, size_t end, Real keep) {
+    if (begin >= end) return;
+
+    const OptimizerState* opt = t->optimizer;
+    Real* w = t->params->values + begin;
+    const Real* g = t->params->grads + begin;
+    size_t n = end - begin;
+
+    if (opt->type == SGD) {
+        if (opt->momentum > 0) {
+            momentum_kernel(w, g, opt->m + begin, n, t->step_size, opt->momentum,
+                            t->grad_scale, keep);
+        } else {
+            sgd_kernel(w, g, n, t->step_size, t->grad_scale, keep);
         }
+    } else {
+        adam_kernel(w, g, opt->m + begin, opt->v + begin, n, opt->beta1, opt->beta2,
+                    t->step_size, t->inv_sqrt_bc2, opt->epsilon, t->grad_scale, keep);
     }
 }
 
-// Update weights using SGD
-void update_weights_sgd(Layer* layer, OptimizerState* optimizer) {
-    OPTIMIZER_CHECK(layer != NULL, "Layer cannot be NULL");
-    OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
-    
-    // Update weights: w = w - lr * dw
-    for (int i = 0; i < layer->weights->rows; i++) {
-        for (int j = 0; j < layer->weights->cols; j++) {
-            layer->weights->data[i][j] -= optimizer->learning_rate * layer->dweights->data[i][j];
+static void update_task(void* ctx, int begin, int end) {
+    const StepTask* t = (const StepTask*)ctx;
+    size_t decay_end = t->params->weights_size;
+
+    for (int c = begin; c < end; c++) {
+        size_t lo = (size_t)c * OPTIMIZER_CHUNK;
+        size_t hi = lo + OPTIMIZER_CHUNK < t->params->size ? lo + OPTIMIZER_CHUNK : t->params->size;
+
+        // Weights decay and biases do not
+        update_range(t, lo, hi < decay_end ? hi : decay_end, (Real)t->keep);
+        update_range(t, lo > decay_end ? lo : decay_end, hi, 1);
+    }
+}
+
+static void norm_task(void* ctx, int begin, int end) {
+    const StepTask* t = (const StepTask*)ctx;
+
+    for (int c = begin; c < end; c++) {
+        size_t lo = (size_t)c * OPTIMIZER_CHUNK;
+        size_t hi = lo + OPTIMIZER_CHUNK < t->params->size ? lo + OPTIMIZER_CHUNK : t->params->size;
+        const Real* g = t->params->grads;
+
+        double sum = 0.0;
+        for (size_t i = lo; i < hi; i++) {
+            sum += (double)g[i] * g[i];
         }
+        t->partials[c] = sum;
+    }
+}
+
+// Allocate (or, after a layout change, reset) the per-parameter state
+static void prepare_state(OptimizerState* optimizer, size_t size) {
+    if (optimizer->state_size != size) {
+        free(optimizer->m);
+        free(optimizer->v);
+        free(optimizer->norm_partials);
+        optimizer->m = NULL;
+        optimizer->v = NULL;
+        optimizer->norm_partials = NULL;
+        optimizer->state_size = size;
+        optimizer->timestep = 0;
     }
-    
-    // Update biases: b = b - lr * db
-    for (int i = 0; i < layer->biases->rows; i++) {
-        layer->biases->data[i][0] -= optimizer->learning_rate * layer->dbiases->data[i][0];
+
+    int needs_m = optimizer->type != SGD || optimizer->momentum > 0;
+    int needs_v = optimizer->type != SGD;
+    if (needs_m && !optimizer->m) optimizer->m = alloc_block(size);
+    if (needs_v && !optimizer->v) optimizer->v = alloc_block(size);
+    if (optimizer->clip_norm > 0 && !optimizer->norm_partials) {
+        size_t num_chunks = (size + OPTIMIZER_CHUNK - 1) / OPTIMIZER_CHUNK;
+        optimizer->norm_partials = (double*)malloc(num_chunks * sizeof(double));
+        OPTIMIZER_CHECK(optimizer->norm_partials != NULL, "Memory allocation failed for gradient norm");
     }
 }
 
-// Update weights using Adam
-void update_weights_adam(Layer* layer, OptimizerState* optimizer, int layer_index) {
-    OPTIMIZER_CHECK(layer != NULL, "Layer cannot be NULL");
+void optimizer_step(OptimizerState* optimizer, ParameterBuffer* params) {
     OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
-    
-    // Initialize moments if needed
-    initialize_adam_moments(optimizer, layer, layer_index);
-    
+    OPTIMIZER_CHECK(params != NULL, "Parameter buffer cannot be NULL");
+
+    prepare_state(optimizer, params->size);
     optimizer->timestep++;
-    
-    double beta1 = optimizer->beta1;
-    double beta2 = optimizer->beta2;
-    double epsilon = optimizer->epsilon;
-    double lr = optimizer->learning_rate;
-    
-    Matrix* m_weights = *optimizer->m_weights[layer_index];
-    Matrix* v_weights = *optimizer->v_weights[layer_index];
-    Matrix* m_biases = *optimizer->m_biases[layer_index];
-    Matrix* v_biases = *optimizer->v_biases[layer_index];
-    
-    // Update weights
-    for (int i = 0; i < layer->weights->rows; i++) {
-        for (int j = 0; j < layer->weights->cols; j++) {
-            double grad = layer->dweights->data[i][j];
-            
-            // Update biased first moment estimate
-            m_weights->data[i][j] = beta1 * m_weights->data[i][j] + (1 - beta1) * grad;
-            // Update biased second raw moment estimate
-            v_weights->data[i][j] = beta2 * v_weights->data[i][j] + (1 - beta2) * grad * grad;
-            
-            // Compute bias-corrected first moment estimate
-            double m_hat = m_weights->data[i][j] / (1 - pow(beta1, optimizer->timestep));
-            // Compute bias-corrected second raw moment estimate
-            double v_hat = v_weights->data[i][j] / (1 - pow(beta2, optimizer->timestep));
-            
-            // Update parameters
-            layer->weights->data[i][j] -= lr * m_hat / (sqrt(v_hat) + epsilon);
+
+    int num_chunks = (int)((params->size + OPTIMIZER_CHUNK - 1) / OPTIMIZER_CHUNK);
+
+    StepTask task;
+    task.optimizer = optimizer;
+    task.params = params;
+    task.grad_scale = 1.0;
+    task.keep = 1.0 - optimizer->learning_rate * optimizer->weight_decay;
+    task.partials = optimizer->norm_partials;
+
+    // Global norm clipping, summed per chunk then in chunk order so the
+    // result does not depend on the thread count
+    if (optimizer->clip_norm > 0) {
+        parallel_for(num_chunks, 1, norm_task, &task);
+
+        double norm = 0.0;
+        for (int c = 0; c < num_chunks; c++) {
+            norm += task.partials[c];
+        }
+        norm = sqrt(norm);
+        if (norm > optimizer->clip_norm) {
+            task.grad_scale = optimizer->clip_norm / norm;
         }
     }
-    
-    // Update biases
-    for (int i = 0; i < layer->biases->rows; i++) {
-        double grad = layer->dbiases->data[i][0];
-        
-        // Update biased first moment estimate
-        m_biases->data[i][0] = beta1 * m_biases->data[i][0] + (1 - beta1) * grad;
-        // Update biased second raw moment estimate
-        v_biases->data[i][0] = beta2 * v_biases->data[i][0] + (1 - beta2) * grad * grad;
-        
-        // Compute bias-corrected first moment estimate
-        double m_hat = m_biases->data[i][0] / (1 - pow(beta1, optimizer->timestep));
-        // Compute bias-corrected second raw moment estimate
-        double v_hat = v_biases->data[i][0] / (1 - pow(beta2, optimizer->timestep));
-        
-        // Update parameters
-        layer->biases->data[i][0] -= lr * m_hat / (sqrt(v_hat) + epsilon);
-    }
-}
-
-// Update weights based on optimizer type
-void update_weights(Layer* layer, OptimizerState* optimizer, int layer_index) {
-    OPTIMIZER_CHECK(layer != NULL, "Layer cannot be NULL");
-    OPTIMIZER_CHECK(optimizer != NULL, "Optimizer cannot be NULL");
-    
-    switch (optimizer->type) {
-        case SGD:
-            update_weights_sgd(layer, optimizer);
-            break;
-        case ADAM:
-            update_weights_adam(layer, optimizer, layer_index);
-            break;
-        default:
-            OPTIMIZER_ERROR("Unknown optimizer type");
+
+    if (optimizer->type == SGD) {
+        task.step_size = optimizer->learning_rate;
+        task.inv_sqrt_bc2 = 1.0;
+    } else {
+        // Bias corrections once per step, not per element
+        double bias_correction1 = 1 - pow(optimizer->beta1, optimizer->timestep);
+        double bias_correction2 = 1 - pow(optimizer->beta2, optimizer->timestep);
+        task.step_size = optimizer->learning_rate / bias_correction1;
+        task.inv_sqrt_bc2 = 1 / sqrt(bias_correction2);
     }
+
+    parallel_for(num_chunks, 1, update_task, &task);
 }
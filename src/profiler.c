@@ -0,0 +1,275 @@
+#include "deepc/profiler.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Error handling
+#define PROFILER_ERROR(msg) do { \
+    fprintf(stderr, "\n*** PROFILER ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define PROFILER_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        PROFILER_ERROR(msg); \
+    } \
+} while(0)
+
+// One timed region of the trace
+typedef struct {
+    double start;           // seconds since the profiler was created
+    double duration;
+    ProfilePhase phase;
+    int layer;
+    int epoch;
+    int batch;
+} TraceEvent;
+
+struct Profiler {
+    TrainingStats stats;
+    BatchCallback callback;
+    void* user_data;
+    double origin;
+
+    int record_trace;
+    TraceEvent* events;
+    size_t num_events;
+    size_t event_capacity;
+
+    // Batch that the regions being timed belong to
+    int epoch;
+    int batch;
+};
+
+static long allocation_count = 0;
+static size_t allocation_bytes = 0;
+
+void profile_count_allocation(size_t bytes) {
+    __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&allocation_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+void deepc_allocation_stats(long* allocations, size_t* allocated_bytes) {
+    if (allocations) *allocations = __atomic_load_n(&allocation_count, __ATOMIC_RELAXED);
+    if (allocated_bytes) *allocated_bytes = __atomic_load_n(&allocation_bytes, __ATOMIC_RELAXED);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+Profiler* create_profiler(int num_layers, int record_trace) {
+    PROFILER_CHECK(num_layers >= 0, "Number of layers cannot be negative");
+
+    Profiler* profiler = (Profiler*)calloc(1, sizeof(Profiler));
+    PROFILER_CHECK(profiler != NULL, "Memory allocation failed for profiler");
+
+    profiler->stats.num_layers = num_layers;
+    profiler->stats.layers = (LayerProfile*)calloc(num_layers > 0 ? num_layers : 1,
+                                                   sizeof(LayerProfile));
+    PROFILER_CHECK(profiler->stats.layers != NULL, "Memory allocation failed for layer profiles");
+
+    profiler->record_trace = record_trace;
+    profiler->origin = now_seconds();
+    return profiler;
+}
+
+void free_profiler(Profiler* profiler) {
+    if (!profiler) return;
+
+    free(profiler->stats.layers);
+    free(profiler->events);
+    free(profiler);
+}
+
+// Zero the totals and drop the trace, keeping the callback
+void reset_profiler(Profiler* profiler) {
+    PROFILER_CHECK(profiler != NULL, "Profiler cannot be NULL");
+
+    LayerProfile* layers = profiler->stats.layers;
+    int num_layers = profiler->stats.num_layers;
+    memset(&profiler->stats, 0, sizeof(TrainingStats));
+    memset(layers, 0, (num_layers > 0 ? num_layers : 1) * sizeof(LayerProfile));
+    profiler->stats.layers = layers;
+    profiler->stats.num_layers = num_layers;
+
+    profiler->num_events = 0;
+    profiler->origin = now_seconds();
+}
+
+const TrainingStats* profiler_stats(const Profiler* profiler) {
+    return profiler ? &profiler->stats : NULL;
+}
+
+void profiler_set_callback(Profiler* profiler, BatchCallback callback, void* user_data) {
+    PROFILER_CHECK(profiler != NULL, "Profiler cannot be NULL");
+    profiler->callback = callback;
+    profiler->user_data = user_data;
+}
+
+// Give profiler the callback of from, which may be NULL
+void profiler_copy_callback(Profiler* profiler, const Profiler* from) {
+    PROFILER_CHECK(profiler != NULL, "Profiler cannot be NULL");
+    if (!from) return;
+    profiler->callback = from->callback;
+    profiler->user_data = from->user_data;
+}
+
+ProfileMark profile_begin(const Profiler* profiler) {
+    ProfileMark mark = {0.0, 0, 0};
+    if (!profiler) return mark;
+
+    deepc_allocation_stats(&mark.allocations, &mark.allocated_bytes);
+    mark.seconds = now_seconds();
+    return mark;
+}
+
+static ProfileTimer* phase_timer(Profiler* profiler, ProfilePhase phase, int layer) {
+    TrainingStats* stats = &profiler->stats;
+
+    switch (phase) {
+        case PROFILE_BATCH_ASSEMBLY: return &stats->batch_assembly;
+        case PROFILE_LOSS:           return &stats->loss;
+        case PROFILE_UPDATE:         return &stats->update;
+        case PROFILE_REDUCE:         return &stats->reduce;
+        case PROFILE_STEP:           return &stats->step;
+        case PROFILE_FORWARD:
+        case PROFILE_BACKWARD:
+            // Layers added after profiling was enabled are not tracked
+            if (layer < 0 || layer >= stats->num_layers) return NULL;
+            return phase == PROFILE_FORWARD ? &stats->layers[layer].forward
+                                            : &stats->layers[layer].backward;
+    }
+    return NULL;
+}
+
+static void record_event(Profiler* profiler, ProfilePhase phase, int layer,
+                         double start, double duration) {
+    if (profiler->num_events == profiler->event_capacity) {
+        if (profiler->event_capacity >= PROFILE_MAX_TRACE_EVENTS) return;
+        size_t capacity = profiler->event_capacity ? profiler->event_capacity * 2 : 1024;
+        TraceEvent* events = (TraceEvent*)realloc(profiler->events, capacity * sizeof(TraceEvent));
+        if (!events) return;
+        profiler->events = events;
+        profiler->event_capacity = capacity;
+    }
+
+    TraceEvent* event = &profiler->events[profiler->num_events++];
+    event->start = start - profiler->origin;
+    event->duration = duration;
+    event->phase = phase;
+    event->layer = layer;
+    event->epoch = profiler->epoch;
+    event->batch = profiler->batch;
+}
+
+void profile_end(Profiler* profiler, ProfilePhase phase, int layer, ProfileMark mark) {
+    if (!profiler) return;
+
+    double end = now_seconds();
+    long allocations;
+    size_t allocated_bytes;
+    deepc_allocation_stats(&allocations, &allocated_bytes);
+
+    ProfileTimer* timer = phase_timer(profiler, phase, layer);
+    if (timer) {
+        timer->seconds += end - mark.seconds;
+        timer->calls++;
+        timer->allocations += allocations - mark.allocations;
+        timer->allocated_bytes += allocated_bytes - mark.allocated_bytes;
+    }
+    if (phase == PROFILE_STEP) {
+        profiler->stats.batch_seconds = end - mark.seconds;
+    }
+
+    if (profiler->record_trace) {
+        record_event(profiler, phase, layer, mark.seconds, end - mark.seconds);
+    }
+}
+
+// Regions from here on belong to this batch
+void profile_begin_batch(Profiler* profiler, int epoch, int batch) {
+    if (!profiler) return;
+    profiler->epoch = epoch;
+    profiler->batch = batch;
+}
+
+// Close the current batch: count it and hand the stats to the callback
+void profile_batch_done(Profiler* profiler, int rows, double loss) {
+    if (!profiler) return;
+
+    TrainingStats* stats = &profiler->stats;
+    stats->batches++;
+    stats->samples += rows;
+    stats->epoch = profiler->epoch;
+    stats->batch = profiler->batch;
+    stats->batch_loss = loss;
+
+    if (profiler->callback) {
+        profiler->callback(stats, profiler->user_data);
+    }
+}
+
+static const char* phase_name(ProfilePhase phase) {
+    switch (phase) {
+        case PROFILE_BATCH_ASSEMBLY: return "batch_assembly";
+        case PROFILE_FORWARD:        return "forward";
+        case PROFILE_LOSS:           return "loss";
+        case PROFILE_BACKWARD:       return "backward";
+        case PROFILE_UPDATE:         return "update";
+        case PROFILE_REDUCE:         return "reduce";
+        case PROFILE_STEP:           return "step";
+    }
+    return "unknown";
+}
+
+// Complete ("X") events in microseconds. Steps go on their own track so
+// the phases nest visibly under them.
+int profiler_write_trace(const Profiler* profiler, const char* filename) {
+    PROFILER_CHECK(profiler != NULL, "Profiler cannot be NULL");
+    PROFILER_CHECK(filename != NULL, "Filename cannot be NULL");
+
+    FILE* file = fopen(filename, "w");
+    if (!file) {
+        printf("ERROR: Could not open file %s for writing\n", filename);
+        return 0;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, "
+            "\"args\": {\"name\": \"steps\"}},\n");
+    fprintf(file, "  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, "
+            "\"args\": {\"name\": \"phases\"}}");
+
+    for (size_t i = 0; i < profiler->num_events; i++) {
+        const TraceEvent* event = &profiler->events[i];
+        int per_layer = event->phase == PROFILE_FORWARD || event->phase == PROFILE_BACKWARD;
+
+        char name[64];
+        if (per_layer) {
+            snprintf(name, sizeof(name), "%s layer %d", phase_name(event->phase), event->layer + 1);
+        } else {
+            snprintf(name, sizeof(name), "%s", phase_name(event->phase));
+        }
+
+        fprintf(file, ",\n  {\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                "\"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, "
+                "\"args\": {\"epoch\": %d, \"batch\": %d",
+                name, phase_name(event->phase), event->phase == PROFILE_STEP ? 1 : 2,
+                event->start * 1e6, event->duration * 1e6, event->epoch + 1, event->batch + 1);
+        if (per_layer) fprintf(file, ", \"layer\": %d", event->layer + 1);
+        fprintf(file, "}}");
+    }
+
+    fprintf(file, "\n]}\n");
+    int ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
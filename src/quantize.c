@@ -0,0 +1,351 @@
+#include "deepc/quantize.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define QUANT_X86 1
+#endif
+
+// Error handling
+#define QUANT_ERROR(msg) do { \
+    fprintf(stderr, "\n*** QUANTIZE ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define QUANT_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        QUANT_ERROR(msg); \
+    } \
+} while(0)
+
+// Input rows quantized together, so each weight row is loaded once per group
+#define QUANT_ROWS 4
+
+// Elements of an input row quantized at a time (a multiple of
+// QUANT_K_ALIGN); QUANT_ROWS of them live on the stack
+#define QUANT_CHUNK 4096
+
+// Dot products of QUANT_ROWS uint8 rows (row stride x_stride) with one int8
+// weight row over k elements, k a multiple of QUANT_K_ALIGN
+typedef void (*QuantDotFunc)(const uint8_t* x, int x_stride, const int8_t* w, int k,
+                             int32_t* out);
+
+typedef struct {
+    const char* name;
+    QuantDotFunc dot;
+} QuantKernel;
+
+// Portable fallback
+static void dot_generic(const uint8_t* x, int x_stride, const int8_t* w, int k, int32_t* out) {
+    for (int r = 0; r < QUANT_ROWS; r++) {
+        const uint8_t* xr = x + (size_t)r * x_stride;
+        int32_t sum = 0;
+        for (int i = 0; i < k; i++) {
+            sum += (int32_t)xr[i] * w[i];
+        }
+        out[r] = sum;
+    }
+}
+
+static const QuantKernel generic_kernel = { "generic", dot_generic };
+
+#ifdef QUANT_X86
+
+// AVX2: widen both operands to 16 bits and multiply-add pairs into 32 bits.
+// (The 8-bit maddubs would saturate at 255 * 127 * 2.)
+__attribute__((target("avx2")))
+static int32_t hsum_avx2(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("avx2")))
+static void dot_avx2(const uint8_t* x, int x_stride, const int8_t* w, int k, int32_t* out) {
+    const uint8_t* x0 = x;
+    const uint8_t* x1 = x + x_stride;
+    const uint8_t* x2 = x + 2 * (size_t)x_stride;
+    const uint8_t* x3 = x + 3 * (size_t)x_stride;
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+
+    for (int i = 0; i < k; i += 16) {
+        __m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(w + i)));
+        acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(x0 + i))), wv));
+        acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(x1 + i))), wv));
+        acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(x2 + i))), wv));
+        acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(
+            _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(x3 + i))), wv));
+    }
+
+    out[0] = hsum_avx2(acc0);
+    out[1] = hsum_avx2(acc1);
+    out[2] = hsum_avx2(acc2);
+    out[3] = hsum_avx2(acc3);
+}
+
+static const QuantKernel avx2_kernel = { "avx2", dot_avx2 };
+
+// AVX-512 VNNI: vpdpbusd multiplies 64 uint8 x int8 pairs and accumulates
+// them into 16 int32 lanes in one instruction, without saturation
+__attribute__((target("avx512f,avx512vnni")))
+static void dot_avx512vnni(const uint8_t* x, int x_stride, const int8_t* w, int k,
+                           int32_t* out) {
+    const uint8_t* x0 = x;
+    const uint8_t* x1 = x + x_stride;
+    const uint8_t* x2 = x + 2 * (size_t)x_stride;
+    const uint8_t* x3 = x + 3 * (size_t)x_stride;
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    __m512i acc2 = _mm512_setzero_si512();
+    __m512i acc3 = _mm512_setzero_si512();
+
+    for (int i = 0; i < k; i += 64) {
+        __m512i wv = _mm512_loadu_si512((const void*)(w + i));
+        acc0 = _mm512_dpbusd_epi32(acc0, _mm512_loadu_si512((const void*)(x0 + i)), wv);
+        acc1 = _mm512_dpbusd_epi32(acc1, _mm512_loadu_si512((const void*)(x1 + i)), wv);
+        acc2 = _mm512_dpbusd_epi32(acc2, _mm512_loadu_si512((const void*)(x2 + i)), wv);
+        acc3 = _mm512_dpbusd_epi32(acc3, _mm512_loadu_si512((const void*)(x3 + i)), wv);
+    }
+
+    out[0] = _mm512_reduce_add_epi32(acc0);
+    out[1] = _mm512_reduce_add_epi32(acc1);
+    out[2] = _mm512_reduce_add_epi32(acc2);
+    out[3] = _mm512_reduce_add_epi32(acc3);
+}
+
+static const QuantKernel avx512vnni_kernel = { "avx512vnni", dot_avx512vnni };
+
+#endif // QUANT_X86
+
+// Pick the best dot-product kernel the CPU supports (once)
+static const QuantKernel* select_kernel(void) {
+    static const QuantKernel* selected = NULL;
+
+    if (selected == NULL) {
+        const QuantKernel* kernel = &generic_kernel;
+#ifdef QUANT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vnni")) {
+            kernel = &avx512vnni_kernel;
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = &avx2_kernel;
+        }
+#endif
+        selected = kernel;
+    }
+
+    return selected;
+}
+
+const char* quantized_kernel_name(void) {
+    return select_kernel()->name;
+}
+
+// Quantize one layer's weights for inputs in [input_min, input_max]
+QuantizedDense* quantize_dense(const Layer* layer, double input_min, double input_max) {
+    QUANT_CHECK(layer != NULL, "Layer cannot be NULL");
+
+    QuantizedDense* q = (QuantizedDense*)malloc(sizeof(QuantizedDense));
+    QUANT_CHECK(q != NULL, "Memory allocation failed for quantized layer");
+
+    int rows = layer->output_size;
+    int cols = layer->input_size;
+    q->output_size = rows;
+    q->input_size = cols;
+    q->padded_input = (cols + QUANT_K_ALIGN - 1) / QUANT_K_ALIGN * QUANT_K_ALIGN;
+    q->mapped = 0;
+
+    void* block = NULL;
+    QUANT_CHECK(posix_memalign(&block, QUANT_K_ALIGN, (size_t)rows * q->padded_input) == 0,
+                "Memory allocation failed for quantized weights");
+    q->weights = (int8_t*)block;
+    memset(q->weights, 0, (size_t)rows * q->padded_input);
+    q->weight_scales = (float*)malloc(rows * sizeof(float));
+    q->weight_sums = (int32_t*)malloc(rows * sizeof(int32_t));
+    QUANT_CHECK(q->weight_scales != NULL && q->weight_sums != NULL,
+                "Memory allocation failed for quantized weights");
+
+    // Symmetric per output channel: the largest magnitude maps to 127
+    for (int o = 0; o < rows; o++) {
+        const Real* w = layer->weights->data[o];
+        double max_abs = 0.0;
+        for (int k = 0; k < cols; k++) {
+            if (fabs(w[k]) > max_abs) max_abs = fabs(w[k]);
+        }
+        double scale = max_abs > 0 ? max_abs / 127.0 : 1.0;
+
+        int8_t* qw = q->weights + (size_t)o * q->padded_input;
+        int32_t sum = 0;
+        for (int k = 0; k < cols; k++) {
+            long v = lrint(w[k] / scale);
+            v = v < -127 ? -127 : v > 127 ? 127 : v;
+            qw[k] = (int8_t)v;
+            sum += (int32_t)v;
+        }
+        q->weight_scales[o] = (float)scale;
+        q->weight_sums[o] = sum;
+    }
+
+    // Asymmetric input range, widened to contain 0 so that zero (ReLU
+    // outputs, padding) is exactly representable
+    double lo = input_min < 0 ? input_min : 0;
+    double hi = input_max > 0 ? input_max : 0;
+    if (!(hi - lo > 1e-12)) hi = lo + 1.0;
+    double input_scale = (hi - lo) / 255.0;
+    long zero_point = lrint(-lo / input_scale);
+    q->input_scale = (float)input_scale;
+    q->input_zero_point = (int)(zero_point < 0 ? 0 : zero_point > 255 ? 255 : zero_point);
+
+    return q;
+}
+
+void free_quantized_dense(QuantizedDense* q) {
+    if (!q) return;
+
+    if (!q->mapped) free(q->weights);
+    free(q->weight_scales);
+    free(q->weight_sums);
+    free(q);
+}
+
+// Quantize n input values into dst and pad it to padded elements with the
+// zero point (the weights there are zero). NaN maps to 0.
+static void quantize_row(const Real* src, int n, uint8_t* dst, int padded,
+                         float inv_scale, int zero_point) {
+    for (int k = 0; k < n; k++) {
+        float v = (float)src[k] * inv_scale + zero_point + 0.5f;
+        v = v > 0 ? v : 0;
+        v = v < 255 ? v : 255;
+        dst[k] = (uint8_t)(int)v;
+    }
+    memset(dst + n, zero_point, padded - n);
+}
+
+void quantized_dense_forward(const QuantizedDense* q, const Matrix* biases,
+                             const Matrix* input, Matrix* output) {
+    QUANT_CHECK(q != NULL && biases != NULL && input != NULL && output != NULL,
+                "Arguments cannot be NULL");
+    QUANT_CHECK(input->cols == q->input_size, "Input dimension mismatch in quantized forward");
+    QUANT_CHECK(output->rows == input->rows && output->cols == q->output_size,
+                "Output dimensions don't match the layer");
+
+    const QuantKernel* kernel = select_kernel();
+    uint8_t qx[QUANT_ROWS * QUANT_CHUNK] __attribute__((aligned(64)));
+    float inv_scale = 1.0f / q->input_scale;
+    int zero_point = q->input_zero_point;
+
+    for (int row = 0; row < input->rows; row += QUANT_ROWS) {
+        int rows = input->rows - row < QUANT_ROWS ? input->rows - row : QUANT_ROWS;
+
+        for (int k0 = 0; k0 < q->padded_input; k0 += QUANT_CHUNK) {
+            int kc = q->padded_input - k0 < QUANT_CHUNK ? q->padded_input - k0 : QUANT_CHUNK;
+            int n = q->input_size - k0 < kc ? q->input_size - k0 : kc;
+
+            // Rows past the end of the input are computed and discarded
+            for (int r = 0; r < QUANT_ROWS; r++) {
+                uint8_t* dst = qx + (size_t)r * QUANT_CHUNK;
+                if (r < rows) {
+                    quantize_row(input->data[row + r] + k0, n, dst, kc, inv_scale, zero_point);
+                } else {
+                    memset(dst, zero_point, kc);
+                }
+            }
+
+            // Integer accumulators: the zero-point correction is exact on
+            // the first chunk, later chunks (inputs over QUANT_CHUNK) add on
+            for (int o = 0; o < q->output_size; o++) {
+                int32_t acc[QUANT_ROWS];
+                kernel->dot(qx, QUANT_CHUNK, q->weights + (size_t)o * q->padded_input + k0, kc, acc);
+                for (int r = 0; r < rows; r++) {
+                    if (k0 == 0) {
+                        output->data[row + r][o] = (Real)(acc[r] - zero_point * q->weight_sums[o]);
+                    } else {
+                        output->data[row + r][o] += (Real)acc[r];
+                    }
+                }
+            }
+        }
+
+        for (int r = 0; r < rows; r++) {
+            Real* out = output->data[row + r];
+            for (int o = 0; o < q->output_size; o++) {
+                out[o] = out[o] * (q->input_scale * q->weight_scales[o]) + biases->data[o][0];
+            }
+        }
+    }
+}
+
+// Smallest and largest non-NaN element
+static void value_range(const Matrix* m, double* min, double* max) {
+    *min = 0.0;
+    *max = 0.0;
+    int seen = 0;
+    for (int i = 0; i < m->rows; i++) {
+        for (int j = 0; j < m->cols; j++) {
+            double v = m->data[i][j];
+            if (isnan(v)) continue;
+            if (!seen || v < *min) *min = v;
+            if (!seen || v > *max) *max = v;
+            seen = 1;
+        }
+    }
+}
+
+void quantize_model(SequentialModel* model, const Matrix* calibration) {
+    QUANT_CHECK(model != NULL, "Model cannot be NULL");
+    QUANT_CHECK(model->input_layer != NULL, "Model has no layers");
+    QUANT_CHECK(calibration != NULL && calibration->rows > 0, "Calibration data cannot be empty");
+    QUANT_CHECK(calibration->cols == model->input_layer->input_size,
+                "Calibration data doesn't match the model input");
+
+    // Calibrate on the float model
+    dequantize_model(model);
+
+    const Matrix* current = calibration;
+    Matrix* activations = NULL;
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        double min, max;
+        value_range(current, &min, &max);
+
+        Matrix* next = create_matrix(current->rows, layer->output_size);
+        forward_pass_into(layer, current, next);
+        free_matrix(activations);
+        activations = next;
+        current = next;
+
+        layer->quantized = quantize_dense(layer, min, max);
+    }
+    free_matrix(activations);
+}
+
+void dequantize_model(SequentialModel* model) {
+    QUANT_CHECK(model != NULL, "Model cannot be NULL");
+
+    for (Layer* layer = model->input_layer; layer; layer = layer->next) {
+        free_quantized_dense(layer->quantized);
+        layer->quantized = NULL;
+    }
+}
+
+int model_is_quantized(const SequentialModel* model) {
+    QUANT_CHECK(model != NULL, "Model cannot be NULL");
+
+    for (const Layer* layer = model->input_layer; layer; layer = layer->next) {
+        if (layer->quantized) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "deepc/random.h"
+
+static uint64_t rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Expand the seed with splitmix64, so that similar seeds give unrelated
+// streams and the state is never all zero
+void rng_seed(Rng* rng, uint64_t seed) {
+    for (int i = 0; i < 4; i++) {
+        seed += 0x9e3779b97f4a7c15ULL;
+        uint64_t z = seed;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        rng->state[i] = z ^ (z >> 31);
+    }
+}
+
+uint64_t rng_next(Rng* rng) {
+    uint64_t* s = rng->state;
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+
+    return result;
+}
+
+double rng_uniform(Rng* rng) {
+    return (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+// Lemire's multiply-and-reject method
+uint64_t rng_bounded(Rng* rng, uint64_t bound) {
+    unsigned __int128 product = (unsigned __int128)rng_next(rng) * bound;
+    uint64_t low = (uint64_t)product;
+
+    if (low < bound) {
+        uint64_t threshold = -bound % bound;
+        while (low < threshold) {
+            product = (unsigned __int128)rng_next(rng) * bound;
+            low = (uint64_t)product;
+        }
+    }
+
+    return (uint64_t)(product >> 64);
+}
+
+void rng_shuffle(Rng* rng, int* indices, int n) {
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)rng_bounded(rng, (uint64_t)i + 1);
+        int temp = indices[i];
+        indices[i] = indices[j];
+        indices[j] = temp;
+    }
+}
@@ -0,0 +1,444 @@
+#include "deepc/sparse.h"
+#include "deepc/threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <ctype.h>
+
+// Error handling
+#define SPARSE_ERROR(msg) do { \
+    fprintf(stderr, "\n*** SPARSE ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define SPARSE_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        SPARSE_ERROR(msg); \
+    } \
+} while(0)
+
+// Output rows per parallel task in sparse_dense_gemm_nt
+#define SPARSE_GEMM_ROWS 64
+// Weight rows computed together, sharing each nonzero's index and value
+#define SPARSE_GEMM_BLOCK 4
+// Nonzero updates per parallel task, at least
+#define SPARSE_PARALLEL_GRAIN 16384
+
+struct SparseGradientState {
+    int num_cols;
+    int* columns;           // written by the last call, or count == -1
+    int count;
+    int* next;              // scratch for the current call's columns
+    unsigned char* mark;    // one per column, all zero between calls
+};
+
+static void reserve_nonzeros(SparseMatrix* s, size_t capacity) {
+    if (capacity <= s->capacity) return;
+
+    int* col_idx = (int*)realloc(s->col_idx, capacity * sizeof(int));
+    SPARSE_CHECK(col_idx != NULL, "Memory allocation failed for sparse indices");
+    s->col_idx = col_idx;
+    Real* values = (Real*)realloc(s->values, capacity * sizeof(Real));
+    SPARSE_CHECK(values != NULL, "Memory allocation failed for sparse values");
+    s->values = values;
+    s->capacity = capacity;
+}
+
+static void reserve_rows(SparseMatrix* s, int rows) {
+    if (s->row_ptr && rows <= s->row_capacity) return;
+
+    size_t* row_ptr = (size_t*)realloc(s->row_ptr, ((size_t)rows + 1) * sizeof(size_t));
+    SPARSE_CHECK(row_ptr != NULL, "Memory allocation failed for sparse rows");
+    s->row_ptr = row_ptr;
+    s->row_capacity = rows;
+}
+
+SparseMatrix* create_sparse_matrix(int rows, int cols, size_t capacity) {
+    SPARSE_CHECK(rows >= 0 && cols > 0, "Sparse matrix dimensions must be positive");
+
+    SparseMatrix* s = (SparseMatrix*)calloc(1, sizeof(SparseMatrix));
+    SPARSE_CHECK(s != NULL, "Memory allocation failed for sparse matrix");
+    s->rows = rows;
+    s->cols = cols;
+
+    reserve_rows(s, rows);
+    memset(s->row_ptr, 0, ((size_t)rows + 1) * sizeof(size_t));
+    reserve_nonzeros(s, capacity > 0 ? capacity : 1);
+    return s;
+}
+
+void free_sparse_matrix(SparseMatrix* s) {
+    if (!s) return;
+
+    free(s->row_ptr);
+    free(s->col_idx);
+    free(s->values);
+    free(s);
+}
+
+SparseMatrix* sparse_from_dense(const Matrix* m) {
+    SPARSE_CHECK(m != NULL, "Matrix cannot be NULL");
+
+    size_t nnz = 0;
+    for (int i = 0; i < m->rows; i++) {
+        for (int j = 0; j < m->cols; j++) {
+            if (m->data[i][j] != 0) nnz++;
+        }
+    }
+
+    SparseMatrix* s = create_sparse_matrix(m->rows, m->cols, nnz);
+    for (int i = 0; i < m->rows; i++) {
+        s->row_ptr[i] = s->nnz;
+        for (int j = 0; j < m->cols; j++) {
+            if (m->data[i][j] == 0) continue;
+            s->col_idx[s->nnz] = j;
+            s->values[s->nnz] = m->data[i][j];
+            s->nnz++;
+        }
+    }
+    s->row_ptr[m->rows] = s->nnz;
+    return s;
+}
+
+Matrix* sparse_to_dense(const SparseMatrix* s) {
+    SPARSE_CHECK(s != NULL, "Sparse matrix cannot be NULL");
+
+    Matrix* m = create_matrix(s->rows, s->cols);
+    for (int i = 0; i < s->rows; i++) {
+        for (size_t p = s->row_ptr[i]; p < s->row_ptr[i + 1]; p++) {
+            m->data[i][s->col_idx[p]] += s->values[p];
+        }
+    }
+    return m;
+}
+
+void sparse_gather_rows(SparseMatrix* dst, const SparseMatrix* src, const int* indices, int count) {
+    SPARSE_CHECK(dst != NULL && src != NULL && indices != NULL, "Arguments cannot be NULL");
+    SPARSE_CHECK(dst != src, "Cannot gather rows into the source matrix");
+    SPARSE_CHECK(count > 0, "Row count must be positive");
+
+    size_t nnz = 0;
+    for (int r = 0; r < count; r++) {
+        int i = indices[r];
+        SPARSE_CHECK(i >= 0 && i < src->rows, "Row index out of bounds");
+        nnz += src->row_ptr[i + 1] - src->row_ptr[i];
+    }
+
+    reserve_rows(dst, count);
+    reserve_nonzeros(dst, nnz);
+    dst->rows = count;
+    dst->cols = src->cols;
+    dst->nnz = 0;
+
+    for (int r = 0; r < count; r++) {
+        int i = indices[r];
+        size_t start = src->row_ptr[i];
+        size_t length = src->row_ptr[i + 1] - start;
+
+        dst->row_ptr[r] = dst->nnz;
+        memcpy(dst->col_idx + dst->nnz, src->col_idx + start, length * sizeof(int));
+        memcpy(dst->values + dst->nnz, src->values + start, length * sizeof(Real));
+        dst->nnz += length;
+    }
+    dst->row_ptr[count] = dst->nnz;
+}
+
+double sparse_density(const SparseMatrix* s) {
+    SPARSE_CHECK(s != NULL, "Sparse matrix cannot be NULL");
+    if (s->rows == 0) return 0.0;
+    return (double)s->nnz / ((double)s->rows * s->cols);
+}
+
+typedef struct {
+    Matrix* c;
+    const SparseMatrix* a;
+    const Matrix* b;
+} SparseGemm;
+
+// Weight rows go in blocks, each pass over a row's nonzeros reading
+// SPARSE_GEMM_BLOCK of them; within a task the rows of a share whatever weight
+// columns they have in common while they are still cached
+static void sparse_gemm_task(void* ctx, int begin, int end) {
+    const SparseGemm* t = (const SparseGemm*)ctx;
+    const SparseMatrix* a = t->a;
+    const Matrix* b = t->b;
+    int first = begin * SPARSE_GEMM_ROWS;
+    int last = end * SPARSE_GEMM_ROWS < a->rows ? end * SPARSE_GEMM_ROWS : a->rows;
+    int n = b->rows;
+
+    int o = 0;
+    for (; o + SPARSE_GEMM_BLOCK <= n; o += SPARSE_GEMM_BLOCK) {
+        const Real* b0 = b->data[o];
+        const Real* b1 = b->data[o + 1];
+        const Real* b2 = b->data[o + 2];
+        const Real* b3 = b->data[o + 3];
+
+        for (int i = first; i < last; i++) {
+            Real s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            for (size_t p = a->row_ptr[i]; p < a->row_ptr[i + 1]; p++) {
+                int k = a->col_idx[p];
+                Real v = a->values[p];
+                s0 += v * b0[k];
+                s1 += v * b1[k];
+                s2 += v * b2[k];
+                s3 += v * b3[k];
+            }
+            Real* out = t->c->data[i] + o;
+            out[0] = s0;
+            out[1] = s1;
+            out[2] = s2;
+            out[3] = s3;
+        }
+    }
+
+    for (; o < n; o++) {
+        const Real* b0 = b->data[o];
+        for (int i = first; i < last; i++) {
+            Real s0 = 0;
+            for (size_t p = a->row_ptr[i]; p < a->row_ptr[i + 1]; p++) {
+                s0 += a->values[p] * b0[a->col_idx[p]];
+            }
+            t->c->data[i][o] = s0;
+        }
+    }
+}
+
+void sparse_dense_gemm_nt(Matrix* c, const SparseMatrix* a, const Matrix* b) {
+    SPARSE_CHECK(c != NULL && a != NULL && b != NULL, "Arguments cannot be NULL");
+    SPARSE_CHECK(a->cols == b->cols, "Inner dimensions don't match");
+    SPARSE_CHECK(c->rows == a->rows && c->cols == b->rows, "Output dimensions don't match");
+
+    SparseGemm task = { c, a, b };
+    int chunks = (a->rows + SPARSE_GEMM_ROWS - 1) / SPARSE_GEMM_ROWS;
+    parallel_for(chunks, 1, sparse_gemm_task, &task);
+}
+
+void free_sparse_gradient_state(SparseGradientState* state) {
+    if (!state) return;
+
+    free(state->columns);
+    free(state->next);
+    free(state->mark);
+    free(state);
+}
+
+void sparse_gradient_invalidate(SparseGradientState* state) {
+    if (state) state->count = -1;
+}
+
+static SparseGradientState* create_gradient_state(int num_cols) {
+    SparseGradientState* state = (SparseGradientState*)calloc(1, sizeof(SparseGradientState));
+    SPARSE_CHECK(state != NULL, "Memory allocation failed for sparse gradient state");
+
+    state->num_cols = num_cols;
+    state->count = -1;
+    state->columns = (int*)malloc(num_cols * sizeof(int));
+    state->next = (int*)malloc(num_cols * sizeof(int));
+    state->mark = (unsigned char*)calloc(num_cols, 1);
+    SPARSE_CHECK(state->columns && state->next && state->mark,
+                 "Memory allocation failed for sparse gradient state");
+    return state;
+}
+
+typedef struct {
+    Matrix* dw;
+    const Matrix* delta;
+    const SparseMatrix* a;
+    double scale;
+    const SparseGradientState* state;
+    int current;            // columns used this time, in state->next
+} SparseGradient;
+
+// Threads own disjoint weight rows, each summed over the batch in row order
+static void sparse_gradient_task(void* ctx, int begin, int end) {
+    const SparseGradient* t = (const SparseGradient*)ctx;
+    const SparseMatrix* a = t->a;
+    const SparseGradientState* state = t->state;
+
+    for (int o = begin; o < end; o++) {
+        Real* row = t->dw->data[o];
+
+        if (state->count < 0) {
+            memset(row, 0, (size_t)t->dw->cols * sizeof(Real));
+        } else {
+            for (int c = 0; c < state->count; c++) row[state->columns[c]] = 0;
+            for (int c = 0; c < t->current; c++) row[state->next[c]] = 0;
+        }
+
+        for (int i = 0; i < a->rows; i++) {
+            Real d = (Real)(t->scale * t->delta->data[i][o]);
+            if (d == 0) continue;
+            for (size_t p = a->row_ptr[i]; p < a->row_ptr[i + 1]; p++) {
+                row[a->col_idx[p]] += d * a->values[p];
+            }
+        }
+    }
+}
+
+void sparse_weight_gradient(Matrix* dw, const Matrix* delta, const SparseMatrix* a,
+                            double scale, SparseGradientState** state) {
+    SPARSE_CHECK(dw != NULL && delta != NULL && a != NULL && state != NULL,
+                 "Arguments cannot be NULL");
+    SPARSE_CHECK(delta->rows == a->rows, "Gradient rows don't match the input");
+    SPARSE_CHECK(dw->rows == delta->cols && dw->cols == a->cols,
+                 "Weight gradient dimensions don't match");
+
+    if (!*state || (*state)->num_cols != a->cols) {
+        free_sparse_gradient_state(*state);
+        *state = create_gradient_state(a->cols);
+    }
+    SparseGradientState* s = *state;
+
+    // Distinct columns of this batch
+    int current = 0;
+    for (size_t p = 0; p < a->nnz; p++) {
+        int k = a->col_idx[p];
+        if (!s->mark[k]) {
+            s->mark[k] = 1;
+            s->next[current++] = k;
+        }
+    }
+
+    SparseGradient task = { dw, delta, a, scale, s, current };
+    size_t work = a->nnz + current + (s->count > 0 ? (size_t)s->count : 0);
+    int grain = work >= SPARSE_PARALLEL_GRAIN ? 1 : (int)(SPARSE_PARALLEL_GRAIN / (work + 1));
+    parallel_for(dw->rows, grain, sparse_gradient_task, &task);
+
+    // This batch's columns are the ones to clear next time
+    for (int c = 0; c < current; c++) s->mark[s->next[c]] = 0;
+    int* columns = s->columns;
+    s->columns = s->next;
+    s->next = columns;
+    s->count = current;
+}
+
+// Sort one row's entries by column (rows are usually short and nearly sorted)
+static void sort_row(int* col_idx, Real* values, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        int k = col_idx[i];
+        Real v = values[i];
+        size_t j = i;
+        while (j > 0 && col_idx[j - 1] > k) {
+            col_idx[j] = col_idx[j - 1];
+            values[j] = values[j - 1];
+            j--;
+        }
+        col_idx[j] = k;
+        values[j] = v;
+    }
+}
+
+SparseMatrix* load_libsvm(const char* filename, int num_features, Matrix** labels) {
+    SPARSE_CHECK(filename != NULL && labels != NULL, "Arguments cannot be NULL");
+
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        printf("ERROR: Could not open file %s\n", filename);
+        return NULL;
+    }
+
+    SparseMatrix* s = create_sparse_matrix(0, 1, 1024);
+    size_t row_capacity = 0;
+    Real* label_values = NULL;
+    int max_index = 0;
+    int rows = 0;
+
+    char* line = NULL;
+    size_t line_capacity = 0;
+    long line_number = 0;
+    int ok = 1;
+
+    while (ok && getline(&line, &line_capacity, file) != -1) {
+        line_number++;
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char* p = line;
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0') continue;
+
+        char* end;
+        double label = strtod(p, &end);
+        if (end == p) {
+            printf("ERROR: Missing label on line %ld of %s\n", line_number, filename);
+            ok = 0;
+            break;
+        }
+        p = end;
+
+        if ((size_t)rows + 1 >= row_capacity) {
+            row_capacity = row_capacity ? row_capacity * 2 : 1024;
+            reserve_rows(s, (int)row_capacity);
+            label_values = (Real*)realloc(label_values, row_capacity * sizeof(Real));
+            SPARSE_CHECK(label_values != NULL, "Memory allocation failed for labels");
+        }
+        label_values[rows] = (Real)label;
+        s->row_ptr[rows] = s->nnz;
+
+        for (;;) {
+            while (isspace((unsigned char)*p)) p++;
+            if (*p == '\0') break;
+
+            // svmlight ranking files carry a query id; it is not a feature
+            if (strncmp(p, "qid:", 4) == 0) {
+                while (*p && !isspace((unsigned char)*p)) p++;
+                continue;
+            }
+
+            long index = strtol(p, &end, 10);
+            if (end == p || *end != ':' || index < 1 || index > INT_MAX ||
+                (num_features > 0 && index > num_features)) {
+                printf("ERROR: Bad feature index on line %ld of %s\n", line_number, filename);
+                ok = 0;
+                break;
+            }
+            p = end + 1;
+            double value = strtod(p, &end);
+            if (end == p) {
+                printf("ERROR: Bad feature value on line %ld of %s\n", line_number, filename);
+                ok = 0;
+                break;
+            }
+            p = end;
+
+            if (s->nnz == s->capacity) reserve_nonzeros(s, s->capacity * 2);
+            s->col_idx[s->nnz] = (int)index - 1;
+            s->values[s->nnz] = (Real)value;
+            s->nnz++;
+            if (index > max_index) max_index = (int)index;
+        }
+
+        sort_row(s->col_idx + s->row_ptr[rows], s->values + s->row_ptr[rows],
+                 s->nnz - s->row_ptr[rows]);
+        rows++;
+    }
+
+    free(line);
+    fclose(file);
+
+    if (ok && rows == 0) {
+        printf("ERROR: No samples found in %s\n", filename);
+        ok = 0;
+    }
+    if (!ok) {
+        free(label_values);
+        free_sparse_matrix(s);
+        return NULL;
+    }
+
+    s->rows = rows;
+    s->cols = num_features > 0 ? num_features : (max_index > 0 ? max_index : 1);
+    s->row_ptr[rows] = s->nnz;
+
+    *labels = create_matrix(rows, 1);
+    for (int i = 0; i < rows; i++) {
+        (*labels)->data[i][0] = label_values[i];
+    }
+    free(label_values);
+    return s;
+}
@@ -0,0 +1,204 @@
+#include "deepc/threadpool.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// Error handling
+#define THREADPOOL_ERROR(msg) do { \
+    fprintf(stderr, "\n*** THREADPOOL ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define THREADPOOL_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        THREADPOOL_ERROR(msg); \
+    } \
+} while(0)
+
+// Chunks handed out per thread, so uneven chunks still balance out
+#define CHUNKS_PER_THREAD 4
+
+// The job currently being run by the pool
+typedef struct {
+    ParallelTask task;
+    void* ctx;
+    int count;
+    int chunk;
+    int next_chunk;     // claimed with an atomic increment
+} ParallelJob;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+
+static int num_threads = 0;         // 0 until configured
+static pthread_t* workers = NULL;   // num_threads - 1 of them once started
+static int workers_started = 0;
+static int shutting_down = 0;
+static int busy = 0;
+static int active_workers = 0;
+static unsigned long generation = 0;
+static ParallelJob job;
+
+// Set while a thread is executing pool work, to run nested calls inline
+static __thread int in_parallel_region = 0;
+
+static int default_num_threads(void) {
+    const char* env = getenv("DEEPC_NUM_THREADS");
+    if (env && atoi(env) > 0) {
+        return atoi(env);
+    }
+    
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+}
+
+static void run_chunks(ParallelJob* j) {
+    in_parallel_region = 1;
+    
+    for (;;) {
+        int c = __atomic_fetch_add(&j->next_chunk, 1, __ATOMIC_RELAXED);
+        long begin = (long)c * j->chunk;
+        if (begin >= j->count) break;
+        
+        long end = begin + j->chunk < j->count ? begin + j->chunk : j->count;
+        j->task(j->ctx, (int)begin, (int)end);
+    }
+    
+    in_parallel_region = 0;
+}
+
+// arg carries the generation current at creation, so a worker that is slow
+// to start still takes part in the first job
+static void* worker_main(void* arg) {
+    unsigned long seen = (unsigned long)(uintptr_t)arg;
+    
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (generation == seen && !shutting_down) {
+            pthread_cond_wait(&work_ready, &pool_lock);
+        }
+        if (shutting_down) break;
+        seen = generation;
+        pthread_mutex_unlock(&pool_lock);
+        
+        run_chunks(&job);
+        
+        pthread_mutex_lock(&pool_lock);
+        if (--active_workers == 0) {
+            pthread_cond_signal(&work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool_lock);
+    
+    return NULL;
+}
+
+// Start the workers; called with pool_lock held
+static void start_workers(void) {
+    if (num_threads == 0) {
+        num_threads = default_num_threads();
+    }
+    
+    workers_started = 1;
+    if (num_threads <= 1) return;
+    
+    workers = (pthread_t*)malloc((num_threads - 1) * sizeof(pthread_t));
+    THREADPOOL_CHECK(workers != NULL, "Memory allocation failed for thread pool");
+    
+    for (int i = 0; i < num_threads - 1; i++) {
+        int rc = pthread_create(&workers[i], NULL, worker_main, (void*)(uintptr_t)generation);
+        THREADPOOL_CHECK(rc == 0, "Failed to start worker thread");
+    }
+}
+
+// Stop and join the workers; called with pool_lock held
+static void stop_workers(void) {
+    if (!workers_started) return;
+    
+    shutting_down = 1;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+    
+    if (workers) {
+        for (int i = 0; i < num_threads - 1; i++) {
+            pthread_join(workers[i], NULL);
+        }
+    }
+    
+    pthread_mutex_lock(&pool_lock);
+    free(workers);
+    workers = NULL;
+    workers_started = 0;
+    shutting_down = 0;
+}
+
+void deepc_set_num_threads(int n) {
+    pthread_mutex_lock(&pool_lock);
+    THREADPOOL_CHECK(!busy, "Cannot resize the thread pool while it is running");
+    
+    stop_workers();
+    num_threads = n > 0 ? n : default_num_threads();
+    
+    pthread_mutex_unlock(&pool_lock);
+}
+
+int deepc_get_num_threads(void) {
+    pthread_mutex_lock(&pool_lock);
+    if (num_threads == 0) {
+        num_threads = default_num_threads();
+    }
+    int n = num_threads;
+    pthread_mutex_unlock(&pool_lock);
+    
+    return n;
+}
+
+void parallel_for(int count, int grain, ParallelTask task, void* ctx) {
+    THREADPOOL_CHECK(task != NULL, "Task cannot be NULL");
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    
+    if (in_parallel_region || count < 2 * grain) {
+        task(ctx, 0, count);
+        return;
+    }
+    
+    pthread_mutex_lock(&pool_lock);
+    if (!workers_started) {
+        start_workers();
+    }
+    if (busy || num_threads <= 1) {
+        pthread_mutex_unlock(&pool_lock);
+        task(ctx, 0, count);
+        return;
+    }
+    
+    int chunk = (count + num_threads * CHUNKS_PER_THREAD - 1) / (num_threads * CHUNKS_PER_THREAD);
+    job.task = task;
+    job.ctx = ctx;
+    job.count = count;
+    job.chunk = chunk > grain ? chunk : grain;
+    job.next_chunk = 0;
+    
+    busy = 1;
+    active_workers = num_threads - 1;
+    generation++;
+    pthread_cond_broadcast(&work_ready);
+    pthread_mutex_unlock(&pool_lock);
+    
+    run_chunks(&job);
+    
+    pthread_mutex_lock(&pool_lock);
+    while (active_workers > 0) {
+        pthread_cond_wait(&work_done, &pool_lock);
+    }
+    busy = 0;
+    pthread_mutex_unlock(&pool_lock);
+}
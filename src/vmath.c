@@ -0,0 +1,270 @@
+#include "deepc/vmath.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+// One copy per ISA level, picked by the loader (ifunc) on x86 Linux
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__linux__)
+#define VM_CLONES __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define VM_CLONES
+#endif
+
+// Softmax rows are exponentiated in at most this many blocks, each at least
+// VM_SOFTMAX_MIN_BLOCK elements long
+#define VM_SOFTMAX_BLOCKS 64
+#define VM_SOFTMAX_MIN_BLOCK 256
+
+// Bit layout and polynomial degree per element type. The series are
+// truncated Taylor expansions, long enough that the truncation error is
+// below half an ulp on the reduced range.
+#ifdef DEEPC_USE_FLOAT32
+typedef uint32_t RealBits;
+#define VM_MANTISSA_BITS 23
+#define VM_MANTISSA_MASK 0x007fffffu
+#define VM_EXPONENT_BIAS 127
+#define VM_EXP_MIN -87.0f
+#define VM_EXP_MAX 88.0f
+#define VM_ROUND_SHIFT 0x1.8p23f
+#define VM_TWO_POW_MANTISSA 0x1p23f
+#define VM_LOG2E 1.44269504088896341f
+#define VM_LN2_HI 0.693359375f
+#define VM_LN2_LO -2.12194440e-4f
+#define VM_SQRT2 1.41421356237309505f
+#define VM_FABS fabsf
+#define VM_COPYSIGN copysignf
+
+// e^r - 1 - r on |r| <= ln(2)/2, through r^7
+static inline Real exp_series(Real r) {
+    Real p = 1.0f / 5040;
+    p = p * r + 1.0f / 720;
+    p = p * r + 1.0f / 120;
+    p = p * r + 1.0f / 24;
+    p = p * r + 1.0f / 6;
+    p = p * r + 0.5f;
+    return p * r * r;
+}
+
+// atanh(s) / s - 1 as a series in s^2, s^2 <= 0.0295, through s^10
+static inline Real log_series(Real s2) {
+    Real p = 1.0f / 11;
+    p = p * s2 + 1.0f / 9;
+    p = p * s2 + 1.0f / 7;
+    p = p * s2 + 1.0f / 5;
+    p = p * s2 + 1.0f / 3;
+    return p * s2;
+}
+#else
+typedef uint64_t RealBits;
+#define VM_MANTISSA_BITS 52
+#define VM_MANTISSA_MASK 0x000fffffffffffffull
+#define VM_EXPONENT_BIAS 1023
+#define VM_EXP_MIN -708.0
+#define VM_EXP_MAX 709.0
+#define VM_ROUND_SHIFT 0x1.8p52
+#define VM_TWO_POW_MANTISSA 0x1p52
+#define VM_LOG2E 1.44269504088896340736
+#define VM_LN2_HI 6.93147180369123816490e-01
+#define VM_LN2_LO 1.90821492927058770002e-10
+#define VM_SQRT2 1.41421356237309504880
+#define VM_FABS fabs
+#define VM_COPYSIGN copysign
+
+// e^r - 1 - r on |r| <= ln(2)/2, through r^13
+static inline Real exp_series(Real r) {
+    Real p = 1.0 / 6227020800.0;
+    p = p * r + 1.0 / 479001600.0;
+    p = p * r + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 0.5;
+    return p * r * r;
+}
+
+// atanh(s) / s - 1 as a series in s^2, s^2 <= 0.0295, through s^22
+static inline Real log_series(Real s2) {
+    Real p = 1.0 / 23;
+    p = p * s2 + 1.0 / 21;
+    p = p * s2 + 1.0 / 19;
+    p = p * s2 + 1.0 / 17;
+    p = p * s2 + 1.0 / 15;
+    p = p * s2 + 1.0 / 13;
+    p = p * s2 + 1.0 / 11;
+    p = p * s2 + 1.0 / 9;
+    p = p * s2 + 1.0 / 7;
+    p = p * s2 + 1.0 / 5;
+    p = p * s2 + 1.0 / 3;
+    return p * s2;
+}
+#endif
+
+static inline RealBits to_bits(Real x) {
+    RealBits b;
+    memcpy(&b, &x, sizeof(b));
+    return b;
+}
+
+static inline Real from_bits(RealBits b) {
+    Real x;
+    memcpy(&x, &b, sizeof(x));
+    return x;
+}
+
+// e^x = 2^n * e^r with n = round(x / ln 2) and |r| <= ln(2) / 2
+static inline Real exp_core(Real x) {
+    Real c = x < VM_EXP_MAX ? x : VM_EXP_MAX;
+    c = c > VM_EXP_MIN ? c : VM_EXP_MIN;
+
+    // Adding 1.5 * 2^mantissa_bits rounds to an integer held in the low
+    // mantissa bits, which also gives 2^n directly from the bit pattern
+    Real t = c * VM_LOG2E + VM_ROUND_SHIFT;
+    Real n = t - VM_ROUND_SHIFT;
+    Real r = c - n * VM_LN2_HI;
+    r = r - n * VM_LN2_LO;
+    Real scale = from_bits((to_bits(t) - to_bits(VM_ROUND_SHIFT) + VM_EXPONENT_BIAS)
+                           << VM_MANTISSA_BITS);
+
+    Real y = (1 + (r + exp_series(r))) * scale;
+    return x != x ? x : y;
+}
+
+// log x = e * ln 2 + 2 atanh((m - 1) / (m + 1)) with x = 2^e * m and m in
+// [sqrt(1/2), sqrt(2))
+static inline Real log_core(Real x) {
+    RealBits bits = to_bits(x);
+    Real m = from_bits((bits & VM_MANTISSA_MASK) | to_bits((Real)1));
+
+    // The exponent as a Real without an integer conversion: placed in the
+    // low bits of 2^mantissa_bits it reads back as 2^mantissa_bits + e + bias
+    Real e = from_bits(to_bits(VM_TWO_POW_MANTISSA) | (bits >> VM_MANTISSA_BITS)) -
+             (VM_TWO_POW_MANTISSA + VM_EXPONENT_BIAS);
+    int high = m > VM_SQRT2;
+    m = high ? m * (Real)0.5 : m;
+    e = high ? e + 1 : e;
+
+    Real s = (m - 1) / (m + 1);
+    Real two_s = s + s;
+    Real y = e * VM_LN2_HI + (two_s + (two_s * log_series(s * s) + e * VM_LN2_LO));
+    return x != x ? x : y;
+}
+
+static inline Real sigmoid_core(Real x) {
+    return 1 / (1 + exp_core(-x));
+}
+
+// tanh |x| = (1 - e^-2|x|) / (1 + e^-2|x|), which never overflows. Below
+// 1/16 that cancels, so small inputs use the odd series through x^11.
+static inline Real tanh_core(Real x) {
+    Real t = exp_core(-2 * VM_FABS(x));
+    Real large = VM_COPYSIGN((1 - t) / (1 + t), x);
+
+    Real x2 = x * x;
+    Real p = (Real)(-1382.0 / 155925);
+    p = p * x2 + (Real)(62.0 / 2835);
+    p = p * x2 + (Real)(-17.0 / 315);
+    p = p * x2 + (Real)(2.0 / 15);
+    p = p * x2 + (Real)(-1.0 / 3);
+    Real small = x * (1 + x2 * p);
+
+    return VM_FABS(x) < (Real)0.0625 ? small : large;
+}
+
+VM_CLONES
+void vm_exp(Real* dst, const Real* src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = exp_core(src[i]);
+    }
+}
+
+VM_CLONES
+void vm_log(Real* dst, const Real* src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = log_core(src[i]);
+    }
+}
+
+VM_CLONES
+void vm_sigmoid(Real* dst, const Real* src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = sigmoid_core(src[i]);
+    }
+}
+
+VM_CLONES
+void vm_tanh(Real* dst, const Real* src, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = tanh_core(src[i]);
+    }
+}
+
+// Sum with independent partial sums, so the adds pipeline (and vectorize)
+static inline double block_sum(const Real* x, int n) {
+    Real partial[8] = {0};
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        for (int k = 0; k < 8; k++) {
+            partial[k] += x[i + k];
+        }
+    }
+    double sum = 0.0;
+    for (int k = 0; k < 8; k++) {
+        sum += partial[k];
+    }
+    for (; i < n; i++) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+VM_CLONES
+void vm_softmax(Real* dst, const Real* src, int n) {
+    if (n <= 0) return;
+
+    int block = (n + VM_SOFTMAX_BLOCKS - 1) / VM_SOFTMAX_BLOCKS;
+    if (block < VM_SOFTMAX_MIN_BLOCK) block = VM_SOFTMAX_MIN_BLOCK;
+
+    // Maximum the elements of each block were exponentiated against
+    Real block_max[VM_SOFTMAX_BLOCKS];
+    Real max = -INFINITY;
+    double sum = 0.0;
+
+    int b = 0;
+    for (int start = 0; start < n; start += block, b++) {
+        int len = n - start < block ? n - start : block;
+        const Real* x = src + start;
+        Real* y = dst + start;
+
+        Real local = x[0];
+        for (int i = 1; i < len; i++) {
+            local = x[i] > local ? x[i] : local;
+        }
+        if (local > max) {
+            // Everything so far was relative to a smaller maximum
+            if (sum > 0) sum *= exp_core(max - local);
+            max = local;
+        }
+        block_max[b] = max;
+
+        for (int i = 0; i < len; i++) {
+            y[i] = exp_core(x[i] - max);
+        }
+        sum += block_sum(y, len);
+    }
+
+    double inv_sum = 1.0 / sum;
+    b = 0;
+    for (int start = 0; start < n; start += block, b++) {
+        int len = n - start < block ? n - start : block;
+        Real factor = (Real)(exp_core(block_max[b] - max) * inv_sum);
+        Real* y = dst + start;
+        for (int i = 0; i < len; i++) {
+            y[i] *= factor;
+        }
+    }
+}
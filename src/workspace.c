@@ -0,0 +1,147 @@
+#include "deepc/workspace.h"
+#include "deepc/profiler.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Error handling
+#define WORKSPACE_ERROR(msg) do { \
+    fprintf(stderr, "\n*** WORKSPACE ERROR ***\n"); \
+    fprintf(stderr, "Message: %s\n", msg); \
+    fprintf(stderr, "File: %s\n", __FILE__); \
+    fprintf(stderr, "Line: %d\n", __LINE__); \
+    fprintf(stderr, "Function: %s\n", __func__); \
+    exit(EXIT_FAILURE); \
+} while(0)
+
+#define WORKSPACE_CHECK(condition, msg) do { \
+    if (!(condition)) { \
+        WORKSPACE_ERROR(msg); \
+    } \
+} while(0)
+
+// Overflow blocks carry their list link in the first alignment unit
+struct WorkspaceBlock {
+    WorkspaceBlock* next;
+};
+
+static size_t align_up(size_t bytes) {
+    return (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+static void* alloc_block(size_t bytes) {
+    void* block = NULL;
+    WORKSPACE_CHECK(posix_memalign(&block, MATRIX_ALIGNMENT, bytes) == 0,
+                    "Memory allocation failed for workspace block");
+    profile_count_allocation(bytes);
+    return block;
+}
+
+// Create a workspace; initial_bytes may be 0 to size it on first use
+Workspace* create_workspace(size_t initial_bytes) {
+    Workspace* ws = (Workspace*)malloc(sizeof(Workspace));
+    WORKSPACE_CHECK(ws != NULL, "Memory allocation failed for workspace");
+
+    ws->capacity = align_up(initial_bytes);
+    ws->buffer = ws->capacity > 0 ? (char*)alloc_block(ws->capacity) : NULL;
+    ws->used = 0;
+    ws->requested = 0;
+    ws->overflow = NULL;
+
+    return ws;
+}
+
+static void free_overflow(Workspace* ws) {
+    WorkspaceBlock* block = ws->overflow;
+    while (block) {
+        WorkspaceBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    ws->overflow = NULL;
+}
+
+// Free workspace memory (every matrix carved from it becomes invalid)
+void free_workspace(Workspace* ws) {
+    if (!ws) return;
+
+    free_overflow(ws);
+    free(ws->buffer);
+    free(ws);
+}
+
+// Recycle all memory handed out since the last reset
+void workspace_reset(Workspace* ws) {
+    WORKSPACE_CHECK(ws != NULL, "Workspace cannot be NULL");
+
+    if (ws->overflow) {
+        // The last step did not fit: grow the main block to cover all of it
+        free_overflow(ws);
+        free(ws->buffer);
+        ws->capacity = ws->requested;
+        ws->buffer = (char*)alloc_block(ws->capacity);
+    }
+
+    ws->used = 0;
+    ws->requested = 0;
+}
+
+// Hand out an aligned chunk of the workspace
+void* workspace_alloc(Workspace* ws, size_t bytes) {
+    WORKSPACE_CHECK(ws != NULL, "Workspace cannot be NULL");
+
+    bytes = align_up(bytes > 0 ? bytes : 1);
+    ws->requested += bytes;
+
+    if (ws->used + bytes <= ws->capacity) {
+        void* ptr = ws->buffer + ws->used;
+        ws->used += bytes;
+        return ptr;
+    }
+
+    // Fall back to a dedicated block until the next reset consolidates
+    WorkspaceBlock* block = (WorkspaceBlock*)alloc_block(MATRIX_ALIGNMENT + bytes);
+    block->next = ws->overflow;
+    ws->overflow = block;
+    return (char*)block + MATRIX_ALIGNMENT;
+}
+
+// Create a matrix inside the workspace
+Matrix* workspace_matrix(Workspace* ws, int rows, int cols) {
+    if (!ws) {
+        return create_matrix(rows, cols);
+    }
+
+    WORKSPACE_CHECK(rows > 0 && cols > 0, "Matrix dimensions must be positive");
+
+    Matrix* m = (Matrix*)workspace_alloc(ws, sizeof(Matrix));
+    m->rows = rows;
+    m->cols = cols;
+    m->stride = cols;
+    m->storage = MATRIX_WORKSPACE;
+    m->data = (Real**)workspace_alloc(ws, rows * sizeof(Real*));
+    m->values = (Real*)workspace_alloc(ws, (size_t)rows * cols * sizeof(Real));
+
+    for (int i = 0; i < rows; i++) {
+        m->data[i] = m->values + (size_t)i * cols;
+    }
+
+    return m;
+}
+
+// View of rows [row, row + rows) of m with only the header in the workspace
+Matrix* workspace_row_view(Workspace* ws, const Matrix* m, int row, int rows) {
+    WORKSPACE_CHECK(ws != NULL, "Workspace cannot be NULL");
+    WORKSPACE_CHECK(m != NULL, "Matrix cannot be NULL");
+    WORKSPACE_CHECK(row >= 0 && rows > 0 && row + rows <= m->rows, "Row range out of bounds");
+
+    Matrix* view = (Matrix*)workspace_alloc(ws, sizeof(Matrix));
+    view->rows = rows;
+    view->cols = m->cols;
+    view->stride = m->stride;
+    view->storage = MATRIX_WORKSPACE;
+    view->data = m->data + row;
+    view->values = m->data[row];
+
+    return view;
+}
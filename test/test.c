@@ -1,10 +1,287 @@
+// test: checks of the training kernels against independent references.
+//
+//   - backward passes against finite differences of the loss, for the
+//     element-wise, softmax Jacobian and fused loss paths
+//   - fit, fit_parallel, checkpointed fit and fit_sparse against each other
+//   - binary model files written and read back unchanged
+//
+// Every check prints one line; the exit status is the number of failures.
 #include "deepc/DeepC.h"
+#include "deepc/random.h"
+#include <stdint.h>
+#include <unistd.h>
 
-int main() {
-    SequentialModel* model = create_model("MyModel");
-    add_layer(model, Dense(64, RELU, 10));
-    add_layer(model, Dense(1, SIGMOID, 64));
-    compile(model, ADAM, BINARY_CROSSENTROPY, 0.001);
+#define TEST_SEED 0x7e57c0deULL
+#define TEST_MODEL_FILE "deepc_test_model.dc"
+
+// Finite differences and summation order are much coarser in float
+#ifdef DEEPC_USE_FLOAT32
+#define GRADIENT_STEP 1e-2
+#define GRADIENT_TOLERANCE 2e-2
+#define AGREEMENT_TOLERANCE 1e-3
+#else
+#define GRADIENT_STEP 1e-5
+#define GRADIENT_TOLERANCE 1e-7
+#define AGREEMENT_TOLERANCE 1e-9
+#endif
+
+static int failures = 0;
+
+static void check(int passed, const char* name, double error) {
+    printf("%s %-44s (error %.3g)\n", passed ? "PASS" : "FAIL", name, error);
+    if (!passed) failures++;
+}
+
+static Matrix* random_matrix(Rng* rng, int rows, int cols, double density) {
+    Matrix* m = create_matrix(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (rng_uniform(rng) < density) m->data[i][j] = rng_uniform(rng) * 2.0 - 1.0;
+        }
+    }
+    return m;
+}
+
+// One-hot rows for softmax outputs, independent 0/1 targets otherwise
+static Matrix* random_targets(Rng* rng, int rows, int cols, int one_hot) {
+    Matrix* y = create_matrix(rows, cols);
+    for (int i = 0; i < rows; i++) {
+        if (one_hot) {
+            y->data[i][rng_bounded(rng, cols)] = 1.0;
+        } else {
+            for (int j = 0; j < cols; j++) y->data[i][j] = rng_uniform(rng) < 0.5;
+        }
+    }
+    return y;
+}
+
+// Reproducible weights, whatever Dense initialized them to
+static void randomize_weights(SequentialModel* model, Rng* rng) {
+    for (int l = 0; l < model->num_layers; l++) {
+        Layer* layer = model->layers[l];
+        for (int i = 0; i < layer->weights->rows; i++) {
+            for (int j = 0; j < layer->weights->cols; j++) {
+                layer->weights->data[i][j] = (rng_uniform(rng) * 2.0 - 1.0) / sqrt(layer->input_size);
+            }
+            layer->biases->data[i][0] = (rng_uniform(rng) - 0.5) * 0.2;
+        }
+    }
+}
+
+static void copy_weights(SequentialModel* dst, const SequentialModel* src) {
+    for (int l = 0; l < src->num_layers; l++) {
+        copy_into(dst->layers[l]->weights, src->layers[l]->weights);
+        copy_into(dst->layers[l]->biases, src->layers[l]->biases);
+    }
+}
+
+static double max_difference(const Matrix* a, const Matrix* b) {
+    double worst = 0.0;
+    for (int i = 0; i < a->rows; i++) {
+        for (int j = 0; j < a->cols; j++) {
+            double d = fabs((double)a->data[i][j] - b->data[i][j]);
+            if (d > worst || d != d) worst = d;
+        }
+    }
+    return worst;
+}
+
+static double max_weight_difference(const SequentialModel* a, const SequentialModel* b) {
+    double worst = 0.0;
+    for (int l = 0; l < a->num_layers; l++) {
+        double dw = max_difference(a->layers[l]->weights, b->layers[l]->weights);
+        double db = max_difference(a->layers[l]->biases, b->layers[l]->biases);
+        if (dw > worst || dw != dw) worst = dw;
+        if (db > worst || db != db) worst = db;
+    }
+    return worst;
+}
+
+static double model_loss(SequentialModel* model, const Matrix* X, const Matrix* y) {
+    Matrix* predictions = predict(model, X);
+    double loss = compute_loss(y, predictions, model->loss_function);
+    free_matrix(predictions);
+    return loss;
+}
+
+// Central difference of the loss in one parameter
+static double numeric_derivative(SequentialModel* model, Real* parameter,
+                                 const Matrix* X, const Matrix* y) {
+    Real saved = *parameter;
+    *parameter = saved + GRADIENT_STEP;
+    double up = model_loss(model, X, y);
+    *parameter = saved - GRADIENT_STEP;
+    double down = model_loss(model, X, y);
+    *parameter = saved;
+    return (up - down) / (2.0 * GRADIENT_STEP);
+}
+
+// One SGD step with learning rate 1 through train_on_batch, the path fit
+// takes, reveals the gradient as the change of every parameter. The layers
+// average it over the batch once more than the loss does, hence the rows.
+static void check_gradient(const char* name, Activation output, LossFunction loss, Rng* rng) {
+    const int rows = 6, inputs = 5, hidden = 7, outputs = 4;
+    SequentialModel* model = create_model(name);
+    add_layer(model, Dense(hidden, TANH, inputs));
+    add_layer(model, Dense(outputs, output, hidden));
+    compile(model, SGD, loss, 1.0);
+    randomize_weights(model, rng);
+
+    Matrix* X = random_matrix(rng, rows, inputs, 1.0);
+    Matrix* y = random_targets(rng, rows, outputs, output == SOFTMAX);
 
+    // Numeric gradients before the step moves the weights
+    int num_parameters = 0;
+    for (int l = 0; l < model->num_layers; l++) {
+        num_parameters += model->layers[l]->output_size * (model->layers[l]->input_size + 1);
+    }
+    double* numeric = (double*)malloc(num_parameters * sizeof(double));
+    double* before = (double*)malloc(num_parameters * sizeof(double));
+    int k = 0;
+    for (int l = 0; l < model->num_layers; l++) {
+        Layer* layer = model->layers[l];
+        for (int i = 0; i < layer->output_size; i++) {
+            for (int j = 0; j <= layer->input_size; j++, k++) {
+                Real* parameter = j < layer->input_size ? &layer->weights->data[i][j]
+                                                        : &layer->biases->data[i][0];
+                numeric[k] = numeric_derivative(model, parameter, X, y);
+                before[k] = *parameter;
+            }
+        }
+    }
+
+    train_on_batch(model, X, y);
+
+    double worst = 0.0;
+    k = 0;
+    for (int l = 0; l < model->num_layers; l++) {
+        Layer* layer = model->layers[l];
+        for (int i = 0; i < layer->output_size; i++) {
+            for (int j = 0; j <= layer->input_size; j++, k++) {
+                Real after = j < layer->input_size ? layer->weights->data[i][j]
+                                                   : layer->biases->data[i][0];
+                double analytic = (before[k] - after) * rows;
+                double error = fabs(analytic - numeric[k]) / (1.0 + fabs(numeric[k]));
+                if (error > worst || error != error) worst = error;
+            }
+        }
+    }
+    check(worst < GRADIENT_TOLERANCE, name, worst);
+
+    free(numeric);
+    free(before);
+    free_matrix(X);
+    free_matrix(y);
+    free_model(model);
+}
+
+static SequentialModel* agreement_model(const char* name) {
+    SequentialModel* model = create_model(name);
+    add_layer(model, Dense(24, RELU, 40));
+    add_layer(model, Dense(16, TANH, 24));
+    add_layer(model, Dense(12, RELU, 16));
+    add_layer(model, Dense(3, SOFTMAX, 12));
+    compile(model, ADAM, CATEGORICAL_CROSSENTROPY, 0.01);
+    set_shuffle(model, 0, 0);
+    return model;
+}
+
+// Every training loop must take the same steps from the same weights
+static void check_training_agreement(Rng* rng) {
+    const int rows = 256, epochs = 3, batch_size = 32;
+    Matrix* X = random_matrix(rng, rows, 40, 0.2);
+    Matrix* y = random_targets(rng, rows, 3, 1);
+    SparseMatrix* X_sparse = sparse_from_dense(X);
+
+    SequentialModel* reference = agreement_model("fit");
+    randomize_weights(reference, rng);
+    SequentialModel* parallel = agreement_model("fit_parallel");
+    SequentialModel* checkpointed = agreement_model("checkpointed");
+    SequentialModel* sparse = agreement_model("fit_sparse");
+    copy_weights(parallel, reference);
+    copy_weights(checkpointed, reference);
+    copy_weights(sparse, reference);
+    set_gradient_checkpointing(checkpointed, 2);
+
+    fit(reference, X, y, epochs, batch_size, 0);
+    fit_parallel(parallel, X, y, epochs, batch_size, 4, 0);
+    fit(checkpointed, X, y, epochs, batch_size, 0);
+    fit_sparse(sparse, X_sparse, y, epochs, batch_size, 0);
+
+    double error = max_weight_difference(reference, parallel);
+    check(error < AGREEMENT_TOLERANCE, "fit_parallel agrees with fit", error);
+    error = max_weight_difference(reference, checkpointed);
+    check(error < AGREEMENT_TOLERANCE, "checkpointed fit agrees with fit", error);
+    error = max_weight_difference(reference, sparse);
+    check(error < AGREEMENT_TOLERANCE, "fit_sparse agrees with fit", error);
+
+    free_model(reference);
+    free_model(parallel);
+    free_model(checkpointed);
+    free_model(sparse);
+    free_sparse_matrix(X_sparse);
+    free_matrix(X);
+    free_matrix(y);
+}
+
+// A binary model file must bring back the same network, bit for bit, and
+// a damaged one must be refused rather than loaded
+static void check_binary_round_trip(Rng* rng) {
+    SequentialModel* model = create_model("round_trip");
+    add_layer(model, Dense(9, RELU, 6));
+    add_layer(model, Dense(5, SIGMOID, 9));
+    add_layer(model, Dense(2, SOFTMAX, 5));
+    compile(model, ADAMW, CATEGORICAL_CROSSENTROPY, 0.003);
+    randomize_weights(model, rng);
+    save_model_binary(model, TEST_MODEL_FILE);
+
+    SequentialModel* loaded = load_model_binary(TEST_MODEL_FILE);
+    int same = loaded && loaded->num_layers == model->num_layers &&
+               loaded->is_compiled && loaded->optimizer_type == model->optimizer_type &&
+               loaded->loss_function == model->loss_function &&
+               loaded->learning_rate == model->learning_rate;
+    for (int l = 0; same && l < model->num_layers; l++) {
+        same = loaded->layers[l]->activation == model->layers[l]->activation;
+    }
+    double error = same ? max_weight_difference(model, loaded) : INFINITY;
+    if (same) {
+        Matrix* X = random_matrix(rng, 8, 6, 1.0);
+        Matrix* expected = predict(model, X);
+        Matrix* actual = predict(loaded, X);
+        double prediction_error = max_difference(expected, actual);
+        if (prediction_error > error) error = prediction_error;
+        free_matrix(X);
+        free_matrix(expected);
+        free_matrix(actual);
+    }
+    check(same && error == 0.0, "binary model round trip", error);
+    free_model(loaded);
+
+    // Cut the file in half
+    FILE* file = fopen(TEST_MODEL_FILE, "r+b");
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    truncate(TEST_MODEL_FILE, size / 2);
+    SequentialModel* damaged = load_model_binary(TEST_MODEL_FILE);
+    check(damaged == NULL, "truncated binary model is refused", 0.0);
+    free_model(damaged);
+
+    remove(TEST_MODEL_FILE);
     free_model(model);
 }
+
+int main() {
+    Rng rng;
+    rng_seed(&rng, TEST_SEED);
+
+    check_gradient("gradient SIGMOID + MSE", SIGMOID, MEAN_SQUARED_ERROR, &rng);
+    check_gradient("gradient SOFTMAX + MSE", SOFTMAX, MEAN_SQUARED_ERROR, &rng);
+    check_gradient("gradient SOFTMAX + CCE (fused)", SOFTMAX, CATEGORICAL_CROSSENTROPY, &rng);
+    check_gradient("gradient SIGMOID + BCE (fused)", SIGMOID, BINARY_CROSSENTROPY, &rng);
+    check_training_agreement(&rng);
+    check_binary_round_trip(&rng);
+
+    printf("%d failure(s)\n", failures);
+    return failures;
+}